@@ -14,11 +14,13 @@
 #include <linux/module.h>
 #include <linux/etherdevice.h>
 #include <linux/hash.h>
+#include <linux/bpf.h>
 #include <net/dst_metadata.h>
 #include <net/gro_cells.h>
 #include <net/rtnetlink.h>
 #include <net/geneve.h>
 #include <net/protocol.h>
+#include <net/xdp.h>
 
 #define GENEVE_NETDEV_VER	"0.6"
 
@@ -67,6 +69,7 @@ struct geneve_dev {
 #endif
 	struct list_head   next;	/* geneve's per namespace list */
 	struct gro_cells   gro_cells;
+	struct bpf_prog __rcu *xdp_prog; /* run on frames decapsulated by XDP */
 	bool		   collect_md;
 	bool		   use_udp6_rx_checksums;
 };
@@ -336,6 +339,7 @@ static void geneve_uninit(struct net_device *dev)
 {
 	struct geneve_dev *geneve = netdev_priv(dev);
 
+	xdp_prog_replace(&geneve->xdp_prog, NULL);
 	dst_cache_destroy(&geneve->info.dst_cache);
 	gro_cells_destroy(&geneve->gro_cells);
 	free_percpu(dev->tstats);
@@ -386,6 +390,58 @@ static int geneve_udp_encap_recv(struct sock *sk, struct sk_buff *skb)
 	return 0;
 }
 
+/* Callback from net/ipv4/udp.c for frames taken on the XDP path of the
+ * underlay device.  Metadata based devices and frames geneve_rx() would
+ * drop are left to geneve_udp_encap_recv().
+ */
+static u32 geneve_xdp_rcv(struct sock *sk, struct xdp_buff *xdp,
+			  const struct iphdr *iph)
+{
+	struct genevehdr *gnvh = xdp->data;
+	struct bpf_prog *xdp_prog;
+	struct geneve_dev *geneve;
+	struct geneve_sock *gs;
+	struct ethhdr *eth;
+	unsigned int hlen;
+
+	if (xdp->data + sizeof(*gnvh) > xdp->data_end)
+		return XDP_PASS;
+
+	if (gnvh->ver != GENEVE_VER ||
+	    gnvh->proto_type != htons(ETH_P_TEB) || gnvh->critical)
+		return XDP_PASS;
+
+	hlen = sizeof(*gnvh) + gnvh->opt_len * 4;
+	if (xdp->data + hlen + ETH_HLEN > xdp->data_end)
+		return XDP_PASS;
+
+	gs = rcu_dereference_sk_user_data(sk);
+	if (!gs || gs->collect_md || geneve_get_sk_family(gs) != AF_INET)
+		return XDP_PASS;
+
+	geneve = geneve_lookup(gs, iph->saddr, gnvh->vni);
+	if (!geneve)
+		return XDP_PASS;
+
+	xdp_prog = rcu_dereference(geneve->xdp_prog);
+	if (!xdp_prog)
+		return XDP_PASS;
+
+	/* Ignore packet loops (and multicast echo) */
+	eth = xdp->data + hlen;
+	if (ether_addr_equal(eth->h_source, geneve->dev->dev_addr))
+		return XDP_PASS;
+
+	return xdp_run_decap(xdp_prog, xdp, hlen, geneve->dev);
+}
+
+static int geneve_xdp(struct net_device *dev, struct netdev_bpf *xdp)
+{
+	struct geneve_dev *geneve = netdev_priv(dev);
+
+	return xdp_redirect_prog_bpf(&geneve->xdp_prog, xdp);
+}
+
 static struct socket *geneve_create_sock(struct net *net, bool ipv6,
 					 __be16 port, bool ipv6_rx_csum)
 {
@@ -543,6 +599,7 @@ static struct geneve_sock *geneve_socket_create(struct net *net, __be16 port,
 	tunnel_cfg.gro_receive = geneve_gro_receive;
 	tunnel_cfg.gro_complete = geneve_gro_complete;
 	tunnel_cfg.encap_rcv = geneve_udp_encap_recv;
+	tunnel_cfg.encap_xdp_rcv = geneve_xdp_rcv;
 	tunnel_cfg.encap_destroy = NULL;
 	setup_udp_tunnel_sock(net, sock, &tunnel_cfg);
 	list_add(&gs->list, &gn->sock_list);
@@ -1004,6 +1061,7 @@ static const struct net_device_ops geneve_netdev_ops = {
 	.ndo_validate_addr	= eth_validate_addr,
 	.ndo_set_mac_address	= eth_mac_addr,
 	.ndo_fill_metadata_dst	= geneve_fill_metadata_dst,
+	.ndo_bpf		= geneve_xdp,
 };
 
 static void geneve_get_drvinfo(struct net_device *dev,
@@ -31,6 +31,8 @@
 #include <net/route.h>
 #include <net/addrconf.h>
 #include <net/l3mdev.h>
+#include <net/xdp.h>
+#include <linux/bpf.h>
 
 #define IPVLAN_DRV	"ipvlan"
 #define IPV_DRV_VER	"0.1"
@@ -75,6 +77,8 @@ struct ipvl_dev {
 	netdev_features_t	sfeatures;
 	u32			msg_enable;
 	spinlock_t		addrs_lock;
+	struct bpf_prog __rcu	*xdp_prog;
+	struct xdp_rxq_info	xdp_rxq;
 };
 
 struct ipvl_addr {
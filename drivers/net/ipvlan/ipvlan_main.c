@@ -207,16 +207,24 @@ static int ipvlan_init(struct net_device *dev)
 	if (!ipvlan->pcpu_stats)
 		return -ENOMEM;
 
+	err = xdp_rxq_info_reg(&ipvlan->xdp_rxq, dev, 0);
+	if (err < 0)
+		goto err_free_stats;
+
 	if (!netif_is_ipvlan_port(phy_dev)) {
 		err = ipvlan_port_create(phy_dev);
-		if (err < 0) {
-			free_percpu(ipvlan->pcpu_stats);
-			return err;
-		}
+		if (err < 0)
+			goto err_unreg_rxq;
 	}
 	port = ipvlan_port_get_rtnl(phy_dev);
 	port->count += 1;
 	return 0;
+
+err_unreg_rxq:
+	xdp_rxq_info_unreg(&ipvlan->xdp_rxq);
+err_free_stats:
+	free_percpu(ipvlan->pcpu_stats);
+	return err;
 }
 
 static void ipvlan_uninit(struct net_device *dev)
@@ -225,6 +233,9 @@ static void ipvlan_uninit(struct net_device *dev)
 	struct net_device *phy_dev = ipvlan->phy_dev;
 	struct ipvl_port *port;
 
+	xdp_prog_replace(&ipvlan->xdp_prog, NULL);
+	xdp_rxq_info_unreg(&ipvlan->xdp_rxq);
+
 	free_percpu(ipvlan->pcpu_stats);
 
 	port = ipvlan_port_get_rtnl(phy_dev);
@@ -404,6 +415,69 @@ static int ipvlan_get_iflink(const struct net_device *dev)
 	return ipvlan->phy_dev->ifindex;
 }
 
+static int ipvlan_xdp(struct net_device *dev, struct netdev_bpf *xdp)
+{
+	struct ipvl_dev *ipvlan = netdev_priv(dev);
+
+	return xdp_redirect_prog_bpf(&ipvlan->xdp_prog, xdp);
+}
+
+/* Frames redirected to an ipvlan slave are delivered to its receive
+ * path through the per-CPU backlog, bypassing the address lookup on
+ * the master since the redirecting program already picked the slave.
+ */
+static int ipvlan_xdp_xmit(struct net_device *dev, int n,
+			   struct xdp_frame **frames, u32 flags)
+{
+	struct ipvl_dev *ipvlan = netdev_priv(dev);
+	struct bpf_prog *xdp_prog;
+	int drops = 0;
+	int i;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	if (unlikely(!(dev->flags & IFF_UP)))
+		return -ENETDOWN;
+
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(ipvlan->xdp_prog);
+	for (i = 0; i < n; i++) {
+		struct xdp_frame *xdpf = frames[i];
+		struct sk_buff *skb;
+		unsigned int len;
+		bool mcast;
+
+		if (xdp_prog &&
+		    xdp_run_frame(xdp_prog, xdpf,
+				  &ipvlan->xdp_rxq) != XDP_PASS) {
+			xdp_return_frame_rx_napi(xdpf);
+			drops++;
+			continue;
+		}
+
+		len = xdpf->len;
+		skb = xdp_build_skb_from_frame(xdpf, dev);
+		if (unlikely(!skb)) {
+			xdp_return_frame_rx_napi(xdpf);
+			ipvlan_count_rx(ipvlan, 0, false, false);
+			drops++;
+			continue;
+		}
+
+		mcast = skb->pkt_type == PACKET_MULTICAST;
+		if (netif_rx(skb) == NET_RX_SUCCESS) {
+			ipvlan_count_rx(ipvlan, len, true, mcast);
+		} else {
+			ipvlan_count_rx(ipvlan, 0, false, false);
+			drops++;
+		}
+	}
+	rcu_read_unlock();
+
+	return n - drops;
+}
+
 static const struct net_device_ops ipvlan_netdev_ops = {
 	.ndo_init		= ipvlan_init,
 	.ndo_uninit		= ipvlan_uninit,
@@ -417,8 +491,15 @@ static const struct net_device_ops ipvlan_netdev_ops = {
 	.ndo_vlan_rx_add_vid	= ipvlan_vlan_rx_add_vid,
 	.ndo_vlan_rx_kill_vid	= ipvlan_vlan_rx_kill_vid,
 	.ndo_get_iflink		= ipvlan_get_iflink,
+	.ndo_bpf		= ipvlan_xdp,
+	.ndo_xdp_xmit		= ipvlan_xdp_xmit,
 };
 
+/* ipvtap attaches its XDP program to the tap fd with TUNSETXDPEBPF, so
+ * its ops are a copy without ndo_bpf, set up at module init.
+ */
+static struct net_device_ops ipvlan_tap_netdev_ops __ro_after_init;
+
 static int ipvlan_hard_header(struct sk_buff *skb, struct net_device *dev,
 			      unsigned short type, const void *daddr,
 			      const void *saddr, unsigned len)
@@ -443,8 +524,8 @@ static const struct header_ops ipvlan_header_ops = {
 
 static bool netif_is_ipvlan(const struct net_device *dev)
 {
-	/* both ipvlan and ipvtap devices use the same netdev_ops */
-	return dev->netdev_ops == &ipvlan_netdev_ops;
+	return dev->netdev_ops == &ipvlan_netdev_ops ||
+	       dev->netdev_ops == &ipvlan_tap_netdev_ops;
 }
 
 static int ipvlan_ethtool_get_link_ksettings(struct net_device *dev,
@@ -717,13 +798,19 @@ void ipvlan_link_setup(struct net_device *dev)
 	dev->max_mtu = ETH_MAX_MTU;
 	dev->priv_flags &= ~(IFF_XMIT_DST_RELEASE | IFF_TX_SKB_SHARING);
 	dev->priv_flags |= IFF_UNICAST_FLT | IFF_NO_QUEUE;
-	dev->netdev_ops = &ipvlan_netdev_ops;
+	dev->netdev_ops = &ipvlan_tap_netdev_ops;
 	dev->needs_free_netdev = true;
 	dev->header_ops = &ipvlan_header_ops;
 	dev->ethtool_ops = &ipvlan_ethtool_ops;
 }
 EXPORT_SYMBOL_GPL(ipvlan_link_setup);
 
+static void ipvlan_setup(struct net_device *dev)
+{
+	ipvlan_link_setup(dev);
+	dev->netdev_ops = &ipvlan_netdev_ops;
+}
+
 static const struct nla_policy ipvlan_nl_policy[IFLA_IPVLAN_MAX + 1] =
 {
 	[IFLA_IPVLAN_MODE] = { .type = NLA_U16 },
@@ -734,7 +821,7 @@ static struct rtnl_link_ops ipvlan_link_ops = {
 	.kind		= "ipvlan",
 	.priv_size	= sizeof(struct ipvl_dev),
 
-	.setup		= ipvlan_link_setup,
+	.setup		= ipvlan_setup,
 	.newlink	= ipvlan_link_new,
 	.dellink	= ipvlan_link_delete,
 };
@@ -1070,6 +1157,9 @@ static int __init ipvlan_init_module(void)
 {
 	int err;
 
+	ipvlan_tap_netdev_ops = ipvlan_netdev_ops;
+	ipvlan_tap_netdev_ops.ndo_bpf = NULL;
+
 	ipvlan_init_secret();
 	register_netdevice_notifier(&ipvlan_notifier_block);
 #if IS_ENABLED(CONFIG_IPV6)
@@ -34,6 +34,7 @@
 #include <net/rtnetlink.h>
 #include <net/xfrm.h>
 #include <linux/netpoll.h>
+#include <linux/bpf.h>
 
 #define MACVLAN_HASH_BITS	8
 #define MACVLAN_HASH_SIZE	(1<<MACVLAN_HASH_BITS)
@@ -867,6 +868,7 @@ static int macvlan_init(struct net_device *dev)
 	struct macvlan_dev *vlan = netdev_priv(dev);
 	const struct net_device *lowerdev = vlan->lowerdev;
 	struct macvlan_port *port = vlan->port;
+	int err;
 
 	dev->state		= (dev->state & ~MACVLAN_STATE_MASK) |
 				  (lowerdev->state & MACVLAN_STATE_MASK);
@@ -886,6 +888,12 @@ static int macvlan_init(struct net_device *dev)
 	if (!vlan->pcpu_stats)
 		return -ENOMEM;
 
+	err = xdp_rxq_info_reg(&vlan->xdp_rxq, dev, 0);
+	if (err) {
+		free_percpu(vlan->pcpu_stats);
+		return err;
+	}
+
 	port->count += 1;
 
 	return 0;
@@ -896,6 +904,9 @@ static void macvlan_uninit(struct net_device *dev)
 	struct macvlan_dev *vlan = netdev_priv(dev);
 	struct macvlan_port *port = vlan->port;
 
+	xdp_prog_replace(&vlan->xdp_prog, NULL);
+	xdp_rxq_info_unreg(&vlan->xdp_rxq);
+
 	free_percpu(vlan->pcpu_stats);
 
 	macvlan_flush_sources(port, vlan);
@@ -904,6 +915,69 @@ static void macvlan_uninit(struct net_device *dev)
 		macvlan_port_destroy(port->dev);
 }
 
+static int macvlan_xdp(struct net_device *dev, struct netdev_bpf *xdp)
+{
+	struct macvlan_dev *vlan = netdev_priv(dev);
+
+	return xdp_redirect_prog_bpf(&vlan->xdp_prog, xdp);
+}
+
+/* Frames redirected to a macvlan device are received by it, as if they
+ * had arrived on the lower device with the macvlan's address: they are
+ * queued to the per-CPU backlog and enter the stack of the macvlan.
+ */
+static int macvlan_xdp_xmit(struct net_device *dev, int n,
+			    struct xdp_frame **frames, u32 flags)
+{
+	struct macvlan_dev *vlan = netdev_priv(dev);
+	struct bpf_prog *xdp_prog;
+	int drops = 0;
+	int i;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	if (unlikely(!(dev->flags & IFF_UP)))
+		return -ENETDOWN;
+
+	rcu_read_lock();
+	xdp_prog = rcu_dereference(vlan->xdp_prog);
+	for (i = 0; i < n; i++) {
+		struct xdp_frame *xdpf = frames[i];
+		struct sk_buff *skb;
+		unsigned int len;
+		bool multicast;
+
+		if (xdp_prog &&
+		    xdp_run_frame(xdp_prog, xdpf,
+				  &vlan->xdp_rxq) != XDP_PASS) {
+			xdp_return_frame_rx_napi(xdpf);
+			drops++;
+			continue;
+		}
+
+		len = xdpf->len;
+		skb = xdp_build_skb_from_frame(xdpf, dev);
+		if (unlikely(!skb)) {
+			xdp_return_frame_rx_napi(xdpf);
+			macvlan_count_rx(vlan, 0, false, false);
+			drops++;
+			continue;
+		}
+
+		multicast = skb->pkt_type == PACKET_MULTICAST;
+		if (netif_rx(skb) == NET_RX_SUCCESS) {
+			macvlan_count_rx(vlan, len, true, multicast);
+		} else {
+			macvlan_count_rx(vlan, 0, false, false);
+			drops++;
+		}
+	}
+	rcu_read_unlock();
+
+	return n - drops;
+}
+
 static void macvlan_dev_get_stats64(struct net_device *dev,
 				    struct rtnl_link_stats64 *stats)
 {
@@ -1126,8 +1200,15 @@ static const struct net_device_ops macvlan_netdev_ops = {
 #endif
 	.ndo_get_iflink		= macvlan_dev_get_iflink,
 	.ndo_features_check	= passthru_features_check,
+	.ndo_bpf		= macvlan_xdp,
+	.ndo_xdp_xmit		= macvlan_xdp_xmit,
 };
 
+/* macvtap attaches its XDP program to the tap fd with TUNSETXDPEBPF, so
+ * its ops are a copy without ndo_bpf, set up at module init.
+ */
+static struct net_device_ops macvlan_tap_netdev_ops __ro_after_init;
+
 void macvlan_common_setup(struct net_device *dev)
 {
 	ether_setup(dev);
@@ -1137,7 +1218,7 @@ void macvlan_common_setup(struct net_device *dev)
 	dev->priv_flags	       &= ~IFF_TX_SKB_SHARING;
 	netif_keep_dst(dev);
 	dev->priv_flags	       |= IFF_UNICAST_FLT;
-	dev->netdev_ops		= &macvlan_netdev_ops;
+	dev->netdev_ops		= &macvlan_tap_netdev_ops;
 	dev->needs_free_netdev	= true;
 	dev->header_ops		= &macvlan_hard_header_ops;
 	dev->ethtool_ops	= &macvlan_ethtool_ops;
@@ -1147,6 +1228,7 @@ EXPORT_SYMBOL_GPL(macvlan_common_setup);
 static void macvlan_setup(struct net_device *dev)
 {
 	macvlan_common_setup(dev);
+	dev->netdev_ops = &macvlan_netdev_ops;
 	dev->priv_flags |= IFF_NO_QUEUE;
 }
 
@@ -1709,6 +1791,9 @@ static int __init macvlan_init_module(void)
 {
 	int err;
 
+	macvlan_tap_netdev_ops = macvlan_netdev_ops;
+	macvlan_tap_netdev_ops.ndo_bpf = NULL;
+
 	register_netdevice_notifier(&macvlan_notifier_block);
 
 	err = macvlan_link_register(&macvlan_link_ops);
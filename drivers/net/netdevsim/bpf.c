@@ -222,7 +222,8 @@ static int nsim_xdp_set_prog(struct netdevsim *ns, struct netdev_bpf *bpf)
 	if (ns->xdp_prog)
 		bpf_prog_put(ns->xdp_prog);
 
-	ns->xdp_prog = bpf->prog;
+	/* read locklessly by the loopback datapath */
+	WRITE_ONCE(ns->xdp_prog, bpf->prog);
 	ns->xdp_flags = bpf->flags;
 
 	if (!bpf->prog)
@@ -0,0 +1,315 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Loopback datapath: packets transmitted on a netdevsim port are
+ * received back on the same port through per-queue NAPI instances,
+ * optionally running the driver-mode XDP program on the way in.
+ */
+
+#include <linux/bpf.h>
+#include <linux/bpf_trace.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/etherdevice.h>
+#include <linux/filter.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <net/xdp.h>
+
+#include "netdevsim.h"
+
+static void nsim_tstats_add(struct netdevsim *ns, bool rx, unsigned int pkts,
+			    unsigned int bytes)
+{
+	struct pcpu_sw_netstats *tstats = this_cpu_ptr(ns->netdev->tstats);
+
+	u64_stats_update_begin(&tstats->syncp);
+	if (rx) {
+		tstats->rx_packets += pkts;
+		tstats->rx_bytes += bytes;
+	} else {
+		tstats->tx_packets += pkts;
+		tstats->tx_bytes += bytes;
+	}
+	u64_stats_update_end(&tstats->syncp);
+}
+
+void nsim_tx_stats_add(struct netdevsim *ns, unsigned int bytes)
+{
+	nsim_tstats_add(ns, false, 1, bytes);
+}
+
+/* Only programs attached in driver mode run on the host, offloaded
+ * ones are "executed by the device", i.e. not at all.
+ */
+static struct bpf_prog *nsim_xdp_prog(struct netdevsim *ns)
+{
+	struct bpf_prog *prog = READ_ONCE(ns->xdp_prog);
+
+	if (prog && bpf_prog_is_dev_bound(prog->aux))
+		return NULL;
+	return prog;
+}
+
+static void nsim_rq_enqueue(struct netdevsim *ns, struct nsim_rq *rq,
+			    struct sk_buff *skb)
+{
+	if (skb_queue_len(&rq->skb_queue) >= READ_ONCE(ns->ring_size)) {
+		atomic_long_inc(&ns->netdev->rx_dropped);
+		kfree_skb(skb);
+		return;
+	}
+
+	skb_queue_tail(&rq->skb_queue, skb);
+}
+
+void nsim_loopback_xmit(struct netdevsim *ns, struct sk_buff *skb)
+{
+	struct nsim_rq *rq;
+
+	rq = &ns->rq[skb_get_queue_mapping(skb) % ns->num_rq];
+
+	skb_tx_timestamp(skb);
+	skb_scrub_packet(skb, false);
+
+	/* XDP programs expect packets as they appear on the wire */
+	if (skb_is_gso(skb) && nsim_xdp_prog(ns)) {
+		struct sk_buff *segs, *next;
+
+		segs = skb_gso_segment(skb, 0);
+		consume_skb(skb);
+		if (IS_ERR_OR_NULL(segs)) {
+			atomic_long_inc(&ns->netdev->rx_dropped);
+			return;
+		}
+
+		for (skb = segs; skb; skb = next) {
+			next = skb->next;
+			skb->next = NULL;
+			nsim_rq_enqueue(ns, rq, skb);
+		}
+	} else {
+		nsim_rq_enqueue(ns, rq, skb);
+	}
+
+	napi_schedule(&rq->napi);
+}
+
+/* Copy the packet into a fresh page the way a NIC would DMA it, run
+ * the XDP program and turn the result back into an skb on XDP_PASS.
+ * XDP_TX frames leave on the wire and are not looped back, so that
+ * forwarding programs do not feed their own output.
+ */
+static struct sk_buff *nsim_rx_xdp(struct nsim_rq *rq, struct bpf_prog *prog,
+				   struct sk_buff *skb, bool *xdp_redirect)
+{
+	struct netdevsim *ns = rq->ns;
+	unsigned int len = skb->len;
+	unsigned int truesize, order;
+	struct xdp_buff xdp;
+	struct page *page;
+	void *hard_start;
+	u32 act;
+
+	if (skb->ip_summed == CHECKSUM_PARTIAL && skb_checksum_help(skb))
+		goto drop;
+
+	truesize = SKB_DATA_ALIGN(XDP_PACKET_HEADROOM + len) +
+		   SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	order = get_order(truesize);
+	page = dev_alloc_pages(order);
+	if (!page)
+		goto drop;
+
+	hard_start = page_address(page);
+	if (skb_copy_bits(skb, 0, hard_start + XDP_PACKET_HEADROOM, len)) {
+		__free_pages(page, order);
+		goto drop;
+	}
+	consume_skb(skb);
+
+	xdp.data_hard_start = hard_start;
+	xdp.data = hard_start + XDP_PACKET_HEADROOM;
+	xdp.data_end = xdp.data + len;
+	xdp.data_meta = xdp.data;
+	xdp.rxq = &rq->xdp_rxq;
+
+	act = bpf_prog_run_xdp(prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		break;
+	case XDP_TX:
+		nsim_tx_stats_add(ns, xdp.data_end - xdp.data);
+		page_frag_free(hard_start);
+		return NULL;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(ns->netdev, &xdp, prog))
+			goto err_xdp;
+		*xdp_redirect = true;
+		return NULL;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+		/* fall through */
+	case XDP_ABORTED:
+		trace_xdp_exception(ns->netdev, prog, act);
+		/* fall through */
+	case XDP_DROP:
+		goto err_xdp;
+	}
+
+	skb = build_skb(hard_start, PAGE_SIZE << order);
+	if (!skb)
+		goto err_xdp;
+
+	skb_reserve(skb, xdp.data - hard_start);
+	skb_put(skb, xdp.data_end - xdp.data);
+	if (xdp.data != xdp.data_meta)
+		skb_metadata_set(skb, xdp.data - xdp.data_meta);
+
+	return skb;
+
+err_xdp:
+	page_frag_free(hard_start);
+	return NULL;
+drop:
+	atomic_long_inc(&ns->netdev->rx_dropped);
+	kfree_skb(skb);
+	return NULL;
+}
+
+static int nsim_napi_poll(struct napi_struct *napi, int budget)
+{
+	struct nsim_rq *rq = container_of(napi, struct nsim_rq, napi);
+	struct netdevsim *ns = rq->ns;
+	bool xdp_redirect = false;
+	struct bpf_prog *xdp_prog;
+	int done = 0;
+
+	rcu_read_lock();
+	xdp_prog = nsim_xdp_prog(ns);
+
+	while (done < budget) {
+		u32 pkt_cost_ns = READ_ONCE(ns->pkt_cost_ns);
+		struct sk_buff *skb;
+
+		skb = skb_dequeue(&rq->skb_queue);
+		if (!skb)
+			break;
+		done++;
+
+		if (pkt_cost_ns)
+			ndelay(pkt_cost_ns);
+
+		if (xdp_prog) {
+			skb = nsim_rx_xdp(rq, xdp_prog, skb, &xdp_redirect);
+			if (!skb)
+				continue;
+		}
+
+		nsim_tstats_add(ns, true, 1, skb->len);
+		skb->protocol = eth_type_trans(skb, ns->netdev);
+		skb_record_rx_queue(skb, rq - ns->rq);
+		if (skb_is_gso(skb))
+			netif_receive_skb(skb);
+		else
+			napi_gro_receive(napi, skb);
+	}
+
+	if (xdp_redirect)
+		xdp_do_flush_map();
+	rcu_read_unlock();
+
+	if (done < budget)
+		napi_complete_done(napi, done);
+
+	return done;
+}
+
+int nsim_xdp_xmit(struct net_device *dev, int n, struct xdp_frame **frames,
+		  u32 flags)
+{
+	struct netdevsim *ns = netdev_priv(dev);
+	unsigned int bytes = 0;
+	int i;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	if (unlikely(!netif_running(dev)))
+		return -ENETDOWN;
+
+	for (i = 0; i < n; i++) {
+		bytes += frames[i]->len;
+		xdp_return_frame_rx_napi(frames[i]);
+	}
+	nsim_tstats_add(ns, false, n, bytes);
+
+	return n;
+}
+
+void nsim_loopback_open(struct netdevsim *ns)
+{
+	unsigned int i;
+
+	for (i = 0; i < ns->num_rq; i++)
+		napi_enable(&ns->rq[i].napi);
+}
+
+void nsim_loopback_stop(struct netdevsim *ns)
+{
+	unsigned int i;
+
+	for (i = 0; i < ns->num_rq; i++) {
+		napi_disable(&ns->rq[i].napi);
+		skb_queue_purge(&ns->rq[i].skb_queue);
+	}
+}
+
+int nsim_loopback_init(struct netdevsim *ns)
+{
+	struct net_device *dev = ns->netdev;
+	unsigned int i;
+	int err;
+
+	ns->num_rq = dev->num_rx_queues;
+	ns->rq = kcalloc(ns->num_rq, sizeof(*ns->rq), GFP_KERNEL);
+	if (!ns->rq)
+		return -ENOMEM;
+
+	for (i = 0; i < ns->num_rq; i++) {
+		struct nsim_rq *rq = &ns->rq[i];
+
+		rq->ns = ns;
+		skb_queue_head_init(&rq->skb_queue);
+		err = xdp_rxq_info_reg(&rq->xdp_rxq, dev, i);
+		if (err)
+			goto err_rxq_unreg;
+		netif_napi_add(dev, &rq->napi, nsim_napi_poll,
+			       NAPI_POLL_WEIGHT);
+	}
+
+	ns->ring_size = NSIM_RING_SIZE_DEFAULT;
+	debugfs_create_bool("loopback", 0600, ns->ddir, &ns->loopback);
+	debugfs_create_u32("ring_size", 0600, ns->ddir, &ns->ring_size);
+	debugfs_create_u32("pkt_cost_ns", 0600, ns->ddir, &ns->pkt_cost_ns);
+
+	return 0;
+
+err_rxq_unreg:
+	while (i--) {
+		netif_napi_del(&ns->rq[i].napi);
+		xdp_rxq_info_unreg(&ns->rq[i].xdp_rxq);
+	}
+	kfree(ns->rq);
+	return err;
+}
+
+void nsim_loopback_uninit(struct netdevsim *ns)
+{
+	unsigned int i;
+
+	for (i = 0; i < ns->num_rq; i++) {
+		netif_napi_del(&ns->rq[i].napi);
+		xdp_rxq_info_unreg(&ns->rq[i].xdp_rxq);
+	}
+	kfree(ns->rq);
+}
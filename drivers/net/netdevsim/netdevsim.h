@@ -17,12 +17,15 @@
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/netdevice.h>
-#include <linux/u64_stats_sync.h>
+#include <linux/skbuff.h>
+#include <net/xdp.h>
 
 #define DRV_NAME	"netdevsim"
 
 #define NSIM_XDP_MAX_MTU	4000
 
+#define NSIM_RING_SIZE_DEFAULT	256
+
 #define NSIM_EA(extack, msg)	NL_SET_ERR_MSG_MOD((extack), msg)
 
 struct bpf_prog;
@@ -50,12 +53,21 @@ struct nsim_ipsec {
 	u32 ok;
 };
 
+struct nsim_rq {
+	struct napi_struct napi;
+	struct sk_buff_head skb_queue;
+	struct xdp_rxq_info xdp_rxq;
+	struct netdevsim *ns;
+};
+
 struct netdevsim {
 	struct net_device *netdev;
 
-	u64 tx_packets;
-	u64 tx_bytes;
-	struct u64_stats_sync syncp;
+	struct nsim_rq *rq;
+	unsigned int num_rq;
+	bool loopback;
+	u32 ring_size;
+	u32 pkt_cost_ns;
 
 	struct device dev;
 
@@ -93,6 +105,15 @@ struct netdevsim {
 
 extern struct dentry *nsim_ddir;
 
+int nsim_loopback_init(struct netdevsim *ns);
+void nsim_loopback_uninit(struct netdevsim *ns);
+void nsim_loopback_open(struct netdevsim *ns);
+void nsim_loopback_stop(struct netdevsim *ns);
+void nsim_loopback_xmit(struct netdevsim *ns, struct sk_buff *skb);
+void nsim_tx_stats_add(struct netdevsim *ns, unsigned int bytes);
+int nsim_xdp_xmit(struct net_device *dev, int n, struct xdp_frame **frames,
+		  u32 flags);
+
 #ifdef CONFIG_BPF_SYSCALL
 int nsim_bpf_init(struct netdevsim *ns);
 void nsim_bpf_uninit(struct netdevsim *ns);
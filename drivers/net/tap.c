@@ -16,6 +16,9 @@
 #include <linux/idr.h>
 #include <linux/fs.h>
 #include <linux/uio.h>
+#include <linux/bpf.h>
+#include <linux/bpf_trace.h>
+#include <linux/filter.h>
 
 #include <net/net_namespace.h>
 #include <net/rtnetlink.h>
@@ -153,6 +156,7 @@ static int tap_enable_queue(struct tap_dev *tap, struct file *file,
 	err = 0;
 	rcu_assign_pointer(tap->taps[tap->numvtaps], q);
 	q->queue_index = tap->numvtaps;
+	q->xdp_rxq.queue_index = q->queue_index;
 	q->enabled = true;
 
 	tap->numvtaps++;
@@ -164,9 +168,15 @@ static int tap_enable_queue(struct tap_dev *tap, struct file *file,
 static int tap_set_queue(struct tap_dev *tap, struct file *file,
 			 struct tap_queue *q)
 {
+	int err;
+
 	if (tap->numqueues == MAX_TAP_QUEUES)
 		return -EBUSY;
 
+	err = xdp_rxq_info_reg(&q->xdp_rxq, tap->dev, tap->numvtaps);
+	if (err)
+		return err;
+
 	rcu_assign_pointer(q->tap, tap);
 	rcu_assign_pointer(tap->taps[tap->numvtaps], q);
 	sock_hold(&q->sk);
@@ -199,6 +209,7 @@ static int tap_disable_queue(struct tap_queue *q)
 		BUG_ON(index >= tap->numvtaps);
 		nq = rtnl_dereference(tap->taps[tap->numvtaps - 1]);
 		nq->queue_index = index;
+		nq->xdp_rxq.queue_index = index;
 
 		rcu_assign_pointer(tap->taps[index], nq);
 		RCU_INIT_POINTER(tap->taps[tap->numvtaps - 1], NULL);
@@ -233,6 +244,7 @@ static void tap_put_queue(struct tap_queue *q)
 		RCU_INIT_POINTER(q->tap, NULL);
 		sock_put(&q->sk);
 		list_del_init(&q->next);
+		xdp_rxq_info_unreg(&q->xdp_rxq);
 	}
 
 	rtnl_unlock();
@@ -297,6 +309,7 @@ static struct tap_queue *tap_get_queue(struct tap_dev *tap,
 void tap_del_queues(struct tap_dev *tap)
 {
 	struct tap_queue *q, *tmp;
+	struct bpf_prog *old;
 
 	ASSERT_RTNL();
 	list_for_each_entry_safe(q, tmp, &tap->queue_list, next) {
@@ -305,12 +318,18 @@ void tap_del_queues(struct tap_dev *tap)
 		if (q->enabled)
 			tap->numvtaps--;
 		tap->numqueues--;
+		xdp_rxq_info_unreg(&q->xdp_rxq);
 		sock_put(&q->sk);
 	}
 	BUG_ON(tap->numvtaps);
 	BUG_ON(tap->numqueues);
 	/* guarantee that any future tap_set_queue will fail */
 	tap->numvtaps = MAX_TAP_QUEUES;
+
+	old = rtnl_dereference(tap->xdp_prog);
+	RCU_INIT_POINTER(tap->xdp_prog, NULL);
+	if (old)
+		bpf_prog_put(old);
 }
 EXPORT_SYMBOL_GPL(tap_del_queues);
 
@@ -618,6 +637,185 @@ static inline struct sk_buff *tap_alloc_skb(struct sock *sk, size_t prepad,
 /* Neighbour code has some assumptions on HH_DATA_MOD alignment */
 #define TAP_RESERVE HH_DATA_OFF(ETH_HLEN)
 
+#define TAP_RX_PAD (NET_IP_ALIGN + NET_SKB_PAD)
+
+static void tap_count_tx_dropped(struct tap_queue *q)
+{
+	struct tap_dev *tap;
+
+	rcu_read_lock();
+	tap = rcu_dereference(q->tap);
+	if (tap && tap->count_tx_dropped)
+		tap->count_tx_dropped(tap);
+	rcu_read_unlock();
+}
+
+static bool tap_can_build_skb(struct tap_queue *q, int len, int noblock,
+			      bool zerocopy)
+{
+	/* The built skb is charged to the socket like one from
+	 * sock_alloc_send_pskb().  Leave a full send buffer to that path,
+	 * which knows how to wait for room or fail with -EAGAIN.
+	 */
+	if (refcount_read(&q->sk.sk_wmem_alloc) >= q->sk.sk_sndbuf)
+		return false;
+
+	if (!noblock)
+		return false;
+
+	if (zerocopy)
+		return false;
+
+	if (SKB_DATA_ALIGN(len + TAP_RX_PAD + XDP_PACKET_HEADROOM) +
+	    SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) > PAGE_SIZE)
+		return false;
+
+	return true;
+}
+
+/* Queue a frame the XDP program bounced with XDP_TX back to the
+ * reader of this queue.
+ */
+static int tap_xdp_tx(struct tap_queue *q, struct sk_buff *skb)
+{
+	if (ptr_ring_produce(&q->ring, skb)) {
+		kfree_skb(skb);
+		return -ENOSPC;
+	}
+
+	wake_up_interruptible_poll(sk_sleep(&q->sk),
+				   EPOLLIN | EPOLLRDNORM | EPOLLRDBAND);
+	return 0;
+}
+
+/* Copy a linear frame into a page fragment, run the XDP program of the
+ * device on it, and build the skb around the same buffer if the program
+ * lets it pass.  Returns NULL if the frame was consumed or dropped by XDP.
+ */
+static struct sk_buff *tap_build_skb(struct tap_queue *q,
+				     struct iov_iter *from,
+				     struct virtio_net_hdr *hdr,
+				     int len)
+{
+	struct page_frag *alloc_frag = &current->task_frag;
+	int buflen = SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	struct bpf_prog *xdp_prog;
+	struct sk_buff *skb;
+	struct tap_dev *tap;
+	unsigned int delta = 0;
+	int err, pad = TAP_RX_PAD;
+	size_t copied;
+	char *buf;
+
+	rcu_read_lock();
+	tap = rcu_dereference(q->tap);
+	if (tap && rcu_access_pointer(tap->xdp_prog))
+		pad += XDP_PACKET_HEADROOM;
+	buflen += SKB_DATA_ALIGN(len + pad);
+	rcu_read_unlock();
+
+	alloc_frag->offset = ALIGN((u64)alloc_frag->offset, SMP_CACHE_BYTES);
+	if (unlikely(!skb_page_frag_refill(buflen, alloc_frag, GFP_KERNEL)))
+		return ERR_PTR(-ENOMEM);
+
+	buf = (char *)page_address(alloc_frag->page) + alloc_frag->offset;
+	copied = copy_page_from_iter(alloc_frag->page,
+				     alloc_frag->offset + pad,
+				     len, from);
+	if (copied != len)
+		return ERR_PTR(-EFAULT);
+
+	local_bh_disable();
+	rcu_read_lock();
+	tap = rcu_dereference(q->tap);
+	xdp_prog = tap ? rcu_dereference(tap->xdp_prog) : NULL;
+	/* GSO frames, and frames that raced with the program being
+	 * attached and lack the headroom for it, skip XDP.
+	 */
+	if (xdp_prog && !hdr->gso_type &&
+	    pad >= TAP_RX_PAD + XDP_PACKET_HEADROOM) {
+		struct xdp_buff xdp;
+		void *orig_data;
+		u32 act;
+
+		xdp.data_hard_start = buf;
+		xdp.data = buf + pad;
+		xdp_set_data_meta_invalid(&xdp);
+		xdp.data_end = xdp.data + len;
+		xdp.rxq = &q->xdp_rxq;
+		orig_data = xdp.data;
+		act = bpf_prog_run_xdp(xdp_prog, &xdp);
+
+		switch (act) {
+		case XDP_REDIRECT:
+			get_page(alloc_frag->page);
+			alloc_frag->offset += buflen;
+			err = xdp_do_redirect(tap->dev, &xdp, xdp_prog);
+			xdp_do_flush_map();
+			if (err)
+				goto err_redirect;
+			rcu_read_unlock();
+			local_bh_enable();
+			return NULL;
+		case XDP_TX:
+		case XDP_PASS:
+			delta = orig_data - xdp.data;
+			len = xdp.data_end - xdp.data;
+			break;
+		default:
+			bpf_warn_invalid_xdp_action(act);
+			/* fall through */
+		case XDP_ABORTED:
+			trace_xdp_exception(tap->dev, xdp_prog, act);
+			/* fall through */
+		case XDP_DROP:
+			goto err_xdp;
+		}
+
+		if (act == XDP_TX) {
+			skb = build_skb(buf, buflen);
+			if (!skb)
+				goto err_xdp;
+			skb_reserve(skb, pad - delta);
+			skb_put(skb, len);
+			get_page(alloc_frag->page);
+			alloc_frag->offset += buflen;
+			if (tap_xdp_tx(q, skb) && tap->count_tx_dropped)
+				tap->count_tx_dropped(tap);
+			rcu_read_unlock();
+			local_bh_enable();
+			return NULL;
+		}
+	}
+
+	skb = build_skb(buf, buflen);
+	if (!skb) {
+		rcu_read_unlock();
+		local_bh_enable();
+		return ERR_PTR(-ENOMEM);
+	}
+
+	skb_reserve(skb, pad - delta);
+	skb_put(skb, len);
+	skb_set_owner_w(skb, &q->sk);
+	get_page(alloc_frag->page);
+	alloc_frag->offset += buflen;
+
+	rcu_read_unlock();
+	local_bh_enable();
+
+	return skb;
+
+err_redirect:
+	put_page(alloc_frag->page);
+err_xdp:
+	if (tap && tap->count_tx_dropped)
+		tap->count_tx_dropped(tap);
+	rcu_read_unlock();
+	local_bh_enable();
+	return NULL;
+}
+
 /* Get packet from user space buffer */
 static ssize_t tap_get_user(struct tap_queue *q, struct msghdr *m,
 			    struct iov_iter *from, int noblock)
@@ -679,6 +877,23 @@ static ssize_t tap_get_user(struct tap_queue *q, struct msghdr *m,
 			zerocopy = true;
 	}
 
+	if (tap_can_build_skb(q, len, noblock, zerocopy)) {
+		skb = tap_build_skb(q, from, &vnet_hdr, len);
+		if (IS_ERR(skb)) {
+			err = PTR_ERR(skb);
+			goto err;
+		}
+		if (!skb) {
+			/* consumed or dropped by XDP */
+			if (m && m->msg_control) {
+				struct ubuf_info *uarg = m->msg_control;
+				uarg->callback(uarg, false);
+			}
+			return total_len;
+		}
+		goto built;
+	}
+
 	if (!zerocopy) {
 		copylen = len;
 		linear = tap16_to_cpu(q, vnet_hdr.hdr_len);
@@ -701,6 +916,7 @@ static ssize_t tap_get_user(struct tap_queue *q, struct msghdr *m,
 	if (err)
 		goto err_kfree;
 
+built:
 	skb_set_network_header(skb, ETH_HLEN);
 	skb_reset_mac_header(skb);
 	skb->protocol = eth_hdr(skb)->h_proto;
@@ -746,11 +962,7 @@ static ssize_t tap_get_user(struct tap_queue *q, struct msghdr *m,
 	kfree_skb(skb);
 
 err:
-	rcu_read_lock();
-	tap = rcu_dereference(q->tap);
-	if (tap && tap->count_tx_dropped)
-		tap->count_tx_dropped(tap);
-	rcu_read_unlock();
+	tap_count_tx_dropped(q);
 
 	return err;
 }
@@ -923,6 +1135,47 @@ static int tap_ioctl_set_queue(struct file *file, unsigned int flags)
 	return ret;
 }
 
+static int tap_set_xdp(struct tap_queue *q, int __user *sp)
+{
+	struct bpf_prog *prog, *old;
+	struct tap_dev *tap;
+	int fd;
+
+	if (get_user(fd, sp))
+		return -EFAULT;
+
+	if (fd == -1) {
+		prog = NULL;
+	} else {
+		prog = bpf_prog_get_type(fd, BPF_PROG_TYPE_XDP);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+	}
+
+	rtnl_lock();
+	tap = rtnl_dereference(q->tap);
+	if (!tap) {
+		rtnl_unlock();
+		if (prog)
+			bpf_prog_put(prog);
+		return -ENOLINK;
+	}
+	if (!ns_capable(dev_net(tap->dev)->user_ns, CAP_NET_ADMIN)) {
+		rtnl_unlock();
+		if (prog)
+			bpf_prog_put(prog);
+		return -EPERM;
+	}
+	old = rtnl_dereference(tap->xdp_prog);
+	rcu_assign_pointer(tap->xdp_prog, prog);
+	rtnl_unlock();
+
+	if (old)
+		bpf_prog_put(old);
+
+	return 0;
+}
+
 static int set_offload(struct tap_queue *q, unsigned long arg)
 {
 	struct tap_dev *tap;
@@ -1088,6 +1341,9 @@ static long tap_ioctl(struct file *file, unsigned int cmd,
 		rtnl_unlock();
 		return ret;
 
+	case TUNSETXDPEBPF:
+		return tap_set_xdp(q, sp);
+
 	case SIOCGIFHWADDR:
 		rtnl_lock();
 		tap = tap_get_tap_dev(q);
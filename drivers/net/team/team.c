@@ -24,11 +24,13 @@
 #include <linux/socket.h>
 #include <linux/etherdevice.h>
 #include <linux/rtnetlink.h>
+#include <linux/bpf.h>
 #include <net/rtnetlink.h>
 #include <net/genetlink.h>
 #include <net/netlink.h>
 #include <net/sch_generic.h>
 #include <net/switchdev.h>
+#include <net/xdp.h>
 #include <generated/utsrelease.h>
 #include <linux/if_team.h>
 
@@ -520,6 +522,12 @@ static bool team_dummy_transmit(struct team *team, struct sk_buff *skb)
 	return false;
 }
 
+static struct team_port *team_dummy_xdp_select_port(struct team *team,
+						     struct xdp_frame *frame)
+{
+	return NULL;
+}
+
 static rx_handler_result_t team_dummy_receive(struct team *team,
 					      struct team_port *port,
 					      struct sk_buff *skb)
@@ -555,6 +563,12 @@ static void team_adjust_ops(struct team *team)
 	else
 		team->ops.transmit = team->mode->ops->transmit;
 
+	if (!team->en_port_count || !team_is_mode_set(team) ||
+	    !team->mode->ops->xdp_select_port)
+		team->ops.xdp_select_port = team_dummy_xdp_select_port;
+	else
+		team->ops.xdp_select_port = team->mode->ops->xdp_select_port;
+
 	if (!team->en_port_count || !team_is_mode_set(team) ||
 	    !team->mode->ops->receive)
 		team->ops.receive = team_dummy_receive;
@@ -1147,6 +1161,64 @@ static void team_upper_dev_unlink(struct team *team, struct team_port *port)
 }
 
 static void __team_port_change_port_added(struct team_port *port, bool linkup);
+
+/* Install @prog as the native XDP program of a port. The port takes
+ * its own reference.
+ */
+static int team_port_xdp_set(struct team_port *port, struct bpf_prog *prog,
+			     struct netlink_ext_ack *extack)
+{
+	struct net_device *port_dev = port->dev;
+	struct netdev_bpf xdp = {
+		.command	= XDP_SETUP_PROG,
+		.prog		= prog,
+		.extack		= extack,
+	};
+	int err;
+
+	if (!port_dev->netdev_ops->ndo_bpf) {
+		NL_SET_ERR_MSG(extack, "Port device does not support native XDP");
+		return -EOPNOTSUPP;
+	}
+
+	if (prog) {
+		prog = bpf_prog_inc(prog);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+	}
+
+	err = port_dev->netdev_ops->ndo_bpf(port_dev, &xdp);
+	if (err && prog)
+		bpf_prog_put(prog);
+	return err;
+}
+
+/* Check whether a port runs an XDP program the team did not install.
+ * Such a program would be silently replaced, and later removed, by the
+ * team's one, so the port is refused instead.
+ */
+static int team_port_xdp_check(struct team_port *port,
+			       struct netlink_ext_ack *extack)
+{
+	struct net_device *port_dev = port->dev;
+	struct netdev_bpf xdp;
+
+	if (rtnl_dereference(port_dev->xdp_prog))
+		goto busy;
+
+	if (!port_dev->netdev_ops->ndo_bpf)
+		return 0;
+
+	memset(&xdp, 0, sizeof(xdp));
+	xdp.command = XDP_QUERY_PROG;
+	if (port_dev->netdev_ops->ndo_bpf(port_dev, &xdp) ||
+	    xdp.prog_attached == XDP_ATTACHED_NONE)
+		return 0;
+
+busy:
+	NL_SET_ERR_MSG(extack, "Port device already has an XDP program");
+	return -EBUSY;
+}
 static int team_dev_type_check_change(struct net_device *dev,
 				      struct net_device *port_dev);
 
@@ -1154,6 +1226,7 @@ static int team_port_add(struct team *team, struct net_device *port_dev,
 			 struct netlink_ext_ack *extack)
 {
 	struct net_device *dev = team->dev;
+	struct bpf_prog *xdp_prog;
 	struct team_port *port;
 	char *portname = port_dev->name;
 	int err;
@@ -1262,6 +1335,18 @@ static int team_port_add(struct team *team, struct net_device *port_dev,
 		goto err_option_port_add;
 	}
 
+	xdp_prog = rtnl_dereference(team->xdp_prog);
+	if (xdp_prog) {
+		err = team_port_xdp_check(port, extack);
+		if (!err)
+			err = team_port_xdp_set(port, xdp_prog, extack);
+		if (err) {
+			netdev_err(dev, "Device %s failed to install XDP program\n",
+				   portname);
+			goto err_xdp_set;
+		}
+	}
+
 	netif_addr_lock_bh(dev);
 	dev_uc_sync_multiple(port_dev, dev);
 	dev_mc_sync_multiple(port_dev, dev);
@@ -1278,6 +1363,9 @@ static int team_port_add(struct team *team, struct net_device *port_dev,
 
 	return 0;
 
+err_xdp_set:
+	__team_option_inst_del_port(team, port);
+
 err_option_port_add:
 	team_upper_dev_unlink(team, port);
 
@@ -1325,6 +1413,8 @@ static int team_port_del(struct team *team, struct net_device *port_dev)
 	list_del_rcu(&port->list);
 	team_upper_dev_unlink(team, port);
 	netdev_rx_handler_unregister(port_dev);
+	if (rtnl_dereference(team->xdp_prog))
+		team_port_xdp_set(port, NULL, NULL);
 	team_port_disable_netpoll(port);
 	vlan_vids_del_by_dev(port_dev, dev);
 	dev_uc_unsync(port_dev, dev);
@@ -1646,6 +1736,7 @@ static int team_init(struct net_device *dev)
 static void team_uninit(struct net_device *dev)
 {
 	struct team *team = netdev_priv(dev);
+	struct bpf_prog *xdp_prog;
 	struct team_port *port;
 	struct team_port *tmp;
 
@@ -1653,6 +1744,12 @@ static void team_uninit(struct net_device *dev)
 	list_for_each_entry_safe(port, tmp, &team->port_list, list)
 		team_port_del(team, port->dev);
 
+	xdp_prog = rtnl_dereference(team->xdp_prog);
+	if (xdp_prog) {
+		RCU_INIT_POINTER(team->xdp_prog, NULL);
+		bpf_prog_put(xdp_prog);
+	}
+
 	__team_change_mode(team, NULL); /* cleanup */
 	__team_options_unregister(team, team_options, ARRAY_SIZE(team_options));
 	team_mcast_rejoin_fini(team);
@@ -1706,6 +1803,138 @@ static netdev_tx_t team_xmit(struct sk_buff *skb, struct net_device *dev)
 	return NETDEV_TX_OK;
 }
 
+static int team_xdp_set(struct team *team, struct bpf_prog *prog,
+			struct netlink_ext_ack *extack)
+{
+	struct bpf_prog *old_prog;
+	struct team_port *port;
+	int err = 0;
+
+	mutex_lock(&team->lock);
+	old_prog = rtnl_dereference(team->xdp_prog);
+	if (!old_prog) {
+		/* Programs already on the ports are not ours to remove */
+		if (!prog)
+			goto out;
+		list_for_each_entry(port, &team->port_list, list) {
+			err = team_port_xdp_check(port, extack);
+			if (err)
+				goto out;
+		}
+	}
+
+	list_for_each_entry(port, &team->port_list, list) {
+		err = team_port_xdp_set(port, prog, extack);
+		if (err)
+			goto rollback;
+	}
+
+	rcu_assign_pointer(team->xdp_prog, prog);
+	if (old_prog)
+		bpf_prog_put(old_prog);
+	mutex_unlock(&team->lock);
+
+	return 0;
+
+rollback:
+	list_for_each_entry_continue_reverse(port, &team->port_list, list)
+		team_port_xdp_set(port, old_prog, NULL);
+out:
+	mutex_unlock(&team->lock);
+
+	return err;
+}
+
+static u32 team_xdp_query(struct team *team)
+{
+	const struct bpf_prog *xdp_prog = rtnl_dereference(team->xdp_prog);
+
+	if (xdp_prog)
+		return xdp_prog->aux->id;
+
+	return 0;
+}
+
+static int team_xdp(struct net_device *dev, struct netdev_bpf *xdp)
+{
+	struct team *team = netdev_priv(dev);
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return team_xdp_set(team, xdp->prog, xdp->extack);
+	case XDP_QUERY_PROG:
+		xdp->prog_id = team_xdp_query(team);
+		xdp->prog_attached = !!xdp->prog_id;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Hand a run of frames that the mode mapped to the same port over to
+ * that port's ndo_xdp_xmit. Returns the number of frames sent, the
+ * others have been freed.
+ */
+static int team_xdp_xmit_port(struct team_port *port, int n,
+			      struct xdp_frame **frames, u32 flags)
+{
+	struct net_device *port_dev = port ? port->dev : NULL;
+	int i, sent;
+
+	if (port_dev && port_dev->netdev_ops->ndo_xdp_xmit) {
+		sent = port_dev->netdev_ops->ndo_xdp_xmit(port_dev, n, frames,
+							  flags);
+		if (sent >= 0)
+			return sent;
+	}
+
+	for (i = 0; i < n; i++)
+		xdp_return_frame_rx_napi(frames[i]);
+	return 0;
+}
+
+/*
+ * note: already called with rcu_read_lock
+ */
+static int team_xdp_xmit(struct net_device *dev, int n,
+			 struct xdp_frame **frames, u32 flags)
+{
+	struct team *team = netdev_priv(dev);
+	struct team_pcpu_stats *pcpu_stats;
+	struct team_port *port = NULL;
+	int i, start = 0, sent = 0;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev)))
+		return -ENETDOWN;
+
+	for (i = 0; i < n; i++) {
+		struct team_port *cur;
+
+		cur = team->ops.xdp_select_port(team, frames[i]);
+		if (i && cur != port) {
+			sent += team_xdp_xmit_port(port, i - start,
+						   &frames[start], flags);
+			start = i;
+		}
+		port = cur;
+	}
+	if (n)
+		sent += team_xdp_xmit_port(port, n - start, &frames[start],
+					   flags);
+
+	pcpu_stats = this_cpu_ptr(team->pcpu_stats);
+	u64_stats_update_begin(&pcpu_stats->syncp);
+	pcpu_stats->tx_packets += sent;
+	u64_stats_update_end(&pcpu_stats->syncp);
+	if (sent != n)
+		this_cpu_add(team->pcpu_stats->tx_dropped, n - sent);
+
+	return sent;
+}
+
 static u16 team_select_queue(struct net_device *dev, struct sk_buff *skb,
 			     void *accel_priv, select_queue_fallback_t fallback)
 {
@@ -2030,6 +2259,8 @@ static const struct net_device_ops team_netdev_ops = {
 	.ndo_fix_features	= team_fix_features,
 	.ndo_change_carrier     = team_change_carrier,
 	.ndo_features_check	= passthru_features_check,
+	.ndo_bpf		= team_xdp,
+	.ndo_xdp_xmit		= team_xdp_xmit,
 };
 
 /***********************
@@ -17,6 +17,8 @@
 #include <linux/etherdevice.h>
 #include <linux/filter.h>
 #include <linux/if_team.h>
+#include <net/flow_dissector.h>
+#include <net/xdp.h>
 
 static rx_handler_result_t lb_receive(struct team *team, struct team_port *port,
 				      struct sk_buff *skb)
@@ -206,6 +208,29 @@ static unsigned int lb_get_skb_hash(struct lb_priv *lb_priv,
 	return c[0] ^ c[1] ^ c[2] ^ c[3];
 }
 
+/* Frames have no skb to run the BPF hash function on, so hash the
+ * flow keys instead and fold the result the same way.
+ */
+static unsigned char lb_get_frame_hash(struct xdp_frame *frame)
+{
+	struct flow_keys keys;
+	struct ethhdr *eth;
+	uint32_t lhash;
+	unsigned char *c;
+
+	if (unlikely(frame->len < ETH_HLEN))
+		return 0;
+
+	eth = frame->data;
+	memset(&keys, 0, sizeof(keys));
+	if (!__skb_flow_dissect(NULL, &flow_keys_dissector, &keys, frame->data,
+				eth->h_proto, ETH_HLEN, frame->len, 0))
+		return 0;
+	lhash = flow_hash_from_keys(&keys);
+	c = (char *) &lhash;
+	return c[0] ^ c[1] ^ c[2] ^ c[3];
+}
+
 static void lb_update_tx_stats(unsigned int tx_bytes, struct lb_priv *lb_priv,
 			       struct lb_port_priv *lb_port_priv,
 			       unsigned char hash)
@@ -223,6 +248,27 @@ static void lb_update_tx_stats(unsigned int tx_bytes, struct lb_priv *lb_priv,
 	u64_stats_update_end(&pcpu_stats->syncp);
 }
 
+/* Frames are accounted when handed to the port: the port's
+ * ndo_xdp_xmit only reports how many frames of a batch it dropped,
+ * not which ones.
+ */
+static struct team_port *lb_xdp_select_port(struct team *team,
+					    struct xdp_frame *frame)
+{
+	struct lb_priv *lb_priv = get_lb_priv(team);
+	lb_select_tx_port_func_t *select_tx_port_func;
+	struct team_port *port;
+	unsigned char hash;
+
+	hash = lb_get_frame_hash(frame);
+	select_tx_port_func = rcu_dereference_bh(lb_priv->select_tx_port_func);
+	port = select_tx_port_func(team, lb_priv, NULL, hash);
+	if (port)
+		lb_update_tx_stats(frame->len, lb_priv, get_lb_port_priv(port),
+				   hash);
+	return port;
+}
+
 static bool lb_transmit(struct team *team, struct sk_buff *skb)
 {
 	struct lb_priv *lb_priv = get_lb_priv(team);
@@ -674,6 +720,7 @@ static const struct team_mode_ops lb_mode_ops = {
 	.port_disabled		= lb_port_disabled,
 	.receive		= lb_receive,
 	.transmit		= lb_transmit,
+	.xdp_select_port	= lb_xdp_select_port,
 };
 
 static const struct team_mode lb_mode = {
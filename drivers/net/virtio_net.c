@@ -33,6 +33,7 @@
 #include <linux/netdevice.h>
 #include <linux/pci.h>
 #include <net/route.h>
+#include <net/udp_tunnel.h>
 #include <net/xdp.h>
 #include <net/net_failover.h>
 
@@ -645,6 +646,14 @@ static struct sk_buff *receive_small(struct net_device *dev,
 
 		switch (act) {
 		case XDP_PASS:
+			act = udp_tunnel_xdp_rcv(&xdp);
+			if (act == XDP_REDIRECT) {
+				*xdp_xmit |= VIRTIO_XDP_REDIR;
+				rcu_read_unlock();
+				goto xdp_xmit;
+			}
+			if (act != XDP_PASS)
+				goto err_xdp;
 			/* Recalculate length in case bpf program changed it */
 			delta = orig_data - xdp.data;
 			len = xdp.data_end - xdp.data;
@@ -791,6 +800,19 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 
 		switch (act) {
 		case XDP_PASS:
+			act = udp_tunnel_xdp_rcv(&xdp);
+			if (act == XDP_REDIRECT) {
+				*xdp_xmit |= VIRTIO_XDP_REDIR;
+				if (unlikely(xdp_page != page))
+					put_page(page);
+				rcu_read_unlock();
+				goto xdp_xmit;
+			}
+			if (act != XDP_PASS) {
+				if (unlikely(xdp_page != page))
+					__free_pages(xdp_page, 0);
+				goto err_xdp;
+			}
 			/* recalculate offset to account for any header
 			 * adjustments. Note other cases do not build an
 			 * skb and avoid using offset
@@ -18,6 +18,7 @@
 #include <linux/igmp.h>
 #include <linux/if_ether.h>
 #include <linux/ethtool.h>
+#include <linux/bpf.h>
 #include <net/arp.h>
 #include <net/ndisc.h>
 #include <net/ip.h>
@@ -28,6 +29,7 @@
 #include <net/netns/generic.h>
 #include <net/tun_proto.h>
 #include <net/vxlan.h>
+#include <net/xdp.h>
 
 #if IS_ENABLED(CONFIG_IPV6)
 #include <net/ip6_tunnel.h>
@@ -1449,6 +1451,64 @@ static int vxlan_rcv(struct sock *sk, struct sk_buff *skb)
 	return 0;
 }
 
+/* Callback from net/ipv4/udp.c for frames taken on the XDP path of the
+ * underlay device.  Only plain VXLAN headers on devices with an XDP
+ * program are handled here, extensions and metadata based devices are
+ * left to vxlan_rcv().
+ */
+static u32 vxlan_xdp_rcv(struct sock *sk, struct xdp_buff *xdp,
+			 const struct iphdr *iph)
+{
+	u32 ifindex = xdp->rxq->dev->ifindex;
+	struct vxlanhdr *vxh = xdp->data;
+	struct bpf_prog *xdp_prog;
+	struct vxlan_dev *vxlan;
+	struct vxlan_sock *vs;
+	struct ethhdr *eth;
+	__be32 vni;
+
+	if (xdp->data + sizeof(*vxh) + ETH_HLEN > xdp->data_end)
+		return XDP_PASS;
+
+	if (vxh->vx_flags != VXLAN_HF_VNI ||
+	    (vxh->vx_vni & ~VXLAN_VNI_MASK))
+		return XDP_PASS;
+
+	vs = rcu_dereference_sk_user_data(sk);
+	if (!vs || vxlan_get_sk_family(vs) != AF_INET ||
+	    (vs->flags & (VXLAN_F_GBP | VXLAN_F_GPE | VXLAN_F_REMCSUM_RX |
+			  VXLAN_F_COLLECT_METADATA)))
+		return XDP_PASS;
+
+	vni = vxlan_vni(vxh->vx_vni);
+	vxlan = vxlan_vs_find_vni(vs, ifindex, vni);
+	if (!vxlan)
+		return XDP_PASS;
+
+	xdp_prog = rcu_dereference(vxlan->xdp_prog);
+	if (!xdp_prog)
+		return XDP_PASS;
+
+	/* Same checks and learning as vxlan_set_mac(), done before the
+	 * program can rewrite the inner header.
+	 */
+	eth = (struct ethhdr *)(vxh + 1);
+	if (ether_addr_equal(eth->h_source, vxlan->dev->dev_addr))
+		return XDP_PASS;
+
+	if (vxlan->cfg.flags & VXLAN_F_LEARN) {
+		union vxlan_addr saddr;
+
+		saddr.sin.sin_addr.s_addr = iph->saddr;
+		saddr.sa.sa_family = AF_INET;
+		if (vxlan_snoop(vxlan->dev, &saddr, eth->h_source,
+				ifindex, vni))
+			return XDP_PASS;
+	}
+
+	return xdp_run_decap(xdp_prog, xdp, sizeof(*vxh), vxlan->dev);
+}
+
 static int arp_reduce(struct net_device *dev, struct sk_buff *skb, __be32 vni)
 {
 	struct vxlan_dev *vxlan = netdev_priv(dev);
@@ -2427,9 +2487,18 @@ static void vxlan_uninit(struct net_device *dev)
 
 	vxlan_fdb_delete_default(vxlan, vxlan->cfg.vni);
 
+	xdp_prog_replace(&vxlan->xdp_prog, NULL);
+
 	free_percpu(dev->tstats);
 }
 
+static int vxlan_xdp(struct net_device *dev, struct netdev_bpf *xdp)
+{
+	struct vxlan_dev *vxlan = netdev_priv(dev);
+
+	return xdp_redirect_prog_bpf(&vxlan->xdp_prog, xdp);
+}
+
 /* Start ageing timer and join group when device is brought up */
 static int vxlan_open(struct net_device *dev)
 {
@@ -2580,6 +2649,7 @@ static const struct net_device_ops vxlan_netdev_ether_ops = {
 	.ndo_fdb_del		= vxlan_fdb_delete,
 	.ndo_fdb_dump		= vxlan_fdb_dump,
 	.ndo_fill_metadata_dst	= vxlan_fill_metadata_dst,
+	.ndo_bpf		= vxlan_xdp,
 };
 
 static const struct net_device_ops vxlan_netdev_raw_ops = {
@@ -2853,6 +2923,7 @@ static struct vxlan_sock *vxlan_socket_create(struct net *net, bool ipv6,
 	tunnel_cfg.sk_user_data = vs;
 	tunnel_cfg.encap_type = 1;
 	tunnel_cfg.encap_rcv = vxlan_rcv;
+	tunnel_cfg.encap_xdp_rcv = vxlan_xdp_rcv;
 	tunnel_cfg.encap_destroy = NULL;
 	tunnel_cfg.gro_receive = vxlan_gro_receive;
 	tunnel_cfg.gro_complete = vxlan_gro_complete;
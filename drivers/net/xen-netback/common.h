@@ -132,6 +132,7 @@ struct xenvif_copy_state {
 	struct gnttab_copy op[COPY_BATCH_SIZE];
 	RING_IDX idx[COPY_BATCH_SIZE];
 	unsigned int num;
+	bool notify; /* frontend must be notified once the batch is done */
 	struct sk_buff_head *completed;
 };
 
@@ -130,11 +130,27 @@ static void xenvif_rx_queue_drop_expired(struct xenvif_queue *queue)
 	}
 }
 
+/* Guest Rx fills the frontend's buffers with grant copy operations.
+ * Mapping the buffers once and reusing them (persistent grants, as
+ * blkback does) is not possible with the netif protocol as defined in
+ * xen/interface/io/netif.h: there is no negotiated feature saying that
+ * an Rx request's gref stays granted after its response, and frontends
+ * rely on that not being the case.  xen-netfront ends foreign access on
+ * each gref when the response arrives (and BUG()s if the backend still
+ * has it mapped), then grants a fresh page for the next request.  Such
+ * a mode needs a new feature key in the canonical Xen netif.h first so
+ * that all frontends agree on it.  Until then, keep the number of copy
+ * hypercalls down by merging contiguous chunks and batching.
+ */
 static void xenvif_rx_copy_flush(struct xenvif_queue *queue)
 {
 	unsigned int i;
 	int notify;
 
+	if (queue->rx_copy.num == 0 &&
+	    skb_queue_empty(queue->rx_copy.completed))
+		return;
+
 	gnttab_batch_copy(queue->rx_copy.op, queue->rx_copy.num);
 
 	for (i = 0; i < queue->rx_copy.num; i++) {
@@ -156,14 +172,49 @@ static void xenvif_rx_copy_flush(struct xenvif_queue *queue)
 
 	queue->rx_copy.num = 0;
 
-	/* Push responses for all completed packets. */
+	/* Push responses for all completed packets.  The event is only
+	 * sent once at the end of xenvif_rx_action(), so remember
+	 * whether any push crossed the frontend's rsp_event.
+	 */
 	RING_PUSH_RESPONSES_AND_CHECK_NOTIFY(&queue->rx, notify);
 	if (notify)
-		notify_remote_via_irq(queue->rx_irq);
+		queue->rx_copy.notify = true;
 
 	__skb_queue_purge(queue->rx_copy.completed);
 }
 
+/* Try to extend the previous copy op instead of adding a new one.
+ * This happens when adjacent chunks of a packet (e.g. the linear
+ * area and the first frag, or consecutive frags) are contiguous in
+ * the same source page and land in the same guest buffer.
+ */
+static bool xenvif_rx_copy_merge(struct xenvif_queue *queue,
+				 struct xen_netif_rx_request *req,
+				 unsigned int offset, void *data, size_t len)
+{
+	struct gnttab_copy *prev;
+
+	if (queue->rx_copy.num == 0)
+		return false;
+
+	prev = &queue->rx_copy.op[queue->rx_copy.num - 1];
+
+	if (queue->rx_copy.idx[queue->rx_copy.num - 1] != queue->rx.req_cons ||
+	    prev->dest.u.ref != req->gref ||
+	    prev->dest.offset + prev->len != offset)
+		return false;
+
+	if ((prev->flags & GNTCOPY_source_gref) ||
+	    prev->source.domid != DOMID_SELF ||
+	    xen_page_foreign(virt_to_page(data)) ||
+	    prev->source.u.gmfn != virt_to_gfn(data) ||
+	    prev->source.offset + prev->len != xen_offset_in_page(data))
+		return false;
+
+	prev->len += len;
+	return true;
+}
+
 static void xenvif_rx_copy_add(struct xenvif_queue *queue,
 			       struct xen_netif_rx_request *req,
 			       unsigned int offset, void *data, size_t len)
@@ -172,6 +223,9 @@ static void xenvif_rx_copy_add(struct xenvif_queue *queue,
 	struct page *page;
 	struct xen_page_foreign *foreign;
 
+	if (xenvif_rx_copy_merge(queue, req, offset, data, len))
+		return;
+
 	if (queue->rx_copy.num == COPY_BATCH_SIZE)
 		xenvif_rx_copy_flush(queue);
 
@@ -465,6 +519,11 @@ void xenvif_rx_action(struct xenvif_queue *queue)
 
 	/* Flush any pending copies and complete all skbs. */
 	xenvif_rx_copy_flush(queue);
+
+	if (queue->rx_copy.notify) {
+		queue->rx_copy.notify = false;
+		notify_remote_via_irq(queue->rx_irq);
+	}
 }
 
 static bool xenvif_rx_queue_stalled(struct xenvif_queue *queue)
@@ -0,0 +1,1529 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * NVMe over Fabrics TCP target.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/err.h>
+#include <linux/crc32c.h>
+#include <linux/highmem.h>
+#include <linux/inet.h>
+#include <linux/llist.h>
+#include <linux/nvme-tcp.h>
+#include <net/sock.h>
+#include <net/tcp.h>
+
+#include "nvmet.h"
+
+#define NVMET_TCP_INLINE_DATA_SIZE	(4 * PAGE_SIZE)
+#define NVMET_TCP_MAXH2CDATA		0x400000
+
+/* per io_work invocation budgets, so one busy queue can't hog its cpu */
+#define NVMET_TCP_RECV_BUDGET		8
+#define NVMET_TCP_SEND_BUDGET		8
+#define NVMET_TCP_IO_WORK_BUDGET	64
+
+enum nvmet_tcp_send_state {
+	NVMET_TCP_SEND_DATA_PDU,
+	NVMET_TCP_SEND_DATA,
+	NVMET_TCP_SEND_R2T,
+	NVMET_TCP_SEND_DDGST,
+	NVMET_TCP_SEND_RESPONSE,
+};
+
+enum nvmet_tcp_recv_state {
+	NVMET_TCP_RECV_PDU,
+	NVMET_TCP_RECV_DATA,
+	NVMET_TCP_RECV_DDGST,
+	NVMET_TCP_RECV_DISCARD,
+	NVMET_TCP_RECV_ERR,
+};
+
+struct nvmet_tcp_cmd {
+	struct nvmet_tcp_queue		*queue;
+	struct nvmet_req		req;
+
+	struct nvme_command		nvme_cmd;
+	struct nvme_tcp_rsp_pdu		rsp_pdu;
+	struct nvme_tcp_data_pdu	data_pdu;
+	struct nvme_tcp_r2t_pdu		r2t_pdu;
+
+	u32				rbytes_done;
+	u32				wbytes_done;
+
+	u32				pdu_len;
+	u32				pdu_recv;
+	struct bio_vec			*iov;
+	struct msghdr			recv_msg;
+
+	struct scatterlist		*cur_sg;
+	u32				offset;
+	enum nvmet_tcp_send_state	state;
+
+	__le32				exp_ddgst;
+	__le32				recv_ddgst;
+	__le32				snd_ddgst;
+
+	struct list_head		entry;
+	struct llist_node		lentry;
+};
+
+enum nvmet_tcp_queue_state {
+	NVMET_TCP_Q_CONNECTING,
+	NVMET_TCP_Q_LIVE,
+	NVMET_TCP_Q_DISCONNECTING,
+};
+
+struct nvmet_tcp_queue {
+	struct socket		*sock;
+	struct nvmet_tcp_port	*port;
+	struct nvmet_port	*nport;
+	struct work_struct	io_work;
+	int			cpu;
+	struct nvmet_cq		nvme_cq;
+	struct nvmet_sq		nvme_sq;
+
+	/* send state */
+	struct nvmet_tcp_cmd	*cmds;
+	unsigned int		nr_cmds;
+	struct list_head	free_list;
+	struct llist_head	resp_list;
+	struct list_head	resp_send_list;
+	struct nvmet_tcp_cmd	*snd_cmd;
+
+	/* recv state */
+	int			offset;
+	int			left;
+	enum nvmet_tcp_recv_state rcv_state;
+	struct nvmet_tcp_cmd	*cmd;
+	union nvme_tcp_pdu	pdu;
+
+	/* digest state */
+	bool			data_digest;
+	u32			rcv_crc;
+	u32			snd_crc;
+
+	spinlock_t		state_lock;
+	enum nvmet_tcp_queue_state state;
+
+	struct sockaddr_storage	sockaddr;
+	struct sockaddr_storage	sockaddr_peer;
+	struct work_struct	release_work;
+
+	int			idx;
+	struct list_head	queue_list;
+
+	/* used until the connect command sized the queue */
+	struct nvmet_tcp_cmd	connect;
+
+	void (*data_ready)(struct sock *);
+	void (*state_change)(struct sock *);
+	void (*write_space)(struct sock *);
+};
+
+struct nvmet_tcp_port {
+	struct socket		*sock;
+	struct work_struct	accept_work;
+	struct nvmet_port	*nport;
+	struct sockaddr_storage	addr;
+	int			last_cpu;
+	void (*data_ready)(struct sock *);
+};
+
+static DEFINE_IDA(nvmet_tcp_queue_ida);
+static LIST_HEAD(nvmet_tcp_queue_list);
+static DEFINE_MUTEX(nvmet_tcp_queue_mutex);
+
+static struct workqueue_struct *nvmet_tcp_wq;
+static const struct nvmet_fabrics_ops nvmet_tcp_ops;
+
+static inline u16 nvmet_tcp_cmd_tag(struct nvmet_tcp_queue *queue,
+		struct nvmet_tcp_cmd *cmd)
+{
+	/* the connect command sits right after the regular ones */
+	if (cmd == &queue->connect)
+		return queue->nr_cmds;
+	return cmd - queue->cmds;
+}
+
+static inline bool nvmet_tcp_need_data_in(struct nvmet_tcp_cmd *cmd)
+{
+	return nvme_is_write(cmd->req.cmd) &&
+		cmd->rbytes_done < cmd->req.transfer_len &&
+		!cmd->req.rsp->status;
+}
+
+static inline bool nvmet_tcp_need_data_out(struct nvmet_tcp_cmd *cmd)
+{
+	return !nvme_is_write(cmd->req.cmd) &&
+		cmd->req.transfer_len > 0 &&
+		!cmd->req.rsp->status;
+}
+
+static inline bool nvmet_tcp_queue_more(struct nvmet_tcp_queue *queue)
+{
+	return !list_empty(&queue->resp_send_list) ||
+		!llist_empty(&queue->resp_list);
+}
+
+static inline void nvmet_tcp_ddgst_init(u32 *crc)
+{
+	*crc = ~0;
+}
+
+static inline void nvmet_tcp_ddgst_update(u32 *crc, const void *data,
+		size_t len)
+{
+	*crc = crc32c(*crc, data, len);
+}
+
+static inline __le32 nvmet_tcp_ddgst_final(u32 crc)
+{
+	return cpu_to_le32(~crc);
+}
+
+static void nvmet_tcp_ddgst_update_page(u32 *crc, struct page *page,
+		size_t offset, size_t len)
+{
+	void *vaddr = kmap(page);
+
+	nvmet_tcp_ddgst_update(crc, vaddr + offset, len);
+	kunmap(page);
+}
+
+static int nvmet_tcp_ddgst_update_kvec(struct kvec *vec, void *crc)
+{
+	nvmet_tcp_ddgst_update(crc, vec->iov_base, vec->iov_len);
+	return 0;
+}
+
+static void nvmet_tcp_init_cmd(struct nvmet_tcp_queue *queue,
+		struct nvmet_tcp_cmd *cmd)
+{
+	cmd->queue = queue;
+	cmd->req.port = queue->nport;
+	cmd->req.cmd = &cmd->nvme_cmd;
+	cmd->req.rsp = &cmd->rsp_pdu.cqe;
+	cmd->recv_msg.msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+}
+
+static int nvmet_tcp_alloc_cmds(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmds;
+	int i, nr_cmds;
+
+	/*
+	 * Twice the queue depth, so that new commands can be received while
+	 * completed ones still wait for their response to go out.
+	 */
+	nr_cmds = queue->nvme_sq.size * 2;
+	cmds = kvcalloc(nr_cmds, sizeof(*cmds), GFP_KERNEL);
+	if (!cmds)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_cmds; i++) {
+		nvmet_tcp_init_cmd(queue, &cmds[i]);
+		list_add_tail(&cmds[i].entry, &queue->free_list);
+	}
+
+	queue->cmds = cmds;
+	queue->nr_cmds = nr_cmds;
+	return 0;
+}
+
+static struct nvmet_tcp_cmd *nvmet_tcp_get_cmd(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd;
+
+	/* size the queue once the connect command installed it */
+	if (unlikely(!queue->cmds && queue->nvme_sq.ctrl) &&
+	    nvmet_tcp_alloc_cmds(queue))
+		return NULL;
+
+	cmd = list_first_entry_or_null(&queue->free_list,
+			struct nvmet_tcp_cmd, entry);
+	if (unlikely(!cmd))
+		return NULL;
+	list_del_init(&cmd->entry);
+
+	cmd->rbytes_done = 0;
+	cmd->wbytes_done = 0;
+	cmd->pdu_len = 0;
+	cmd->pdu_recv = 0;
+	cmd->iov = NULL;
+	return cmd;
+}
+
+static void nvmet_tcp_free_cmd_buffers(struct nvmet_tcp_cmd *cmd)
+{
+	kfree(cmd->iov);
+	cmd->iov = NULL;
+	if (cmd->req.sg) {
+		sgl_free(cmd->req.sg);
+		cmd->req.sg = NULL;
+	}
+}
+
+static void nvmet_tcp_put_cmd(struct nvmet_tcp_cmd *cmd)
+{
+	nvmet_tcp_free_cmd_buffers(cmd);
+	list_add_tail(&cmd->entry, &cmd->queue->free_list);
+}
+
+static void nvmet_tcp_fatal_error(struct nvmet_tcp_queue *queue)
+{
+	queue->rcv_state = NVMET_TCP_RECV_ERR;
+	if (queue->nvme_sq.ctrl)
+		nvmet_ctrl_fatal_error(queue->nvme_sq.ctrl);
+	else
+		kernel_sock_shutdown(queue->sock, SHUT_RDWR);
+}
+
+static void nvmet_tcp_build_iovec(struct nvmet_tcp_cmd *cmd)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(cmd->req.sg, sg, cmd->req.sg_cnt, i) {
+		cmd->iov[i].bv_page = sg_page(sg);
+		cmd->iov[i].bv_len = sg->length;
+		cmd->iov[i].bv_offset = sg->offset;
+	}
+
+	iov_iter_bvec(&cmd->recv_msg.msg_iter, ITER_BVEC | READ, cmd->iov,
+			cmd->req.sg_cnt, cmd->req.transfer_len);
+}
+
+static u16 nvmet_tcp_map_data(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvme_sgl_desc *sgl = &cmd->req.cmd->common.dptr.sgl;
+	u32 len = le32_to_cpu(sgl->length);
+
+	if (!len)
+		return cmd->pdu_len ? NVME_SC_INVALID_FIELD | NVME_SC_DNR : 0;
+
+	switch (sgl->type) {
+	case (NVME_SGL_FMT_DATA_DESC << 4) | NVME_SGL_FMT_OFFSET:
+		if (!nvme_is_write(cmd->req.cmd))
+			return NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+		if (le64_to_cpu(sgl->addr) || len != cmd->pdu_len ||
+		    len > NVMET_TCP_INLINE_DATA_SIZE) {
+			pr_err("invalid inline data offset!\n");
+			return NVME_SC_SGL_INVALID_OFFSET | NVME_SC_DNR;
+		}
+		break;
+	case (NVME_TRANSPORT_SGL_DATA_DESC << 4) | NVME_SGL_FMT_TRANSPORT_A:
+		if (cmd->pdu_len)
+			return NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+		break;
+	default:
+		pr_err("invalid SGL type: %#x\n", sgl->type);
+		return NVME_SC_SGL_INVALID_TYPE | NVME_SC_DNR;
+	}
+
+	cmd->req.sg = sgl_alloc(len, GFP_KERNEL, &cmd->req.sg_cnt);
+	if (!cmd->req.sg)
+		return NVME_SC_INTERNAL;
+	cmd->req.transfer_len = len;
+
+	if (nvme_is_write(cmd->req.cmd)) {
+		cmd->iov = kmalloc_array(cmd->req.sg_cnt, sizeof(*cmd->iov),
+				GFP_KERNEL);
+		if (!cmd->iov) {
+			sgl_free(cmd->req.sg);
+			cmd->req.sg = NULL;
+			cmd->req.transfer_len = 0;
+			return NVME_SC_INTERNAL;
+		}
+		nvmet_tcp_build_iovec(cmd);
+	}
+
+	return 0;
+}
+
+static void nvmet_setup_c2h_data_pdu(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvme_tcp_data_pdu *pdu = &cmd->data_pdu;
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	u8 ddgst = queue->data_digest ? NVME_TCP_DIGEST_LENGTH : 0;
+
+	cmd->offset = 0;
+	cmd->state = NVMET_TCP_SEND_DATA_PDU;
+
+	pdu->hdr.type = nvme_tcp_c2h_data;
+	pdu->hdr.flags = NVME_TCP_F_DATA_LAST;
+	if (queue->data_digest)
+		pdu->hdr.flags |= NVME_TCP_F_DDGST;
+	pdu->hdr.hlen = sizeof(*pdu);
+	pdu->hdr.pdo = pdu->hdr.hlen;
+	pdu->hdr.plen =
+		cpu_to_le32(pdu->hdr.hlen + cmd->req.transfer_len + ddgst);
+
+	pdu->command_id = cmd->req.cmd->common.command_id;
+	pdu->ttag = 0;
+	pdu->data_offset = cpu_to_le32(cmd->wbytes_done);
+	pdu->data_length = cpu_to_le32(cmd->req.transfer_len);
+
+	if (queue->data_digest)
+		nvmet_tcp_ddgst_init(&queue->snd_crc);
+}
+
+static void nvmet_setup_r2t_pdu(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvme_tcp_r2t_pdu *pdu = &cmd->r2t_pdu;
+
+	cmd->offset = 0;
+	cmd->state = NVMET_TCP_SEND_R2T;
+
+	pdu->hdr.type = nvme_tcp_r2t;
+	pdu->hdr.flags = 0;
+	pdu->hdr.hlen = sizeof(*pdu);
+	pdu->hdr.pdo = 0;
+	pdu->hdr.plen = cpu_to_le32(pdu->hdr.hlen);
+
+	pdu->command_id = cmd->req.cmd->common.command_id;
+	pdu->ttag = nvmet_tcp_cmd_tag(cmd->queue, cmd);
+	pdu->r2t_offset = cpu_to_le32(cmd->rbytes_done);
+	pdu->r2t_length = cpu_to_le32(cmd->req.transfer_len - cmd->rbytes_done);
+}
+
+static void nvmet_setup_response_pdu(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvme_tcp_rsp_pdu *pdu = &cmd->rsp_pdu;
+
+	cmd->offset = 0;
+	cmd->state = NVMET_TCP_SEND_RESPONSE;
+
+	pdu->hdr.type = nvme_tcp_rsp;
+	pdu->hdr.flags = 0;
+	pdu->hdr.hlen = sizeof(*pdu);
+	pdu->hdr.pdo = 0;
+	pdu->hdr.plen = cpu_to_le32(pdu->hdr.hlen);
+}
+
+static void nvmet_tcp_process_resp_list(struct nvmet_tcp_queue *queue)
+{
+	struct llist_node *node;
+	struct nvmet_tcp_cmd *cmd, *tmp;
+
+	node = llist_del_all(&queue->resp_list);
+	if (!node)
+		return;
+
+	/* llist_add() pushes to the head, restore completion order */
+	node = llist_reverse_order(node);
+	llist_for_each_entry_safe(cmd, tmp, node, lentry)
+		list_add_tail(&cmd->entry, &queue->resp_send_list);
+}
+
+static struct nvmet_tcp_cmd *nvmet_tcp_fetch_cmd(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd;
+
+	if (list_empty(&queue->resp_send_list))
+		nvmet_tcp_process_resp_list(queue);
+
+	cmd = list_first_entry_or_null(&queue->resp_send_list,
+			struct nvmet_tcp_cmd, entry);
+	if (!cmd)
+		return NULL;
+	list_del_init(&cmd->entry);
+
+	if (nvmet_tcp_need_data_out(cmd))
+		nvmet_setup_c2h_data_pdu(cmd);
+	else if (nvmet_tcp_need_data_in(cmd))
+		nvmet_setup_r2t_pdu(cmd);
+	else
+		nvmet_setup_response_pdu(cmd);
+
+	queue->snd_cmd = cmd;
+	return cmd;
+}
+
+static void nvmet_tcp_queue_response(struct nvmet_req *req)
+{
+	struct nvmet_tcp_cmd *cmd =
+		container_of(req, struct nvmet_tcp_cmd, req);
+	struct nvmet_tcp_queue *queue = cmd->queue;
+
+	llist_add(&cmd->lentry, &queue->resp_list);
+	queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+}
+
+/*
+ * Send what is left of a PDU header or digest.  Returns 1 once the whole
+ * buffer went out and -EAGAIN if the socket took only part of it.
+ */
+static int nvmet_tcp_send_buf(struct nvmet_tcp_cmd *cmd, void *buf,
+		size_t size, int flags)
+{
+	struct msghdr msg = { .msg_flags = flags };
+	struct kvec iov = {
+		.iov_base = buf + cmd->offset,
+		.iov_len = size - cmd->offset,
+	};
+	int ret;
+
+	ret = kernel_sendmsg(cmd->queue->sock, &msg, &iov, 1, iov.iov_len);
+	if (unlikely(ret <= 0))
+		return ret;
+
+	cmd->offset += ret;
+	if (cmd->offset < size)
+		return -EAGAIN;
+
+	cmd->offset = 0;
+	return 1;
+}
+
+static int nvmet_try_send_data_pdu(struct nvmet_tcp_cmd *cmd)
+{
+	int ret;
+
+	ret = nvmet_tcp_send_buf(cmd, &cmd->data_pdu, sizeof(cmd->data_pdu),
+			MSG_DONTWAIT | MSG_MORE);
+	if (ret <= 0)
+		return ret;
+
+	cmd->cur_sg = cmd->req.sg;
+	cmd->state = NVMET_TCP_SEND_DATA;
+	return 1;
+}
+
+static int nvmet_try_send_data(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	int ret;
+
+	while (cmd->cur_sg) {
+		struct page *page = sg_page(cmd->cur_sg);
+		u32 offset = cmd->cur_sg->offset + cmd->offset;
+		u32 left = cmd->cur_sg->length - cmd->offset;
+		int flags = MSG_DONTWAIT | MSG_MORE;
+
+		/* the data digest or the response always follows */
+		if (!sg_is_last(cmd->cur_sg))
+			flags |= MSG_SENDPAGE_NOTLAST;
+
+		ret = kernel_sendpage(queue->sock, page, offset, left, flags);
+		if (ret <= 0)
+			return ret;
+
+		if (queue->data_digest)
+			nvmet_tcp_ddgst_update_page(&queue->snd_crc, page,
+					offset, ret);
+
+		cmd->offset += ret;
+		cmd->wbytes_done += ret;
+		if (cmd->offset == cmd->cur_sg->length) {
+			cmd->cur_sg = sg_next(cmd->cur_sg);
+			cmd->offset = 0;
+		}
+	}
+
+	if (queue->data_digest) {
+		cmd->snd_ddgst = nvmet_tcp_ddgst_final(queue->snd_crc);
+		cmd->state = NVMET_TCP_SEND_DDGST;
+	} else {
+		nvmet_setup_response_pdu(cmd);
+	}
+	return 1;
+}
+
+static int nvmet_try_send_ddgst(struct nvmet_tcp_cmd *cmd)
+{
+	int ret;
+
+	ret = nvmet_tcp_send_buf(cmd, &cmd->snd_ddgst, sizeof(cmd->snd_ddgst),
+			MSG_DONTWAIT | MSG_MORE);
+	if (ret <= 0)
+		return ret;
+
+	nvmet_setup_response_pdu(cmd);
+	return 1;
+}
+
+static int nvmet_try_send_r2t(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	int flags = MSG_DONTWAIT;
+	int ret;
+
+	if (nvmet_tcp_queue_more(queue))
+		flags |= MSG_MORE;
+
+	ret = nvmet_tcp_send_buf(cmd, &cmd->r2t_pdu, sizeof(cmd->r2t_pdu),
+			flags);
+	if (ret <= 0)
+		return ret;
+
+	/* the command stays around until its data arrived */
+	queue->snd_cmd = NULL;
+	return 1;
+}
+
+static int nvmet_try_send_response(struct nvmet_tcp_cmd *cmd)
+{
+	struct nvmet_tcp_queue *queue = cmd->queue;
+	int flags = MSG_DONTWAIT;
+	int ret;
+
+	if (nvmet_tcp_queue_more(queue))
+		flags |= MSG_MORE;
+
+	ret = nvmet_tcp_send_buf(cmd, &cmd->rsp_pdu, sizeof(cmd->rsp_pdu),
+			flags);
+	if (ret <= 0)
+		return ret;
+
+	queue->snd_cmd = NULL;
+	nvmet_tcp_put_cmd(cmd);
+	return 1;
+}
+
+static int nvmet_tcp_try_send_one(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd = queue->snd_cmd;
+	int ret = 0;
+
+	if (!cmd) {
+		cmd = nvmet_tcp_fetch_cmd(queue);
+		if (!cmd)
+			return 0;
+	}
+
+	if (cmd->state == NVMET_TCP_SEND_DATA_PDU) {
+		ret = nvmet_try_send_data_pdu(cmd);
+		if (ret <= 0)
+			goto done_send;
+	}
+
+	if (cmd->state == NVMET_TCP_SEND_DATA) {
+		ret = nvmet_try_send_data(cmd);
+		if (ret <= 0)
+			goto done_send;
+	}
+
+	if (cmd->state == NVMET_TCP_SEND_DDGST) {
+		ret = nvmet_try_send_ddgst(cmd);
+		if (ret <= 0)
+			goto done_send;
+	}
+
+	if (cmd->state == NVMET_TCP_SEND_R2T)
+		ret = nvmet_try_send_r2t(cmd);
+	else if (cmd->state == NVMET_TCP_SEND_RESPONSE)
+		ret = nvmet_try_send_response(cmd);
+
+done_send:
+	if (ret == -EAGAIN)
+		return 0;
+	return ret;
+}
+
+static int nvmet_tcp_try_send(struct nvmet_tcp_queue *queue,
+		int budget, int *sends)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < budget; i++) {
+		ret = nvmet_tcp_try_send_one(queue);
+		if (ret <= 0)
+			break;
+		(*sends)++;
+	}
+
+	return ret;
+}
+
+static void nvmet_prepare_receive_pdu(struct nvmet_tcp_queue *queue)
+{
+	queue->offset = 0;
+	queue->left = sizeof(struct nvme_tcp_hdr);
+	queue->cmd = NULL;
+	queue->rcv_state = NVMET_TCP_RECV_PDU;
+}
+
+static int nvmet_tcp_handle_icreq(struct nvmet_tcp_queue *queue)
+{
+	struct nvme_tcp_icreq_pdu *icreq = &queue->pdu.icreq;
+	struct nvme_tcp_icresp_pdu *icresp = &queue->pdu.icresp;
+	struct msghdr msg = {};
+	struct kvec iov;
+	int ret;
+
+	if (le16_to_cpu(icreq->pfv) != NVME_TCP_PFV_1_0) {
+		pr_err("queue %d: bad pfv %d\n",
+			queue->idx, le16_to_cpu(icreq->pfv));
+		return -EPROTO;
+	}
+
+	if (icreq->hpda != 0) {
+		pr_err("queue %d: unsupported hpda %d\n",
+			queue->idx, icreq->hpda);
+		return -EPROTO;
+	}
+
+	/* header digests are not supported, leaving them off is allowed */
+	queue->data_digest = !!(icreq->digest & NVME_TCP_DATA_DIGEST_ENABLE);
+
+	/* icresp reuses the receive buffer, icreq is consumed by now */
+	memset(icresp, 0, sizeof(*icresp));
+	icresp->hdr.type = nvme_tcp_icresp;
+	icresp->hdr.hlen = sizeof(*icresp);
+	icresp->hdr.pdo = 0;
+	icresp->hdr.plen = cpu_to_le32(icresp->hdr.hlen);
+	icresp->pfv = cpu_to_le16(NVME_TCP_PFV_1_0);
+	icresp->maxdata = cpu_to_le32(NVMET_TCP_MAXH2CDATA);
+	icresp->cpda = 0;
+	if (queue->data_digest)
+		icresp->digest |= NVME_TCP_DATA_DIGEST_ENABLE;
+
+	iov.iov_base = icresp;
+	iov.iov_len = sizeof(*icresp);
+	ret = kernel_sendmsg(queue->sock, &msg, &iov, 1, iov.iov_len);
+	if (ret < 0)
+		return ret;
+	if (ret != iov.iov_len)
+		return -EIO;
+
+	spin_lock_bh(&queue->state_lock);
+	if (queue->state == NVMET_TCP_Q_CONNECTING)
+		queue->state = NVMET_TCP_Q_LIVE;
+	spin_unlock_bh(&queue->state_lock);
+
+	nvmet_prepare_receive_pdu(queue);
+	return 0;
+}
+
+static void nvmet_tcp_prep_recv_data(struct nvmet_tcp_queue *queue,
+		struct nvmet_tcp_cmd *cmd)
+{
+	if (queue->data_digest)
+		nvmet_tcp_ddgst_init(&queue->rcv_crc);
+	queue->cmd = cmd;
+	queue->rcv_state = NVMET_TCP_RECV_DATA;
+}
+
+/* Swallow the in-capsule data of a command that was failed upfront. */
+static void nvmet_tcp_prep_discard(struct nvmet_tcp_queue *queue)
+{
+	u32 left = le32_to_cpu(queue->pdu.hdr.plen) - queue->pdu.hdr.hlen;
+
+	if (!left) {
+		nvmet_prepare_receive_pdu(queue);
+		return;
+	}
+
+	queue->left = left;
+	queue->rcv_state = NVMET_TCP_RECV_DISCARD;
+}
+
+static int nvmet_tcp_handle_cmd(struct nvmet_tcp_queue *queue)
+{
+	struct nvme_tcp_hdr *hdr = &queue->pdu.hdr;
+	u32 inline_len = le32_to_cpu(hdr->plen) - hdr->hlen;
+	struct nvmet_tcp_cmd *cmd;
+	u16 status;
+
+	if (inline_len) {
+		bool ddgst = hdr->flags & NVME_TCP_F_DDGST;
+
+		if (ddgst != queue->data_digest ||
+		    (ddgst && inline_len <= NVME_TCP_DIGEST_LENGTH)) {
+			pr_err("queue %d: bad command pdu digest flags\n",
+				queue->idx);
+			return -EPROTO;
+		}
+		if (ddgst)
+			inline_len -= NVME_TCP_DIGEST_LENGTH;
+	}
+
+	cmd = nvmet_tcp_get_cmd(queue);
+	if (unlikely(!cmd)) {
+		pr_err("queue %d: out of commands\n", queue->idx);
+		return -ENOMEM;
+	}
+
+	memcpy(&cmd->nvme_cmd, &queue->pdu.cmd.cmd, sizeof(cmd->nvme_cmd));
+	cmd->pdu_len = inline_len;
+
+	if (unlikely(!nvmet_req_init(&cmd->req, &queue->nvme_cq,
+			&queue->nvme_sq, &nvmet_tcp_ops))) {
+		/* the error response was queued already */
+		nvmet_tcp_prep_discard(queue);
+		return 0;
+	}
+
+	status = nvmet_tcp_map_data(cmd);
+	if (unlikely(status)) {
+		nvmet_req_complete(&cmd->req, status);
+		nvmet_tcp_prep_discard(queue);
+		return 0;
+	}
+
+	if (cmd->pdu_len) {
+		nvmet_tcp_prep_recv_data(queue, cmd);
+		return 0;
+	}
+
+	if (nvmet_tcp_need_data_in(cmd)) {
+		/* ask the host for the data */
+		nvmet_tcp_queue_response(&cmd->req);
+	} else {
+		nvmet_req_execute(&cmd->req);
+	}
+
+	nvmet_prepare_receive_pdu(queue);
+	return 0;
+}
+
+static int nvmet_tcp_handle_h2c_data(struct nvmet_tcp_queue *queue)
+{
+	struct nvme_tcp_data_pdu *data = &queue->pdu.data;
+	u32 data_offset = le32_to_cpu(data->data_offset);
+	u32 data_len = le32_to_cpu(data->data_length);
+	u32 ddgst = queue->data_digest ? NVME_TCP_DIGEST_LENGTH : 0;
+	struct nvmet_tcp_cmd *cmd;
+
+	if (data->ttag > queue->nr_cmds)
+		goto err_proto;
+	if (data->ttag == queue->nr_cmds)
+		cmd = &queue->connect;
+	else
+		cmd = &queue->cmds[data->ttag];
+
+	if (cmd->req.cmd->common.command_id != data->command_id ||
+	    !nvmet_tcp_need_data_in(cmd) ||
+	    !!(data->hdr.flags & NVME_TCP_F_DDGST) != queue->data_digest ||
+	    data_offset != cmd->rbytes_done ||
+	    !data_len || data_len > NVMET_TCP_MAXH2CDATA ||
+	    data_len > cmd->req.transfer_len - data_offset ||
+	    le32_to_cpu(data->hdr.plen) != data->hdr.hlen + data_len + ddgst)
+		goto err_proto;
+
+	cmd->pdu_len = data_len;
+	cmd->pdu_recv = 0;
+	nvmet_tcp_prep_recv_data(queue, cmd);
+	return 0;
+
+err_proto:
+	pr_err("queue %d: unexpected h2c data pdu (ttag %u offset %u len %u)\n",
+		queue->idx, data->ttag, data_offset, data_len);
+	return -EPROTO;
+}
+
+static u8 nvmet_tcp_pdu_hlen(u8 type)
+{
+	switch (type) {
+	case nvme_tcp_icreq:
+		return sizeof(struct nvme_tcp_icreq_pdu);
+	case nvme_tcp_cmd:
+		return sizeof(struct nvme_tcp_cmd_pdu);
+	case nvme_tcp_h2c_data:
+		return sizeof(struct nvme_tcp_data_pdu);
+	default:
+		return 0;
+	}
+}
+
+static int nvmet_tcp_check_hdr(struct nvmet_tcp_queue *queue)
+{
+	struct nvme_tcp_hdr *hdr = &queue->pdu.hdr;
+	bool connecting = queue->state == NVMET_TCP_Q_CONNECTING;
+
+	if (connecting != (hdr->type == nvme_tcp_icreq)) {
+		pr_err("queue %d: unexpected pdu type %d\n",
+			queue->idx, hdr->type);
+		return -EPROTO;
+	}
+
+	if (hdr->hlen != nvmet_tcp_pdu_hlen(hdr->type) ||
+	    le32_to_cpu(hdr->plen) < hdr->hlen ||
+	    (hdr->type == nvme_tcp_icreq &&
+	     le32_to_cpu(hdr->plen) != hdr->hlen)) {
+		pr_err("queue %d: bad pdu type %d hlen %d plen %d\n",
+			queue->idx, hdr->type, hdr->hlen,
+			le32_to_cpu(hdr->plen));
+		return -EPROTO;
+	}
+
+	if (hdr->flags & NVME_TCP_F_HDGST) {
+		pr_err("queue %d: header digest not negotiated\n", queue->idx);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+
+static int nvmet_tcp_try_recv_pdu(struct nvmet_tcp_queue *queue)
+{
+	struct nvme_tcp_hdr *hdr = &queue->pdu.hdr;
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT };
+	struct kvec iov;
+	int ret;
+
+recv:
+	iov.iov_base = (void *)&queue->pdu + queue->offset;
+	iov.iov_len = queue->left;
+	ret = kernel_recvmsg(queue->sock, &msg, &iov, 1,
+			iov.iov_len, msg.msg_flags);
+	if (unlikely(ret <= 0))
+		return ret ? ret : -EAGAIN;
+
+	queue->offset += ret;
+	queue->left -= ret;
+	if (queue->left)
+		return -EAGAIN;
+
+	if (queue->offset == sizeof(struct nvme_tcp_hdr)) {
+		ret = nvmet_tcp_check_hdr(queue);
+		if (ret)
+			return ret;
+
+		queue->left = hdr->hlen - queue->offset;
+		goto recv;
+	}
+
+	switch (hdr->type) {
+	case nvme_tcp_icreq:
+		return nvmet_tcp_handle_icreq(queue);
+	case nvme_tcp_cmd:
+		return nvmet_tcp_handle_cmd(queue);
+	default:
+		return nvmet_tcp_handle_h2c_data(queue);
+	}
+}
+
+static void nvmet_tcp_done_recv_data(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd = queue->cmd;
+
+	nvmet_prepare_receive_pdu(queue);
+	if (cmd->rbytes_done == cmd->req.transfer_len)
+		nvmet_req_execute(&cmd->req);
+}
+
+static int nvmet_tcp_try_recv_data(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd = queue->cmd;
+	struct iov_iter *iter = &cmd->recv_msg.msg_iter;
+	int ret;
+
+	while (cmd->pdu_recv < cmd->pdu_len) {
+		size_t count = iov_iter_count(iter);
+		struct iov_iter data = *iter;
+
+		/* don't read past this pdu into its digest or the next one */
+		iov_iter_truncate(iter, cmd->pdu_len - cmd->pdu_recv);
+		ret = sock_recvmsg(queue->sock, &cmd->recv_msg,
+				cmd->recv_msg.msg_flags);
+		iov_iter_reexpand(iter, count - max(ret, 0));
+		if (unlikely(ret <= 0))
+			return ret ? ret : -EAGAIN;
+
+		if (queue->data_digest)
+			iov_iter_for_each_range(&data, ret,
+					nvmet_tcp_ddgst_update_kvec,
+					&queue->rcv_crc);
+
+		cmd->pdu_recv += ret;
+		cmd->rbytes_done += ret;
+	}
+
+	if (queue->data_digest) {
+		cmd->exp_ddgst = nvmet_tcp_ddgst_final(queue->rcv_crc);
+		queue->offset = 0;
+		queue->left = NVME_TCP_DIGEST_LENGTH;
+		queue->rcv_state = NVMET_TCP_RECV_DDGST;
+		return 0;
+	}
+
+	nvmet_tcp_done_recv_data(queue);
+	return 0;
+}
+
+static int nvmet_tcp_try_recv_ddgst(struct nvmet_tcp_queue *queue)
+{
+	struct nvmet_tcp_cmd *cmd = queue->cmd;
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT };
+	struct kvec iov = {
+		.iov_base = (void *)&cmd->recv_ddgst + queue->offset,
+		.iov_len = queue->left,
+	};
+	int ret;
+
+	ret = kernel_recvmsg(queue->sock, &msg, &iov, 1,
+			iov.iov_len, msg.msg_flags);
+	if (unlikely(ret <= 0))
+		return ret ? ret : -EAGAIN;
+
+	queue->offset += ret;
+	queue->left -= ret;
+	if (queue->left)
+		return -EAGAIN;
+
+	if (cmd->recv_ddgst != cmd->exp_ddgst) {
+		pr_err("queue %d: cmd %d data digest error: recv %#x expected %#x\n",
+			queue->idx, cmd->req.cmd->common.command_id,
+			le32_to_cpu(cmd->recv_ddgst),
+			le32_to_cpu(cmd->exp_ddgst));
+		return -EPROTO;
+	}
+
+	nvmet_tcp_done_recv_data(queue);
+	return 0;
+}
+
+static int nvmet_tcp_try_recv_discard(struct nvmet_tcp_queue *queue)
+{
+	struct msghdr msg = { .msg_flags = MSG_DONTWAIT | MSG_TRUNC };
+	int ret;
+
+	while (queue->left) {
+		/* tcp drops the bytes instead of copying them out */
+		ret = kernel_recvmsg(queue->sock, &msg, NULL, 0,
+				queue->left, msg.msg_flags);
+		if (unlikely(ret <= 0))
+			return ret ? ret : -EAGAIN;
+		queue->left -= ret;
+	}
+
+	nvmet_prepare_receive_pdu(queue);
+	return 0;
+}
+
+static int nvmet_tcp_try_recv_one(struct nvmet_tcp_queue *queue)
+{
+	int ret = 0;
+
+	if (unlikely(queue->rcv_state == NVMET_TCP_RECV_ERR ||
+		     queue->state == NVMET_TCP_Q_DISCONNECTING))
+		return 0;
+
+	if (queue->rcv_state == NVMET_TCP_RECV_PDU) {
+		ret = nvmet_tcp_try_recv_pdu(queue);
+		if (ret)
+			goto done_recv;
+	}
+
+	if (queue->rcv_state == NVMET_TCP_RECV_DATA) {
+		ret = nvmet_tcp_try_recv_data(queue);
+		if (ret)
+			goto done_recv;
+	}
+
+	if (queue->rcv_state == NVMET_TCP_RECV_DDGST) {
+		ret = nvmet_tcp_try_recv_ddgst(queue);
+		if (ret)
+			goto done_recv;
+	}
+
+	if (queue->rcv_state == NVMET_TCP_RECV_DISCARD)
+		ret = nvmet_tcp_try_recv_discard(queue);
+
+done_recv:
+	if (ret == -EAGAIN)
+		return 0;
+	if (ret < 0)
+		return ret;
+	return 1;
+}
+
+static int nvmet_tcp_try_recv(struct nvmet_tcp_queue *queue,
+		int budget, int *recvs)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < budget; i++) {
+		ret = nvmet_tcp_try_recv_one(queue);
+		if (ret <= 0)
+			break;
+		(*recvs)++;
+	}
+
+	return ret;
+}
+
+static void nvmet_tcp_socket_error(struct nvmet_tcp_queue *queue, int status)
+{
+	queue->rcv_state = NVMET_TCP_RECV_ERR;
+	/* a dead connection is torn down from the state_change callback */
+	if (status == -EPIPE || status == -ECONNRESET)
+		kernel_sock_shutdown(queue->sock, SHUT_RDWR);
+	else
+		nvmet_tcp_fatal_error(queue);
+}
+
+static void nvmet_tcp_io_work(struct work_struct *w)
+{
+	struct nvmet_tcp_queue *queue =
+		container_of(w, struct nvmet_tcp_queue, io_work);
+	bool pending;
+	int ret, ops = 0;
+
+	do {
+		pending = false;
+
+		ret = nvmet_tcp_try_recv(queue, NVMET_TCP_RECV_BUDGET, &ops);
+		if (ret > 0) {
+			pending = true;
+		} else if (ret < 0) {
+			nvmet_tcp_socket_error(queue, ret);
+			return;
+		}
+
+		ret = nvmet_tcp_try_send(queue, NVMET_TCP_SEND_BUDGET, &ops);
+		if (ret > 0) {
+			pending = true;
+		} else if (ret < 0) {
+			nvmet_tcp_socket_error(queue, ret);
+			return;
+		}
+	} while (pending && ops < NVMET_TCP_IO_WORK_BUDGET);
+
+	/* out of budget with work left, give others a chance first */
+	if (pending)
+		queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+}
+
+static void nvmet_tcp_schedule_release_queue(struct nvmet_tcp_queue *queue)
+{
+	spin_lock_bh(&queue->state_lock);
+	if (queue->state != NVMET_TCP_Q_DISCONNECTING) {
+		queue->state = NVMET_TCP_Q_DISCONNECTING;
+		schedule_work(&queue->release_work);
+	}
+	spin_unlock_bh(&queue->state_lock);
+}
+
+static void nvmet_tcp_data_ready(struct sock *sk)
+{
+	struct nvmet_tcp_queue *queue;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	queue = sk->sk_user_data;
+	if (likely(queue))
+		queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+static void nvmet_tcp_write_space(struct sock *sk)
+{
+	struct nvmet_tcp_queue *queue;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	queue = sk->sk_user_data;
+	if (unlikely(!queue))
+		goto out;
+
+	if (sk_stream_is_writeable(sk)) {
+		clear_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
+		queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+	}
+out:
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+static void nvmet_tcp_state_change(struct sock *sk)
+{
+	struct nvmet_tcp_queue *queue;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	queue = sk->sk_user_data;
+	if (!queue)
+		goto out;
+
+	switch (sk->sk_state) {
+	case TCP_FIN_WAIT1:
+	case TCP_CLOSE_WAIT:
+	case TCP_CLOSE:
+		sk->sk_user_data = NULL;
+		nvmet_tcp_schedule_release_queue(queue);
+		break;
+	default:
+		pr_warn("queue %d unhandled state %d\n",
+			queue->idx, sk->sk_state);
+	}
+out:
+	write_unlock_bh(&sk->sk_callback_lock);
+}
+
+static void nvmet_tcp_restore_socket_callbacks(struct nvmet_tcp_queue *queue)
+{
+	struct sock *sk = queue->sock->sk;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	sk->sk_data_ready = queue->data_ready;
+	sk->sk_state_change = queue->state_change;
+	sk->sk_write_space = queue->write_space;
+	sk->sk_user_data = NULL;
+	write_unlock_bh(&sk->sk_callback_lock);
+}
+
+static int nvmet_tcp_set_queue_sock(struct nvmet_tcp_queue *queue)
+{
+	struct socket *sock = queue->sock;
+	int ret;
+
+	ret = kernel_getsockname(sock, (struct sockaddr *)&queue->sockaddr);
+	if (ret < 0)
+		return ret;
+
+	ret = kernel_getpeername(sock,
+			(struct sockaddr *)&queue->sockaddr_peer);
+	if (ret < 0)
+		return ret;
+
+	write_lock_bh(&sock->sk->sk_callback_lock);
+	/* the peer may be gone already, state_change would never fire */
+	if (sock->sk->sk_state != TCP_ESTABLISHED) {
+		ret = -ENOTCONN;
+	} else {
+		sock->sk->sk_user_data = queue;
+		queue->data_ready = sock->sk->sk_data_ready;
+		sock->sk->sk_data_ready = nvmet_tcp_data_ready;
+		queue->state_change = sock->sk->sk_state_change;
+		sock->sk->sk_state_change = nvmet_tcp_state_change;
+		queue->write_space = sock->sk->sk_write_space;
+		sock->sk->sk_write_space = nvmet_tcp_write_space;
+	}
+	write_unlock_bh(&sock->sk->sk_callback_lock);
+
+	return ret;
+}
+
+static void nvmet_tcp_uninit_data_in_cmds(struct nvmet_tcp_queue *queue)
+{
+	unsigned int i;
+
+	/* these hold a sq reference but will never see their data */
+	for (i = 0; i < queue->nr_cmds; i++) {
+		if (nvmet_tcp_need_data_in(&queue->cmds[i]))
+			nvmet_req_uninit(&queue->cmds[i].req);
+	}
+
+	if (nvmet_tcp_need_data_in(&queue->connect))
+		nvmet_req_uninit(&queue->connect.req);
+}
+
+static void nvmet_tcp_free_cmds(struct nvmet_tcp_queue *queue)
+{
+	unsigned int i;
+
+	for (i = 0; i < queue->nr_cmds; i++)
+		nvmet_tcp_free_cmd_buffers(&queue->cmds[i]);
+	nvmet_tcp_free_cmd_buffers(&queue->connect);
+	kvfree(queue->cmds);
+}
+
+static void nvmet_tcp_release_queue_work(struct work_struct *w)
+{
+	struct nvmet_tcp_queue *queue =
+		container_of(w, struct nvmet_tcp_queue, release_work);
+
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_del_init(&queue->queue_list);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+
+	nvmet_tcp_restore_socket_callbacks(queue);
+	flush_work(&queue->io_work);
+
+	nvmet_tcp_uninit_data_in_cmds(queue);
+	nvmet_sq_destroy(&queue->nvme_sq);
+	cancel_work_sync(&queue->io_work);
+	sock_release(queue->sock);
+	nvmet_tcp_free_cmds(queue);
+
+	ida_simple_remove(&nvmet_tcp_queue_ida, queue->idx);
+	kfree(queue);
+}
+
+static int nvmet_tcp_alloc_queue(struct nvmet_tcp_port *port,
+		struct socket *newsock)
+{
+	struct nvmet_tcp_queue *queue;
+	int ret;
+
+	queue = kzalloc(sizeof(*queue), GFP_KERNEL);
+	if (!queue)
+		return -ENOMEM;
+
+	INIT_WORK(&queue->release_work, nvmet_tcp_release_queue_work);
+	INIT_WORK(&queue->io_work, nvmet_tcp_io_work);
+	queue->sock = newsock;
+	queue->port = port;
+	queue->nport = port->nport;
+	spin_lock_init(&queue->state_lock);
+	queue->state = NVMET_TCP_Q_CONNECTING;
+	INIT_LIST_HEAD(&queue->free_list);
+	init_llist_head(&queue->resp_list);
+	INIT_LIST_HEAD(&queue->resp_send_list);
+
+	queue->idx = ida_simple_get(&nvmet_tcp_queue_ida, 0, 0, GFP_KERNEL);
+	if (queue->idx < 0) {
+		ret = queue->idx;
+		goto out_free_queue;
+	}
+
+	nvmet_tcp_init_cmd(queue, &queue->connect);
+	list_add_tail(&queue->connect.entry, &queue->free_list);
+
+	ret = nvmet_sq_init(&queue->nvme_sq);
+	if (ret)
+		goto out_ida_remove;
+
+	port->last_cpu = cpumask_next_wrap(port->last_cpu,
+			cpu_online_mask, -1, false);
+	queue->cpu = port->last_cpu;
+	nvmet_prepare_receive_pdu(queue);
+
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_add_tail(&queue->queue_list, &nvmet_tcp_queue_list);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+
+	ret = nvmet_tcp_set_queue_sock(queue);
+	if (ret)
+		goto out_destroy_sq;
+
+	/* the icreq may have arrived before our callbacks were set */
+	queue_work_on(queue->cpu, nvmet_tcp_wq, &queue->io_work);
+
+	return 0;
+
+out_destroy_sq:
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_del_init(&queue->queue_list);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+	nvmet_sq_destroy(&queue->nvme_sq);
+out_ida_remove:
+	ida_simple_remove(&nvmet_tcp_queue_ida, queue->idx);
+out_free_queue:
+	kfree(queue);
+	return ret;
+}
+
+static void nvmet_tcp_accept_work(struct work_struct *w)
+{
+	struct nvmet_tcp_port *port =
+		container_of(w, struct nvmet_tcp_port, accept_work);
+	struct socket *newsock;
+	int ret;
+
+	while (true) {
+		ret = kernel_accept(port->sock, &newsock, O_NONBLOCK);
+		if (ret < 0) {
+			if (ret != -EAGAIN)
+				pr_warn("failed to accept err=%d\n", ret);
+			return;
+		}
+
+		ret = nvmet_tcp_alloc_queue(port, newsock);
+		if (ret) {
+			pr_err("failed to allocate queue\n");
+			sock_release(newsock);
+		}
+	}
+}
+
+static void nvmet_tcp_listen_data_ready(struct sock *sk)
+{
+	struct nvmet_tcp_port *port;
+
+	read_lock_bh(&sk->sk_callback_lock);
+	port = sk->sk_user_data;
+	/* accepted sockets inherit this callback until we set up ours */
+	if (port && sk->sk_state == TCP_LISTEN)
+		schedule_work(&port->accept_work);
+	read_unlock_bh(&sk->sk_callback_lock);
+}
+
+static int nvmet_tcp_add_port(struct nvmet_port *nport)
+{
+	struct nvmet_tcp_port *port;
+	__kernel_sa_family_t af;
+	int opt, ret;
+
+	port = kzalloc(sizeof(*port), GFP_KERNEL);
+	if (!port)
+		return -ENOMEM;
+
+	switch (nport->disc_addr.adrfam) {
+	case NVMF_ADDR_FAMILY_IP4:
+		af = AF_INET;
+		break;
+	case NVMF_ADDR_FAMILY_IP6:
+		af = AF_INET6;
+		break;
+	default:
+		pr_err("address family %d not supported\n",
+				nport->disc_addr.adrfam);
+		ret = -EINVAL;
+		goto err_port;
+	}
+
+	ret = inet_pton_with_scope(&init_net, af, nport->disc_addr.traddr,
+			nport->disc_addr.trsvcid, &port->addr);
+	if (ret) {
+		pr_err("malformed ip/port passed: %s:%s\n",
+			nport->disc_addr.traddr, nport->disc_addr.trsvcid);
+		goto err_port;
+	}
+
+	port->nport = nport;
+	port->last_cpu = -1;
+	INIT_WORK(&port->accept_work, nvmet_tcp_accept_work);
+
+	ret = sock_create_kern(&init_net, port->addr.ss_family,
+			SOCK_STREAM, IPPROTO_TCP, &port->sock);
+	if (ret) {
+		pr_err("failed to create a socket\n");
+		goto err_port;
+	}
+
+	port->sock->sk->sk_user_data = port;
+	port->data_ready = port->sock->sk->sk_data_ready;
+	port->sock->sk->sk_data_ready = nvmet_tcp_listen_data_ready;
+
+	opt = 1;
+	ret = kernel_setsockopt(port->sock, SOL_SOCKET, SO_REUSEADDR,
+			(char *)&opt, sizeof(opt));
+	if (ret) {
+		pr_err("failed to set SO_REUSEADDR sock opt %d\n", ret);
+		goto err_sock;
+	}
+
+	/* inherited by the accepted sockets */
+	ret = kernel_setsockopt(port->sock, IPPROTO_TCP, TCP_NODELAY,
+			(char *)&opt, sizeof(opt));
+	if (ret) {
+		pr_err("failed to set TCP_NODELAY sock opt %d\n", ret);
+		goto err_sock;
+	}
+
+	ret = kernel_bind(port->sock, (struct sockaddr *)&port->addr,
+			sizeof(port->addr));
+	if (ret) {
+		pr_err("failed to bind port socket %d\n", ret);
+		goto err_sock;
+	}
+
+	ret = kernel_listen(port->sock, 128);
+	if (ret) {
+		pr_err("failed to listen %d on port sock\n", ret);
+		goto err_sock;
+	}
+
+	nport->priv = port;
+	pr_info("enabling port %d (%pISpc)\n",
+		le16_to_cpu(nport->disc_addr.portid), &port->addr);
+
+	return 0;
+
+err_sock:
+	sock_release(port->sock);
+err_port:
+	kfree(port);
+	return ret;
+}
+
+static void nvmet_tcp_remove_port(struct nvmet_port *nport)
+{
+	struct nvmet_tcp_port *port = xchg(&nport->priv, NULL);
+	struct sock *sk;
+
+	if (!port)
+		return;
+
+	sk = port->sock->sk;
+	write_lock_bh(&sk->sk_callback_lock);
+	sk->sk_data_ready = port->data_ready;
+	sk->sk_user_data = NULL;
+	write_unlock_bh(&sk->sk_callback_lock);
+	cancel_work_sync(&port->accept_work);
+
+	sock_release(port->sock);
+	kfree(port);
+}
+
+static void nvmet_tcp_delete_ctrl(struct nvmet_ctrl *ctrl)
+{
+	struct nvmet_tcp_queue *queue;
+
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_for_each_entry(queue, &nvmet_tcp_queue_list, queue_list)
+		if (queue->nvme_sq.ctrl == ctrl)
+			kernel_sock_shutdown(queue->sock, SHUT_RDWR);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+}
+
+static void nvmet_tcp_disc_port_addr(struct nvmet_req *req,
+		struct nvmet_port *nport, char *traddr)
+{
+	struct nvmet_tcp_port *port = nport->priv;
+
+	if (inet_addr_is_any((struct sockaddr *)&port->addr)) {
+		struct nvmet_tcp_cmd *cmd =
+			container_of(req, struct nvmet_tcp_cmd, req);
+		struct nvmet_tcp_queue *queue = cmd->queue;
+
+		sprintf(traddr, "%pISc", (struct sockaddr *)&queue->sockaddr);
+	} else {
+		memcpy(traddr, nport->disc_addr.traddr, NVMF_TRADDR_SIZE);
+	}
+}
+
+static const struct nvmet_fabrics_ops nvmet_tcp_ops = {
+	.owner			= THIS_MODULE,
+	.type			= NVMF_TRTYPE_TCP,
+	.sqe_inline_size	= NVMET_TCP_INLINE_DATA_SIZE,
+	.msdbd			= 1,
+	.has_keyed_sgls		= 0,
+	.add_port		= nvmet_tcp_add_port,
+	.remove_port		= nvmet_tcp_remove_port,
+	.queue_response		= nvmet_tcp_queue_response,
+	.delete_ctrl		= nvmet_tcp_delete_ctrl,
+	.disc_traddr		= nvmet_tcp_disc_port_addr,
+};
+
+static int __init nvmet_tcp_init(void)
+{
+	int ret;
+
+	nvmet_tcp_wq = alloc_workqueue("nvmet_tcp_wq", WQ_HIGHPRI, 0);
+	if (!nvmet_tcp_wq)
+		return -ENOMEM;
+
+	ret = nvmet_register_transport(&nvmet_tcp_ops);
+	if (ret)
+		goto err;
+
+	return 0;
+err:
+	destroy_workqueue(nvmet_tcp_wq);
+	return ret;
+}
+
+static void __exit nvmet_tcp_exit(void)
+{
+	struct nvmet_tcp_queue *queue;
+
+	nvmet_unregister_transport(&nvmet_tcp_ops);
+
+	flush_scheduled_work();
+	mutex_lock(&nvmet_tcp_queue_mutex);
+	list_for_each_entry(queue, &nvmet_tcp_queue_list, queue_list)
+		kernel_sock_shutdown(queue->sock, SHUT_RDWR);
+	mutex_unlock(&nvmet_tcp_queue_mutex);
+	flush_scheduled_work();
+
+	destroy_workqueue(nvmet_tcp_wq);
+}
+
+module_init(nvmet_tcp_init);
+module_exit(nvmet_tcp_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_ALIAS("nvmet-transport-3"); /* 3 == NVMF_TRTYPE_TCP */
@@ -307,6 +307,8 @@ struct ceph_connection {
 
 	/* message out temps */
 	struct ceph_msg_header out_hdr;
+	struct ceph_msg_footer out_footer[2];	/* or ceph_msg_footer_old */
+	int out_footer_idx;		/* next out_footer[] to use */
 	struct ceph_msg *out_msg;        /* sending message (== tail of
 					    out_sent) */
 	bool out_msg_done;
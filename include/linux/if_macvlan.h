@@ -9,6 +9,7 @@
 #include <linux/netlink.h>
 #include <net/netlink.h>
 #include <linux/u64_stats_sync.h>
+#include <net/xdp.h>
 
 struct macvlan_port;
 
@@ -31,6 +32,8 @@ struct macvlan_dev {
 	u16			flags;
 	int			nest_level;
 	unsigned int		macaddr_count;
+	struct bpf_prog __rcu	*xdp_prog;
+	struct xdp_rxq_info	xdp_rxq;
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	struct netpoll		*netpoll;
 #endif
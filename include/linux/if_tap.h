@@ -21,6 +21,7 @@ static inline struct ptr_ring *tap_get_ptr_ring(struct file *f)
 #endif /* CONFIG_TAP */
 
 #include <net/sock.h>
+#include <net/xdp.h>
 #include <linux/skb_array.h>
 
 /*
@@ -42,6 +43,7 @@ struct tap_dev {
 	int			numqueues;
 	netdev_features_t	tap_features;
 	int			minor;
+	struct bpf_prog __rcu	*xdp_prog;
 
 	void (*update_features)(struct tap_dev *tap, netdev_features_t features);
 	void (*count_tx_dropped)(struct tap_dev *tap);
@@ -71,6 +73,7 @@ struct tap_queue {
 	bool enabled;
 	struct list_head next;
 	struct ptr_ring ring;
+	struct xdp_rxq_info xdp_rxq;
 };
 
 rx_handler_result_t tap_handle_frame(struct sk_buff **pskb);
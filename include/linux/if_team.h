@@ -28,6 +28,7 @@ struct team_pcpu_stats {
 };
 
 struct team;
+struct xdp_frame;
 
 struct team_port {
 	struct net_device *dev;
@@ -107,6 +108,8 @@ struct team_mode_ops {
 				       struct team_port *port,
 				       struct sk_buff *skb);
 	bool (*transmit)(struct team *team, struct sk_buff *skb);
+	struct team_port *(*xdp_select_port)(struct team *team,
+					     struct xdp_frame *frame);
 	int (*port_enter)(struct team *team, struct team_port *port);
 	void (*port_leave)(struct team *team, struct team_port *port);
 	void (*port_change_dev_addr)(struct team *team, struct team_port *port);
@@ -193,6 +196,7 @@ struct team {
 
 	const struct team_mode *mode;
 	struct team_mode_ops ops;
+	struct bpf_prog __rcu *xdp_prog; /* installed on all ports */
 	bool user_carrier_enabled;
 	bool queue_override_enabled;
 	struct list_head *qom_lists; /* array of queue override mapping lists */
@@ -38,6 +38,7 @@ struct inet_diag_handler {
 
 	__u16		idiag_type;
 	__u16		idiag_info_size;
+	bool		idiag_bpf;	/* runs INET_DIAG_REQ_BPF_FD programs */
 };
 
 struct inet_connection_sock;
@@ -59,6 +60,8 @@ struct sock *inet_diag_find_one_icsk(struct net *net,
 				     const struct inet_diag_req_v2 *req);
 
 int inet_diag_bc_sk(const struct nlattr *_bc, struct sock *sk);
+bool inet_diag_bpf_sk(const struct netlink_callback *cb, struct sock *sk,
+		      const struct inet_diag_req_v2 *r, u8 *ext);
 
 void inet_diag_msg_common_fill(struct inet_diag_msg *r, struct sock *sk);
 
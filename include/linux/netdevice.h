@@ -306,6 +306,24 @@ int __init netdev_boot_setup(char *str);
  * Structure for NAPI scheduling similar to tasklet but with weighting
  */
 #define GRO_HASH_BUCKETS	8
+#define NAPI_STAT_BUCKETS	16
+
+/* Per-instance NAPI statistics, allocated on the first poll after
+ * net.core.napi_stats is enabled.  Only updated by the owner of
+ * NAPI_STATE_SCHED, so no locking is needed.  Histograms are log2
+ * bucketed: bucket 0 counts zero, bucket i counts [2^(i-1), 2^i) and
+ * the last bucket also absorbs everything larger.
+ */
+struct napi_stats {
+	struct rcu_head		rcu;
+	u64			polls;
+	u64			packets;
+	u64			budget_exhausted;
+	u64			squeezed;
+	u64			work_hist[NAPI_STAT_BUCKETS];
+	u64			sched_lat_hist[NAPI_STAT_BUCKETS]; /* usecs */
+};
+
 struct napi_struct {
 	/* The poll_list must only be managed by the entity which
 	 * changes the state of the NAPI_STATE_SCHED bit.  This means
@@ -322,6 +340,7 @@ struct napi_struct {
 #ifdef CONFIG_NETPOLL
 	int			poll_owner;
 #endif
+	int			defer_hard_irqs_count;
 	struct net_device	*dev;
 	struct list_head	gro_hash[GRO_HASH_BUCKETS];
 	struct sk_buff		*skb;
@@ -329,6 +348,8 @@ struct napi_struct {
 	struct list_head	dev_list;
 	struct hlist_node	napi_hash_node;
 	unsigned int		napi_id;
+	u64			sched_time;
+	struct napi_stats __rcu	*stats;
 };
 
 enum {
@@ -339,6 +360,7 @@ enum {
 	NAPI_STATE_HASHED,	/* In NAPI hash (busy polling possible) */
 	NAPI_STATE_NO_BUSY_POLL,/* Do not add in napi_hash, no busy polling */
 	NAPI_STATE_IN_BUSY_POLL,/* sk_busy_loop() owns this NAPI */
+	NAPI_STATE_PREFER_BUSY_POLL,/* busy poller waits, softirq yields */
 };
 
 enum {
@@ -349,6 +371,7 @@ enum {
 	NAPIF_STATE_HASHED	 = BIT(NAPI_STATE_HASHED),
 	NAPIF_STATE_NO_BUSY_POLL = BIT(NAPI_STATE_NO_BUSY_POLL),
 	NAPIF_STATE_IN_BUSY_POLL = BIT(NAPI_STATE_IN_BUSY_POLL),
+	NAPIF_STATE_PREFER_BUSY_POLL = BIT(NAPI_STATE_PREFER_BUSY_POLL),
 };
 
 enum gro_result {
@@ -419,6 +442,11 @@ static inline bool napi_disable_pending(struct napi_struct *n)
 	return test_bit(NAPI_STATE_DISABLE, &n->state);
 }
 
+static inline bool napi_prefer_busy_poll(struct napi_struct *n)
+{
+	return test_bit(NAPI_STATE_PREFER_BUSY_POLL, &n->state);
+}
+
 bool napi_schedule_prep(struct napi_struct *n);
 
 /**
@@ -478,7 +506,7 @@ static inline bool napi_complete(struct napi_struct *n)
  * before freeing memory containing @napi, if
  * this function returns true.
  * Note: core networking stack automatically calls it
- * from netif_napi_del().
+ * from __netif_napi_del().
  * Drivers might want to call this helper to combine all
  * the needed RCU grace periods into a single one.
  */
@@ -1883,6 +1911,7 @@ struct net_device {
 
 	struct bpf_prog __rcu	*xdp_prog;
 	unsigned long		gro_flush_timeout;
+	int			napi_defer_hard_irqs;
 	rx_handler_func_t __rcu	*rx_handler;
 	void __rcu		*rx_handler_data;
 
@@ -2180,6 +2209,17 @@ static inline void netif_tx_napi_add(struct net_device *dev,
 	netif_napi_add(dev, napi, poll, weight);
 }
 
+/**
+ *  __netif_napi_del - remove a NAPI context without waiting
+ *  @napi: NAPI context
+ *
+ *  Like netif_napi_del() but if this returns true, the caller must
+ *  observe an RCU grace period (synchronize_net()) before freeing
+ *  @napi, which allows the grace periods of several deletions to be
+ *  combined into one.
+ */
+bool __netif_napi_del(struct napi_struct *napi);
+
 /**
  *  netif_napi_del - remove a NAPI context
  *  @napi: NAPI context
@@ -3559,6 +3599,9 @@ void dev_queue_xmit_nit(struct sk_buff *skb, struct net_device *dev);
 
 extern int		netdev_budget;
 extern unsigned int	netdev_budget_usecs;
+extern int		sysctl_napi_stats;
+extern u64		napi_stats_enabled_at;
+DECLARE_STATIC_KEY_FALSE(napi_stats_needed_key);
 
 /* Called by rtnetlink.c:rtnl_unlock() */
 void netdev_run_todo(void);
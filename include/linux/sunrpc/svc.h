@@ -19,6 +19,7 @@
 #include <linux/sunrpc/svcauth.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/llist.h>
 
 /* statistics for svc_pool structures */
 struct svc_pool_stats {
@@ -37,13 +38,20 @@ struct svc_pool_stats {
  * services that can benefit from it (i.e. nfs but not lockd) will
  * have one pool per NUMA node.  This optimisation reduces cross-
  * node traffic on multi-node NUMA NFS servers.
+ *
+ * Idle threads push themselves onto sp_idle_threads without taking
+ * sp_lock; the enqueue side pops them under sp_lock. A thread whose
+ * pool has nothing queued may steal transports from congested pools,
+ * preferring pools on its own NUMA node.
  */
 struct svc_pool {
 	unsigned int		sp_id;	    	/* pool id; also node id on NUMA */
+	int			sp_node;	/* NUMA node of pool cpus */
 	spinlock_t		sp_lock;	/* protects all fields */
 	struct list_head	sp_sockets;	/* pending sockets */
 	unsigned int		sp_nrthreads;	/* # of threads in pool */
 	struct list_head	sp_all_threads;	/* all server threads */
+	struct llist_head	sp_idle_threads; /* idle server threads */
 	struct svc_pool_stats	sp_stats;	/* statistics on pool operation */
 #define	SP_TASK_PENDING		(0)		/* still work to do even if no
 						 * xprt is queued. */
@@ -101,6 +109,7 @@ struct svc_serv {
 
 	unsigned int		sv_nrpools;	/* number of thread pools */
 	struct svc_pool *	sv_pools;	/* array of thread pools */
+	atomic_t		sv_nrcongested;	/* # of SP_CONGESTED pools */
 	const struct svc_serv_ops *sv_ops;	/* server operations */
 #if defined(CONFIG_SUNRPC_BACKCHANNEL)
 	struct list_head	sv_cb_list;	/* queue for callback requests
@@ -124,6 +133,17 @@ static inline void svc_get(struct svc_serv *serv)
 	serv->sv_nrthreads++;
 }
 
+/*
+ * A pool stops being congested once it has a thread of its own again
+ * or nothing is left queued on it.
+ */
+static inline void svc_pool_clear_congested(struct svc_serv *serv,
+					    struct svc_pool *pool)
+{
+	if (test_and_clear_bit(SP_CONGESTED, &pool->sp_flags))
+		atomic_dec(&serv->sv_nrcongested);
+}
+
 /*
  * Maximum payload size supported by a kernel RPC server.
  * This is use to determine the max number of pages nfsd is
@@ -228,6 +248,7 @@ static inline void svc_putu32(struct kvec *iov, __be32 val)
  */
 struct svc_rqst {
 	struct list_head	rq_all;		/* all threads list */
+	struct llist_node	rq_idle;	/* idle threads list */
 	struct rcu_head		rq_rcu_head;	/* for RCU deferred kfree */
 	struct svc_xprt *	rq_xprt;	/* transport ptr */
 
@@ -271,6 +292,7 @@ struct svc_rqst {
 #define	RQ_VICTIM	(5)			/* about to be shut down */
 #define	RQ_BUSY		(6)			/* request is busy */
 #define	RQ_DATA		(7)			/* request has data */
+#define	RQ_IDLE		(8)			/* on sp_idle_threads */
 	unsigned long		rq_flags;	/* flags field */
 	ktime_t			rq_qtime;	/* enqueue time */
 
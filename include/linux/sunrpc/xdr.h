@@ -53,6 +53,7 @@ struct xdr_buf {
 			tail[1];	/* Appended after page data */
 
 	struct page **	pages;		/* Array of pages */
+	struct bio_vec *bvec;		/* Pages as bio_vecs */
 	unsigned int	page_base,	/* Start of page data */
 			page_len,	/* Length of page data */
 			flags;		/* Flags for data disposition */
@@ -63,6 +64,14 @@ struct xdr_buf {
 			len;		/* Length of XDR encoded message */
 };
 
+static inline unsigned int
+xdr_buf_pagecount(struct xdr_buf *buf)
+{
+	if (!buf->page_len)
+		return 0;
+	return (buf->page_base + buf->page_len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+}
+
 static inline void
 xdr_buf_init(struct xdr_buf *buf, void *start, size_t len)
 {
@@ -115,6 +124,8 @@ __be32 *xdr_decode_netobj(__be32 *p, struct xdr_netobj *);
 void	xdr_inline_pages(struct xdr_buf *, unsigned int,
 			 struct page **, unsigned int, unsigned int);
 void	xdr_terminate_string(struct xdr_buf *, const u32);
+int	xdr_alloc_bvec(struct xdr_buf *, gfp_t);
+void	xdr_free_bvec(struct xdr_buf *);
 
 static inline __be32 *xdr_encode_array(__be32 *p, const void *s, unsigned int len)
 {
@@ -22,6 +22,9 @@
 #include <net/netns/hash.h>
 #include <uapi/linux/udp.h>
 
+struct xdp_buff;
+struct iphdr;
+
 static inline struct udphdr *udp_hdr(const struct sk_buff *skb)
 {
 	return (struct udphdr *)skb_transport_header(skb);
@@ -71,6 +74,8 @@ struct udp_sock {
 	 * For encapsulation sockets.
 	 */
 	int (*encap_rcv)(struct sock *sk, struct sk_buff *skb);
+	u32 (*encap_xdp_rcv)(struct sock *sk, struct xdp_buff *xdp,
+			     const struct iphdr *iph);
 	void (*encap_destroy)(struct sock *sk);
 
 	/* GRO functions for UDP socket */
@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Multipath TCP
+ *
+ * Hooks used by the TCP stack on MPTCP subflows, and the interface
+ * for pluggable packet schedulers and path managers.
+ */
+
+#ifndef __NET_MPTCP_H
+#define __NET_MPTCP_H
+
+#include <linux/list.h>
+#include <linux/skbuff.h>
+#include <linux/tcp.h>
+#include <linux/types.h>
+#include <net/request_sock.h>
+
+#define MPTCPOPT_HMAC_LEN	20
+
+/* Per-packet MPTCP option state, filled in while the TCP options of
+ * an outgoing segment are computed and written out afterwards.
+ */
+struct mptcp_out_options {
+#ifdef CONFIG_MPTCP
+	u16	suboptions;
+	u8	join_id;
+	u8	backup : 1,
+		use_map : 1,
+		data_fin : 1;
+	u32	token;
+	u32	nonce;
+	u64	sndr_key;
+	u64	rcvr_key;
+	u64	thmac;
+	u64	data_ack;
+	u64	data_seq;
+	u32	subflow_seq;
+	u16	data_len;
+	u8	hmac[MPTCPOPT_HMAC_LEN];
+#endif
+};
+
+#ifdef CONFIG_MPTCP
+
+void mptcp_init(void);
+
+static inline bool sk_is_mptcp(const struct sock *sk)
+{
+	return tcp_sk(sk)->is_mptcp;
+}
+
+extern struct request_sock_ops mptcp_subflow_request_sock_ops;
+
+static inline bool rsk_is_mptcp(const struct request_sock *req)
+{
+	return req->rsk_ops == &mptcp_subflow_request_sock_ops;
+}
+
+bool mptcp_syn_options(struct sock *sk, const struct sk_buff *skb,
+		       unsigned int *size, struct mptcp_out_options *opts);
+bool mptcp_synack_options(const struct request_sock *req, unsigned int *size,
+			  struct mptcp_out_options *opts);
+bool mptcp_established_options(struct sock *sk, struct sk_buff *skb,
+			       unsigned int *size, unsigned int remaining,
+			       struct mptcp_out_options *opts);
+__be32 *mptcp_write_options(__be32 *ptr, const struct mptcp_out_options *opts);
+void mptcp_incoming_options(struct sock *sk, struct sk_buff *skb);
+
+#else
+
+static inline void mptcp_init(void)
+{
+}
+
+static inline bool sk_is_mptcp(const struct sock *sk)
+{
+	return false;
+}
+
+static inline bool rsk_is_mptcp(const struct request_sock *req)
+{
+	return false;
+}
+
+static inline bool mptcp_syn_options(struct sock *sk,
+				     const struct sk_buff *skb,
+				     unsigned int *size,
+				     struct mptcp_out_options *opts)
+{
+	return false;
+}
+
+static inline bool mptcp_synack_options(const struct request_sock *req,
+					unsigned int *size,
+					struct mptcp_out_options *opts)
+{
+	return false;
+}
+
+static inline bool mptcp_established_options(struct sock *sk,
+					     struct sk_buff *skb,
+					     unsigned int *size,
+					     unsigned int remaining,
+					     struct mptcp_out_options *opts)
+{
+	return false;
+}
+
+static inline __be32 *mptcp_write_options(__be32 *ptr,
+					  const struct mptcp_out_options *opts)
+{
+	return ptr;
+}
+
+static inline void mptcp_incoming_options(struct sock *sk,
+					  struct sk_buff *skb)
+{
+}
+
+#endif /* CONFIG_MPTCP */
+
+#define MPTCP_SUBFLOWS_MAX	8
+#define MPTCP_SCHED_NAME_MAX	16
+#define MPTCP_PM_NAME_MAX	16
+
+/* Subflows a scheduler may pick from: all of them are established and
+ * have room in their send buffer.
+ */
+struct mptcp_sched_data {
+	struct sock	*last;		/* subflow of the previous chunk */
+	unsigned int	nr;
+	struct sock	*subflows[MPTCP_SUBFLOWS_MAX];
+};
+
+struct mptcp_sched_ops {
+	struct list_head	list;
+
+	/* select the subflow for the next chunk of data (required) */
+	struct sock *(*get_subflow)(const struct mptcp_sched_data *data);
+
+	char			name[MPTCP_SCHED_NAME_MAX];
+	struct module		*owner;
+};
+
+struct mptcp_pm_ops {
+	struct list_head	list;
+
+	/* the connection we opened is established, called from process
+	 * context with the MPTCP socket locked (optional)
+	 */
+	void (*fully_established)(struct sock *sk);
+	/* a subflow of the connection is going away (optional) */
+	void (*subflow_closed)(struct sock *sk, struct sock *ssk);
+
+	char			name[MPTCP_PM_NAME_MAX];
+	struct module		*owner;
+};
+
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched);
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched);
+int mptcp_register_path_manager(struct mptcp_pm_ops *pm);
+void mptcp_unregister_path_manager(struct mptcp_pm_ops *pm);
+
+bool mptcp_subflow_is_backup(const struct sock *ssk);
+int mptcp_subflow_connect(struct sock *sk, __be32 saddr);
+bool mptcp_uses_saddr(const struct sock *sk, __be32 saddr);
+
+#endif /* __NET_MPTCP_H */
@@ -11,6 +11,7 @@ typedef int (*rtnl_dumpit_func)(struct sk_buff *, struct netlink_callback *);
 
 enum rtnl_link_flags {
 	RTNL_FLAG_DOIT_UNLOCKED = 1,
+	RTNL_FLAG_DUMP_UNLOCKED = 2,
 };
 
 void rtnl_register(int protocol, int msgtype,
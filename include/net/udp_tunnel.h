@@ -64,6 +64,9 @@ static inline int udp_sock_create(struct net *net,
 }
 
 typedef int (*udp_tunnel_encap_rcv_t)(struct sock *sk, struct sk_buff *skb);
+typedef u32 (*udp_tunnel_encap_xdp_rcv_t)(struct sock *sk,
+					  struct xdp_buff *xdp,
+					  const struct iphdr *iph);
 typedef void (*udp_tunnel_encap_destroy_t)(struct sock *sk);
 typedef struct sk_buff *(*udp_tunnel_gro_receive_t)(struct sock *sk,
 						    struct list_head *head,
@@ -76,6 +79,7 @@ struct udp_tunnel_sock_cfg {
 	/* Used for setting up udp_sock fields, see udp.h for details */
 	__u8  encap_type;
 	udp_tunnel_encap_rcv_t encap_rcv;
+	udp_tunnel_encap_xdp_rcv_t encap_xdp_rcv;
 	udp_tunnel_encap_destroy_t encap_destroy;
 	udp_tunnel_gro_receive_t gro_receive;
 	udp_tunnel_gro_complete_t gro_complete;
@@ -85,6 +89,16 @@ struct udp_tunnel_sock_cfg {
 void setup_udp_tunnel_sock(struct net *net, struct socket *sock,
 			   struct udp_tunnel_sock_cfg *sock_cfg);
 
+/* Called by drivers on frames their XDP program passed */
+#ifdef CONFIG_INET
+u32 udp_tunnel_xdp_rcv(struct xdp_buff *xdp);
+#else
+static inline u32 udp_tunnel_xdp_rcv(struct xdp_buff *xdp)
+{
+	return XDP_PASS;
+}
+#endif
+
 /* -- List of parsable UDP tunnel types --
  *
  * Adding to this list will result in serious debate.  The main issue is
@@ -240,6 +240,7 @@ struct vxlan_dev {
 	spinlock_t	  hash_lock;
 	unsigned int	  addrcnt;
 	struct gro_cells  gro_cells;
+	struct bpf_prog __rcu *xdp_prog; /* run on frames decapsulated by XDP */
 
 	struct vxlan_config	cfg;
 
@@ -121,6 +121,18 @@ void xdp_return_frame(struct xdp_frame *xdpf);
 void xdp_return_frame_rx_napi(struct xdp_frame *xdpf);
 void xdp_return_buff(struct xdp_buff *xdp);
 
+struct netdev_bpf;
+
+void xdp_prog_replace(struct bpf_prog __rcu **pprog, struct bpf_prog *prog);
+int xdp_redirect_prog_bpf(struct bpf_prog __rcu **pprog,
+			  struct netdev_bpf *xdp);
+u32 xdp_run_frame(struct bpf_prog *xdp_prog, struct xdp_frame *xdpf,
+		  struct xdp_rxq_info *rxq);
+u32 xdp_run_decap(struct bpf_prog *xdp_prog, struct xdp_buff *xdp,
+		  unsigned int hlen, struct net_device *dev);
+struct sk_buff *xdp_build_skb_from_frame(struct xdp_frame *xdpf,
+					 struct net_device *dev);
+
 int xdp_rxq_info_reg(struct xdp_rxq_info *xdp_rxq,
 		     struct net_device *dev, u32 queue_index);
 void xdp_rxq_info_unreg(struct xdp_rxq_info *xdp_rxq);
@@ -59,6 +59,7 @@
 #define TUNGETVNETBE _IOR('T', 223, int)
 #define TUNSETSTEERINGEBPF _IOR('T', 224, int)
 #define TUNSETFILTEREBPF _IOR('T', 225, int)
+#define TUNSETXDPEBPF _IOR('T', 226, int)
 
 /* TUNSETIFF ifr flags */
 #define IFF_TUN		0x0001
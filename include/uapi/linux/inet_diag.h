@@ -64,9 +64,23 @@ struct inet_diag_req_raw {
 enum {
 	INET_DIAG_REQ_NONE,
 	INET_DIAG_REQ_BYTECODE,
+	INET_DIAG_REQ_BPF_FD,
 };
 
-#define INET_DIAG_REQ_MAX INET_DIAG_REQ_BYTECODE
+#define INET_DIAG_REQ_MAX INET_DIAG_REQ_BPF_FD
+
+/* Return values of a BPF_INET_DIAG program attached to a dump with
+ * INET_DIAG_REQ_BPF_FD.  INET_DIAG_BPF_REPORT_EXT reports the socket
+ * with only those of the requested extensions (INET_DIAG_* bits of
+ * idiag_ext) that are also set in bits 8-15 of the return value.
+ */
+enum {
+	INET_DIAG_BPF_SKIP,
+	INET_DIAG_BPF_REPORT,
+	INET_DIAG_BPF_REPORT_EXT,
+};
+
+#define INET_DIAG_BPF_EXT_SHIFT	8
 
 /* Bytecode is sequence of 4 byte commands followed by variable arguments.
  * All the commands identified by "code" are conditional jumps forward:
@@ -53,11 +53,78 @@ enum {
 	NET_DM_CMD_CONFIG,
 	NET_DM_CMD_START,
 	NET_DM_CMD_STOP,
+	NET_DM_CMD_PACKET_ALERT,
+	NET_DM_CMD_STATS_GET,
+	NET_DM_CMD_STATS_NEW,
 	_NET_DM_CMD_MAX,
 };
 
 #define NET_DM_CMD_MAX (_NET_DM_CMD_MAX - 1)
 
+/* Attributes of NET_DM_CMD_CONFIG, NET_DM_CMD_PACKET_ALERT and
+ * NET_DM_CMD_STATS_NEW
+ */
+enum net_dm_attr {
+	NET_DM_ATTR_UNSPEC,
+
+	NET_DM_ATTR_ALERT_MODE,			/* u8 */
+	NET_DM_ATTR_PC,				/* u64 */
+	NET_DM_ATTR_SYMBOL,			/* string */
+	NET_DM_ATTR_IN_PORT,			/* nested */
+	NET_DM_ATTR_TIMESTAMP,			/* u64 */
+	NET_DM_ATTR_PROTO,			/* u16 */
+	NET_DM_ATTR_PAYLOAD,			/* binary */
+	NET_DM_ATTR_PAD,
+	NET_DM_ATTR_TRUNC_LEN,			/* u32 */
+	NET_DM_ATTR_ORIG_LEN,			/* u32 */
+	NET_DM_ATTR_QUEUE_LEN,			/* u32 */
+	NET_DM_ATTR_SAMPLE_RATE,		/* u32 */
+	NET_DM_ATTR_STATS,			/* nested */
+	NET_DM_ATTR_LOC_HIST,			/* nested */
+	NET_DM_ATTR_LOC,			/* nested */
+
+	__NET_DM_ATTR_MAX,
+	NET_DM_ATTR_MAX = __NET_DM_ATTR_MAX - 1
+};
+
+/**
+ * enum net_dm_alert_mode - Alert mode.
+ * @NET_DM_ALERT_MODE_SUMMARY: A summary of recent drops is sent to user space.
+ * @NET_DM_ALERT_MODE_PACKET: Each dropped packet is sent to user space along
+ *                            with metadata.
+ */
+enum net_dm_alert_mode {
+	NET_DM_ALERT_MODE_SUMMARY,
+	NET_DM_ALERT_MODE_PACKET,
+};
+
+enum {
+	NET_DM_ATTR_PORT_NETDEV_IFINDEX,	/* u32 */
+	NET_DM_ATTR_PORT_NETDEV_NAME,		/* string */
+
+	__NET_DM_ATTR_PORT_MAX,
+	NET_DM_ATTR_PORT_MAX = __NET_DM_ATTR_PORT_MAX - 1
+};
+
+/* Attributes nested in NET_DM_ATTR_STATS */
+enum {
+	NET_DM_ATTR_STATS_DROPPED,		/* u64 */
+	NET_DM_ATTR_STATS_LOC_OTHER,		/* u64 */
+
+	__NET_DM_ATTR_STATS_MAX,
+	NET_DM_ATTR_STATS_MAX = __NET_DM_ATTR_STATS_MAX - 1
+};
+
+/* Attributes of each NET_DM_ATTR_LOC nested in NET_DM_ATTR_LOC_HIST */
+enum {
+	NET_DM_ATTR_LOC_PC,			/* u64 */
+	NET_DM_ATTR_LOC_SYMBOL,			/* string */
+	NET_DM_ATTR_LOC_COUNT,			/* u64 */
+
+	__NET_DM_ATTR_LOC_MAX,
+	NET_DM_ATTR_LOC_MAX = __NET_DM_ATTR_LOC_MAX - 1
+};
+
 /*
  * Our group identifiers
  */
@@ -1239,6 +1239,7 @@ bpf_prog_load_check_attach_type(enum bpf_prog_type prog_type,
 		case BPF_CGROUP_INET_SOCK_CREATE:
 		case BPF_CGROUP_INET4_POST_BIND:
 		case BPF_CGROUP_INET6_POST_BIND:
+		case BPF_INET_DIAG:
 			return 0;
 		default:
 			return -EINVAL;
@@ -19,6 +19,7 @@
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/jhash.h>
+#include <linux/hash.h>
 #include <linux/random.h>
 #include <linux/slab.h>
 #include <linux/atomic.h>
@@ -67,6 +68,35 @@ int br_fdb_hash_init(struct net_bridge *br)
 void br_fdb_hash_fini(struct net_bridge *br)
 {
 	rhashtable_destroy(&br->fdb_hash_tbl);
+	free_percpu(br->fdb_cache);
+}
+
+static void br_fdb_cache_invalidate(struct net_bridge *br)
+{
+	/* Order the unlink before the bump: a reader that sees the new
+	 * generation can no longer find the removed entry.
+	 */
+	smp_mb__before_atomic();
+	atomic64_inc(&br->fdb_cache_gen);
+}
+
+int br_fdb_cache_toggle(struct net_bridge *br, unsigned long val)
+{
+	if (val && !br->fdb_cache) {
+		br->fdb_cache = alloc_percpu(struct br_fdb_cache);
+		if (!br->fdb_cache)
+			return -ENOMEM;
+	}
+
+	/* Drop anything cached before the cache was last disabled. The
+	 * per-cpu memory is kept until the bridge goes away since
+	 * readers do not synchronize with the toggle.
+	 */
+	br_fdb_cache_invalidate(br);
+	smp_wmb();
+	WRITE_ONCE(br->fdb_cache_enabled, !!val);
+
+	return 0;
 }
 
 /* if topology_changing then use forward_delay (default 15 sec)
@@ -152,6 +182,47 @@ struct net_bridge_fdb_entry *br_fdb_find_rcu(struct net_bridge *br,
 	return fdb_find_rcu(&br->fdb_hash_tbl, addr, vid);
 }
 
+static u32 br_fdb_cache_hash(const unsigned char *addr, __u16 vid)
+{
+	return hash_32(get_unaligned((u32 *)(addr + 2)) ^ vid,
+		       BR_FDB_CACHE_BITS);
+}
+
+/* Same as br_fdb_find_rcu() but memoizes hits in a small per-cpu cache
+ * when it is enabled. Only used with BHs disabled so that a cache slot
+ * is never updated concurrently on the same CPU.
+ */
+struct net_bridge_fdb_entry *br_fdb_find_rcu_cached(struct net_bridge *br,
+						    const unsigned char *addr,
+						    __u16 vid)
+{
+	struct net_bridge_fdb_entry *f;
+	struct br_fdb_cache_entry *ent;
+	u64 gen;
+
+	if (!READ_ONCE(br->fdb_cache_enabled) || !in_softirq())
+		return br_fdb_find_rcu(br, addr, vid);
+
+	smp_rmb();
+	gen = atomic64_read(&br->fdb_cache_gen);
+	smp_rmb();
+
+	ent = this_cpu_ptr(br->fdb_cache)->entries +
+	      br_fdb_cache_hash(addr, vid);
+	f = ent->fdb;
+	if (f && ent->gen == gen && f->key.vlan_id == vid &&
+	    ether_addr_equal(f->key.addr.addr, addr))
+		return f;
+
+	f = br_fdb_find_rcu(br, addr, vid);
+	if (f) {
+		ent->fdb = f;
+		ent->gen = gen;
+	}
+
+	return f;
+}
+
 /* When a static FDB entry is added, the mac address from the entry is
  * added to the bridge private HW address list and all required ports
  * are then updated with the new information.
@@ -208,6 +279,7 @@ static void fdb_delete(struct net_bridge *br, struct net_bridge_fdb_entry *f,
 	hlist_del_init_rcu(&f->fdb_node);
 	rhashtable_remove_fast(&br->fdb_hash_tbl, &f->rhnode,
 			       br_fdb_rht_params);
+	br_fdb_cache_invalidate(br);
 	fdb_notify(br, f, RTM_DELNEIGH, swdev_notify);
 	call_rcu(&f->rcu, fdb_rcu_free);
 }
@@ -305,6 +305,23 @@ static inline struct net_bridge_port *br_port_get_rtnl_rcu(const struct net_devi
 		rcu_dereference_rtnl(dev->rx_handler_data) : NULL;
 }
 
+#define BR_FDB_CACHE_BITS	6
+
+/* Per-CPU direct-mapped cache of unicast destination lookups. An entry
+ * is only valid while its generation matches br->fdb_cache_gen, which
+ * is bumped whenever an FDB entry is removed from the hash table.  The
+ * generation is 64-bit so that it cannot wrap around to the value of a
+ * stale slot.
+ */
+struct br_fdb_cache_entry {
+	struct net_bridge_fdb_entry	*fdb;
+	u64				gen;
+};
+
+struct br_fdb_cache {
+	struct br_fdb_cache_entry	entries[1 << BR_FDB_CACHE_BITS];
+};
+
 struct net_bridge {
 	spinlock_t			lock;
 	spinlock_t			hash_lock;
@@ -321,6 +338,9 @@ struct net_bridge {
 #endif
 
 	struct rhashtable		fdb_hash_tbl;
+	bool				fdb_cache_enabled;
+	atomic64_t			fdb_cache_gen;
+	struct br_fdb_cache		__percpu *fdb_cache;
 #if IS_ENABLED(CONFIG_BRIDGE_NETFILTER)
 	union {
 		struct rtable		fake_rtable;
@@ -537,6 +557,10 @@ void br_fdb_delete_by_port(struct net_bridge *br,
 struct net_bridge_fdb_entry *br_fdb_find_rcu(struct net_bridge *br,
 					     const unsigned char *addr,
 					     __u16 vid);
+struct net_bridge_fdb_entry *br_fdb_find_rcu_cached(struct net_bridge *br,
+						    const unsigned char *addr,
+						    __u16 vid);
+int br_fdb_cache_toggle(struct net_bridge *br, unsigned long val);
 int br_fdb_test_addr(struct net_device *dev, unsigned char *addr);
 int br_fdb_fillbuf(struct net_bridge *br, void *buf, unsigned long count,
 		   unsigned long off);
@@ -737,6 +737,21 @@ static ssize_t nf_call_arptables_store(
 }
 static DEVICE_ATTR_RW(nf_call_arptables);
 #endif
+static ssize_t fdb_cache_show(struct device *d,
+			      struct device_attribute *attr, char *buf)
+{
+	struct net_bridge *br = to_bridge(d);
+	return sprintf(buf, "%u\n", br->fdb_cache_enabled);
+}
+
+static ssize_t fdb_cache_store(struct device *d,
+			       struct device_attribute *attr,
+			       const char *buf, size_t len)
+{
+	return store_bridge_parm(d, buf, len, br_fdb_cache_toggle);
+}
+static DEVICE_ATTR_RW(fdb_cache);
+
 #ifdef CONFIG_BRIDGE_VLAN_FILTERING
 static ssize_t vlan_filtering_show(struct device *d,
 				   struct device_attribute *attr,
@@ -823,6 +838,7 @@ static struct attribute *bridge_attrs[] = {
 	&dev_attr_gc_timer.attr,
 	&dev_attr_group_addr.attr,
 	&dev_attr_flush.attr,
+	&dev_attr_fdb_cache.attr,
 #ifdef CONFIG_BRIDGE_IGMP_SNOOPING
 	&dev_attr_multicast_router.attr,
 	&dev_attr_multicast_snooping.attr,
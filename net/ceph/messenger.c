@@ -187,6 +187,9 @@ static atomic_t addr_str_seq = ATOMIC_INIT(0);
 
 static struct page *zero_page;		/* used in certain error cases */
 
+/* Max number of data pieces received with a single recvmsg */
+#define CEPH_MSGR_RECV_BVECS	16
+
 const char *ceph_pr_addr(const struct sockaddr_storage *ss)
 {
 	int i;
@@ -533,19 +536,17 @@ static int ceph_tcp_recvmsg(struct socket *sock, void *buf, size_t len)
 	return r;
 }
 
-static int ceph_tcp_recvpage(struct socket *sock, struct page *page,
-		     int page_offset, size_t length)
+/*
+ * Receive into several page pieces at once.  @len is the sum of the
+ * bv_len of the @nr entries in @bvecs.
+ */
+static int ceph_tcp_recvbvecs(struct socket *sock, struct bio_vec *bvecs,
+			      int nr, size_t len)
 {
-	struct bio_vec bvec = {
-		.bv_page = page,
-		.bv_offset = page_offset,
-		.bv_len = length
-	};
 	struct msghdr msg = { .msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL };
 	int r;
 
-	BUG_ON(page_offset + length > PAGE_SIZE);
-	iov_iter_bvec(&msg.msg_iter, READ | ITER_BVEC, &bvec, 1, length);
+	iov_iter_bvec(&msg.msg_iter, READ | ITER_BVEC, bvecs, nr, len);
 	r = sock_recvmsg(sock, &msg, msg.msg_flags);
 	if (r == -EAGAIN)
 		r = 0;
@@ -1263,11 +1264,11 @@ static void prepare_message_data(struct ceph_msg *msg, u32 data_len)
 static void prepare_write_message_footer(struct ceph_connection *con)
 {
 	struct ceph_msg *m = con->out_msg;
+	struct ceph_msg_footer *footer;
 
 	m->footer.flags |= CEPH_MSG_FOOTER_COMPLETE;
 
 	dout("prepare_write_message_footer %p\n", con);
-	con_out_kvec_add(con, sizeof_footer(con), &m->footer);
 	if (con->peer_features & CEPH_FEATURE_MSG_AUTH) {
 		if (con->ops->sign_message)
 			con->ops->sign_message(m);
@@ -1276,19 +1277,38 @@ static void prepare_write_message_footer(struct ceph_connection *con)
 	} else {
 		m->old_footer.flags = m->footer.flags;
 	}
-	con->out_more = m->more_to_follow;
+
+	/*
+	 * Send a copy: the footer may still be queued in out_kvec[] after
+	 * the message itself has been put, see con_can_chain_message().
+	 * A message without data gets its footer right away, while the
+	 * previous footer can still be pending, so alternate between two
+	 * copies.  Chaining only happens with a single footer pending.
+	 */
+	footer = &con->out_footer[con->out_footer_idx];
+	con->out_footer_idx ^= 1;
+	memcpy(footer, &m->footer, sizeof(*footer));
+	con_out_kvec_add(con, sizeof_footer(con), footer);
+
+	/* let TCP merge this message with the ones queued behind it */
+	con->out_more = m->more_to_follow ||
+			!list_empty(&con->out_queue) ||
+			con_flag_test(con, CON_FLAG_KEEPALIVE_PENDING);
 	con->out_msg_done = true;
 }
 
 /*
- * Prepare headers for the next outgoing message.
+ * Prepare headers for the next outgoing message.  If the footer of the
+ * previous message is still pending in out_kvec[], the headers are
+ * appended behind it.
  */
 static void prepare_write_message(struct ceph_connection *con)
 {
 	struct ceph_msg *m;
 	u32 crc;
 
-	con_out_kvec_reset(con);
+	if (!con->out_kvec_left)
+		con_out_kvec_reset(con);
 	con->out_msg_done = false;
 
 	/* Sneak an ack in there first?  If we can get it into the same
@@ -1607,7 +1627,6 @@ static int write_partial_message_data(struct ceph_connection *con)
 		struct page *page;
 		size_t page_offset;
 		size_t length;
-		bool last_piece;
 		int ret;
 
 		if (!cursor->resid) {
@@ -1615,10 +1634,10 @@ static int write_partial_message_data(struct ceph_connection *con)
 			continue;
 		}
 
-		page = ceph_msg_data_next(cursor, &page_offset, &length,
-					  &last_piece);
+		page = ceph_msg_data_next(cursor, &page_offset, &length, NULL);
+		/* the footer always follows the data */
 		ret = ceph_tcp_sendpage(con->sock, page, page_offset,
-					length, !last_piece);
+					length, true);
 		if (ret <= 0) {
 			if (do_datacrc)
 				msg->footer.data_crc = cpu_to_le32(crc);
@@ -2313,16 +2332,48 @@ static int read_partial_message_section(struct ceph_connection *con,
 	return 1;
 }
 
+/*
+ * Map up to @max pieces of message data, starting at @cursor, into
+ * @bvecs.  The cursor is advanced on a copy only, the caller moves the
+ * real one by however much was actually received.
+ */
+static int ceph_msg_data_map_bvecs(const struct ceph_msg_data_cursor *cursor,
+				   struct bio_vec *bvecs, int max, size_t *len)
+{
+	struct ceph_msg_data_cursor probe = *cursor;
+	size_t page_offset, length;
+	int nr = 0;
+
+	*len = 0;
+	while (probe.total_resid && nr < max) {
+		if (!probe.resid) {
+			ceph_msg_data_advance(&probe, 0);
+			continue;
+		}
+
+		bvecs[nr].bv_page = ceph_msg_data_next(&probe, &page_offset,
+						       &length, NULL);
+		bvecs[nr].bv_offset = page_offset;
+		bvecs[nr].bv_len = length;
+		*len += length;
+		nr++;
+		ceph_msg_data_advance(&probe, length);
+	}
+	return nr;
+}
+
 static int read_partial_msg_data(struct ceph_connection *con)
 {
 	struct ceph_msg *msg = con->in_msg;
 	struct ceph_msg_data_cursor *cursor = &msg->cursor;
 	bool do_datacrc = !ceph_test_opt(from_msgr(con->msgr), NOCRC);
+	struct bio_vec bvecs[CEPH_MSGR_RECV_BVECS];
 	struct page *page;
 	size_t page_offset;
 	size_t length;
+	size_t len;
 	u32 crc = 0;
-	int ret;
+	int ret, nr;
 
 	BUG_ON(!msg);
 	if (list_empty(&msg->data))
@@ -2331,13 +2382,10 @@ static int read_partial_msg_data(struct ceph_connection *con)
 	if (do_datacrc)
 		crc = con->in_data_crc;
 	while (cursor->total_resid) {
-		if (!cursor->resid) {
-			ceph_msg_data_advance(cursor, 0);
-			continue;
-		}
-
-		page = ceph_msg_data_next(cursor, &page_offset, &length, NULL);
-		ret = ceph_tcp_recvpage(con->sock, page, page_offset, length);
+		/* receive as many pieces as we can with one call */
+		nr = ceph_msg_data_map_bvecs(cursor, bvecs, ARRAY_SIZE(bvecs),
+					     &len);
+		ret = ceph_tcp_recvbvecs(con->sock, bvecs, nr, len);
 		if (ret <= 0) {
 			if (do_datacrc)
 				con->in_data_crc = crc;
@@ -2345,9 +2393,21 @@ static int read_partial_msg_data(struct ceph_connection *con)
 			return ret;
 		}
 
-		if (do_datacrc)
-			crc = ceph_crc32c_page(crc, page, page_offset, ret);
-		ceph_msg_data_advance(cursor, (size_t)ret);
+		while (ret) {
+			if (!cursor->resid) {
+				ceph_msg_data_advance(cursor, 0);
+				continue;
+			}
+
+			page = ceph_msg_data_next(cursor, &page_offset,
+						  &length, NULL);
+			length = min_t(size_t, length, ret);
+			if (do_datacrc)
+				crc = ceph_crc32c_page(crc, page, page_offset,
+						       length);
+			ceph_msg_data_advance(cursor, length);
+			ret -= length;
+		}
 	}
 	if (do_datacrc)
 		con->in_data_crc = crc;
@@ -2560,6 +2620,24 @@ static int read_keepalive_ack(struct ceph_connection *con)
 	return 1;
 }
 
+/*
+ * Can the next queued message be appended to out_kvec[] while the
+ * footer of the current one is still pending?  Room is needed for an
+ * ack (2), tag, header, front, middle and footer.  Nothing but that one
+ * footer may be pending: out_footer[] only has room for it and the
+ * footer of a data-less next message.
+ */
+static bool con_can_chain_message(struct ceph_connection *con)
+{
+	return con->state == CON_STATE_OPEN &&
+	       !list_empty(&con->out_queue) &&
+	       !con_flag_test(con, CON_FLAG_KEEPALIVE_PENDING) &&
+	       !con->out_skip &&
+	       con->out_kvec_cur == &con->out_kvec[0] &&
+	       con->out_kvec_left <= 1 &&
+	       con->out_kvec_left + 7 <= ARRAY_SIZE(con->out_kvec);
+}
+
 /*
  * Write something to the socket.  Called in a worker thread when the
  * socket appears to be writeable and we have something ready to send.
@@ -2599,6 +2677,18 @@ static int try_write(struct ceph_connection *con)
 	dout("try_write out_kvec_bytes %d\n", con->out_kvec_bytes);
 	BUG_ON(!con->sock);
 
+	/*
+	 * Only the footer of the current message is left to send: retire
+	 * the message and put the next one's header behind the footer, so
+	 * both go out with a single sendmsg.
+	 */
+	if (con->out_msg && con->out_msg_done && con_can_chain_message(con)) {
+		ceph_msg_put(con->out_msg);
+		con->out_msg = NULL;
+		prepare_write_message(con);
+		goto more;
+	}
+
 	/* kvec data queued? */
 	if (con->out_kvec_left) {
 		ret = write_partial_kvec(con);
@@ -3778,10 +3778,17 @@ int dev_weight_tx_bias __read_mostly = 1;  /* bias for output_queue quota */
 int dev_rx_weight __read_mostly = 64;
 int dev_tx_weight __read_mostly = 64;
 
+/* net.core.napi_stats: per-NAPI statistics in /proc/net/napi_stat */
+int sysctl_napi_stats __read_mostly;
+u64 napi_stats_enabled_at __read_mostly;
+DEFINE_STATIC_KEY_FALSE(napi_stats_needed_key);
+
 /* Called with irq disabled */
 static inline void ____napi_schedule(struct softnet_data *sd,
 				     struct napi_struct *napi)
 {
+	if (static_branch_unlikely(&napi_stats_needed_key))
+		napi->sched_time = local_clock();
 	list_add_tail(&napi->poll_list, &sd->poll_list);
 	__raise_softirq_irqoff(NET_RX_SOFTIRQ);
 }
@@ -5769,7 +5776,8 @@ EXPORT_SYMBOL(__napi_schedule_irqoff);
 
 bool napi_complete_done(struct napi_struct *n, int work_done)
 {
-	unsigned long flags, val, new;
+	unsigned long flags, val, new, timeout = 0;
+	bool ret = true;
 
 	/*
 	 * 1) Don't let napi dequeue from the cpu poll list
@@ -5781,17 +5789,27 @@ bool napi_complete_done(struct napi_struct *n, int work_done)
 				 NAPIF_STATE_IN_BUSY_POLL)))
 		return false;
 
-	if (n->gro_count) {
-		unsigned long timeout = 0;
-
-		if (work_done)
-			timeout = n->dev->gro_flush_timeout;
-
+	if (work_done) {
+		if (n->gro_count)
+			timeout = READ_ONCE(n->dev->gro_flush_timeout);
+		n->defer_hard_irqs_count =
+			READ_ONCE(n->dev->napi_defer_hard_irqs);
+	}
+	/* Keep device interrupts masked for napi_defer_hard_irqs empty
+	 * polls, relying on the gro_flush_timeout timer to poll again.
+	 */
+	if (n->defer_hard_irqs_count > 0) {
+		n->defer_hard_irqs_count--;
+		timeout = READ_ONCE(n->dev->gro_flush_timeout);
 		if (timeout)
-			hrtimer_start(&n->timer, ns_to_ktime(timeout),
-				      HRTIMER_MODE_REL_PINNED);
-		else
-			napi_gro_flush(n, false);
+			ret = false;
+	}
+	if (n->gro_count) {
+		/* When the NAPI instance uses a timeout and keeps postponing
+		 * it, we need to bound somehow the time packets are kept in
+		 * the GRO layer.
+		 */
+		napi_gro_flush(n, !!timeout);
 	}
 	if (unlikely(!list_empty(&n->poll_list))) {
 		/* If n->poll_list is not empty, we need to mask irqs */
@@ -5805,7 +5823,8 @@ bool napi_complete_done(struct napi_struct *n, int work_done)
 
 		WARN_ON_ONCE(!(val & NAPIF_STATE_SCHED));
 
-		new = val & ~(NAPIF_STATE_MISSED | NAPIF_STATE_SCHED);
+		new = val & ~(NAPIF_STATE_MISSED | NAPIF_STATE_SCHED |
+			      NAPIF_STATE_PREFER_BUSY_POLL);
 
 		/* If STATE_MISSED was set, leave STATE_SCHED set,
 		 * because we will call napi->poll() one more time.
@@ -5820,7 +5839,10 @@ bool napi_complete_done(struct napi_struct *n, int work_done)
 		return false;
 	}
 
-	return true;
+	if (timeout)
+		hrtimer_start(&n->timer, ns_to_ktime(timeout),
+			      HRTIMER_MODE_REL_PINNED);
+	return ret;
 }
 EXPORT_SYMBOL(napi_complete_done);
 
@@ -5841,8 +5863,28 @@ static struct napi_struct *napi_by_id(unsigned int napi_id)
 
 #define BUSY_POLL_BUDGET 8
 
-static void busy_poll_stop(struct napi_struct *napi, void *have_poll_lock)
+static void __busy_poll_stop(struct napi_struct *napi, bool skip_schedule)
+{
+	if (!skip_schedule) {
+		__napi_schedule(napi);
+		return;
+	}
+
+	if (napi->gro_count) {
+		/* flush too old packets
+		 * If HZ < 1000, flush all packets.
+		 */
+		napi_gro_flush(napi, HZ >= 1000);
+	}
+
+	clear_bit(NAPI_STATE_SCHED, &napi->state);
+}
+
+static void busy_poll_stop(struct napi_struct *napi, void *have_poll_lock,
+			   bool prefer_busy_poll)
 {
+	bool skip_schedule = false;
+	unsigned long timeout;
 	int rc;
 
 	/* Busy polling means there is a high chance device driver hard irq
@@ -5859,6 +5901,21 @@ static void busy_poll_stop(struct napi_struct *napi, void *have_poll_lock)
 
 	local_bh_disable();
 
+	/* If the device defers its interrupts, leave them masked and let
+	 * the watchdog timer pick up the NAPI should we not come back in
+	 * time, instead of handing the queue back to softirq.
+	 */
+	if (prefer_busy_poll) {
+		napi->defer_hard_irqs_count =
+			READ_ONCE(napi->dev->napi_defer_hard_irqs);
+		timeout = READ_ONCE(napi->dev->gro_flush_timeout);
+		if (napi->defer_hard_irqs_count && timeout) {
+			hrtimer_start(&napi->timer, ns_to_ktime(timeout),
+				      HRTIMER_MODE_REL_PINNED);
+			skip_schedule = true;
+		}
+	}
+
 	/* All we really want here is to re-enable device interrupts.
 	 * Ideally, a new ndo_busy_poll_stop() could avoid another round.
 	 */
@@ -5866,13 +5923,13 @@ static void busy_poll_stop(struct napi_struct *napi, void *have_poll_lock)
 	trace_napi_poll(napi, rc, BUSY_POLL_BUDGET);
 	netpoll_poll_unlock(have_poll_lock);
 	if (rc == BUSY_POLL_BUDGET)
-		__napi_schedule(napi);
+		__busy_poll_stop(napi, skip_schedule);
 	local_bh_enable();
 }
 
 void napi_busy_loop(unsigned int napi_id,
 		    bool (*loop_end)(void *, unsigned long),
-		    void *loop_end_arg)
+		    void *loop_end_arg, bool prefer_busy_poll)
 {
 	unsigned long start_time = loop_end ? busy_loop_current_time() : 0;
 	int (*napi_poll)(struct napi_struct *napi, int budget);
@@ -5888,6 +5945,15 @@ void napi_busy_loop(unsigned int napi_id,
 	if (!napi)
 		goto out;
 
+	/* Only take the queue away from softirq when the device is set up
+	 * to defer its interrupts, otherwise it would merely bounce between
+	 * softirq and the busy poller.
+	 */
+	if (prefer_busy_poll &&
+	    (!READ_ONCE(napi->dev->napi_defer_hard_irqs) ||
+	     !READ_ONCE(napi->dev->gro_flush_timeout)))
+		prefer_busy_poll = false;
+
 	preempt_disable();
 	for (;;) {
 		int work = 0;
@@ -5900,12 +5966,20 @@ void napi_busy_loop(unsigned int napi_id,
 			 * we avoid dirtying napi->state as much as we can.
 			 */
 			if (val & (NAPIF_STATE_DISABLE | NAPIF_STATE_SCHED |
-				   NAPIF_STATE_IN_BUSY_POLL))
+				   NAPIF_STATE_IN_BUSY_POLL)) {
+				if (prefer_busy_poll)
+					set_bit(NAPI_STATE_PREFER_BUSY_POLL,
+						&napi->state);
 				goto count;
+			}
 			if (cmpxchg(&napi->state, val,
 				    val | NAPIF_STATE_IN_BUSY_POLL |
-					  NAPIF_STATE_SCHED) != val)
+					  NAPIF_STATE_SCHED) != val) {
+				if (prefer_busy_poll)
+					set_bit(NAPI_STATE_PREFER_BUSY_POLL,
+						&napi->state);
 				goto count;
+			}
 			have_poll_lock = netpoll_poll_lock(napi);
 			napi_poll = napi->poll;
 		}
@@ -5922,7 +5996,8 @@ void napi_busy_loop(unsigned int napi_id,
 
 		if (unlikely(need_resched())) {
 			if (napi_poll)
-				busy_poll_stop(napi, have_poll_lock);
+				busy_poll_stop(napi, have_poll_lock,
+					       prefer_busy_poll);
 			preempt_enable();
 			rcu_read_unlock();
 			cond_resched();
@@ -5933,7 +6008,7 @@ void napi_busy_loop(unsigned int napi_id,
 		cpu_relax();
 	}
 	if (napi_poll)
-		busy_poll_stop(napi, have_poll_lock);
+		busy_poll_stop(napi, have_poll_lock, prefer_busy_poll);
 	preempt_enable();
 out:
 	rcu_read_unlock();
@@ -5990,9 +6065,11 @@ static enum hrtimer_restart napi_watchdog(struct hrtimer *timer)
 	/* Note : we use a relaxed variant of napi_schedule_prep() not setting
 	 * NAPI_STATE_MISSED, since we do not react to a device IRQ.
 	 */
-	if (napi->gro_count && !napi_disable_pending(napi) &&
-	    !test_and_set_bit(NAPI_STATE_SCHED, &napi->state))
+	if (!napi_disable_pending(napi) &&
+	    !test_and_set_bit(NAPI_STATE_SCHED, &napi->state)) {
+		clear_bit(NAPI_STATE_PREFER_BUSY_POLL, &napi->state);
 		__napi_schedule_irqoff(napi);
+	}
 
 	return HRTIMER_NORESTART;
 }
@@ -6014,6 +6091,8 @@ void netif_napi_add(struct net_device *dev, struct napi_struct *napi,
 		pr_err_once("netif_napi_add() called with weight %d on device %s\n",
 			    weight, dev->name);
 	napi->weight = weight;
+	napi->sched_time = 0;
+	RCU_INIT_POINTER(napi->stats, NULL);
 	list_add(&napi->dev_list, &dev->napi_list);
 	napi->dev = dev;
 #ifdef CONFIG_NETPOLL
@@ -6036,6 +6115,7 @@ void napi_disable(struct napi_struct *n)
 
 	hrtimer_cancel(&n->timer);
 
+	clear_bit(NAPI_STATE_PREFER_BUSY_POLL, &n->state);
 	clear_bit(NAPI_STATE_DISABLE, &n->state);
 }
 EXPORT_SYMBOL(napi_disable);
@@ -6052,20 +6132,86 @@ static void flush_gro_hash(struct napi_struct *napi)
 	}
 }
 
-/* Must be called in process context */
-void netif_napi_del(struct napi_struct *napi)
+bool __netif_napi_del(struct napi_struct *napi)
 {
-	might_sleep();
-	if (napi_hash_del(napi))
-		synchronize_net();
+	bool rcu_sync_needed = napi_hash_del(napi);
+	struct napi_stats *stats;
+
 	list_del_init(&napi->dev_list);
 	napi_free_frags(napi);
 
 	flush_gro_hash(napi);
 	napi->gro_count = 0;
+
+	/* The statistics free themselves after a grace period */
+	stats = rcu_dereference_protected(napi->stats, 1);
+	RCU_INIT_POINTER(napi->stats, NULL);
+	if (stats)
+		kfree_rcu(stats, rcu);
+
+	return rcu_sync_needed;
+}
+EXPORT_SYMBOL(__netif_napi_del);
+
+/* Must be called in process context */
+void netif_napi_del(struct napi_struct *napi)
+{
+	might_sleep();
+	if (__netif_napi_del(napi))
+		synchronize_net();
 }
 EXPORT_SYMBOL(netif_napi_del);
 
+static unsigned int napi_stat_bucket(u64 val)
+{
+	return min_t(unsigned int, fls64(val), NAPI_STAT_BUCKETS - 1);
+}
+
+static void napi_poll_stats(struct napi_struct *n, int work, int weight)
+{
+	struct napi_stats *stats = rcu_dereference_bh(n->stats);
+
+	if (unlikely(!stats)) {
+		stats = kzalloc(sizeof(*stats), GFP_ATOMIC);
+		if (!stats)
+			return;
+		rcu_assign_pointer(n->stats, stats);
+	}
+
+	stats->polls++;
+	stats->packets += work;
+	stats->work_hist[napi_stat_bucket(work)]++;
+	if (work >= weight)
+		stats->budget_exhausted++;
+
+	/* Only the first poll after a schedule measures latency,
+	 * repolls from net_rx_action() do not go through ____napi_schedule().
+	 * A timestamp taken before the statistics were last enabled may have
+	 * sat there while they were off, so it is dropped.
+	 */
+	if (n->sched_time) {
+		u64 lat = local_clock() - n->sched_time;
+
+		if (n->sched_time >= READ_ONCE(napi_stats_enabled_at))
+			stats->sched_lat_hist[napi_stat_bucket(
+				div_u64(lat, NSEC_PER_USEC))]++;
+		n->sched_time = 0;
+	}
+}
+
+/* Count the instances net_rx_action() leaves pending on @list */
+static void napi_stats_squeezed(struct list_head *list)
+{
+	struct napi_stats *stats;
+	struct napi_struct *n;
+
+	list_for_each_entry(n, list, poll_list) {
+		stats = rcu_dereference_bh(n->stats);
+		if (stats)
+			stats->squeezed++;
+	}
+}
+
 static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 {
 	void *have;
@@ -6087,6 +6233,8 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 	if (test_bit(NAPI_STATE_SCHED, &n->state)) {
 		work = n->poll(n, weight);
 		trace_napi_poll(n, work, weight);
+		if (static_branch_unlikely(&napi_stats_needed_key))
+			napi_poll_stats(n, work, weight);
 	}
 
 	WARN_ON_ONCE(work > weight);
@@ -6104,6 +6252,19 @@ static int napi_poll(struct napi_struct *n, struct list_head *repoll)
 		goto out_unlock;
 	}
 
+	/* The NAPI context has more processing work, but busy polling
+	 * is preferred. Exit early.
+	 */
+	if (napi_prefer_busy_poll(n)) {
+		if (napi_complete_done(n, work)) {
+			/* If timeout is not set, we need to make sure
+			 * that the NAPI is re-scheduled.
+			 */
+			napi_schedule(n);
+		}
+		goto out_unlock;
+	}
+
 	if (n->gro_count) {
 		/* flush too old packets
 		 * If HZ < 1000, flush all packets.
@@ -6160,6 +6321,10 @@ static __latent_entropy void net_rx_action(struct softirq_action *h)
 		if (unlikely(budget <= 0 ||
 			     time_after_eq(jiffies, time_limit))) {
 			sd->time_squeeze++;
+			if (static_branch_unlikely(&napi_stats_needed_key)) {
+				napi_stats_squeezed(&list);
+				napi_stats_squeezed(&repoll);
+			}
 			break;
 		}
 	}
@@ -8806,6 +8971,7 @@ EXPORT_SYMBOL(alloc_netdev_mqs);
 void free_netdev(struct net_device *dev)
 {
 	struct napi_struct *p, *n;
+	bool rcu_sync_needed = false;
 
 	might_sleep();
 	netif_free_tx_queues(dev);
@@ -8817,7 +8983,9 @@ void free_netdev(struct net_device *dev)
 	dev_addr_flush(dev);
 
 	list_for_each_entry_safe(p, n, &dev->napi_list, dev_list)
-		netif_napi_del(p);
+		rcu_sync_needed |= __netif_napi_del(p);
+	if (rcu_sync_needed)
+		synchronize_net();
 
 	free_percpu(dev->pcpu_refcnt);
 	dev->pcpu_refcnt = NULL;
@@ -25,6 +25,9 @@
 #include <linux/bitops.h>
 #include <linux/slab.h>
 #include <linux/module.h>
+#include <linux/random.h>
+#include <linux/hash.h>
+#include <linux/sort.h>
 #include <net/genetlink.h>
 #include <net/netevent.h>
 
@@ -44,11 +47,28 @@
 static int trace_state = TRACE_OFF;
 static DEFINE_MUTEX(trace_state_mutex);
 
+/* Distinct drop locations counted per CPU in packet mode and reported
+ * across all CPUs by NET_DM_CMD_STATS_GET.  Drops at locations that do
+ * not fit are only accounted in the "other" counter.
+ */
+#define NET_DM_LOC_HIST_SIZE	64
+#define NET_DM_LOC_HIST_MAX	256
+
+struct net_dm_loc_stat {
+	void			*pc;
+	u64			count;
+};
+
 struct per_cpu_dm_data {
 	spinlock_t		lock;
 	struct sk_buff		*skb;
+	struct sk_buff_head	drop_queue;
 	struct work_struct	dm_alert_work;
 	struct timer_list	send_timer;
+	/* protected by lock */
+	struct net_dm_loc_stat	loc_hist[NET_DM_LOC_HIST_SIZE];
+	u64			loc_other;
+	u64			dropped;
 };
 
 struct dm_hw_stat_delta {
@@ -68,6 +88,25 @@ static int dm_delay = 1;
 static unsigned long dm_hw_check_delta = 2*HZ;
 static LIST_HEAD(hw_stats_list);
 
+static enum net_dm_alert_mode net_dm_alert_mode = NET_DM_ALERT_MODE_SUMMARY;
+static u32 net_dm_trunc_len;
+static u32 net_dm_queue_len = 1000;
+static u32 net_dm_sample_rate = 1;
+
+struct net_dm_alert_ops {
+	void (*kfree_skb_probe)(void *ignore, struct sk_buff *skb,
+				void *location);
+	void (*napi_poll_probe)(void *ignore, struct napi_struct *napi,
+				int work, int budget);
+	void (*work_item_func)(struct work_struct *work);
+};
+
+struct net_dm_skb_cb {
+	void *pc;
+};
+
+#define NET_DM_SKB_CB(__skb) ((struct net_dm_skb_cb *)&((__skb)->cb[0]))
+
 static struct sk_buff *reset_per_cpu_data(struct per_cpu_dm_data *data)
 {
 	size_t al;
@@ -234,8 +273,321 @@ static void trace_napi_poll_hit(void *ignore, struct napi_struct *napi,
 	rcu_read_unlock();
 }
 
+static const struct net_dm_alert_ops net_dm_alert_summary_ops = {
+	.kfree_skb_probe	= trace_kfree_skb_hit,
+	.napi_poll_probe	= trace_napi_poll_hit,
+	.work_item_func		= send_dm_alert,
+};
+
+/* In packet mode every sampled drop is cloned onto a per-CPU queue,
+ * which is drained from process context into one netlink message per
+ * packet.  The queue length bounds the memory used and, together with
+ * the sampling rate, the rate of alerts sent to user space.
+ */
+static void net_dm_loc_hist_add(struct per_cpu_dm_data *data, void *pc)
+{
+	unsigned int i, idx = hash_ptr(pc, ilog2(NET_DM_LOC_HIST_SIZE));
+
+	for (i = 0; i < NET_DM_LOC_HIST_SIZE; i++) {
+		struct net_dm_loc_stat *stat;
+
+		stat = &data->loc_hist[(idx + i) % NET_DM_LOC_HIST_SIZE];
+		if (stat->pc == pc || !stat->pc) {
+			stat->pc = pc;
+			stat->count++;
+			return;
+		}
+	}
+
+	data->loc_other++;
+}
+
+static void net_dm_packet_trace_kfree_skb_hit(void *ignore,
+					      struct sk_buff *skb,
+					      void *location)
+{
+	ktime_t tstamp = ktime_get_real();
+	u32 rate = READ_ONCE(net_dm_sample_rate);
+	struct per_cpu_dm_data *data;
+	struct sk_buff *nskb;
+	unsigned long flags;
+
+	data = this_cpu_ptr(&dm_cpu_data);
+
+	/* The histogram covers every drop, including the ones that are
+	 * sampled out or never make it to user space.
+	 */
+	spin_lock_irqsave(&data->lock, flags);
+	net_dm_loc_hist_add(data, location);
+	spin_unlock_irqrestore(&data->lock, flags);
+
+	if (rate > 1 && prandom_u32_max(rate))
+		return;
+
+	nskb = skb_clone(skb, GFP_ATOMIC);
+	if (!nskb)
+		goto unreported;
+
+	NET_DM_SKB_CB(nskb)->pc = location;
+	/* Override the timestamp because we care about the time when the
+	 * packet was dropped.
+	 */
+	nskb->tstamp = tstamp;
+
+	spin_lock_irqsave(&data->drop_queue.lock, flags);
+	if (skb_queue_len(&data->drop_queue) >= READ_ONCE(net_dm_queue_len)) {
+		spin_unlock_irqrestore(&data->drop_queue.lock, flags);
+		consume_skb(nskb);
+		goto unreported;
+	}
+	__skb_queue_tail(&data->drop_queue, nskb);
+	spin_unlock_irqrestore(&data->drop_queue.lock, flags);
+
+	schedule_work(&data->dm_alert_work);
+	return;
+
+unreported:
+	spin_lock_irqsave(&data->lock, flags);
+	data->dropped++;
+	spin_unlock_irqrestore(&data->lock, flags);
+}
+
+static void net_dm_packet_trace_napi_poll_hit(void *ignore,
+					      struct napi_struct *napi,
+					      int work, int budget)
+{
+}
+
+#define NET_DM_MAX_SYMBOL_LEN 40
+#define NET_DM_MAX_PACKET_SIZE (0xffff - NLA_HDRLEN - NLA_ALIGNTO)
+
+static size_t net_dm_in_port_size(void)
+{
+	       /* NET_DM_ATTR_IN_PORT nest */
+	return nla_total_size(0) +
+	       /* NET_DM_ATTR_PORT_NETDEV_IFINDEX */
+	       nla_total_size(sizeof(u32)) +
+	       /* NET_DM_ATTR_PORT_NETDEV_NAME */
+	       nla_total_size(IFNAMSIZ + 1);
+}
+
+static size_t net_dm_packet_report_size(size_t payload_len)
+{
+	size_t size;
+
+	size = nlmsg_msg_size(GENL_HDRLEN + net_drop_monitor_family.hdrsize);
+
+	return NLMSG_ALIGN(size) +
+	       /* NET_DM_ATTR_PC */
+	       nla_total_size_64bit(sizeof(u64)) +
+	       /* NET_DM_ATTR_SYMBOL */
+	       nla_total_size(NET_DM_MAX_SYMBOL_LEN + 1) +
+	       /* NET_DM_ATTR_IN_PORT */
+	       net_dm_in_port_size() +
+	       /* NET_DM_ATTR_TIMESTAMP */
+	       nla_total_size_64bit(sizeof(u64)) +
+	       /* NET_DM_ATTR_ORIG_LEN */
+	       nla_total_size(sizeof(u32)) +
+	       /* NET_DM_ATTR_PROTO */
+	       nla_total_size(sizeof(u16)) +
+	       /* NET_DM_ATTR_PAYLOAD */
+	       nla_total_size(payload_len);
+}
+
+static int net_dm_packet_report_in_port_put(struct sk_buff *msg, int ifindex)
+{
+	struct net_device *dev;
+	struct nlattr *attr;
+
+	attr = nla_nest_start(msg, NET_DM_ATTR_IN_PORT);
+	if (!attr)
+		return -EMSGSIZE;
+
+	if (ifindex &&
+	    nla_put_u32(msg, NET_DM_ATTR_PORT_NETDEV_IFINDEX, ifindex))
+		goto nla_put_failure;
+
+	rcu_read_lock();
+	dev = ifindex ? dev_get_by_index_rcu(&init_net, ifindex) : NULL;
+	if (dev && nla_put_string(msg, NET_DM_ATTR_PORT_NETDEV_NAME,
+				  dev->name)) {
+		rcu_read_unlock();
+		goto nla_put_failure;
+	}
+	rcu_read_unlock();
+
+	nla_nest_end(msg, attr);
+
+	return 0;
+
+nla_put_failure:
+	nla_nest_cancel(msg, attr);
+	return -EMSGSIZE;
+}
+
+static int net_dm_packet_report_fill(struct sk_buff *msg, struct sk_buff *skb,
+				     size_t payload_len)
+{
+	u64 pc = (u64)(uintptr_t) NET_DM_SKB_CB(skb)->pc;
+	char buf[NET_DM_MAX_SYMBOL_LEN];
+	struct nlattr *attr;
+	void *hdr;
+
+	hdr = genlmsg_put(msg, 0, 0, &net_drop_monitor_family, 0,
+			  NET_DM_CMD_PACKET_ALERT);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	if (nla_put_u64_64bit(msg, NET_DM_ATTR_PC, pc, NET_DM_ATTR_PAD))
+		goto nla_put_failure;
+
+	snprintf(buf, sizeof(buf), "%pS", NET_DM_SKB_CB(skb)->pc);
+	if (nla_put_string(msg, NET_DM_ATTR_SYMBOL, buf))
+		goto nla_put_failure;
+
+	if (net_dm_packet_report_in_port_put(msg, skb->skb_iif))
+		goto nla_put_failure;
+
+	if (nla_put_u64_64bit(msg, NET_DM_ATTR_TIMESTAMP,
+			      ktime_to_ns(skb->tstamp), NET_DM_ATTR_PAD))
+		goto nla_put_failure;
+
+	if (nla_put_u32(msg, NET_DM_ATTR_ORIG_LEN, skb->len))
+		goto nla_put_failure;
+
+	if (!payload_len)
+		goto out;
+
+	if (nla_put_u16(msg, NET_DM_ATTR_PROTO, be16_to_cpu(skb->protocol)))
+		goto nla_put_failure;
+
+	attr = nla_reserve(msg, NET_DM_ATTR_PAYLOAD, payload_len);
+	if (!attr)
+		goto nla_put_failure;
+
+	if (skb_copy_bits(skb, 0, nla_data(attr), payload_len))
+		goto nla_put_failure;
+
+out:
+	genlmsg_end(msg, hdr);
+
+	return 0;
+
+nla_put_failure:
+	genlmsg_cancel(msg, hdr);
+	return -EMSGSIZE;
+}
+
+static void net_dm_packet_report(struct sk_buff *skb)
+{
+	struct sk_buff *msg;
+	size_t payload_len;
+	int rc;
+
+	/* Make sure we start copying the packet from the MAC header */
+	if (skb_mac_header_was_set(skb)) {
+		if (skb->data > skb_mac_header(skb))
+			skb_push(skb, skb->data - skb_mac_header(skb));
+		else
+			skb_pull(skb, skb_mac_header(skb) - skb->data);
+	}
+
+	/* Ensure packet fits inside a single netlink attribute */
+	payload_len = min_t(size_t, skb->len, NET_DM_MAX_PACKET_SIZE);
+	if (net_dm_trunc_len)
+		payload_len = min_t(size_t, net_dm_trunc_len, payload_len);
+
+	msg = nlmsg_new(net_dm_packet_report_size(payload_len), GFP_KERNEL);
+	if (!msg)
+		goto out;
+
+	rc = net_dm_packet_report_fill(msg, skb, payload_len);
+	if (rc) {
+		nlmsg_free(msg);
+		goto out;
+	}
+
+	genlmsg_multicast(&net_drop_monitor_family, msg, 0, 0, GFP_KERNEL);
+
+out:
+	consume_skb(skb);
+}
+
+static void net_dm_packet_work(struct work_struct *work)
+{
+	struct per_cpu_dm_data *data;
+	struct sk_buff_head list;
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	data = container_of(work, struct per_cpu_dm_data, dm_alert_work);
+
+	__skb_queue_head_init(&list);
+
+	spin_lock_irqsave(&data->drop_queue.lock, flags);
+	skb_queue_splice_tail_init(&data->drop_queue, &list);
+	spin_unlock_irqrestore(&data->drop_queue.lock, flags);
+
+	while ((skb = __skb_dequeue(&list)))
+		net_dm_packet_report(skb);
+}
+
+static const struct net_dm_alert_ops net_dm_alert_packet_ops = {
+	.kfree_skb_probe	= net_dm_packet_trace_kfree_skb_hit,
+	.napi_poll_probe	= net_dm_packet_trace_napi_poll_hit,
+	.work_item_func		= net_dm_packet_work,
+};
+
+static const struct net_dm_alert_ops *net_dm_alert_ops_arr[] = {
+	[NET_DM_ALERT_MODE_SUMMARY]	= &net_dm_alert_summary_ops,
+	[NET_DM_ALERT_MODE_PACKET]	= &net_dm_alert_packet_ops,
+};
+
+static void net_dm_works_init(const struct net_dm_alert_ops *ops)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct per_cpu_dm_data *data = &per_cpu(dm_cpu_data, cpu);
+
+		INIT_WORK(&data->dm_alert_work, ops->work_item_func);
+	}
+}
+
+static void net_dm_stats_reset(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct per_cpu_dm_data *data = &per_cpu(dm_cpu_data, cpu);
+		unsigned long flags;
+
+		spin_lock_irqsave(&data->lock, flags);
+		memset(data->loc_hist, 0, sizeof(data->loc_hist));
+		data->loc_other = 0;
+		data->dropped = 0;
+		spin_unlock_irqrestore(&data->lock, flags);
+	}
+}
+
+static void net_dm_works_flush(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct per_cpu_dm_data *data = &per_cpu(dm_cpu_data, cpu);
+
+		/* Send out a pending summary rather than losing it */
+		if (del_timer_sync(&data->send_timer))
+			schedule_work(&data->dm_alert_work);
+		flush_work(&data->dm_alert_work);
+		skb_queue_purge(&data->drop_queue);
+	}
+}
+
 static int set_all_monitor_traces(int state)
 {
+	const struct net_dm_alert_ops *ops;
 	int rc = 0;
 	struct dm_hw_stat_delta *new_stat = NULL;
 	struct dm_hw_stat_delta *temp;
@@ -247,6 +599,9 @@ static int set_all_monitor_traces(int state)
 		goto out_unlock;
 	}
 
+	/* The alert mode can only change while tracing is off */
+	ops = net_dm_alert_ops_arr[net_dm_alert_mode];
+
 	switch (state) {
 	case TRACE_ON:
 		if (!try_module_get(THIS_MODULE)) {
@@ -254,16 +609,20 @@ static int set_all_monitor_traces(int state)
 			break;
 		}
 
-		rc |= register_trace_kfree_skb(trace_kfree_skb_hit, NULL);
-		rc |= register_trace_napi_poll(trace_napi_poll_hit, NULL);
+		net_dm_works_init(ops);
+		net_dm_stats_reset();
+		rc |= register_trace_kfree_skb(ops->kfree_skb_probe, NULL);
+		rc |= register_trace_napi_poll(ops->napi_poll_probe, NULL);
 		break;
 
 	case TRACE_OFF:
-		rc |= unregister_trace_kfree_skb(trace_kfree_skb_hit, NULL);
-		rc |= unregister_trace_napi_poll(trace_napi_poll_hit, NULL);
+		rc |= unregister_trace_kfree_skb(ops->kfree_skb_probe, NULL);
+		rc |= unregister_trace_napi_poll(ops->napi_poll_probe, NULL);
 
 		tracepoint_synchronize_unregister();
 
+		net_dm_works_flush();
+
 		/*
 		 * Clean the device list
 		 */
@@ -294,10 +653,61 @@ static int set_all_monitor_traces(int state)
 }
 
 
+static int net_dm_alert_mode_set(struct genl_info *info)
+{
+	struct netlink_ext_ack *extack = info->extack;
+	u8 val;
+
+	if (!info->attrs[NET_DM_ATTR_ALERT_MODE])
+		return 0;
+
+	val = nla_get_u8(info->attrs[NET_DM_ATTR_ALERT_MODE]);
+	switch (val) {
+	case NET_DM_ALERT_MODE_SUMMARY:
+	case NET_DM_ALERT_MODE_PACKET:
+		net_dm_alert_mode = val;
+		return 0;
+	default:
+		NL_SET_ERR_MSG_MOD(extack, "Invalid alert mode");
+		return -EINVAL;
+	}
+}
+
 static int net_dm_cmd_config(struct sk_buff *skb,
 			struct genl_info *info)
 {
-	return -ENOTSUPP;
+	struct netlink_ext_ack *extack = info->extack;
+	int rc = 0;
+
+	mutex_lock(&trace_state_mutex);
+
+	if (trace_state == TRACE_ON) {
+		NL_SET_ERR_MSG_MOD(extack, "Cannot configure drop monitor while tracing is on");
+		rc = -EBUSY;
+		goto out_unlock;
+	}
+
+	rc = net_dm_alert_mode_set(info);
+	if (rc)
+		goto out_unlock;
+
+	if (info->attrs[NET_DM_ATTR_TRUNC_LEN])
+		net_dm_trunc_len =
+			nla_get_u32(info->attrs[NET_DM_ATTR_TRUNC_LEN]);
+
+	if (info->attrs[NET_DM_ATTR_QUEUE_LEN])
+		net_dm_queue_len =
+			nla_get_u32(info->attrs[NET_DM_ATTR_QUEUE_LEN]);
+
+	if (info->attrs[NET_DM_ATTR_SAMPLE_RATE])
+		net_dm_sample_rate =
+			max_t(u32, 1,
+			      nla_get_u32(info->attrs[NET_DM_ATTR_SAMPLE_RATE]));
+
+out_unlock:
+	mutex_unlock(&trace_state_mutex);
+
+	return rc;
 }
 
 static int net_dm_cmd_trace(struct sk_buff *skb,
@@ -313,6 +723,191 @@ static int net_dm_cmd_trace(struct sk_buff *skb,
 	return -ENOTSUPP;
 }
 
+static unsigned int net_dm_loc_hist_merge(struct net_dm_loc_stat *hist,
+					  unsigned int n,
+					  const struct net_dm_loc_stat *stat,
+					  u64 *other)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (hist[i].pc == stat->pc) {
+			hist[i].count += stat->count;
+			return n;
+		}
+	}
+
+	if (n == NET_DM_LOC_HIST_MAX) {
+		*other += stat->count;
+		return n;
+	}
+
+	hist[n] = *stat;
+	return n + 1;
+}
+
+static int net_dm_loc_stat_cmp(const void *a, const void *b)
+{
+	const struct net_dm_loc_stat *sa = a, *sb = b;
+
+	if (sa->count == sb->count)
+		return 0;
+	return sa->count > sb->count ? -1 : 1;
+}
+
+static size_t net_dm_stats_size(unsigned int n)
+{
+	size_t size;
+
+	size = nlmsg_msg_size(GENL_HDRLEN + net_drop_monitor_family.hdrsize);
+
+	return NLMSG_ALIGN(size) +
+	       /* NET_DM_ATTR_STATS nest */
+	       nla_total_size(0) +
+	       /* NET_DM_ATTR_STATS_DROPPED */
+	       nla_total_size_64bit(sizeof(u64)) +
+	       /* NET_DM_ATTR_STATS_LOC_OTHER */
+	       nla_total_size_64bit(sizeof(u64)) +
+	       /* NET_DM_ATTR_LOC_HIST nest */
+	       nla_total_size(0) +
+	       /* NET_DM_ATTR_LOC nests */
+	       n * (nla_total_size(0) +
+		    /* NET_DM_ATTR_LOC_PC */
+		    nla_total_size_64bit(sizeof(u64)) +
+		    /* NET_DM_ATTR_LOC_SYMBOL */
+		    nla_total_size(NET_DM_MAX_SYMBOL_LEN + 1) +
+		    /* NET_DM_ATTR_LOC_COUNT */
+		    nla_total_size_64bit(sizeof(u64)));
+}
+
+static int net_dm_loc_put(struct sk_buff *msg,
+			  const struct net_dm_loc_stat *stat)
+{
+	char buf[NET_DM_MAX_SYMBOL_LEN];
+	struct nlattr *attr;
+
+	attr = nla_nest_start(msg, NET_DM_ATTR_LOC);
+	if (!attr)
+		return -EMSGSIZE;
+
+	if (nla_put_u64_64bit(msg, NET_DM_ATTR_LOC_PC,
+			      (u64)(uintptr_t) stat->pc, NET_DM_ATTR_PAD))
+		goto nla_put_failure;
+
+	snprintf(buf, sizeof(buf), "%pS", stat->pc);
+	if (nla_put_string(msg, NET_DM_ATTR_LOC_SYMBOL, buf))
+		goto nla_put_failure;
+
+	if (nla_put_u64_64bit(msg, NET_DM_ATTR_LOC_COUNT, stat->count,
+			      NET_DM_ATTR_PAD))
+		goto nla_put_failure;
+
+	nla_nest_end(msg, attr);
+
+	return 0;
+
+nla_put_failure:
+	nla_nest_cancel(msg, attr);
+	return -EMSGSIZE;
+}
+
+static int net_dm_stats_fill(struct sk_buff *msg, struct genl_info *info,
+			     const struct net_dm_loc_stat *hist,
+			     unsigned int n, u64 other, u64 dropped)
+{
+	struct nlattr *attr;
+	unsigned int i;
+	void *hdr;
+
+	hdr = genlmsg_put_reply(msg, info, &net_drop_monitor_family, 0,
+				NET_DM_CMD_STATS_NEW);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	attr = nla_nest_start(msg, NET_DM_ATTR_STATS);
+	if (!attr)
+		goto nla_put_failure;
+
+	if (nla_put_u64_64bit(msg, NET_DM_ATTR_STATS_DROPPED, dropped,
+			      NET_DM_ATTR_PAD) ||
+	    nla_put_u64_64bit(msg, NET_DM_ATTR_STATS_LOC_OTHER, other,
+			      NET_DM_ATTR_PAD))
+		goto nla_put_failure;
+
+	nla_nest_end(msg, attr);
+
+	attr = nla_nest_start(msg, NET_DM_ATTR_LOC_HIST);
+	if (!attr)
+		goto nla_put_failure;
+
+	for (i = 0; i < n; i++) {
+		if (net_dm_loc_put(msg, &hist[i]))
+			goto nla_put_failure;
+	}
+
+	nla_nest_end(msg, attr);
+
+	genlmsg_end(msg, hdr);
+
+	return 0;
+
+nla_put_failure:
+	genlmsg_cancel(msg, hdr);
+	return -EMSGSIZE;
+}
+
+/* Report the drops seen in packet mode since tracing was last started,
+ * aggregated by drop location and sorted by count.
+ */
+static int net_dm_cmd_stats_get(struct sk_buff *skb, struct genl_info *info)
+{
+	struct net_dm_loc_stat *hist;
+	u64 other = 0, dropped = 0;
+	struct sk_buff *msg;
+	unsigned int n = 0;
+	int cpu, rc;
+
+	hist = kcalloc(NET_DM_LOC_HIST_MAX, sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct per_cpu_dm_data *data = &per_cpu(dm_cpu_data, cpu);
+		unsigned long flags;
+		int i;
+
+		spin_lock_irqsave(&data->lock, flags);
+		for (i = 0; i < NET_DM_LOC_HIST_SIZE; i++) {
+			if (!data->loc_hist[i].pc)
+				continue;
+			n = net_dm_loc_hist_merge(hist, n, &data->loc_hist[i],
+						  &other);
+		}
+		other += data->loc_other;
+		dropped += data->dropped;
+		spin_unlock_irqrestore(&data->lock, flags);
+	}
+
+	sort(hist, n, sizeof(*hist), net_dm_loc_stat_cmp, NULL);
+
+	msg = nlmsg_new(net_dm_stats_size(n), GFP_KERNEL);
+	if (!msg) {
+		rc = -ENOMEM;
+		goto out;
+	}
+
+	rc = net_dm_stats_fill(msg, info, hist, n, other, dropped);
+	if (rc) {
+		nlmsg_free(msg);
+		goto out;
+	}
+
+	rc = genlmsg_reply(msg, info);
+out:
+	kfree(hist);
+	return rc;
+}
+
 static int dropmon_net_event(struct notifier_block *ev_block,
 			     unsigned long event, void *ptr)
 {
@@ -352,10 +947,19 @@ static int dropmon_net_event(struct notifier_block *ev_block,
 	return NOTIFY_DONE;
 }
 
+static const struct nla_policy net_dm_nl_policy[NET_DM_ATTR_MAX + 1] = {
+	[NET_DM_ATTR_ALERT_MODE] = { .type = NLA_U8 },
+	[NET_DM_ATTR_TRUNC_LEN] = { .type = NLA_U32 },
+	[NET_DM_ATTR_QUEUE_LEN] = { .type = NLA_U32 },
+	[NET_DM_ATTR_SAMPLE_RATE] = { .type = NLA_U32 },
+};
+
 static const struct genl_ops dropmon_ops[] = {
 	{
 		.cmd = NET_DM_CMD_CONFIG,
 		.doit = net_dm_cmd_config,
+		.policy = net_dm_nl_policy,
+		.flags = GENL_ADMIN_PERM,
 	},
 	{
 		.cmd = NET_DM_CMD_START,
@@ -365,12 +969,18 @@ static const struct genl_ops dropmon_ops[] = {
 		.cmd = NET_DM_CMD_STOP,
 		.doit = net_dm_cmd_trace,
 	},
+	{
+		.cmd = NET_DM_CMD_STATS_GET,
+		.doit = net_dm_cmd_stats_get,
+		.flags = GENL_ADMIN_PERM,
+	},
 };
 
 static struct genl_family net_drop_monitor_family __ro_after_init = {
 	.hdrsize        = 0,
 	.name           = "NET_DM",
 	.version        = 2,
+	.maxattr	= NET_DM_ATTR_MAX,
 	.module		= THIS_MODULE,
 	.ops		= dropmon_ops,
 	.n_ops		= ARRAY_SIZE(dropmon_ops),
@@ -414,6 +1024,7 @@ static int __init init_net_drop_monitor(void)
 		INIT_WORK(&data->dm_alert_work, send_dm_alert);
 		timer_setup(&data->send_timer, sched_send_work, 0);
 		spin_lock_init(&data->lock);
+		skb_queue_head_init(&data->drop_queue);
 		reset_per_cpu_data(data);
 	}
 
@@ -449,6 +1060,7 @@ static void exit_net_drop_monitor(void)
 		 * to this struct and can free the skb inside it
 		 */
 		kfree_skb(data->skb);
+		skb_queue_purge(&data->drop_queue);
 	}
 
 	BUG_ON(genl_unregister_family(&net_drop_monitor_family));
@@ -2,6 +2,7 @@
 #include <linux/netdevice.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <linux/rtnetlink.h>
 #include <net/wext.h>
 
 #define BUCKET_SPACE (32 - NETDEV_HASHBITS - 1)
@@ -116,6 +117,66 @@ static int dev_seq_show(struct seq_file *seq, void *v)
 	return 0;
 }
 
+static void napi_seq_printf_hist(struct seq_file *seq, const u64 *hist)
+{
+	int i;
+
+	for (i = 0; i < NAPI_STAT_BUCKETS; i++)
+		seq_printf(seq, " %llu", hist[i]);
+}
+
+/*
+ *	One line per NAPI instance: counters, then the log2 histogram of
+ *	packets per poll, then the log2 histogram of schedule to poll
+ *	latency in usecs.
+ */
+/* The NAPI lists of the devices are protected by RTNL */
+static void *napi_seq_start(struct seq_file *seq, loff_t *pos)
+	__acquires(RCU)
+{
+	rtnl_lock();
+	return dev_seq_start(seq, pos);
+}
+
+static void napi_seq_stop(struct seq_file *seq, void *v)
+	__releases(RCU)
+{
+	dev_seq_stop(seq, v);
+	rtnl_unlock();
+}
+
+static int napi_seq_show(struct seq_file *seq, void *v)
+{
+	struct net_device *dev = v;
+	struct napi_struct *n;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(seq, "dev napi_id weight polls packets "
+			   "budget_exhausted squeezed work_hist[%d] "
+			   "sched_lat_usecs_hist[%d]\n",
+			   NAPI_STAT_BUCKETS, NAPI_STAT_BUCKETS);
+		return 0;
+	}
+
+	list_for_each_entry(n, &dev->napi_list, dev_list) {
+		static const struct napi_stats napi_stats_none;
+		const struct napi_stats *stats;
+
+		stats = rcu_dereference(n->stats);
+		if (!stats)
+			stats = &napi_stats_none;
+
+		seq_printf(seq, "%s %u %d %llu %llu %llu %llu",
+			   dev->name, n->napi_id, n->weight,
+			   stats->polls, stats->packets,
+			   stats->budget_exhausted, stats->squeezed);
+		napi_seq_printf_hist(seq, stats->work_hist);
+		napi_seq_printf_hist(seq, stats->sched_lat_hist);
+		seq_putc(seq, '\n');
+	}
+	return 0;
+}
+
 static struct softnet_data *softnet_get_online(loff_t *pos)
 {
 	struct softnet_data *sd = NULL;
@@ -175,6 +236,13 @@ static const struct seq_operations dev_seq_ops = {
 	.show  = dev_seq_show,
 };
 
+static const struct seq_operations napi_seq_ops = {
+	.start = napi_seq_start,
+	.next  = dev_seq_next,
+	.stop  = napi_seq_stop,
+	.show  = napi_seq_show,
+};
+
 static const struct seq_operations softnet_seq_ops = {
 	.start = softnet_seq_start,
 	.next  = softnet_seq_next,
@@ -285,12 +353,17 @@ static int __net_init dev_proc_net_init(struct net *net)
 	if (!proc_create_net("ptype", 0444, net->proc_net, &ptype_seq_ops,
 			sizeof(struct seq_net_private)))
 		goto out_softnet;
+	if (!proc_create_net("napi_stat", 0444, net->proc_net, &napi_seq_ops,
+			sizeof(struct seq_net_private)))
+		goto out_ptype;
 
 	if (wext_proc_init(net))
-		goto out_ptype;
+		goto out_napi;
 	rc = 0;
 out:
 	return rc;
+out_napi:
+	remove_proc_entry("napi_stat", net->proc_net);
 out_ptype:
 	remove_proc_entry("ptype", net->proc_net);
 out_softnet:
@@ -304,6 +377,7 @@ static void __net_exit dev_proc_net_exit(struct net *net)
 {
 	wext_proc_exit(net);
 
+	remove_proc_entry("napi_stat", net->proc_net);
 	remove_proc_entry("ptype", net->proc_net);
 	remove_proc_entry("softnet_stat", net->proc_net);
 	remove_proc_entry("dev", net->proc_net);
@@ -158,6 +158,7 @@
 #include <linux/etherdevice.h>
 #include <linux/kthread.h>
 #include <linux/prefetch.h>
+#include <linux/jhash.h>
 #include <net/net_namespace.h>
 #include <net/checksum.h>
 #include <net/ipv6.h>
@@ -242,14 +243,29 @@ static char *pkt_flag_names[] = {
 #define PKTGEN_MAGIC 0xbe9be955
 #define PG_PROC_DIR "pktgen"
 #define PGCTRL	    "pgctrl"
+#define PGRX	    "pgrx"
 
-#define MAX_CFLOWS  65536
+#define MAX_CFLOWS  (1 << 20)
+#define MAX_FLOW_GROUPS 20
+
+/* Packet sizes leave room for the Ethernet, IPv4 and UDP headers and
+ * keep the IP total length within 16 bits.
+ */
+#define MIN_PKT_SIZE (14 + 20 + 8)
+#define MAX_PKT_SIZE (14 + 0xffff)
+
+#define MAX_IMIX_ENTRIES 20
+#define IMIX_PRECISION 100 /* Precision of IMIX distribution */
 
 #define VLAN_TAG_SIZE(x) ((x)->vlan_id == 0xffff ? 0 : 4)
 #define SVLAN_TAG_SIZE(x) ((x)->svlan_id == 0xffff ? 0 : 4)
 
 struct flow_state {
 	__be32 cur_daddr;
+	__be32 cur_saddr;
+	__u16 cur_udp_src;
+	__u16 cur_udp_dst;
+	__u32 seq;		/* sequence number of the flow's next packet */
 	int count;
 #ifdef CONFIG_XFRM
 	struct xfrm_state *x;
@@ -260,6 +276,19 @@ struct flow_state {
 /* flow flag bits */
 #define F_INIT   (1<<0)		/* flow has been initialized */
 
+struct imix_pkt {
+	u64 size;
+	u64 weight;
+	u64 count_so_far;
+};
+
+/* A run of consecutive flow indices picked with a common weight */
+struct flow_group {
+	unsigned int first;
+	unsigned int count;
+	u64 weight;
+};
+
 struct pktgen_dev {
 	/*
 	 * Try to keep frequent/infrequent used vars. separated.
@@ -279,6 +308,16 @@ struct pktgen_dev {
 	int min_pkt_size;
 	int max_pkt_size;
 	int pkt_overhead;	/* overhead for MPLS, VLANs, IPSEC etc */
+
+	/* IMIX: if n_imix is non-zero, packet sizes are picked from
+	 * imix_entries according to their weights instead of from the
+	 * [min_pkt_size, max_pkt_size] range.  imix_distribution maps a
+	 * random number in [0, IMIX_PRECISION) to an entry index.
+	 */
+	struct imix_pkt imix_entries[MAX_IMIX_ENTRIES];
+	int n_imix;
+	__u8 imix_distribution[IMIX_PRECISION];
+
 	int nfrags;
 	int removal_mark;	/* non-zero => the device is marked for
 				 * removal by worker thread */
@@ -403,11 +442,20 @@ struct pktgen_dev {
 				  */
 	char odevname[32];
 	struct flow_state *flows;
+	unsigned int max_flows;	/* Allocated entries in flows */
 	unsigned int cflows;	/* Concurrent flows (config) */
 	unsigned int lflow;		/* Flow length  (config) */
 	unsigned int nflows;	/* accumulated flows (stats) */
 	unsigned int curfl;		/* current sequenced flow (state)*/
 
+	/* With FLOW_RND, flows are picked from flow_groups according to
+	 * their weights when n_flow_groups is non-zero, and uniformly
+	 * from [0, cflows) otherwise.
+	 */
+	struct flow_group flow_groups[MAX_FLOW_GROUPS];
+	int n_flow_groups;
+	__u8 flow_distribution[IMIX_PRECISION];
+
 	u16 queue_map_min;
 	u16 queue_map_max;
 	__u32 skb_priority;	/* skb priority field */
@@ -434,11 +482,16 @@ struct pktgen_hdr {
 
 static unsigned int pg_net_id __read_mostly;
 
+struct pktgen_rx;
+
 struct pktgen_net {
 	struct net		*net;
 	struct proc_dir_entry	*proc_dir;
 	struct list_head	pktgen_threads;
 	bool			pktgen_exiting;
+	struct mutex		rx_lock;	/* protects rx */
+	struct pktgen_rx	*rx;
+	unsigned int		rx_flows;	/* table size for the next rx */
 };
 
 struct pktgen_thread {
@@ -474,6 +527,7 @@ static int pktgen_device_event(struct notifier_block *, unsigned long, void *);
 static void pktgen_run_all_threads(struct pktgen_net *pn);
 static void pktgen_reset_all_threads(struct pktgen_net *pn);
 static void pktgen_stop_all_threads_ifs(struct pktgen_net *pn);
+static void pktgen_rx_dev_gone(struct pktgen_net *pn, struct net_device *dev);
 
 static void pktgen_stop(struct pktgen_thread *t);
 static void pktgen_clear_counters(struct pktgen_dev *pkt_dev);
@@ -561,6 +615,15 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 		   (unsigned long long)pkt_dev->count, pkt_dev->min_pkt_size,
 		   pkt_dev->max_pkt_size);
 
+	if (pkt_dev->n_imix) {
+		seq_puts(seq, "     imix_weights: ");
+		for (i = 0; i < pkt_dev->n_imix; i++)
+			seq_printf(seq, "%llu,%llu ",
+				   pkt_dev->imix_entries[i].size,
+				   pkt_dev->imix_entries[i].weight);
+		seq_puts(seq, "\n");
+	}
+
 	seq_printf(seq,
 		   "     frags: %d  delay: %llu  clone_skb: %d  ifname: %s\n",
 		   pkt_dev->nfrags, (unsigned long long) pkt_dev->delay,
@@ -569,6 +632,15 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 	seq_printf(seq, "     flows: %u flowlen: %u\n", pkt_dev->cflows,
 		   pkt_dev->lflow);
 
+	if (pkt_dev->n_flow_groups) {
+		seq_puts(seq, "     flow_weights: ");
+		for (i = 0; i < pkt_dev->n_flow_groups; i++)
+			seq_printf(seq, "%u,%llu ",
+				   pkt_dev->flow_groups[i].count,
+				   pkt_dev->flow_groups[i].weight);
+		seq_puts(seq, "\n");
+	}
+
 	seq_printf(seq,
 		   "     queue_map_min: %u  queue_map_max: %u\n",
 		   pkt_dev->queue_map_min,
@@ -678,6 +750,15 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 		   (unsigned long long)pkt_dev->sofar,
 		   (unsigned long long)pkt_dev->errors);
 
+	if (pkt_dev->n_imix) {
+		seq_puts(seq, "     imix_size_counts: ");
+		for (i = 0; i < pkt_dev->n_imix; i++)
+			seq_printf(seq, "%llu,%llu ",
+				   pkt_dev->imix_entries[i].size,
+				   pkt_dev->imix_entries[i].count_so_far);
+		seq_puts(seq, "\n");
+	}
+
 	seq_printf(seq,
 		   "     started: %lluus  stopped: %lluus idle: %lluus\n",
 		   (unsigned long long) ktime_to_us(pkt_dev->started_at),
@@ -830,6 +911,239 @@ static ssize_t get_labels(const char __user *buffer, struct pktgen_dev *pkt_dev)
 	return i;
 }
 
+/* Parse "size_1,weight_1 size_2,weight_2 ..." as written to the
+ * imix_weights parameter, e.g.
+ *
+ *	echo "imix_weights 64,7 576,4 1500,1" > /proc/net/pktgen/eth0
+ *
+ * Up to MAX_IMIX_ENTRIES pairs are accepted; sizes are clamped like
+ * pkt_size and weights must be non-zero.  Each packet then picks its
+ * size with probability weight_i / sum(weights), overriding
+ * min_pkt_size/max_pkt_size.  IMIX cannot be combined with clone_skb.
+ *
+ * An empty list or a lone "0" turns IMIX off again.
+ */
+static ssize_t get_imix_entries(const char __user *buffer, size_t maxlen,
+				struct pktgen_dev *pkt_dev)
+{
+	struct imix_pkt entries[MAX_IMIX_ENTRIES];
+	const int max_digits = 10;
+	int n = 0;
+	ssize_t i = 0;
+	long len;
+	char c;
+
+	if (!maxlen)
+		goto out;
+
+	do {
+		unsigned long weight;
+		unsigned long size;
+
+		if (n == MAX_IMIX_ENTRIES)
+			return -E2BIG;
+
+		len = num_arg(&buffer[i], max_digits, &size);
+		if (len <= 0)
+			return len ? len : -EINVAL;
+		i += len;
+		if (i == maxlen)
+			c = '\n';
+		else if (get_user(c, &buffer[i]))
+			return -EFAULT;
+		if (!n && !size && c != ',')
+			goto out;
+		/* Check for comma between size_i and weight_i */
+		if (c != ',')
+			return -EINVAL;
+		i++;
+
+		size = clamp_t(unsigned long, size, MIN_PKT_SIZE, MAX_PKT_SIZE);
+
+		len = num_arg(&buffer[i], max_digits, &weight);
+		if (len <= 0)
+			return len ? len : -EINVAL;
+		if (!weight)
+			return -EINVAL;
+
+		entries[n].size = size;
+		entries[n].weight = weight;
+		entries[n].count_so_far = 0;
+		n++;
+
+		i += len;
+		if (i == maxlen)
+			break;
+		if (get_user(c, &buffer[i]))
+			return -EFAULT;
+		i++;
+	} while (c == ' ' && i < maxlen);
+
+	if (pkt_dev->clone_skb > 0)
+		return -EINVAL;
+
+	memcpy(pkt_dev->imix_entries, entries, n * sizeof(entries[0]));
+out:
+	/* Go back to the configured size once IMIX is turned off */
+	if (!n && pkt_dev->n_imix)
+		pkt_dev->cur_pkt_size = pkt_dev->min_pkt_size;
+	pkt_dev->n_imix = n;
+	return i;
+}
+
+/* Map [0, IMIX_PRECISION) onto indices 0..n-1 in proportion to weights */
+static void fill_distribution(__u8 *distribution, const u64 *weights, int n)
+{
+	int cumulative_probabilities[MAX_IMIX_ENTRIES];
+	u64 cumulative_prob = 0;
+	u64 total_weight = 0;
+	int i, j = 0;
+
+	for (i = 0; i < n; i++)
+		total_weight += weights[i];
+
+	/* Fill cumulative_probabilities with sum of normalized probabilities */
+	for (i = 0; i < n - 1; i++) {
+		cumulative_prob += div64_u64(weights[i] * IMIX_PRECISION,
+					     total_weight);
+		cumulative_probabilities[i] = cumulative_prob;
+	}
+	cumulative_probabilities[n - 1] = IMIX_PRECISION;
+
+	for (i = 0; i < IMIX_PRECISION; i++) {
+		while (j < n - 1 && i >= cumulative_probabilities[j])
+			j++;
+		distribution[i] = j;
+	}
+}
+
+static void fill_imix_distribution(struct pktgen_dev *pkt_dev)
+{
+	u64 weights[MAX_IMIX_ENTRIES];
+	int i;
+
+	for (i = 0; i < pkt_dev->n_imix; i++)
+		weights[i] = pkt_dev->imix_entries[i].weight;
+
+	fill_distribution(pkt_dev->imix_distribution, weights,
+			  pkt_dev->n_imix);
+}
+
+/* Parse "count_1,weight_1 count_2,weight_2 ..." as written to the
+ * flow_weights parameter, e.g.
+ *
+ *	echo "flows 1000000" > /proc/net/pktgen/eth0
+ *	echo "flow_weights 1000,80 999000,20" > /proc/net/pktgen/eth0
+ *
+ * The groups cover consecutive flow indices starting at 0 and must fit
+ * in the configured number of flows.  With FLOW_RND a group is picked
+ * with probability weight_i / sum(weights) and a flow uniformly within
+ * it; the example sends 80% of the packets on the first 1000 flows.
+ * Sequential flows ignore the weights.  An empty list or a lone "0"
+ * goes back to uniform selection.
+ */
+static ssize_t get_flow_weights(const char __user *buffer, size_t maxlen,
+				struct pktgen_dev *pkt_dev)
+{
+	struct flow_group groups[MAX_FLOW_GROUPS];
+	const int max_digits = 10;
+	unsigned int first = 0;
+	int n = 0;
+	ssize_t i = 0;
+	long len;
+	char c;
+
+	if (!maxlen)
+		goto out;
+
+	do {
+		unsigned long weight;
+		unsigned long cnt;
+
+		if (n == MAX_FLOW_GROUPS)
+			return -E2BIG;
+
+		len = num_arg(&buffer[i], max_digits, &cnt);
+		if (len <= 0)
+			return len ? len : -EINVAL;
+		i += len;
+		if (i == maxlen)
+			c = '\n';
+		else if (get_user(c, &buffer[i]))
+			return -EFAULT;
+		if (!n && !cnt && c != ',')
+			goto out;
+		/* Check for comma between count_i and weight_i */
+		if (c != ',')
+			return -EINVAL;
+		i++;
+
+		if (!cnt || cnt > pkt_dev->cflows - first)
+			return -EINVAL;
+
+		len = num_arg(&buffer[i], max_digits, &weight);
+		if (len <= 0)
+			return len ? len : -EINVAL;
+		if (!weight)
+			return -EINVAL;
+
+		groups[n].first = first;
+		groups[n].count = cnt;
+		groups[n].weight = weight;
+		first += cnt;
+		n++;
+
+		i += len;
+		if (i == maxlen)
+			break;
+		if (get_user(c, &buffer[i]))
+			return -EFAULT;
+		i++;
+	} while (c == ' ' && i < maxlen);
+
+	memcpy(pkt_dev->flow_groups, groups, n * sizeof(groups[0]));
+out:
+	pkt_dev->n_flow_groups = n;
+	return i;
+}
+
+static void fill_flow_distribution(struct pktgen_dev *pkt_dev)
+{
+	u64 weights[MAX_FLOW_GROUPS];
+	int i;
+
+	for (i = 0; i < pkt_dev->n_flow_groups; i++)
+		weights[i] = pkt_dev->flow_groups[i].weight;
+
+	fill_distribution(pkt_dev->flow_distribution, weights,
+			  pkt_dev->n_flow_groups);
+}
+
+/* The flow table is sized on demand so that devices which never use
+ * many flows do not pay for MAX_CFLOWS entries.  It never shrinks, so
+ * free_SAs() still finds the IPsec states of entries beyond cflows.
+ */
+static int pktgen_grow_flows(struct pktgen_dev *pkt_dev, unsigned int n)
+{
+	int node = cpu_to_node(pkt_dev->pg_thread->cpu);
+	struct flow_state *flows;
+
+	if (pkt_dev->running)
+		return -EBUSY;
+
+	flows = vzalloc_node(array_size(n, sizeof(struct flow_state)), node);
+	if (!flows)
+		return -ENOMEM;
+
+	memcpy(flows, pkt_dev->flows,
+	       pkt_dev->max_flows * sizeof(struct flow_state));
+	vfree(pkt_dev->flows);
+	pkt_dev->flows = flows;
+	pkt_dev->max_flows = n;
+
+	return 0;
+}
+
 static __u32 pktgen_read_flag(const char *f, bool *disable)
 {
 	__u32 i;
@@ -922,8 +1236,8 @@ static ssize_t pktgen_if_write(struct file *file,
 			return len;
 
 		i += len;
-		if (value < 14 + 20 + 8)
-			value = 14 + 20 + 8;
+		value = clamp_t(unsigned long, value,
+				MIN_PKT_SIZE, MAX_PKT_SIZE);
 		if (value != pkt_dev->min_pkt_size) {
 			pkt_dev->min_pkt_size = value;
 			pkt_dev->cur_pkt_size = value;
@@ -939,8 +1253,8 @@ static ssize_t pktgen_if_write(struct file *file,
 			return len;
 
 		i += len;
-		if (value < 14 + 20 + 8)
-			value = 14 + 20 + 8;
+		value = clamp_t(unsigned long, value,
+				MIN_PKT_SIZE, MAX_PKT_SIZE);
 		if (value != pkt_dev->max_pkt_size) {
 			pkt_dev->max_pkt_size = value;
 			pkt_dev->cur_pkt_size = value;
@@ -958,8 +1272,8 @@ static ssize_t pktgen_if_write(struct file *file,
 			return len;
 
 		i += len;
-		if (value < 14 + 20 + 8)
-			value = 14 + 20 + 8;
+		value = clamp_t(unsigned long, value,
+				MIN_PKT_SIZE, MAX_PKT_SIZE);
 		if (value != pkt_dev->min_pkt_size) {
 			pkt_dev->min_pkt_size = value;
 			pkt_dev->max_pkt_size = value;
@@ -1095,6 +1409,9 @@ static ssize_t pktgen_if_write(struct file *file,
 		    ((pkt_dev->xmit_mode == M_NETIF_RECEIVE) ||
 		     !(pkt_dev->odev->priv_flags & IFF_TX_SKB_SHARING)))
 			return -ENOTSUPP;
+		/* a cloned skb cannot change size */
+		if (value > 0 && pkt_dev->n_imix)
+			return -EINVAL;
 		i += len;
 		pkt_dev->clone_skb = value;
 
@@ -1476,10 +1793,33 @@ static ssize_t pktgen_if_write(struct file *file,
 		if (value > MAX_CFLOWS)
 			value = MAX_CFLOWS;
 
+		if (value > pkt_dev->max_flows) {
+			int err = pktgen_grow_flows(pkt_dev, value);
+
+			if (err)
+				return err;
+		}
+
 		pkt_dev->cflows = value;
+		/* The weighted groups must stay within the flows */
+		pkt_dev->n_flow_groups = 0;
 		sprintf(pg_result, "OK: flows=%u", pkt_dev->cflows);
 		return count;
 	}
+
+	if (!strcmp(name, "flow_weights")) {
+		len = get_flow_weights(&user_buffer[i], count - i, pkt_dev);
+		if (len < 0)
+			return len;
+
+		if (pkt_dev->n_flow_groups)
+			fill_flow_distribution(pkt_dev);
+
+		i += len;
+		sprintf(pg_result, "OK: flow_weights=%d groups",
+			pkt_dev->n_flow_groups);
+		return count;
+	}
 #ifdef CONFIG_XFRM
 	if (!strcmp(name, "spi")) {
 		len = num_arg(&user_buffer[i], 10, &value);
@@ -1525,6 +1865,20 @@ static ssize_t pktgen_if_write(struct file *file,
 		return count;
 	}
 
+	if (!strcmp(name, "imix_weights")) {
+		len = get_imix_entries(&user_buffer[i], count - i, pkt_dev);
+		if (len < 0)
+			return len;
+
+		if (pkt_dev->n_imix)
+			fill_imix_distribution(pkt_dev);
+
+		i += len;
+		sprintf(pg_result, "OK: imix_weights=%d entries",
+			pkt_dev->n_imix);
+		return count;
+	}
+
 	if (!strcmp(name, "mpls")) {
 		unsigned int n, cnt;
 
@@ -1966,6 +2320,7 @@ static int pktgen_device_event(struct notifier_block *unused,
 
 	case NETDEV_UNREGISTER:
 		pktgen_mark_device(pn, dev->name);
+		pktgen_rx_dev_gone(pn, dev);
 		break;
 	}
 
@@ -2224,7 +2579,15 @@ static inline int f_pick(struct pktgen_dev *pkt_dev)
 				pkt_dev->curfl = 0; /*reset */
 		}
 	} else {
-		flow = prandom_u32() % pkt_dev->cflows;
+		if (pkt_dev->n_flow_groups) {
+			const struct flow_group *g;
+
+			g = &pkt_dev->flow_groups[pkt_dev->flow_distribution[
+				prandom_u32() % IMIX_PRECISION]];
+			flow = g->first + prandom_u32() % g->count;
+		} else {
+			flow = prandom_u32() % pkt_dev->cflows;
+		}
 		pkt_dev->curfl = flow;
 
 		if (pkt_dev->flows[flow].count > pkt_dev->lflow) {
@@ -2302,9 +2665,13 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 	__u32 imn;
 	__u32 imx;
 	int flow = 0;
+	bool seen = false;
 
-	if (pkt_dev->cflows)
+	if (pkt_dev->cflows) {
 		flow = f_pick(pkt_dev);
+		/* A known IPv4 flow reuses its 5-tuple, see below */
+		seen = f_seen(pkt_dev, flow);
+	}
 
 	/*  Deal with source MAC */
 	if (pkt_dev->src_mac_count > 1) {
@@ -2377,7 +2744,7 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 		pkt_dev->svlan_id = prandom_u32() & (4096 - 1);
 	}
 
-	if (pkt_dev->udp_src_min < pkt_dev->udp_src_max) {
+	if (!seen && pkt_dev->udp_src_min < pkt_dev->udp_src_max) {
 		if (pkt_dev->flags & F_UDPSRC_RND)
 			pkt_dev->cur_udp_src = prandom_u32() %
 				(pkt_dev->udp_src_max - pkt_dev->udp_src_min)
@@ -2390,7 +2757,7 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 		}
 	}
 
-	if (pkt_dev->udp_dst_min < pkt_dev->udp_dst_max) {
+	if (!seen && pkt_dev->udp_dst_min < pkt_dev->udp_dst_max) {
 		if (pkt_dev->flags & F_UDPDST_RND) {
 			pkt_dev->cur_udp_dst = prandom_u32() %
 				(pkt_dev->udp_dst_max - pkt_dev->udp_dst_min)
@@ -2406,7 +2773,7 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 
 		imn = ntohl(pkt_dev->saddr_min);
 		imx = ntohl(pkt_dev->saddr_max);
-		if (imn < imx) {
+		if (!seen && imn < imx) {
 			__u32 t;
 			if (pkt_dev->flags & F_IPSRC_RND)
 				t = prandom_u32() % (imx - imn) + imn;
@@ -2420,8 +2787,11 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 			pkt_dev->cur_saddr = htonl(t);
 		}
 
-		if (pkt_dev->cflows && f_seen(pkt_dev, flow)) {
+		if (seen) {
 			pkt_dev->cur_daddr = pkt_dev->flows[flow].cur_daddr;
+			pkt_dev->cur_saddr = pkt_dev->flows[flow].cur_saddr;
+			pkt_dev->cur_udp_src = pkt_dev->flows[flow].cur_udp_src;
+			pkt_dev->cur_udp_dst = pkt_dev->flows[flow].cur_udp_dst;
 		} else {
 			imn = ntohl(pkt_dev->daddr_min);
 			imx = ntohl(pkt_dev->daddr_max);
@@ -2453,6 +2823,12 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 				pkt_dev->flows[flow].flags |= F_INIT;
 				pkt_dev->flows[flow].cur_daddr =
 				    pkt_dev->cur_daddr;
+				pkt_dev->flows[flow].cur_saddr =
+				    pkt_dev->cur_saddr;
+				pkt_dev->flows[flow].cur_udp_src =
+				    pkt_dev->cur_udp_src;
+				pkt_dev->flows[flow].cur_udp_dst =
+				    pkt_dev->cur_udp_dst;
 #ifdef CONFIG_XFRM
 				if (pkt_dev->flags & F_IPSEC)
 					get_ipsec_sa(pkt_dev, flow);
@@ -2476,7 +2852,15 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 		}
 	}
 
-	if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
+	if (pkt_dev->n_imix) {
+		__u8 entry_index;
+
+		entry_index = pkt_dev->imix_distribution[prandom_u32() %
+							 IMIX_PRECISION];
+		/* Only size is changed, fixed Ethernet header etc. */
+		pkt_dev->cur_pkt_size = pkt_dev->imix_entries[entry_index].size;
+		pkt_dev->imix_entries[entry_index].count_so_far++;
+	} else if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
 		__u32 t;
 		if (pkt_dev->flags & F_TXSIZE_RND) {
 			t = prandom_u32() %
@@ -2543,15 +2927,14 @@ static int pktgen_output_ipsec(struct sk_buff *skb, struct pktgen_dev *pkt_dev)
 
 static void free_SAs(struct pktgen_dev *pkt_dev)
 {
-	if (pkt_dev->cflows) {
-		/* let go of the SAs if we have them */
-		int i;
-		for (i = 0; i < pkt_dev->cflows; i++) {
-			struct xfrm_state *x = pkt_dev->flows[i].x;
-			if (x) {
-				xfrm_state_put(x);
-				pkt_dev->flows[i].x = NULL;
-			}
+	/* let go of the SAs if we have them */
+	int i;
+
+	for (i = 0; i < pkt_dev->max_flows; i++) {
+		struct xfrm_state *x = pkt_dev->flows[i].x;
+		if (x) {
+			xfrm_state_put(x);
+			pkt_dev->flows[i].x = NULL;
 		}
 	}
 }
@@ -2677,7 +3060,13 @@ static void pktgen_finalize_skb(struct pktgen_dev *pkt_dev, struct sk_buff *skb,
 	 * convert them to network byte order
 	 */
 	pgh->pgh_magic = htonl(PKTGEN_MAGIC);
-	pgh->seq_num = htonl(pkt_dev->seq_num);
+	/* IPv4 flows number their own packets so that the receiver can
+	 * account loss per 5-tuple.
+	 */
+	if (pkt_dev->cflows && !(pkt_dev->flags & F_IPV6))
+		pgh->seq_num = htonl(pkt_dev->flows[pkt_dev->curfl].seq++);
+	else
+		pgh->seq_num = htonl(pkt_dev->seq_num);
 
 	if (pkt_dev->flags & F_NO_TIMESTAMP) {
 		pgh->tv_sec = 0;
@@ -3603,13 +3992,13 @@ static int pktgen_add_device(struct pktgen_thread *t, const char *ifname)
 		return -ENOMEM;
 
 	strcpy(pkt_dev->odevname, ifname);
-	pkt_dev->flows = vzalloc_node(array_size(MAX_CFLOWS,
-						 sizeof(struct flow_state)),
-				      node);
+	/* Flow 0 is always used; "flows" grows the table as needed */
+	pkt_dev->flows = vzalloc_node(sizeof(struct flow_state), node);
 	if (pkt_dev->flows == NULL) {
 		kfree(pkt_dev);
 		return -ENOMEM;
 	}
+	pkt_dev->max_flows = 1;
 
 	pkt_dev->removal_mark = 0;
 	pkt_dev->nfrags = 0;
@@ -3777,6 +4166,451 @@ static int pktgen_remove_device(struct pktgen_thread *t,
 	return 0;
 }
 
+/*
+ * Receive side: "start <ifname>" written to /proc/net/pktgen/pgrx hooks
+ * IPv4 packets on that device and accounts the ones that carry a pktgen
+ * header.  Loss and reordering are tracked per 5-tuple from the sequence
+ * numbers, so the sender must either use a fixed 5-tuple or "flows".
+ * Latency is taken from the transmit timestamp and only makes sense when
+ * both ends share a clock, e.g. with xmit_mode netif_receive or across a
+ * forwarding path on the same host.
+ */
+
+#define PKTGEN_RX_WAYS		8	/* flows per hash bucket */
+#define PKTGEN_RX_LOCKS		256
+#define PKTGEN_RX_DEF_FLOWS	65536
+#define PKTGEN_RX_LAT_BUCKETS	24	/* log2 of the latency in usec */
+
+struct pktgen_rx_flow {
+	__be32 saddr;
+	__be32 daddr;
+	__be16 sport;
+	__be16 dport;
+	__u32 next_seq;
+	__u64 packets;		/* zero for a free entry */
+	__u64 lost;
+	__u64 reordered;
+};
+
+struct pktgen_rx_stats {
+	__u64 packets;
+	__u64 bytes;
+	__u64 untracked;	/* packets of flows that did not fit */
+	__u64 latency[PKTGEN_RX_LAT_BUCKETS];
+};
+
+struct pktgen_rx {
+	struct packet_type pt;
+	struct net_device *dev;		/* NULL once stopped */
+	char ifname[IFNAMSIZ];
+	struct pktgen_rx_stats __percpu *stats;
+	struct pktgen_rx_flow *flows;
+	unsigned int nr_buckets;
+	spinlock_t locks[PKTGEN_RX_LOCKS];
+};
+
+static unsigned int pktgen_rx_nr_flows(const struct pktgen_rx *rx)
+{
+	return rx->nr_buckets * PKTGEN_RX_WAYS;
+}
+
+static spinlock_t *pktgen_rx_lock(struct pktgen_rx *rx, unsigned int slot)
+{
+	return &rx->locks[(slot / PKTGEN_RX_WAYS) % PKTGEN_RX_LOCKS];
+}
+
+static void pktgen_rx_account(struct pktgen_rx *rx,
+			      struct pktgen_rx_stats *stats,
+			      const struct iphdr *iph,
+			      const struct udphdr *uh, u32 seq)
+{
+	u32 ports = (__force u32)uh->source << 16 | (__force u32)uh->dest;
+	unsigned int slot;
+	struct pktgen_rx_flow *f;
+	spinlock_t *lock;
+	int i;
+
+	slot = jhash_3words((__force u32)iph->saddr, (__force u32)iph->daddr,
+			    ports, 0) & (rx->nr_buckets - 1);
+	slot *= PKTGEN_RX_WAYS;
+	f = &rx->flows[slot];
+	lock = pktgen_rx_lock(rx, slot);
+
+	spin_lock(lock);
+	/* Entries are only freed all at once, so the first free entry ends
+	 * the bucket.
+	 */
+	for (i = 0; i < PKTGEN_RX_WAYS; i++, f++) {
+		if (!f->packets) {
+			f->saddr = iph->saddr;
+			f->daddr = iph->daddr;
+			f->sport = uh->source;
+			f->dport = uh->dest;
+			f->next_seq = seq;
+			goto found;
+		}
+		if (f->saddr == iph->saddr && f->daddr == iph->daddr &&
+		    f->sport == uh->source && f->dport == uh->dest)
+			goto found;
+	}
+	spin_unlock(lock);
+	stats->untracked++;
+	return;
+
+found:
+	f->packets++;
+	if ((s32)(seq - f->next_seq) >= 0) {
+		f->lost += seq - f->next_seq;
+		f->next_seq = seq + 1;
+	} else {
+		/* A late packet that was already counted as lost */
+		f->reordered++;
+		if (f->lost)
+			f->lost--;
+	}
+	spin_unlock(lock);
+}
+
+static int pktgen_rx_rcv(struct sk_buff *skb, struct net_device *dev,
+			 struct packet_type *pt, struct net_device *orig_dev)
+{
+	struct pktgen_rx *rx = container_of(pt, struct pktgen_rx, pt);
+	struct pktgen_rx_stats *stats;
+	struct pktgen_hdr _pgh, *pgh;
+	struct udphdr _uh, *uh;
+	struct iphdr _iph, *iph;
+	unsigned int off;
+
+	iph = skb_header_pointer(skb, 0, sizeof(_iph), &_iph);
+	if (!iph || iph->ihl < 5 || iph->protocol != IPPROTO_UDP ||
+	    ip_is_fragment(iph))
+		goto out;
+
+	off = iph->ihl * 4;
+	uh = skb_header_pointer(skb, off, sizeof(_uh), &_uh);
+	if (!uh)
+		goto out;
+
+	pgh = skb_header_pointer(skb, off + sizeof(_uh), sizeof(_pgh), &_pgh);
+	if (!pgh || pgh->pgh_magic != htonl(PKTGEN_MAGIC))
+		goto out;
+
+	stats = this_cpu_ptr(rx->stats);
+	stats->packets++;
+	stats->bytes += skb->len;
+
+	if (pgh->tv_sec || pgh->tv_usec) {
+		ktime_t sent = ktime_set(ntohl(pgh->tv_sec),
+					 ntohl(pgh->tv_usec) * NSEC_PER_USEC);
+		s64 us = ktime_us_delta(ktime_get_real(), sent);
+
+		/* Bucket n > 0 holds [2^(n-1), 2^n) usec */
+		if (us >= 0)
+			stats->latency[min_t(int, us ? ilog2((u64)us) + 1 : 0,
+					     PKTGEN_RX_LAT_BUCKETS - 1)]++;
+	}
+
+	pktgen_rx_account(rx, stats, iph, uh, ntohl(pgh->seq_num));
+out:
+	consume_skb(skb);
+	return NET_RX_SUCCESS;
+}
+
+static void pktgen_rx_detach(struct pktgen_rx *rx)
+{
+	if (!rx->dev)
+		return;
+
+	dev_remove_pack(&rx->pt);
+	dev_put(rx->dev);
+	rx->dev = NULL;
+}
+
+static void pktgen_rx_free(struct pktgen_rx *rx)
+{
+	if (!rx)
+		return;
+
+	pktgen_rx_detach(rx);
+	free_percpu(rx->stats);
+	vfree(rx->flows);
+	kfree(rx);
+}
+
+static void pktgen_rx_dev_gone(struct pktgen_net *pn, struct net_device *dev)
+{
+	mutex_lock(&pn->rx_lock);
+	if (pn->rx && pn->rx->dev == dev)
+		pktgen_rx_detach(pn->rx);
+	mutex_unlock(&pn->rx_lock);
+}
+
+/* Called with rx_lock held; the results of a previous run are dropped */
+static int pktgen_rx_start(struct pktgen_net *pn, const char *ifname)
+{
+	struct net_device *dev;
+	struct pktgen_rx *rx;
+	int i;
+
+	dev = dev_get_by_name(pn->net, ifname);
+	if (!dev)
+		return -ENODEV;
+
+	rx = kzalloc(sizeof(*rx), GFP_KERNEL);
+	if (!rx)
+		goto err_put;
+
+	rx->nr_buckets = pn->rx_flows / PKTGEN_RX_WAYS;
+	rx->flows = vzalloc(array_size(pktgen_rx_nr_flows(rx),
+				       sizeof(struct pktgen_rx_flow)));
+	rx->stats = alloc_percpu(struct pktgen_rx_stats);
+	if (!rx->flows || !rx->stats)
+		goto err_free;
+
+	for (i = 0; i < PKTGEN_RX_LOCKS; i++)
+		spin_lock_init(&rx->locks[i]);
+
+	strlcpy(rx->ifname, dev->name, sizeof(rx->ifname));
+	rx->dev = dev;
+	rx->pt.type = htons(ETH_P_IP);
+	rx->pt.dev = dev;
+	rx->pt.func = pktgen_rx_rcv;
+
+	pktgen_rx_free(pn->rx);
+	pn->rx = rx;
+	dev_add_pack(&rx->pt);
+
+	return 0;
+
+err_free:
+	free_percpu(rx->stats);
+	vfree(rx->flows);
+	kfree(rx);
+err_put:
+	dev_put(dev);
+	return -ENOMEM;
+}
+
+/* Called with rx_lock held */
+static void pktgen_rx_reset(struct pktgen_rx *rx)
+{
+	int cpu;
+
+	/* Unhook while clearing so the counters start from a clean slate */
+	if (rx->dev)
+		dev_remove_pack(&rx->pt);
+
+	memset(rx->flows, 0,
+	       pktgen_rx_nr_flows(rx) * sizeof(struct pktgen_rx_flow));
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(rx->stats, cpu), 0,
+		       sizeof(struct pktgen_rx_stats));
+
+	if (rx->dev)
+		dev_add_pack(&rx->pt);
+}
+
+static void pktgen_rx_show_summary(struct seq_file *seq, struct pktgen_rx *rx)
+{
+	u64 lost = 0, reordered = 0;
+	struct pktgen_rx_stats sum;
+	unsigned int i, nflows = 0;
+	int cpu;
+
+	memset(&sum, 0, sizeof(sum));
+	for_each_possible_cpu(cpu) {
+		const struct pktgen_rx_stats *s = per_cpu_ptr(rx->stats, cpu);
+
+		sum.packets += s->packets;
+		sum.bytes += s->bytes;
+		sum.untracked += s->untracked;
+		for (i = 0; i < PKTGEN_RX_LAT_BUCKETS; i++)
+			sum.latency[i] += s->latency[i];
+	}
+
+	for (i = 0; i < pktgen_rx_nr_flows(rx); i++) {
+		const struct pktgen_rx_flow *f = &rx->flows[i];
+		spinlock_t *lock = pktgen_rx_lock(rx, i);
+
+		spin_lock_bh(lock);
+		if (f->packets) {
+			nflows++;
+			lost += f->lost;
+			reordered += f->reordered;
+		}
+		spin_unlock_bh(lock);
+	}
+
+	seq_printf(seq, "RX: %s%s  flows: %u/%u  untracked: %llu\n",
+		   rx->ifname, rx->dev ? "" : " (stopped)", nflows,
+		   pktgen_rx_nr_flows(rx), sum.untracked);
+	seq_printf(seq, "     packets: %llu  bytes: %llu  lost: %llu  reordered: %llu\n",
+		   sum.packets, sum.bytes, lost, reordered);
+
+	seq_puts(seq, "     latency_usec:");
+	for (i = 0; i < PKTGEN_RX_LAT_BUCKETS; i++) {
+		if (!sum.latency[i])
+			continue;
+		if (i == PKTGEN_RX_LAT_BUCKETS - 1)
+			seq_printf(seq, " [%u,inf):%llu", 1U << (i - 1),
+				   sum.latency[i]);
+		else
+			seq_printf(seq, " [%u,%u):%llu", i ? 1U << (i - 1) : 0,
+				   1U << i, sum.latency[i]);
+	}
+	seq_puts(seq, "\n");
+}
+
+/* *pos is 0 for the summary and slot + 1 for a flow */
+static void *pktgen_rx_seq_find(struct pktgen_rx *rx, loff_t *pos)
+{
+	unsigned int slot;
+
+	for (slot = *pos - 1; slot < pktgen_rx_nr_flows(rx); slot++) {
+		if (READ_ONCE(rx->flows[slot].packets)) {
+			*pos = slot + 1;
+			return &rx->flows[slot];
+		}
+	}
+
+	return NULL;
+}
+
+static void *pktgen_rx_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct pktgen_net *pn = seq->private;
+
+	mutex_lock(&pn->rx_lock);
+	if (!*pos)
+		return SEQ_START_TOKEN;
+	if (!pn->rx)
+		return NULL;
+
+	return pktgen_rx_seq_find(pn->rx, pos);
+}
+
+static void *pktgen_rx_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct pktgen_net *pn = seq->private;
+
+	++*pos;
+	if (!pn->rx)
+		return NULL;
+
+	return pktgen_rx_seq_find(pn->rx, pos);
+}
+
+static void pktgen_rx_seq_stop(struct seq_file *seq, void *v)
+{
+	struct pktgen_net *pn = seq->private;
+
+	mutex_unlock(&pn->rx_lock);
+}
+
+static int pktgen_rx_seq_show(struct seq_file *seq, void *v)
+{
+	struct pktgen_net *pn = seq->private;
+	struct pktgen_rx *rx = pn->rx;
+	struct pktgen_rx_flow f;
+	spinlock_t *lock;
+
+	if (v == SEQ_START_TOKEN) {
+		if (rx)
+			pktgen_rx_show_summary(seq, rx);
+		else
+			seq_puts(seq, "RX: off\n");
+		return 0;
+	}
+
+	lock = pktgen_rx_lock(rx, (struct pktgen_rx_flow *)v - rx->flows);
+	spin_lock_bh(lock);
+	f = *(struct pktgen_rx_flow *)v;
+	spin_unlock_bh(lock);
+
+	seq_printf(seq, "     %pI4:%u -> %pI4:%u  rx: %llu  lost: %llu  reordered: %llu\n",
+		   &f.saddr, ntohs(f.sport), &f.daddr, ntohs(f.dport),
+		   f.packets, f.lost, f.reordered);
+	return 0;
+}
+
+static const struct seq_operations pktgen_rx_seq_ops = {
+	.start	= pktgen_rx_seq_start,
+	.next	= pktgen_rx_seq_next,
+	.stop	= pktgen_rx_seq_stop,
+	.show	= pktgen_rx_seq_show,
+};
+
+static int pgrx_open(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq;
+	int ret;
+
+	ret = seq_open(file, &pktgen_rx_seq_ops);
+	if (ret)
+		return ret;
+
+	seq = file->private_data;
+	seq->private = PDE_DATA(inode);
+	return 0;
+}
+
+/* Commands: "start <ifname>", "stop", "reset" and "flows <n>", the
+ * latter sizing the flow table of the next start.
+ */
+static ssize_t pgrx_write(struct file *file, const char __user *buf,
+			  size_t count, loff_t *ppos)
+{
+	struct seq_file *seq = file->private_data;
+	struct pktgen_net *pn = seq->private;
+	unsigned int value;
+	char data[128];
+	int ret = 0;
+
+	if (!capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	if (count == 0)
+		return -EINVAL;
+
+	if (count > sizeof(data))
+		count = sizeof(data);
+
+	if (copy_from_user(data, buf, count))
+		return -EFAULT;
+
+	data[count - 1] = 0;	/* Strip trailing '\n' and terminate string */
+
+	mutex_lock(&pn->rx_lock);
+	if (!strncmp(data, "start ", 6)) {
+		ret = pktgen_rx_start(pn, skip_spaces(data + 6));
+	} else if (!strcmp(data, "stop")) {
+		if (pn->rx)
+			pktgen_rx_detach(pn->rx);
+	} else if (!strcmp(data, "reset")) {
+		if (pn->rx)
+			pktgen_rx_reset(pn->rx);
+	} else if (!strncmp(data, "flows ", 6)) {
+		ret = kstrtouint(skip_spaces(data + 6), 10, &value);
+		if (!ret)
+			pn->rx_flows = roundup_pow_of_two(
+				clamp_t(unsigned int, value,
+					PKTGEN_RX_WAYS, MAX_CFLOWS));
+	} else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&pn->rx_lock);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations pktgen_rx_fops = {
+	.open    = pgrx_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.write   = pgrx_write,
+	.release = seq_release,
+};
+
 static int __net_init pg_net_init(struct net *net)
 {
 	struct pktgen_net *pn = net_generic(net, pg_net_id);
@@ -3786,6 +4620,8 @@ static int __net_init pg_net_init(struct net *net)
 	pn->net = net;
 	INIT_LIST_HEAD(&pn->pktgen_threads);
 	pn->pktgen_exiting = false;
+	mutex_init(&pn->rx_lock);
+	pn->rx_flows = PKTGEN_RX_DEF_FLOWS;
 	pn->proc_dir = proc_mkdir(PG_PROC_DIR, pn->net->proc_net);
 	if (!pn->proc_dir) {
 		pr_warn("cannot create /proc/net/%s\n", PG_PROC_DIR);
@@ -3798,6 +4634,13 @@ static int __net_init pg_net_init(struct net *net)
 		goto remove;
 	}
 
+	pe = proc_create_data(PGRX, 0600, pn->proc_dir, &pktgen_rx_fops, pn);
+	if (pe == NULL) {
+		pr_err("cannot create %s procfs entry\n", PGRX);
+		ret = -EINVAL;
+		goto remove_entry;
+	}
+
 	for_each_online_cpu(cpu) {
 		int err;
 
@@ -3810,11 +4653,13 @@ static int __net_init pg_net_init(struct net *net)
 	if (list_empty(&pn->pktgen_threads)) {
 		pr_err("Initialization failed for all threads\n");
 		ret = -ENODEV;
-		goto remove_entry;
+		goto remove_rx_entry;
 	}
 
 	return 0;
 
+remove_rx_entry:
+	remove_proc_entry(PGRX, pn->proc_dir);
 remove_entry:
 	remove_proc_entry(PGCTRL, pn->proc_dir);
 remove:
@@ -3844,6 +4689,10 @@ static void __net_exit pg_net_exit(struct net *net)
 		kfree(t);
 	}
 
+	remove_proc_entry(PGRX, pn->proc_dir);
+	pktgen_rx_free(pn->rx);
+	pn->rx = NULL;
+
 	remove_proc_entry(PGCTRL, pn->proc_dir);
 	remove_proc_entry(PG_PROC_DIR, pn->net->proc_net);
 }
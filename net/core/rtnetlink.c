@@ -4241,6 +4241,17 @@ static int rtnl_get_offload_stats_size(const struct net_device *dev)
 	return nla_size;
 }
 
+/* Stats which can be collected without RTNL. dev_get_stats() is also
+ * called under RCU only by /proc/net/dev, everything else may call into
+ * link ops or the master device and needs RTNL.
+ */
+#define RTNL_STATS_UNLOCKED_MASK	IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64)
+
+static bool rtnl_stats_need_rtnl(u32 filter_mask)
+{
+	return filter_mask & ~RTNL_STATS_UNLOCKED_MASK;
+}
+
 static int rtnl_fill_statsinfo(struct sk_buff *skb, struct net_device *dev,
 			       int type, u32 pid, u32 seq, u32 change,
 			       unsigned int flags, unsigned int filter_mask,
@@ -4252,7 +4263,8 @@ static int rtnl_fill_statsinfo(struct sk_buff *skb, struct net_device *dev,
 	int s_prividx = *prividx;
 	int err;
 
-	ASSERT_RTNL();
+	if (rtnl_stats_need_rtnl(filter_mask))
+		ASSERT_RTNL();
 
 	nlh = nlmsg_put(skb, pid, seq, type, sizeof(*ifsm), flags);
 	if (!nlh)
@@ -4461,6 +4473,7 @@ static int rtnl_stats_get(struct sk_buff *skb, struct nlmsghdr *nlh,
 	int idxattr = 0, prividx = 0;
 	struct if_stats_msg *ifsm;
 	struct sk_buff *nskb;
+	bool need_rtnl;
 	u32 filter_mask;
 	int err;
 
@@ -4468,21 +4481,34 @@ static int rtnl_stats_get(struct sk_buff *skb, struct nlmsghdr *nlh,
 		return -EINVAL;
 
 	ifsm = nlmsg_data(nlh);
-	if (ifsm->ifindex > 0)
-		dev = __dev_get_by_index(net, ifsm->ifindex);
-	else
+	if (ifsm->ifindex <= 0)
 		return -EINVAL;
 
-	if (!dev)
-		return -ENODEV;
-
+	/* Registered with RTNL_FLAG_DOIT_UNLOCKED: only grab RTNL when the
+	 * request asks for more than the plain link counters, otherwise a
+	 * device reference is enough.
+	 */
 	filter_mask = ifsm->filter_mask;
-	if (!filter_mask)
-		return -EINVAL;
+	need_rtnl = rtnl_stats_need_rtnl(filter_mask);
+	if (need_rtnl)
+		rtnl_lock();
+
+	dev = dev_get_by_index(net, ifsm->ifindex);
+	if (!dev) {
+		err = -ENODEV;
+		goto out_unlock;
+	}
+
+	if (!filter_mask) {
+		err = -EINVAL;
+		goto out_put;
+	}
 
 	nskb = nlmsg_new(if_nlmsg_stats_size(dev, filter_mask), GFP_KERNEL);
-	if (!nskb)
-		return -ENOBUFS;
+	if (!nskb) {
+		err = -ENOBUFS;
+		goto out_put;
+	}
 
 	err = rtnl_fill_statsinfo(nskb, dev, RTM_NEWSTATS,
 				  NETLINK_CB(skb).portid, nlh->nlmsg_seq, 0,
@@ -4495,6 +4521,11 @@ static int rtnl_stats_get(struct sk_buff *skb, struct nlmsghdr *nlh,
 		err = rtnl_unicast(nskb, net, NETLINK_CB(skb).portid);
 	}
 
+out_put:
+	dev_put(dev);
+out_unlock:
+	if (need_rtnl)
+		rtnl_unlock();
 	return err;
 }
 
@@ -4507,6 +4538,7 @@ static int rtnl_stats_dump(struct sk_buff *skb, struct netlink_callback *cb)
 	struct hlist_head *head;
 	struct net_device *dev;
 	u32 filter_mask = 0;
+	bool need_rtnl;
 	int idx = 0;
 
 	s_h = cb->args[0];
@@ -4524,10 +4556,19 @@ static int rtnl_stats_dump(struct sk_buff *skb, struct netlink_callback *cb)
 	if (!filter_mask)
 		return -EINVAL;
 
+	/* Monitoring agents polling only the link counters walk the device
+	 * hash under RCU and do not contend with configuration changes.
+	 */
+	need_rtnl = rtnl_stats_need_rtnl(filter_mask);
+	if (need_rtnl)
+		rtnl_lock();
+	else
+		rcu_read_lock();
+
 	for (h = s_h; h < NETDEV_HASHENTRIES; h++, s_idx = 0) {
 		idx = 0;
 		head = &net->dev_index_head[h];
-		hlist_for_each_entry(dev, head, index_hlist) {
+		hlist_for_each_entry_rcu(dev, head, index_hlist) {
 			if (idx < s_idx)
 				goto cont;
 			err = rtnl_fill_statsinfo(skb, dev, RTM_NEWSTATS,
@@ -4550,6 +4591,11 @@ static int rtnl_stats_dump(struct sk_buff *skb, struct netlink_callback *cb)
 		}
 	}
 out:
+	if (need_rtnl)
+		rtnl_unlock();
+	else
+		rcu_read_unlock();
+
 	cb->args[3] = s_prividx;
 	cb->args[2] = s_idxattr;
 	cb->args[1] = idx;
@@ -4558,6 +4604,17 @@ static int rtnl_stats_dump(struct sk_buff *skb, struct netlink_callback *cb)
 	return skb->len;
 }
 
+static int rtnl_lock_dumpit(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	rtnl_dumpit_func dumpit = cb->data;
+	int err;
+
+	rtnl_lock();
+	err = dumpit(skb, cb);
+	rtnl_unlock();
+	return err;
+}
+
 /* Process one rtnetlink message. */
 
 static int rtnetlink_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh,
@@ -4604,6 +4661,7 @@ static int rtnetlink_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh,
 		}
 		owner = link->owner;
 		dumpit = link->dumpit;
+		flags = link->flags;
 
 		if (type == RTM_GETLINK - RTM_BASE)
 			min_dump_alloc = rtnl_calcit(skb, nlh);
@@ -4618,10 +4676,16 @@ static int rtnetlink_rcv_msg(struct sk_buff *skb, struct nlmsghdr *nlh,
 		rtnl = net->rtnl;
 		if (err == 0) {
 			struct netlink_dump_control c = {
-				.dump		= dumpit,
+				.dump		= rtnl_lock_dumpit,
+				.data		= dumpit,
 				.min_dump_alloc	= min_dump_alloc,
 				.module		= owner,
 			};
+
+			if (flags & RTNL_FLAG_DUMP_UNLOCKED) {
+				c.dump = dumpit;
+				c.data = NULL;
+			}
 			err = netlink_dump_start(rtnl, skb, nlh, &c);
 			/* netlink_dump_start() will keep a reference on
 			 * module if dump is still in progress.
@@ -4730,7 +4794,6 @@ static int __net_init rtnetlink_net_init(struct net *net)
 	struct netlink_kernel_cfg cfg = {
 		.groups		= RTNLGRP_MAX,
 		.input		= rtnetlink_rcv,
-		.cb_mutex	= &rtnl_mutex,
 		.flags		= NL_CFG_F_NONROOT_RECV,
 		.bind		= rtnetlink_bind,
 	};
@@ -4779,5 +4842,5 @@ void __init rtnetlink_init(void)
 	rtnl_register(PF_BRIDGE, RTM_SETLINK, rtnl_bridge_setlink, NULL, 0);
 
 	rtnl_register(PF_UNSPEC, RTM_GETSTATS, rtnl_stats_get, rtnl_stats_dump,
-		      0);
+		      RTNL_FLAG_DOIT_UNLOCKED | RTNL_FLAG_DUMP_UNLOCKED);
 }
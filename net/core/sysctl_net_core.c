@@ -15,6 +15,7 @@
 #include <linux/vmalloc.h>
 #include <linux/init.h>
 #include <linux/slab.h>
+#include <linux/sched/clock.h>
 
 #include <net/ip.h>
 #include <net/sock.h>
@@ -241,6 +242,30 @@ static int proc_do_dev_weight(struct ctl_table *table, int write,
 	return ret;
 }
 
+static int proc_do_napi_stats(struct ctl_table *table, int write,
+			      void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	static DEFINE_MUTEX(napi_stats_mutex);
+	int ret;
+
+	mutex_lock(&napi_stats_mutex);
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (write && !ret) {
+		if (!sysctl_napi_stats) {
+			static_branch_disable(&napi_stats_needed_key);
+		} else if (!static_key_enabled(&napi_stats_needed_key)) {
+			/* Older schedule timestamps are stale, see
+			 * napi_poll_stats()
+			 */
+			WRITE_ONCE(napi_stats_enabled_at, local_clock());
+			static_branch_enable(&napi_stats_needed_key);
+		}
+	}
+	mutex_unlock(&napi_stats_mutex);
+
+	return ret;
+}
+
 static int proc_do_rss_key(struct ctl_table *table, int write,
 			   void __user *buffer, size_t *lenp, loff_t *ppos)
 {
@@ -515,6 +540,15 @@ static struct ctl_table net_core_table[] = {
 		.proc_handler	= proc_dointvec_minmax,
 		.extra1		= &zero,
 	},
+	{
+		.procname	= "napi_stats",
+		.data		= &sysctl_napi_stats,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_do_napi_stats,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
 	{
 		.procname	= "fb_tunnels_only_for_init_net",
 		.data		= &sysctl_fb_tunnels_only_for_init_net,
@@ -8,9 +8,13 @@
 #include <linux/slab.h>
 #include <linux/idr.h>
 #include <linux/rhashtable.h>
+#include <linux/etherdevice.h>
+#include <linux/filter.h>
+#include <linux/rtnetlink.h>
 #include <net/page_pool.h>
 
 #include <net/xdp.h>
+#include <trace/events/xdp.h>
 
 #define REG_STATE_NEW		0x0
 #define REG_STATE_REGISTERED	0x1
@@ -370,3 +374,190 @@ void xdp_return_buff(struct xdp_buff *xdp)
 	__xdp_return(xdp->data, &xdp->rxq->mem, true, xdp->handle);
 }
 EXPORT_SYMBOL_GPL(xdp_return_buff);
+
+/* Replace the program a device keeps in @pprog, dropping the reference
+ * held on the previous one.  Called under RTNL.
+ */
+void xdp_prog_replace(struct bpf_prog __rcu **pprog, struct bpf_prog *prog)
+{
+	struct bpf_prog *old = rtnl_dereference(*pprog);
+
+	rcu_assign_pointer(*pprog, prog);
+	if (old)
+		bpf_prog_put(old);
+}
+EXPORT_SYMBOL_GPL(xdp_prog_replace);
+
+/* ndo_bpf for software devices that only run their program, kept in
+ * @pprog, on frames handed to them at XDP level: redirected into them
+ * through ndo_xdp_xmit, or decapsulated on the XDP path of the underlay.
+ * A plain attach installs it like on any other software device; traffic
+ * the device receives any other way is only seen by a program attached
+ * in generic mode.
+ */
+int xdp_redirect_prog_bpf(struct bpf_prog __rcu **pprog,
+			  struct netdev_bpf *xdp)
+{
+	struct bpf_prog *prog;
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		xdp_prog_replace(pprog, xdp->prog);
+		return 0;
+	case XDP_QUERY_PROG:
+		prog = rtnl_dereference(*pprog);
+		xdp->prog_id = prog ? prog->aux->id : 0;
+		xdp->prog_attached = !!xdp->prog_id;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+EXPORT_SYMBOL_GPL(xdp_redirect_prog_bpf);
+
+/* Run the XDP program of the device owning @rxq on a frame redirected
+ * into it.  On XDP_PASS the frame is updated to reflect any head or
+ * meta data adjustments made by the program; every other verdict is
+ * left to the caller, which still owns @xdpf.
+ */
+u32 xdp_run_frame(struct bpf_prog *xdp_prog, struct xdp_frame *xdpf,
+		  struct xdp_rxq_info *rxq)
+{
+	struct xdp_buff xdp;
+	u32 act;
+
+	xdp.data_hard_start = xdpf->data - xdpf->headroom;
+	xdp.data = xdpf->data;
+	xdp.data_end = xdpf->data + xdpf->len;
+	xdp.data_meta = xdpf->data - xdpf->metasize;
+	xdp.rxq = rxq;
+
+	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		xdpf->data = xdp.data;
+		xdpf->len = xdp.data_end - xdp.data;
+		xdpf->headroom = xdp.data - xdp.data_hard_start;
+		xdpf->metasize = xdp.data - xdp.data_meta;
+		break;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+		/* fall through */
+	case XDP_TX:
+	case XDP_REDIRECT:
+	case XDP_ABORTED:
+		trace_xdp_exception(rxq->dev, xdp_prog, act);
+		/* fall through */
+	case XDP_DROP:
+		break;
+	}
+
+	return act;
+}
+EXPORT_SYMBOL_GPL(xdp_run_frame);
+
+/* Strip the @hlen bytes of tunnel header in front of the inner frame of
+ * @xdp and run the XDP program of tunnel device @dev on it, as if the
+ * frame had been received on @dev.  The caller restores the buffer on
+ * XDP_PASS.  A redirect is carried out here, as it has to be done on
+ * behalf of @xdp_prog; XDP_TX has no meaning for a frame that still
+ * carries its outer headers in the headroom and counts as an exception.
+ *
+ * Returns XDP_PASS, XDP_DROP, or XDP_REDIRECT once the frame has been
+ * redirected.
+ */
+u32 xdp_run_decap(struct bpf_prog *xdp_prog, struct xdp_buff *xdp,
+		  unsigned int hlen, struct net_device *dev)
+{
+	struct xdp_rxq_info *orig_rxq = xdp->rxq;
+	bool meta = !xdp_data_meta_unsupported(xdp);
+	struct xdp_rxq_info rxq;
+	u32 act;
+
+	xdp->data += hlen;
+	if (meta)
+		xdp->data_meta = xdp->data;
+	else
+		xdp_set_data_meta_invalid(xdp);
+
+	rxq = *orig_rxq;
+	rxq.dev = dev;
+	xdp->rxq = &rxq;
+
+	act = bpf_prog_run_xdp(xdp_prog, xdp);
+	switch (act) {
+	case XDP_PASS:
+	case XDP_DROP:
+		break;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(dev, xdp, xdp_prog))
+			act = XDP_DROP;
+		break;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+		/* fall through */
+	case XDP_TX:
+	case XDP_ABORTED:
+		trace_xdp_exception(dev, xdp_prog, act);
+		act = XDP_DROP;
+		break;
+	}
+
+	xdp->rxq = orig_rxq;
+	return act;
+}
+EXPORT_SYMBOL_GPL(xdp_run_decap);
+
+/* Build an skb around the memory backing a redirected frame, so it can
+ * be handed to the network stack of @dev.  On success the frame memory
+ * is owned by the skb; on failure the caller still owns @xdpf.
+ */
+struct sk_buff *xdp_build_skb_from_frame(struct xdp_frame *xdpf,
+					 struct net_device *dev)
+{
+	unsigned int frame_size;
+	void *pkt_data_start;
+	struct sk_buff *skb;
+
+	/* build_skb need to place skb_shared_info after SKB end, and
+	 * also want to know the memory "truesize".  Thus, need to
+	 * know the memory frame size backing xdp_buff.
+	 *
+	 * XDP was designed to have PAGE_SIZE frames, but this
+	 * assumption is not longer true with ixgbe and i40e.  It
+	 * would be preferred to set frame_size to 2048 or 4096
+	 * depending on the driver.
+	 *   frame_size = 2048;
+	 *   frame_len  = frame_size - sizeof(*xdp_frame);
+	 *
+	 * Instead, with info avail, skb_shared_info in placed after
+	 * packet len.  This, unfortunately fakes the truesize.
+	 * Another disadvantage of this approach, the skb_shared_info
+	 * is not at a fixed memory location, with mixed length
+	 * packets, which is bad for cache-line hotness.
+	 */
+	frame_size = SKB_DATA_ALIGN(xdpf->len) + xdpf->headroom +
+		SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+
+	pkt_data_start = xdpf->data - xdpf->headroom;
+	skb = build_skb(pkt_data_start, frame_size);
+	if (!skb)
+		return NULL;
+
+	skb_reserve(skb, xdpf->headroom);
+	__skb_put(skb, xdpf->len);
+	if (xdpf->metasize)
+		skb_metadata_set(skb, xdpf->metasize);
+
+	/* Essential SKB info: protocol and skb->dev */
+	skb->protocol = eth_type_trans(skb, dev);
+
+	/* Optional SKB info, currently missing:
+	 * - HW checksum info		(skb->ip_summed)
+	 * - HW RX hash			(skb_set_hash)
+	 * - RX ring dev queue index	(skb_record_rx_queue)
+	 */
+
+	return skb;
+}
+EXPORT_SYMBOL_GPL(xdp_build_skb_from_frame);
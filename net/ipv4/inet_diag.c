@@ -18,6 +18,8 @@
 #include <linux/cache.h>
 #include <linux/init.h>
 #include <linux/time.h>
+#include <linux/bpf.h>
+#include <linux/filter.h>
 
 #include <net/icmp.h>
 #include <net/tcp.h>
@@ -696,6 +698,37 @@ int inet_diag_bc_sk(const struct nlattr *bc, struct sock *sk)
 }
 EXPORT_SYMBOL_GPL(inet_diag_bc_sk);
 
+/* Run the BPF_INET_DIAG program attached to a dump via
+ * INET_DIAG_REQ_BPF_FD, if any.  The program sees full sockets only, has
+ * a read-only context, and may aggregate into maps.  Returns false if
+ * the socket is not to be reported, otherwise sets @ext to the
+ * extensions to report it with.
+ */
+bool inet_diag_bpf_sk(const struct netlink_callback *cb, struct sock *sk,
+		      const struct inet_diag_req_v2 *r, u8 *ext)
+{
+	struct bpf_prog *prog = cb->data;
+	u32 ret;
+
+	*ext = r->idiag_ext;
+	if (!prog || !sk_fullsock(sk))
+		return true;
+
+	rcu_read_lock();
+	ret = BPF_PROG_RUN(prog, sk);
+	rcu_read_unlock();
+
+	switch (ret & 0xff) {
+	case INET_DIAG_BPF_SKIP:
+		return false;
+	case INET_DIAG_BPF_REPORT_EXT:
+		*ext &= ret >> INET_DIAG_BPF_EXT_SHIFT;
+		break;
+	}
+	return true;
+}
+EXPORT_SYMBOL_GPL(inet_diag_bpf_sk);
+
 static int valid_cc(const void *bc, int len, int cc)
 {
 	while (len >= 0) {
@@ -853,10 +886,15 @@ static int inet_csk_diag_dump(struct sock *sk,
 			      const struct nlattr *bc,
 			      bool net_admin)
 {
+	struct inet_diag_req_v2 req = *r;
+
 	if (!inet_diag_bc_sk(bc, sk))
 		return 0;
 
-	return inet_csk_diag_fill(sk, skb, r,
+	if (!inet_diag_bpf_sk(cb, sk, r, &req.idiag_ext))
+		return 0;
+
+	return inet_csk_diag_fill(sk, skb, &req,
 				  sk_user_ns(NETLINK_CB(cb->skb).sk),
 				  NETLINK_CB(cb->skb).portid,
 				  cb->nlh->nlmsg_seq, NLM_F_MULTI, cb->nlh,
@@ -961,6 +999,7 @@ void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 		struct hlist_nulls_node *node;
 		struct sock *sk_arr[SKARR_SZ];
 		int num_arr[SKARR_SZ];
+		u8 ext_arr[SKARR_SZ];
 		int idx, accum, res;
 
 		if (hlist_nulls_empty(&head->chain))
@@ -998,6 +1037,9 @@ void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 			if (!inet_diag_bc_sk(bc, sk))
 				goto next_normal;
 
+			if (!inet_diag_bpf_sk(cb, sk, r, &ext_arr[accum]))
+				goto next_normal;
+
 			sock_hold(sk);
 			num_arr[accum] = num;
 			sk_arr[accum] = sk;
@@ -1010,7 +1052,10 @@ void inet_diag_dump_icsk(struct inet_hashinfo *hashinfo, struct sk_buff *skb,
 		res = 0;
 		for (idx = 0; idx < accum; idx++) {
 			if (res >= 0) {
-				res = sk_diag_fill(sk_arr[idx], skb, r,
+				struct inet_diag_req_v2 req = *r;
+
+				req.idiag_ext = ext_arr[idx];
+				res = sk_diag_fill(sk_arr[idx], skb, &req,
 					   sk_user_ns(NETLINK_CB(cb->skb).sk),
 					   NETLINK_CB(cb->skb).portid,
 					   cb->nlh->nlmsg_seq, NLM_F_MULTI,
@@ -1065,6 +1110,51 @@ static int inet_diag_dump(struct sk_buff *skb, struct netlink_callback *cb)
 	return __inet_diag_dump(skb, cb, nlmsg_data(cb->nlh), bc);
 }
 
+static int inet_diag_dump_start(struct netlink_callback *cb)
+{
+	const struct inet_diag_req_v2 *r = nlmsg_data(cb->nlh);
+	int hdrlen = sizeof(struct inet_diag_req_v2);
+	const struct inet_diag_handler *handler;
+	struct bpf_prog *prog;
+	struct nlattr *attr;
+	bool supported;
+
+	attr = nlmsg_find_attr(cb->nlh, hdrlen, INET_DIAG_REQ_BPF_FD);
+	if (!attr)
+		return 0;
+	if (nla_len(attr) < sizeof(u32))
+		return -EINVAL;
+
+	handler = inet_diag_lock_handler(r->sdiag_protocol);
+	supported = !IS_ERR(handler) && handler->idiag_bpf;
+	inet_diag_unlock_handler(handler);
+	if (!supported)
+		return -EOPNOTSUPP;
+
+	prog = bpf_prog_get_type(nla_get_u32(attr),
+				 BPF_PROG_TYPE_CGROUP_SOCK);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	/* the context of other attach types is writable */
+	if (prog->expected_attach_type != BPF_INET_DIAG) {
+		bpf_prog_put(prog);
+		return -EINVAL;
+	}
+
+	cb->data = prog;
+	return 0;
+}
+
+static int inet_diag_dump_done(struct netlink_callback *cb)
+{
+	struct bpf_prog *prog = cb->data;
+
+	if (prog)
+		bpf_prog_put(prog);
+	return 0;
+}
+
 static int inet_diag_type2proto(int type)
 {
 	switch (type) {
@@ -1165,7 +1255,9 @@ static int inet_diag_handler_cmd(struct sk_buff *skb, struct nlmsghdr *h)
 		}
 		{
 			struct netlink_dump_control c = {
+				.start = inet_diag_dump_start,
 				.dump = inet_diag_dump,
+				.done = inet_diag_dump_done,
 			};
 			return netlink_dump_start(net->diag_nlsk, skb, h, &c);
 		}
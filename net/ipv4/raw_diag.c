@@ -135,10 +135,15 @@ static int sk_diag_dump(struct sock *sk, struct sk_buff *skb,
 			const struct inet_diag_req_v2 *r,
 			struct nlattr *bc, bool net_admin)
 {
+	struct inet_diag_req_v2 r_ext = *r;
+
 	if (!inet_diag_bc_sk(bc, sk))
 		return 0;
 
-	return inet_sk_diag_fill(sk, NULL, skb, r,
+	if (!inet_diag_bpf_sk(cb, sk, r, &r_ext.idiag_ext))
+		return 0;
+
+	return inet_sk_diag_fill(sk, NULL, skb, &r_ext,
 				 sk_user_ns(NETLINK_CB(cb->skb).sk),
 				 NETLINK_CB(cb->skb).portid,
 				 cb->nlh->nlmsg_seq, NLM_F_MULTI,
@@ -223,6 +228,7 @@ static const struct inet_diag_handler raw_diag_handler = {
 	.idiag_get_info		= raw_diag_get_info,
 	.idiag_type		= IPPROTO_RAW,
 	.idiag_info_size	= 0,
+	.idiag_bpf		= true,
 #ifdef CONFIG_INET_DIAG_DESTROY
 	.destroy		= raw_diag_destroy,
 #endif
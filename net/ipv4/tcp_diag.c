@@ -170,6 +170,7 @@ static const struct inet_diag_handler tcp_diag_handler = {
 	.idiag_get_aux_size	= tcp_diag_get_aux_size,
 	.idiag_type		= IPPROTO_TCP,
 	.idiag_info_size	= sizeof(struct tcp_info),
+	.idiag_bpf		= true,
 #ifdef CONFIG_INET_DIAG_DESTROY
 	.destroy		= tcp_diag_destroy,
 #endif
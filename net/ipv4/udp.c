@@ -97,6 +97,7 @@
 #include <linux/mm.h>
 #include <linux/inet.h>
 #include <linux/netdevice.h>
+#include <linux/etherdevice.h>
 #include <linux/slab.h>
 #include <net/tcp_states.h>
 #include <linux/skbuff.h>
@@ -108,6 +109,8 @@
 #include <net/route.h>
 #include <net/checksum.h>
 #include <net/xfrm.h>
+#include <net/xdp.h>
+#include <net/l3mdev.h>
 #include <trace/events/udp.h>
 #include <linux/static_key.h>
 #include <trace/events/skb.h>
@@ -1900,6 +1903,105 @@ void udp_encap_enable(void)
 }
 EXPORT_SYMBOL(udp_encap_enable);
 
+/* Hand a UDP encapsulated IPv4 frame, which the XDP program of the
+ * receiving device has passed, to the tunnel socket owning its
+ * destination port before any skb is built.  Only unicast frames for a
+ * local address without IP options or fragmentation are considered; all
+ * others, and every frame the tunnel leaves alone, continue unchanged.
+ *
+ * Returns XDP_PASS, XDP_DROP, or XDP_REDIRECT once the tunnel device's
+ * program has redirected the inner frame, in which case the caller
+ * flushes redirects at the end of its poll as for its own program.
+ */
+u32 udp_tunnel_xdp_rcv(struct xdp_buff *xdp)
+{
+	u32 (*encap_xdp_rcv)(struct sock *sk, struct xdp_buff *xdp,
+			     const struct iphdr *iph);
+	struct net_device *dev = xdp->rxq->dev;
+	void *data_meta = xdp->data_meta;
+	void *data_end = xdp->data_end;
+	void *data = xdp->data;
+	struct ethhdr *eth = data;
+	int dif = dev->ifindex;
+	struct udphdr *uh;
+	struct iphdr *iph;
+	struct sock *sk;
+	int sdif = 0;
+	u16 len;
+	u32 act;
+
+	if (!static_branch_unlikely(&udp_encap_needed_key))
+		return XDP_PASS;
+
+	if (data + ETH_HLEN + sizeof(*iph) + sizeof(*uh) > data_end)
+		return XDP_PASS;
+
+	if (eth->h_proto != htons(ETH_P_IP) ||
+	    !ether_addr_equal(eth->h_dest, dev->dev_addr))
+		return XDP_PASS;
+
+	iph = data + ETH_HLEN;
+	if (iph->version != 4 || iph->ihl != 5 ||
+	    iph->protocol != IPPROTO_UDP || ip_is_fragment(iph) ||
+	    ip_fast_csum((u8 *)iph, iph->ihl))
+		return XDP_PASS;
+
+	len = ntohs(iph->tot_len);
+	if (len < sizeof(*iph) + sizeof(*uh) ||
+	    (void *)iph + len > data_end)
+		return XDP_PASS;
+
+	uh = (struct udphdr *)(iph + 1);
+	if (ntohs(uh->len) != len - sizeof(*iph))
+		return XDP_PASS;
+
+	/* Leave checksum errors to the stack, which accounts for them */
+	if (uh->check &&
+	    csum_tcpudp_magic(iph->saddr, iph->daddr, ntohs(uh->len),
+			      IPPROTO_UDP, csum_partial(uh, ntohs(uh->len), 0)))
+		return XDP_PASS;
+
+	if (ipv4_is_multicast(iph->daddr) ||
+	    inet_addr_type_dev_table(dev_net(dev), dev,
+				     iph->daddr) != RTN_LOCAL)
+		return XDP_PASS;
+
+	if (netif_is_l3_slave(dev)) {
+		sdif = dif;
+		dif = l3mdev_master_ifindex_rcu(dev);
+	}
+
+	sk = __udp4_lib_lookup(dev_net(dev), iph->saddr, uh->source,
+			       iph->daddr, uh->dest, dif, sdif,
+			       &udp_table, NULL);
+	if (!sk)
+		return XDP_PASS;
+
+	encap_xdp_rcv = READ_ONCE(udp_sk(sk)->encap_xdp_rcv);
+	if (!encap_xdp_rcv)
+		return XDP_PASS;
+
+	/* The outer headers become headroom; meta data, if supported,
+	 * starts out empty in front of the tunnel header.
+	 */
+	xdp->data = uh + 1;
+	xdp->data_end = (void *)iph + len;
+	if (data_meta > data)
+		xdp_set_data_meta_invalid(xdp);
+	else
+		xdp->data_meta = xdp->data;
+
+	act = encap_xdp_rcv(sk, xdp, iph);
+	if (act == XDP_PASS) {
+		xdp->data = data;
+		xdp->data_end = data_end;
+		xdp->data_meta = data_meta;
+	}
+
+	return act;
+}
+EXPORT_SYMBOL_GPL(udp_tunnel_xdp_rcv);
+
 /* returns:
  *  -1: error
  *   0: success
@@ -22,10 +22,15 @@ static int sk_diag_dump(struct sock *sk, struct sk_buff *skb,
 			const struct inet_diag_req_v2 *req,
 			struct nlattr *bc, bool net_admin)
 {
+	struct inet_diag_req_v2 r_ext = *req;
+
 	if (!inet_diag_bc_sk(bc, sk))
 		return 0;
 
-	return inet_sk_diag_fill(sk, NULL, skb, req,
+	if (!inet_diag_bpf_sk(cb, sk, req, &r_ext.idiag_ext))
+		return 0;
+
+	return inet_sk_diag_fill(sk, NULL, skb, &r_ext,
 			sk_user_ns(NETLINK_CB(cb->skb).sk),
 			NETLINK_CB(cb->skb).portid,
 			cb->nlh->nlmsg_seq, NLM_F_MULTI, cb->nlh, net_admin);
@@ -246,6 +251,7 @@ static const struct inet_diag_handler udp_diag_handler = {
 	.idiag_get_info  = udp_diag_get_info,
 	.idiag_type	 = IPPROTO_UDP,
 	.idiag_info_size = 0,
+	.idiag_bpf	 = true,
 #ifdef CONFIG_INET_DIAG_DESTROY
 	.destroy	 = udp_diag_destroy,
 #endif
@@ -270,6 +276,7 @@ static const struct inet_diag_handler udplite_diag_handler = {
 	.idiag_get_info  = udp_diag_get_info,
 	.idiag_type	 = IPPROTO_UDPLITE,
 	.idiag_info_size = 0,
+	.idiag_bpf	 = true,
 #ifdef CONFIG_INET_DIAG_DESTROY
 	.destroy	 = udplite_diag_destroy,
 #endif
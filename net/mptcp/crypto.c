@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP cryptographic functions
+ *
+ * The key, token and IDSN derivation and the MP_JOIN HMAC of RFC 6824
+ * all hash less than two SHA-1 blocks of data, so the blocks are built
+ * here by hand and run through sha_transform() instead of going through
+ * the crypto API for every handshake.
+ */
+
+#include <linux/cryptohash.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <asm/unaligned.h>
+
+#include "protocol.h"
+
+#define SHA1_BLOCK_SIZE	64
+
+void mptcp_crypto_key_sha1(u64 key, u32 *token, u64 *idsn)
+{
+	u32 workspace[SHA_WORKSPACE_WORDS];
+	u32 digest[SHA_DIGEST_WORDS];
+	u8 input[SHA1_BLOCK_SIZE];
+
+	memset(input, 0, sizeof(input));
+	put_unaligned_be64(key, input);
+	input[8] = 0x80;
+	/* message length in bits */
+	input[63] = 8 * 8;
+
+	sha_init(digest);
+	sha_transform(digest, input, workspace);
+	memzero_explicit(workspace, sizeof(workspace));
+
+	if (token)
+		*token = digest[0];
+	if (idsn)
+		*idsn = ((u64)digest[3] << 32) | digest[4];
+}
+
+void mptcp_crypto_hmac_sha1(u64 key1, u64 key2, u32 nonce1, u32 nonce2,
+			    u8 *hmac)
+{
+	u32 workspace[SHA_WORKSPACE_WORDS];
+	u32 digest[SHA_DIGEST_WORDS];
+	u8 input[2 * SHA1_BLOCK_SIZE];
+	u8 key[16];
+	int i;
+
+	put_unaligned_be64(key1, key);
+	put_unaligned_be64(key2, key + 8);
+
+	/* inner: (key ^ ipad) || nonce1 || nonce2 */
+	memset(input, 0x36, SHA1_BLOCK_SIZE);
+	for (i = 0; i < sizeof(key); i++)
+		input[i] ^= key[i];
+	memset(input + SHA1_BLOCK_SIZE, 0, SHA1_BLOCK_SIZE);
+	put_unaligned_be32(nonce1, input + SHA1_BLOCK_SIZE);
+	put_unaligned_be32(nonce2, input + SHA1_BLOCK_SIZE + 4);
+	input[SHA1_BLOCK_SIZE + 8] = 0x80;
+	/* (64 + 8) bytes, 576 bits */
+	put_unaligned_be16((SHA1_BLOCK_SIZE + 8) * 8, input + 126);
+
+	sha_init(digest);
+	sha_transform(digest, input, workspace);
+	sha_transform(digest, input + SHA1_BLOCK_SIZE, workspace);
+
+	/* outer: (key ^ opad) || inner digest */
+	memset(input, 0x5c, SHA1_BLOCK_SIZE);
+	for (i = 0; i < sizeof(key); i++)
+		input[i] ^= key[i];
+	memset(input + SHA1_BLOCK_SIZE, 0, SHA1_BLOCK_SIZE);
+	for (i = 0; i < SHA_DIGEST_WORDS; i++)
+		put_unaligned_be32(digest[i], input + SHA1_BLOCK_SIZE + i * 4);
+	input[SHA1_BLOCK_SIZE + MPTCPOPT_HMAC_LEN] = 0x80;
+	/* (64 + 20) bytes, 672 bits */
+	put_unaligned_be16((SHA1_BLOCK_SIZE + MPTCPOPT_HMAC_LEN) * 8,
+			   input + 126);
+
+	sha_init(digest);
+	sha_transform(digest, input, workspace);
+	sha_transform(digest, input + SHA1_BLOCK_SIZE, workspace);
+	memzero_explicit(workspace, sizeof(workspace));
+	memzero_explicit(input, sizeof(input));
+
+	for (i = 0; i < SHA_DIGEST_WORDS; i++)
+		put_unaligned_be32(digest[i], hmac + i * 4);
+}
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP per-namespace settings
+ *
+ * /proc/sys/net/mptcp/enabled       - allow IPPROTO_MPTCP sockets
+ * /proc/sys/net/mptcp/scheduler     - scheduler of new connections
+ * /proc/sys/net/mptcp/path_manager  - path manager of new connections
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sysctl.h>
+#include <net/net_namespace.h>
+#include <net/netns/generic.h>
+
+#include "protocol.h"
+
+static unsigned int mptcp_pernet_id __read_mostly;
+
+struct mptcp_pernet {
+	struct ctl_table_header *ctl_table_hdr;
+
+	int enabled;
+	spinlock_t lock;	/* protects the names below */
+	char scheduler[MPTCP_SCHED_NAME_MAX];
+	char path_manager[MPTCP_PM_NAME_MAX];
+};
+
+static struct mptcp_pernet *mptcp_get_pernet(const struct net *net)
+{
+	return net_generic(net, mptcp_pernet_id);
+}
+
+bool mptcp_is_enabled(const struct net *net)
+{
+	return READ_ONCE(mptcp_get_pernet(net)->enabled);
+}
+
+static void mptcp_copy_name(struct mptcp_pernet *pernet, char *name,
+			   const char *val, size_t len)
+{
+	spin_lock(&pernet->lock);
+	strlcpy(name, val, len);
+	spin_unlock(&pernet->lock);
+}
+
+void mptcp_get_scheduler(const struct net *net, char *name)
+{
+	struct mptcp_pernet *pernet = mptcp_get_pernet(net);
+
+	mptcp_copy_name(pernet, name, pernet->scheduler, MPTCP_SCHED_NAME_MAX);
+}
+
+void mptcp_get_path_manager(const struct net *net, char *name)
+{
+	struct mptcp_pernet *pernet = mptcp_get_pernet(net);
+
+	mptcp_copy_name(pernet, name, pernet->path_manager, MPTCP_PM_NAME_MAX);
+}
+
+#ifdef CONFIG_SYSCTL
+static int proc_mptcp_name(struct ctl_table *ctl, int write,
+			   void __user *buffer, size_t *lenp, loff_t *ppos,
+			   bool (*registered)(const char *name))
+{
+	struct mptcp_pernet *pernet = ctl->extra1;
+	char val[MPTCP_SCHED_NAME_MAX];
+	struct ctl_table tbl = {
+		.data = val,
+		.maxlen = ctl->maxlen,
+	};
+	int ret;
+
+	BUILD_BUG_ON(MPTCP_PM_NAME_MAX > MPTCP_SCHED_NAME_MAX);
+
+	mptcp_copy_name(pernet, val, ctl->data, ctl->maxlen);
+
+	ret = proc_dostring(&tbl, write, buffer, lenp, ppos);
+	if (write && ret == 0) {
+		if (!registered(val))
+			return -ENOENT;
+		mptcp_copy_name(pernet, ctl->data, val, ctl->maxlen);
+	}
+	return ret;
+}
+
+static int proc_mptcp_scheduler(struct ctl_table *ctl, int write,
+				void __user *buffer, size_t *lenp,
+				loff_t *ppos)
+{
+	return proc_mptcp_name(ctl, write, buffer, lenp, ppos,
+			       mptcp_sched_registered);
+}
+
+static int proc_mptcp_path_manager(struct ctl_table *ctl, int write,
+				   void __user *buffer, size_t *lenp,
+				   loff_t *ppos)
+{
+	return proc_mptcp_name(ctl, write, buffer, lenp, ppos,
+			       mptcp_pm_registered);
+}
+
+static int zero;
+static int one = 1;
+
+static struct ctl_table mptcp_sysctl_table[] = {
+	{
+		.procname	= "enabled",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
+	{
+		.procname	= "scheduler",
+		.maxlen		= MPTCP_SCHED_NAME_MAX,
+		.mode		= 0644,
+		.proc_handler	= proc_mptcp_scheduler,
+	},
+	{
+		.procname	= "path_manager",
+		.maxlen		= MPTCP_PM_NAME_MAX,
+		.mode		= 0644,
+		.proc_handler	= proc_mptcp_path_manager,
+	},
+	{ }
+};
+
+static int mptcp_pernet_new_table(struct net *net, struct mptcp_pernet *pernet)
+{
+	struct ctl_table *table;
+
+	table = kmemdup(mptcp_sysctl_table, sizeof(mptcp_sysctl_table),
+			GFP_KERNEL);
+	if (!table)
+		return -ENOMEM;
+
+	table[0].data = &pernet->enabled;
+	table[1].data = pernet->scheduler;
+	table[1].extra1 = pernet;
+	table[2].data = pernet->path_manager;
+	table[2].extra1 = pernet;
+
+	pernet->ctl_table_hdr = register_net_sysctl(net, "net/mptcp", table);
+	if (!pernet->ctl_table_hdr) {
+		kfree(table);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void mptcp_pernet_del_table(struct mptcp_pernet *pernet)
+{
+	struct ctl_table *table = pernet->ctl_table_hdr->ctl_table_arg;
+
+	unregister_net_sysctl_table(pernet->ctl_table_hdr);
+	kfree(table);
+}
+#else
+static int mptcp_pernet_new_table(struct net *net, struct mptcp_pernet *pernet)
+{
+	return 0;
+}
+
+static void mptcp_pernet_del_table(struct mptcp_pernet *pernet)
+{
+}
+#endif /* CONFIG_SYSCTL */
+
+static int __net_init mptcp_net_init(struct net *net)
+{
+	struct mptcp_pernet *pernet = mptcp_get_pernet(net);
+
+	pernet->enabled = 1;
+	spin_lock_init(&pernet->lock);
+	strlcpy(pernet->scheduler, "default", sizeof(pernet->scheduler));
+	strlcpy(pernet->path_manager, "default", sizeof(pernet->path_manager));
+
+	return mptcp_pernet_new_table(net, pernet);
+}
+
+static void __net_exit mptcp_net_exit(struct net *net)
+{
+	mptcp_pernet_del_table(mptcp_get_pernet(net));
+}
+
+static struct pernet_operations mptcp_pernet_ops = {
+	.init	= mptcp_net_init,
+	.exit	= mptcp_net_exit,
+	.id	= &mptcp_pernet_id,
+	.size	= sizeof(struct mptcp_pernet),
+};
+
+int __init mptcp_ctrl_init(void)
+{
+	return register_pernet_subsys(&mptcp_pernet_ops);
+}
@@ -0,0 +1,446 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP option handling
+ *
+ * Parsing and generation of the MP_CAPABLE, MP_JOIN and DSS options
+ * (RFC 6824) carried by the TCP segments of MPTCP subflows.
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <net/tcp.h>
+#include <asm/unaligned.h>
+
+#include "protocol.h"
+
+/* @ptr points right after the kind and length bytes */
+static void mptcp_parse_option(const unsigned char *ptr, int opsize,
+			       struct mptcp_options_received *mp_opt)
+{
+	u8 subtype = *ptr >> 4;
+	int expected;
+	u8 flags;
+
+	switch (subtype) {
+	case MPTCPOPT_MP_CAPABLE:
+		if (opsize != TCPOLEN_MPTCP_MPC_SYN &&
+		    opsize != TCPOLEN_MPTCP_MPC_ACK)
+			break;
+
+		/* checksums are not supported, such peers fall back to TCP */
+		flags = ptr[1];
+		if ((*ptr & 0xF) != MPTCP_VERSION ||
+		    !(flags & MPTCP_CAP_HMAC_SHA1) ||
+		    (flags & MPTCP_CAP_CHECKSUM_REQD))
+			break;
+
+		mp_opt->mp_capable = 1;
+		mp_opt->sndr_key = get_unaligned_be64(ptr + 2);
+		if (opsize == TCPOLEN_MPTCP_MPC_ACK) {
+			mp_opt->rcvr_key = get_unaligned_be64(ptr + 10);
+			mp_opt->mpc_ack = 1;
+		}
+		break;
+
+	case MPTCPOPT_MP_JOIN:
+		mp_opt->backup = *ptr & MPTCPOPT_BACKUP;
+		if (opsize == TCPOLEN_MPTCP_MPJ_SYN) {
+			mp_opt->mp_join_syn = 1;
+			mp_opt->join_id = ptr[1];
+			mp_opt->token = get_unaligned_be32(ptr + 2);
+			mp_opt->nonce = get_unaligned_be32(ptr + 6);
+		} else if (opsize == TCPOLEN_MPTCP_MPJ_SYNACK) {
+			mp_opt->mp_join_synack = 1;
+			mp_opt->join_id = ptr[1];
+			mp_opt->thmac = get_unaligned_be64(ptr + 2);
+			mp_opt->nonce = get_unaligned_be32(ptr + 10);
+		} else if (opsize == TCPOLEN_MPTCP_MPJ_ACK) {
+			mp_opt->mp_join_ack = 1;
+			memcpy(mp_opt->hmac, ptr + 2, MPTCPOPT_HMAC_LEN);
+		}
+		break;
+
+	case MPTCPOPT_DSS:
+		flags = ptr[1];
+		mp_opt->use_ack = !!(flags & MPTCP_DSS_HAS_ACK);
+		mp_opt->ack64 = !!(flags & MPTCP_DSS_ACK64);
+		mp_opt->use_map = !!(flags & MPTCP_DSS_HAS_MAP);
+		mp_opt->dsn64 = !!(flags & MPTCP_DSS_DSN64);
+		mp_opt->data_fin = !!(flags & MPTCP_DSS_DATA_FIN);
+
+		expected = TCPOLEN_MPTCP_DSS_BASE;
+		if (mp_opt->use_ack)
+			expected += mp_opt->ack64 ? TCPOLEN_MPTCP_DSS_ACK64 :
+						    TCPOLEN_MPTCP_DSS_ACK32;
+		if (mp_opt->use_map)
+			expected += mp_opt->dsn64 ? TCPOLEN_MPTCP_DSS_MAP64 :
+						    TCPOLEN_MPTCP_DSS_MAP32;
+
+		/* the checksum, if any, is ignored */
+		if (opsize != expected &&
+		    !(mp_opt->use_map &&
+		      opsize == expected + TCPOLEN_MPTCP_DSS_CHECKSUM)) {
+			mp_opt->use_ack = 0;
+			mp_opt->use_map = 0;
+			break;
+		}
+
+		mp_opt->dss = 1;
+		ptr += 2;
+		if (mp_opt->use_ack) {
+			if (mp_opt->ack64) {
+				mp_opt->data_ack = get_unaligned_be64(ptr);
+				ptr += 8;
+			} else {
+				mp_opt->data_ack = get_unaligned_be32(ptr);
+				ptr += 4;
+			}
+		}
+		if (mp_opt->use_map) {
+			if (mp_opt->dsn64) {
+				mp_opt->data_seq = get_unaligned_be64(ptr);
+				ptr += 8;
+			} else {
+				mp_opt->data_seq = get_unaligned_be32(ptr);
+				ptr += 4;
+			}
+			mp_opt->subflow_seq = get_unaligned_be32(ptr);
+			mp_opt->data_len = get_unaligned_be16(ptr + 4);
+		}
+		break;
+	}
+}
+
+void mptcp_get_options(const struct sk_buff *skb,
+		       struct mptcp_options_received *mp_opt)
+{
+	const struct tcphdr *th = tcp_hdr(skb);
+	int length = (th->doff * 4) - sizeof(struct tcphdr);
+	const unsigned char *ptr;
+
+	memset(mp_opt, 0, sizeof(*mp_opt));
+	ptr = (const unsigned char *)(th + 1);
+
+	while (length > 0) {
+		int opcode = *ptr++;
+		int opsize;
+
+		switch (opcode) {
+		case TCPOPT_EOL:
+			return;
+		case TCPOPT_NOP:
+			length--;
+			continue;
+		default:
+			opsize = *ptr++;
+			if (opsize < 2) /* "silly options" */
+				return;
+			if (opsize > length)
+				return;	/* don't parse partial options */
+			if (opcode == TCPOPT_MPTCP && opsize > 2)
+				mptcp_parse_option(ptr, opsize, mp_opt);
+			ptr += opsize - 2;
+			length -= opsize;
+		}
+	}
+}
+
+bool mptcp_syn_options(struct sock *sk, const struct sk_buff *skb,
+		       unsigned int *size, struct mptcp_out_options *opts)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+
+	if (!subflow)
+		return false;
+
+	/* retransmitted SYNs keep the sequence number */
+	subflow->snd_isn = TCP_SKB_CB(skb)->seq;
+
+	if (subflow->request_mptcp) {
+		opts->suboptions = OPTION_MPTCP_MPC_SYN;
+		opts->sndr_key = subflow->local_key;
+		*size = TCPOLEN_MPTCP_MPC_SYN;
+		return true;
+	}
+
+	if (subflow->request_join) {
+		opts->suboptions = OPTION_MPTCP_MPJ_SYN;
+		opts->join_id = subflow->local_id;
+		opts->backup = subflow->backup;
+		opts->token = subflow->token;
+		opts->nonce = subflow->local_nonce;
+		*size = TCPOLEN_MPTCP_MPJ_SYN;
+		return true;
+	}
+
+	return false;
+}
+
+bool mptcp_synack_options(const struct request_sock *req, unsigned int *size,
+			  struct mptcp_out_options *opts)
+{
+	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
+
+	if (subflow_req->mp_capable) {
+		opts->suboptions = OPTION_MPTCP_MPC_SYNACK;
+		opts->sndr_key = subflow_req->local_key;
+		*size = TCPOLEN_MPTCP_MPC_SYNACK;
+		return true;
+	}
+
+	if (subflow_req->mp_join) {
+		opts->suboptions = OPTION_MPTCP_MPJ_SYNACK;
+		opts->join_id = 0;
+		opts->backup = 0;
+		opts->thmac = subflow_req->thmac;
+		opts->nonce = subflow_req->local_nonce;
+		*size = TCPOLEN_MPTCP_MPJ_SYNACK;
+		return true;
+	}
+
+	return false;
+}
+
+/* The third ACK of the handshake echoes the keys (MP_CAPABLE) or
+ * carries our HMAC (MP_JOIN). The MP_CAPABLE one is sent once, a lost
+ * one is made up for by the server accepting the first DSS instead;
+ * the MP_JOIN one is repeated until the peer sends a DSS.
+ */
+static bool mptcp_hs_ack_options(struct mptcp_subflow_context *subflow,
+				 unsigned int *size,
+				 struct mptcp_out_options *opts)
+{
+	if (subflow->mp_capable) {
+		opts->suboptions = OPTION_MPTCP_MPC_ACK;
+		opts->sndr_key = subflow->local_key;
+		opts->rcvr_key = subflow->remote_key;
+		*size = TCPOLEN_MPTCP_MPC_ACK;
+		subflow->send_hs_ack = 0;
+		return true;
+	}
+
+	if (subflow->mp_join) {
+		opts->suboptions = OPTION_MPTCP_MPJ_ACK;
+		memcpy(opts->hmac, subflow->hmac, MPTCPOPT_HMAC_LEN);
+		*size = TCPOLEN_MPTCP_MPJ_ACK;
+		return true;
+	}
+
+	return false;
+}
+
+bool mptcp_established_options(struct sock *sk, struct sk_buff *skb,
+			       unsigned int *size, unsigned int remaining,
+			       struct mptcp_out_options *opts)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+	const struct tcp_skb_cb *tcb;
+	struct mptcp_sock *msk;
+	struct mptcp_map *map;
+	unsigned int data_len;
+	bool fin;
+
+	if (!subflow || !subflow->conn)
+		return false;
+
+	/* MSS computation, reserve room for a full DSS */
+	if (!skb) {
+		*size = TCPOLEN_MPTCP_DSS_MAP_ALIGNED;
+		return *size <= remaining;
+	}
+
+	tcb = TCP_SKB_CB(skb);
+	fin = tcb->tcp_flags & TCPHDR_FIN;
+	data_len = tcb->end_seq - tcb->seq - fin;
+
+	if (subflow->send_hs_ack && !data_len && !fin &&
+	    mptcp_hs_ack_options(subflow, size, opts))
+		return *size <= remaining;
+
+	msk = mptcp_sk(subflow->conn);
+	opts->suboptions = OPTION_MPTCP_DSS;
+	opts->data_ack = atomic64_read(&msk->ack_seq);
+	opts->use_map = 0;
+	opts->data_fin = 0;
+	*size = TCPOLEN_MPTCP_DSS_ACK_ALIGNED;
+
+	if (data_len) {
+		u32 offset;
+
+		map = mptcp_subflow_tx_map(subflow, tcb->seq);
+		if (!map)
+			goto out;
+
+		offset = tcb->seq - map->subflow_seq;
+		data_len = min_t(unsigned int, data_len, map->len - offset);
+		data_len = min_t(unsigned int, data_len, U16_MAX - 1);
+
+		opts->use_map = 1;
+		opts->data_seq = map->data_seq + offset;
+		opts->subflow_seq = tcb->seq - subflow->snd_isn;
+		opts->data_len = data_len;
+
+		if (test_bit(MPTCP_SEND_DATA_FIN, &msk->flags) &&
+		    opts->data_seq + data_len == READ_ONCE(msk->data_fin_seq)) {
+			opts->data_fin = 1;
+			opts->data_len++;
+		}
+	} else if (fin && test_bit(MPTCP_SEND_DATA_FIN, &msk->flags)) {
+		/* DATA_FIN on its own is not mapped to subflow data */
+		opts->use_map = 1;
+		opts->data_fin = 1;
+		opts->data_seq = READ_ONCE(msk->data_fin_seq);
+		opts->subflow_seq = 0;
+		opts->data_len = 1;
+	}
+
+	if (opts->use_map)
+		*size = TCPOLEN_MPTCP_DSS_MAP_ALIGNED;
+out:
+	return *size <= remaining;
+}
+
+static __be32 mptcp_option(u8 subopt, u8 len, u8 nib, u8 field)
+{
+	return htonl((TCPOPT_MPTCP << 24) | (len << 16) | (subopt << 12) |
+		     ((nib & 0xF) << 8) | field);
+}
+
+__be32 *mptcp_write_options(__be32 *ptr, const struct mptcp_out_options *opts)
+{
+	switch (opts->suboptions) {
+	case OPTION_MPTCP_MPC_SYN:
+	case OPTION_MPTCP_MPC_SYNACK:
+		*ptr++ = mptcp_option(MPTCPOPT_MP_CAPABLE,
+				      TCPOLEN_MPTCP_MPC_SYN, MPTCP_VERSION,
+				      MPTCP_CAP_HMAC_SHA1);
+		put_unaligned_be64(opts->sndr_key, ptr);
+		ptr += 2;
+		break;
+
+	case OPTION_MPTCP_MPC_ACK:
+		*ptr++ = mptcp_option(MPTCPOPT_MP_CAPABLE,
+				      TCPOLEN_MPTCP_MPC_ACK, MPTCP_VERSION,
+				      MPTCP_CAP_HMAC_SHA1);
+		put_unaligned_be64(opts->sndr_key, ptr);
+		put_unaligned_be64(opts->rcvr_key, ptr + 2);
+		ptr += 4;
+		break;
+
+	case OPTION_MPTCP_MPJ_SYN:
+		*ptr++ = mptcp_option(MPTCPOPT_MP_JOIN, TCPOLEN_MPTCP_MPJ_SYN,
+				      opts->backup, opts->join_id);
+		*ptr++ = htonl(opts->token);
+		*ptr++ = htonl(opts->nonce);
+		break;
+
+	case OPTION_MPTCP_MPJ_SYNACK:
+		*ptr++ = mptcp_option(MPTCPOPT_MP_JOIN,
+				      TCPOLEN_MPTCP_MPJ_SYNACK,
+				      opts->backup, opts->join_id);
+		put_unaligned_be64(opts->thmac, ptr);
+		ptr += 2;
+		*ptr++ = htonl(opts->nonce);
+		break;
+
+	case OPTION_MPTCP_MPJ_ACK:
+		*ptr++ = mptcp_option(MPTCPOPT_MP_JOIN, TCPOLEN_MPTCP_MPJ_ACK,
+				      0, 0);
+		memcpy(ptr, opts->hmac, MPTCPOPT_HMAC_LEN);
+		ptr += MPTCPOPT_HMAC_LEN / 4;
+		break;
+
+	case OPTION_MPTCP_DSS: {
+		u8 len = TCPOLEN_MPTCP_DSS_BASE + TCPOLEN_MPTCP_DSS_ACK64;
+		u8 flags = MPTCP_DSS_HAS_ACK | MPTCP_DSS_ACK64;
+
+		if (opts->use_map) {
+			len += TCPOLEN_MPTCP_DSS_MAP64;
+			flags |= MPTCP_DSS_HAS_MAP | MPTCP_DSS_DSN64;
+			if (opts->data_fin)
+				flags |= MPTCP_DSS_DATA_FIN;
+		}
+
+		*ptr++ = mptcp_option(MPTCPOPT_DSS, len, 0, flags);
+		put_unaligned_be64(opts->data_ack, ptr);
+		ptr += 2;
+
+		if (opts->use_map) {
+			put_unaligned_be64(opts->data_seq, ptr);
+			ptr += 2;
+			*ptr++ = htonl(opts->subflow_seq);
+			*ptr++ = htonl((opts->data_len << 16) |
+				       (TCPOPT_NOP << 8) | TCPOPT_NOP);
+		}
+		break;
+	}
+	}
+
+	return ptr;
+}
+
+void mptcp_incoming_options(struct sock *sk, struct sk_buff *skb)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+	struct mptcp_options_received mp_opt;
+	struct mptcp_sock *msk;
+	u64 data_seq;
+	u32 len;
+
+	if (!subflow || !subflow->conn)
+		return;
+
+	mptcp_get_options(skb, &mp_opt);
+	if (!mp_opt.dss)
+		return;
+
+	msk = mptcp_sk(subflow->conn);
+
+	/* a DSS from the peer completes the MP_JOIN handshake */
+	if (subflow->send_hs_ack) {
+		subflow->send_hs_ack = 0;
+		mptcp_write_space(subflow->conn);
+	}
+
+	if (mp_opt.use_ack) {
+		u64 data_ack = mp_opt.data_ack;
+
+		if (!mp_opt.ack64) {
+			u64 snd_una = atomic64_read(&msk->snd_una);
+
+			data_ack = mptcp_expand_seq(snd_una, data_ack);
+		}
+		mptcp_data_acked(subflow->conn, data_ack);
+	}
+
+	if (!mp_opt.use_map)
+		return;
+
+	data_seq = mp_opt.data_seq;
+	if (!mp_opt.dsn64)
+		data_seq = mptcp_expand_seq(atomic64_read(&msk->ack_seq),
+					    data_seq);
+
+	len = mp_opt.data_len;
+	if (mp_opt.data_fin) {
+		if (!len)
+			return;
+
+		/* the DATA_FIN takes the last byte of the mapping */
+		len--;
+		if (!test_bit(MPTCP_DATA_FIN, &msk->flags)) {
+			msk->rcv_data_fin_seq = data_seq + len;
+			smp_mb__before_atomic();
+			set_bit(MPTCP_DATA_FIN, &msk->flags);
+			mptcp_data_ready(subflow->conn);
+		}
+	}
+
+	/* data we cannot map would stall the reader forever, reset the
+	 * subflow so that the peer retransmits it on another one
+	 */
+	if (len && mp_opt.subflow_seq &&
+	    mptcp_subflow_rx_map_add(subflow, data_seq,
+				     subflow->rcv_isn + mp_opt.subflow_seq,
+				     len))
+		mptcp_subflow_reset(sk);
+}
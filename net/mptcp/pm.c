@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP path managers
+ *
+ * The path manager decides which additional subflows a connection
+ * opens. Path managers register under a name and net.mptcp.path_manager
+ * selects the one new connections use.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/inetdevice.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/netdevice.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+
+#include "protocol.h"
+
+static DEFINE_SPINLOCK(mptcp_pm_list_lock);
+static LIST_HEAD(mptcp_pm_list);
+
+/* Simple linear search, don't expect many entries! */
+static struct mptcp_pm_ops *mptcp_pm_find(const char *name)
+{
+	struct mptcp_pm_ops *e;
+
+	list_for_each_entry_rcu(e, &mptcp_pm_list, list) {
+		if (strcmp(e->name, name) == 0)
+			return e;
+	}
+
+	return NULL;
+}
+
+int mptcp_register_path_manager(struct mptcp_pm_ops *pm)
+{
+	int ret = 0;
+
+	spin_lock(&mptcp_pm_list_lock);
+	if (mptcp_pm_find(pm->name)) {
+		pr_notice("%s already registered\n", pm->name);
+		ret = -EEXIST;
+	} else {
+		list_add_tail_rcu(&pm->list, &mptcp_pm_list);
+		pr_debug("%s registered\n", pm->name);
+	}
+	spin_unlock(&mptcp_pm_list_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_path_manager);
+
+void mptcp_unregister_path_manager(struct mptcp_pm_ops *pm)
+{
+	spin_lock(&mptcp_pm_list_lock);
+	list_del_rcu(&pm->list);
+	spin_unlock(&mptcp_pm_list_lock);
+
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_path_manager);
+
+bool mptcp_pm_registered(const char *name)
+{
+	bool found;
+
+	rcu_read_lock();
+	found = !!mptcp_pm_find(name);
+	rcu_read_unlock();
+
+	return found;
+}
+
+/* The default path manager keeps the connection on its initial
+ * subflow.
+ */
+static struct mptcp_pm_ops mptcp_pm_default = {
+	.name		= "default",
+	.owner		= THIS_MODULE,
+};
+
+/* Open one more subflow from each local IPv4 address the connection
+ * does not use yet.
+ */
+static void mptcp_pm_fullmesh_established(struct sock *sk)
+{
+	__be32 addrs[MPTCP_SUBFLOWS_MAX];
+	struct net_device *dev;
+	int i, nr = 0;
+
+	rcu_read_lock();
+	for_each_netdev_rcu(sock_net(sk), dev) {
+		struct in_device *in_dev;
+
+		if (!(dev->flags & IFF_UP) || (dev->flags & IFF_LOOPBACK))
+			continue;
+
+		in_dev = __in_dev_get_rcu(dev);
+		if (!in_dev)
+			continue;
+
+		for_ifa(in_dev) {
+			if (nr == ARRAY_SIZE(addrs))
+				goto out;
+			if (!mptcp_uses_saddr(sk, ifa->ifa_local))
+				addrs[nr++] = ifa->ifa_local;
+		} endfor_ifa(in_dev);
+	}
+out:
+	rcu_read_unlock();
+
+	for (i = 0; i < nr; i++) {
+		if (mptcp_subflow_connect(sk, addrs[i]) == -EMLINK)
+			break;
+	}
+}
+
+static struct mptcp_pm_ops mptcp_pm_fullmesh = {
+	.fully_established	= mptcp_pm_fullmesh_established,
+	.name			= "fullmesh",
+	.owner			= THIS_MODULE,
+};
+
+void mptcp_pm_get(struct mptcp_sock *msk)
+{
+	const struct mptcp_pm_ops *pm;
+	char name[MPTCP_PM_NAME_MAX];
+
+	mptcp_get_path_manager(sock_net((struct sock *)msk), name);
+
+	rcu_read_lock();
+	pm = mptcp_pm_find(name);
+	if (!pm || !try_module_get(pm->owner))
+		pm = &mptcp_pm_default;
+	rcu_read_unlock();
+
+	msk->pm = pm;
+}
+
+void mptcp_pm_put(struct mptcp_sock *msk)
+{
+	if (msk->pm) {
+		module_put(msk->pm->owner);
+		msk->pm = NULL;
+	}
+}
+
+void __init mptcp_pm_init(void)
+{
+	mptcp_register_path_manager(&mptcp_pm_default);
+	mptcp_register_path_manager(&mptcp_pm_fullmesh);
+}
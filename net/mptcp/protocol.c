@@ -0,0 +1,1315 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP
+ *
+ * The MPTCP socket handed to applications creating a stream socket with
+ * IPPROTO_MPTCP. It owns the TCP subflows of the connection: data is
+ * spread over them by the packet scheduler, reassembled in data
+ * sequence order on receive, and kept until the peer acknowledges it at
+ * the connection level so that it can be sent again on another subflow
+ * if its subflow goes away.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/net.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include <net/sock.h>
+#include <net/inet_common.h>
+#include <net/inet_hashtables.h>
+#include <net/protocol.h>
+#include <net/tcp.h>
+
+#include "protocol.h"
+
+static void mptcp_worker(struct work_struct *work);
+
+static void mptcp_sock_init(struct mptcp_sock *msk)
+{
+	INIT_LIST_HEAD(&msk->conn_list);
+	INIT_LIST_HEAD(&msk->join_list);
+	INIT_LIST_HEAD(&msk->rtx_queue);
+	INIT_HLIST_NODE(&msk->token_node);
+	INIT_WORK(&msk->work, mptcp_worker);
+	spin_lock_init(&msk->join_list_lock);
+	msk->flags = BIT(MPTCP_SEND_SPACE);
+	msk->subflows = 0;
+	msk->local_id = 0;
+	msk->last_snd = NULL;
+	msk->subflow = NULL;
+}
+
+/* Defer work needing the MPTCP socket lock to process context. The
+ * pending work holds a reference on the socket.
+ */
+void mptcp_schedule_work(struct sock *sk)
+{
+	sock_hold(sk);
+	if (!schedule_work(&mptcp_sk(sk)->work))
+		sock_put(sk);
+}
+
+/* Subflows joined from softirq context are moved to the connection
+ * list once the MPTCP socket is locked.
+ */
+static void mptcp_splice_joins(struct mptcp_sock *msk)
+{
+	spin_lock_bh(&msk->join_list_lock);
+	list_splice_tail_init(&msk->join_list, &msk->conn_list);
+	spin_unlock_bh(&msk->join_list_lock);
+}
+
+static void mptcp_copy_inaddrs(struct sock *msk, const struct sock *ssk)
+{
+	struct inet_sock *inet = inet_sk(msk);
+	const struct inet_sock *ssk_inet = inet_sk(ssk);
+
+	inet->inet_sport = ssk_inet->inet_sport;
+	inet->inet_dport = ssk_inet->inet_dport;
+	inet->inet_saddr = ssk_inet->inet_saddr;
+	inet->inet_daddr = ssk_inet->inet_daddr;
+	inet->inet_rcv_saddr = ssk_inet->inet_rcv_saddr;
+}
+
+void mptcp_sock_graft(struct sock *sk, struct socket *parent)
+{
+	write_lock_bh(&sk->sk_callback_lock);
+	rcu_assign_pointer(sk->sk_wq, parent->wq);
+	sk_set_socket(sk, parent);
+	sk->sk_uid = SOCK_INODE(parent)->i_uid;
+	security_sock_graft(sk, parent);
+	write_unlock_bh(&sk->sk_callback_lock);
+}
+
+void mptcp_data_ready(struct sock *sk)
+{
+	set_bit(MPTCP_DATA_READY, &mptcp_sk(sk)->flags);
+	sk->sk_data_ready(sk);
+}
+
+void mptcp_write_space(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	set_bit(MPTCP_SEND_SPACE, &msk->flags);
+	if (test_bit(MPTCP_WORK_REINJECT, &msk->flags))
+		mptcp_schedule_work(sk);
+	sk->sk_write_space(sk);
+}
+
+/* Called from softirq context on every DSS carrying a data ack. */
+void mptcp_data_acked(struct sock *sk, u64 data_ack)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	u64 old, cur;
+
+	old = atomic64_read(&msk->snd_una);
+	for (;;) {
+		/* the DATA_FIN takes one sequence number */
+		if (!after64(data_ack, old) ||
+		    after64(data_ack, READ_ONCE(msk->write_seq) + 1))
+			return;
+
+		cur = atomic64_cmpxchg(&msk->snd_una, old, data_ack);
+		if (cur == old)
+			break;
+		old = cur;
+	}
+
+	/* free acked data and wake up writers from process context */
+	if (!sk_stream_is_writeable(sk))
+		mptcp_schedule_work(sk);
+}
+
+static void mptcp_clean_una(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	u64 snd_una = atomic64_read(&msk->snd_una);
+	struct mptcp_data_frag *dfrag, *tmp;
+	bool cleaned = false;
+
+	list_for_each_entry_safe(dfrag, tmp, &msk->rtx_queue, list) {
+		if (after64(dfrag->data_seq + dfrag->data_len, snd_una))
+			break;
+
+		list_del(&dfrag->list);
+		sk->sk_wmem_queued -= dfrag->data_len;
+		put_page(dfrag->page);
+		kfree(dfrag);
+		cleaned = true;
+	}
+
+	if (cleaned)
+		mptcp_write_space(sk);
+}
+
+static void mptcp_purge_rtx_queue(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_data_frag *dfrag, *tmp;
+
+	list_for_each_entry_safe(dfrag, tmp, &msk->rtx_queue, list) {
+		list_del(&dfrag->list);
+		put_page(dfrag->page);
+		kfree(dfrag);
+	}
+	sk->sk_wmem_queued = 0;
+}
+
+/* Send data acked by the peer at the subflow level but not at the
+ * connection level again, starting at msk->reinject_seq.
+ */
+static void mptcp_reinject(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_data_frag *dfrag;
+	u64 snd_una;
+
+	snd_una = atomic64_read(&msk->snd_una);
+	if (before64(msk->reinject_seq, snd_una))
+		msk->reinject_seq = snd_una;
+
+	list_for_each_entry(dfrag, &msk->rtx_queue, list) {
+		u64 end = dfrag->data_seq + dfrag->data_len;
+		struct sock *ssk;
+		int offset, len;
+		int ret;
+
+		if (!after64(end, msk->reinject_seq))
+			continue;
+
+		offset = 0;
+		if (after64(msk->reinject_seq, dfrag->data_seq))
+			offset = msk->reinject_seq - dfrag->data_seq;
+		len = dfrag->data_len - offset;
+
+		ssk = mptcp_sched_get_subflow(msk);
+		if (!ssk)
+			goto retry;
+
+		lock_sock(ssk);
+		ret = mptcp_subflow_send(ssk, dfrag->page,
+					 dfrag->offset + offset, len,
+					 dfrag->data_seq + offset);
+		release_sock(ssk);
+		if (ret <= 0)
+			goto retry;
+
+		msk->reinject_seq += ret;
+		if (ret < len)
+			goto retry;
+	}
+
+	return;
+
+retry:
+	/* picked up again on the next write space event */
+	set_bit(MPTCP_WORK_REINJECT, &msk->flags);
+}
+
+/* Drop the subflows that were reset or closed with nothing left to
+ * read. The initial subflow of a connection we opened lives as long
+ * as the MPTCP socket, a reset only disconnects it.
+ */
+static void mptcp_close_subflows(struct sock *sk)
+{
+	struct mptcp_subflow_context *subflow, *tmp;
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	bool closed = false;
+	int err = 0;
+
+	list_for_each_entry_safe(subflow, tmp, &msk->conn_list, node) {
+		struct socket *sock = subflow->sock;
+		struct sock *ssk = subflow->ssk;
+
+		if (!subflow->reset &&
+		    (ssk->sk_state != TCP_CLOSE ||
+		     !skb_queue_empty(&ssk->sk_receive_queue)))
+			continue;
+		if (msk->subflow && sock == msk->subflow) {
+			/* keep the socket, but stop talking on it */
+			if (subflow->reset && ssk->sk_state != TCP_CLOSE) {
+				lock_sock(ssk);
+				tcp_disconnect(ssk, 0);
+				release_sock(ssk);
+				closed = true;
+			}
+			continue;
+		}
+
+		list_del_init(&subflow->node);
+		if (msk->pm->subflow_closed)
+			msk->pm->subflow_closed(sk, ssk);
+		if (msk->last_snd == ssk)
+			msk->last_snd = NULL;
+		if (ssk->sk_err)
+			err = ssk->sk_err;
+
+		spin_lock_bh(&msk->join_list_lock);
+		msk->subflows--;
+		spin_unlock_bh(&msk->join_list_lock);
+
+		lock_sock(ssk);
+		if (subflow->reset) {
+			sock_set_flag(ssk, SOCK_LINGER);
+			ssk->sk_lingertime = 0;
+		}
+		release_sock(ssk);
+
+		if (sock)
+			sock_release(sock);
+		else
+			tcp_close(ssk, 0);
+		closed = true;
+	}
+
+	if (!closed)
+		return;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		if (subflow->ssk->sk_state != TCP_CLOSE) {
+			set_bit(MPTCP_WORK_REINJECT, &msk->flags);
+			msk->reinject_seq = atomic64_read(&msk->snd_una);
+			return;
+		}
+	}
+
+	/* no way left to reach the peer */
+	sk->sk_err = err ? : ECONNRESET;
+	sk->sk_shutdown = SHUTDOWN_MASK;
+	inet_sk_state_store(sk, TCP_CLOSE);
+	sk->sk_error_report(sk);
+}
+
+static void mptcp_send_acks(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = subflow->ssk;
+
+		lock_sock(ssk);
+		if (subflow->send_ack) {
+			subflow->send_ack = 0;
+			tcp_send_ack(ssk);
+		}
+		release_sock(ssk);
+	}
+}
+
+/* carry the data ack covering a received DATA_FIN to the peer */
+static void mptcp_send_data_ack(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = subflow->ssk;
+
+		if (ssk->sk_state == TCP_CLOSE ||
+		    !mptcp_subflow_usable(subflow))
+			continue;
+
+		lock_sock(ssk);
+		tcp_send_ack(ssk);
+		release_sock(ssk);
+		break;
+	}
+}
+
+static void mptcp_close(struct sock *sk, long timeout);
+
+static void mptcp_worker(struct work_struct *work)
+{
+	struct mptcp_sock *msk = container_of(work, struct mptcp_sock, work);
+	struct sock *sk = (struct sock *)msk;
+
+	/* the listener went away before the connection was accepted */
+	if (test_and_clear_bit(MPTCP_WORK_ORPHAN, &msk->flags)) {
+		mptcp_close(sk, 0);
+		goto out;
+	}
+
+	lock_sock(sk);
+	if (sk->sk_state == TCP_CLOSE)
+		goto unlock;
+
+	mptcp_splice_joins(msk);
+	mptcp_clean_una(sk);
+
+	if (test_and_clear_bit(MPTCP_WORK_CLOSE_SUBFLOW, &msk->flags) &&
+	    !test_bit(MPTCP_FALLBACK, &msk->flags))
+		mptcp_close_subflows(sk);
+	if (test_and_clear_bit(MPTCP_WORK_REINJECT, &msk->flags))
+		mptcp_reinject(sk);
+	if (test_and_clear_bit(MPTCP_WORK_SEND_ACK, &msk->flags))
+		mptcp_send_acks(msk);
+	if (test_and_clear_bit(MPTCP_WORK_PM, &msk->flags) &&
+	    msk->pm->fully_established)
+		msk->pm->fully_established(sk);
+
+unlock:
+	release_sock(sk);
+out:
+	sock_put(sk);
+}
+
+static int mptcp_init_sock(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	mptcp_sock_init(msk);
+
+	if (!mptcp_is_enabled(sock_net(sk)))
+		return -ENOPROTOOPT;
+
+	mptcp_sched_get(msk);
+	mptcp_pm_get(msk);
+	sk->sk_write_space = sk_stream_write_space;
+
+	/* user sockets hand their initial subflow to user space on fallback */
+	return mptcp_subflow_create_socket(sk, &msk->subflow,
+					   !sk->sk_net_refcnt);
+}
+
+/* Called from softirq context once the initial subflow of a connection
+ * we opened is established, @remote_key is only valid without fallback.
+ */
+void mptcp_finish_connect(struct sock *sk, u64 remote_key)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	u64 ack_seq;
+
+	if (!test_bit(MPTCP_FALLBACK, &msk->flags)) {
+		msk->remote_key = remote_key;
+		mptcp_crypto_key_sha1(remote_key, &msk->remote_token,
+				      &ack_seq);
+		atomic64_set(&msk->ack_seq, ack_seq + 1);
+		set_bit(MPTCP_WORK_PM, &msk->flags);
+		mptcp_schedule_work(sk);
+	}
+
+	inet_sk_state_store(sk, TCP_ESTABLISHED);
+	sk->sk_state_change(sk);
+}
+
+/* Called from softirq context for a subflow that completed its MP_JOIN
+ * handshake. Returns false if the connection cannot take it.
+ */
+bool mptcp_finish_join(struct sock *sk, struct mptcp_subflow_context *subflow)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	bool ret = false;
+
+	spin_lock_bh(&msk->join_list_lock);
+	if (sk->sk_state == TCP_ESTABLISHED &&
+	    msk->subflows < MPTCP_SUBFLOWS_MAX) {
+		list_add_tail(&subflow->node, &msk->join_list);
+		msk->subflows++;
+		if (sk->sk_socket)
+			mptcp_sock_graft(subflow->ssk, sk->sk_socket);
+		ret = true;
+	}
+	spin_unlock_bh(&msk->join_list_lock);
+
+	return ret;
+}
+
+/**
+ * mptcp_sk_clone - create the connection of an MP_CAPABLE child
+ * @sk: the listening MPTCP socket
+ * @local_key: key we announced in the SYN/ACK
+ * @remote_key: key announced by the peer
+ * @priority: allocation flags
+ *
+ * The new socket is established and waits to be accepted through the
+ * listener. Returns NULL if it cannot be created or its token was
+ * taken by another connection in the meantime.
+ */
+struct sock *mptcp_sk_clone(const struct sock *sk, u64 local_key,
+			    u64 remote_key, gfp_t priority)
+{
+	struct mptcp_sock *msk;
+	struct sock *nsk;
+	u64 idsn;
+
+	nsk = sk_clone_lock(sk, priority);
+	if (!nsk)
+		return NULL;
+
+	msk = mptcp_sk(nsk);
+	mptcp_sock_init(msk);
+	msk->local_key = local_key;
+	msk->remote_key = remote_key;
+	mptcp_crypto_key_sha1(local_key, &msk->token, &idsn);
+	if (mptcp_token_insert(nsk)) {
+		sk_free_unlock_clone(nsk);
+		return NULL;
+	}
+
+	msk->write_seq = idsn + 1;
+	atomic64_set(&msk->snd_una, msk->write_seq);
+	mptcp_crypto_key_sha1(remote_key, &msk->remote_token, &idsn);
+	atomic64_set(&msk->ack_seq, idsn + 1);
+
+	__module_get(msk->sched->owner);
+	__module_get(msk->pm->owner);
+	msk->subflows = 1;
+	inet_sk_state_store(nsk, TCP_ESTABLISHED);
+	bh_unlock_sock(nsk);
+
+	return nsk;
+}
+
+static void mptcp_queue_data_fin(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	if (test_bit(MPTCP_FALLBACK, &msk->flags) ||
+	    !((1 << sk->sk_state) & (TCPF_ESTABLISHED | TCPF_CLOSE_WAIT)))
+		return;
+
+	WRITE_ONCE(msk->data_fin_seq, msk->write_seq);
+	smp_mb__before_atomic();
+	set_bit(MPTCP_SEND_DATA_FIN, &msk->flags);
+}
+
+static void mptcp_close(struct sock *sk, long timeout)
+{
+	struct mptcp_subflow_context *subflow, *tmp;
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	lock_sock(sk);
+
+	mptcp_token_destroy(sk);
+	mptcp_queue_data_fin(sk);
+
+	spin_lock_bh(&msk->join_list_lock);
+	inet_sk_state_store(sk, TCP_CLOSE);
+	list_splice_tail_init(&msk->join_list, &msk->conn_list);
+	spin_unlock_bh(&msk->join_list_lock);
+
+	list_for_each_entry_safe(subflow, tmp, &msk->conn_list, node) {
+		struct socket *sock = subflow->sock;
+		struct sock *ssk = subflow->ssk;
+
+		list_del_init(&subflow->node);
+		if (sock) {
+			if (sock == msk->subflow)
+				msk->subflow = NULL;
+			sock_release(sock);
+		} else {
+			tcp_close(ssk, timeout);
+		}
+	}
+
+	/* the listener, or a socket that never connected */
+	if (msk->subflow) {
+		sock_release(msk->subflow);
+		msk->subflow = NULL;
+	}
+
+	release_sock(sk);
+	sk_common_release(sk);
+}
+
+static void mptcp_destroy(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	mptcp_token_destroy(sk);
+	mptcp_purge_rtx_queue(sk);
+	mptcp_sched_put(msk);
+	mptcp_pm_put(msk);
+}
+
+static int mptcp_disconnect(struct sock *sk, int flags)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+	struct sock *ssk;
+
+	if (msk->subflow) {
+		ssk = msk->subflow->sk;
+		subflow = mptcp_subflow_ctx(ssk);
+		/* not on the connection list while listening */
+		if (list_empty(&subflow->node)) {
+			lock_sock(ssk);
+			tcp_disconnect(ssk, flags);
+			release_sock(ssk);
+		}
+	}
+
+	mptcp_for_each_subflow(msk, subflow) {
+		ssk = subflow->ssk;
+		lock_sock(ssk);
+		tcp_disconnect(ssk, flags);
+		release_sock(ssk);
+	}
+
+	inet_sk_state_store(sk, TCP_CLOSE);
+	return 0;
+}
+
+static void mptcp_shutdown(struct sock *sk, int how)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+
+	if (!(how & SEND_SHUTDOWN))
+		return;
+
+	mptcp_queue_data_fin(sk);
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = subflow->ssk;
+
+		lock_sock(ssk);
+		ssk->sk_shutdown |= how;
+		tcp_shutdown(ssk, how);
+		release_sock(ssk);
+	}
+}
+
+/* the subflow socket options are forwarded to */
+static struct sock *mptcp_first_subflow(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+	struct sock *ssk = NULL;
+
+	lock_sock(sk);
+	if (msk->subflow) {
+		ssk = msk->subflow->sk;
+	} else if (!list_empty(&msk->conn_list)) {
+		subflow = list_first_entry(&msk->conn_list,
+					   struct mptcp_subflow_context, node);
+		ssk = subflow->ssk;
+	}
+	if (ssk)
+		sock_hold(ssk);
+	release_sock(sk);
+
+	return ssk;
+}
+
+static int mptcp_setsockopt(struct sock *sk, int level, int optname,
+			    char __user *optval, unsigned int optlen)
+{
+	struct sock *ssk = mptcp_first_subflow(sk);
+	int ret;
+
+	if (!ssk)
+		return -ENOTCONN;
+
+	ret = ssk->sk_prot->setsockopt(ssk, level, optname, optval, optlen);
+	sock_put(ssk);
+
+	return ret;
+}
+
+static int mptcp_getsockopt(struct sock *sk, int level, int optname,
+			    char __user *optval, int __user *optlen)
+{
+	struct sock *ssk = mptcp_first_subflow(sk);
+	int ret;
+
+	if (!ssk)
+		return -ENOTCONN;
+
+	ret = ssk->sk_prot->getsockopt(ssk, level, optname, optval, optlen);
+	sock_put(ssk);
+
+	return ret;
+}
+
+/* Mark the connection as out of send space. Subflows only report
+ * write space to a socket flagged with SOCK_NOSPACE.
+ */
+static void mptcp_nospace(struct mptcp_sock *msk)
+{
+	struct sock *sk = (struct sock *)msk;
+	struct mptcp_subflow_context *subflow;
+
+	clear_bit(MPTCP_SEND_SPACE, &msk->flags);
+	smp_mb__after_atomic(); /* msk->flags is changed by write_space cb */
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct socket *sock = READ_ONCE(subflow->ssk->sk_socket);
+
+		if (sock)
+			set_bit(SOCK_NOSPACE, &sock->flags);
+	}
+	set_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
+}
+
+static struct sock *mptcp_get_subflow(struct sock *sk)
+{
+	if (!sk_stream_memory_free(sk))
+		return NULL;
+
+	return mptcp_sched_get_subflow(mptcp_sk(sk));
+}
+
+static int mptcp_wait_sndbuf(struct sock *sk, long *timeo)
+{
+	DEFINE_WAIT_FUNC(wait, woken_wake_function);
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	if (!*timeo)
+		return -EAGAIN;
+	if (signal_pending(current))
+		return sock_intr_errno(*timeo);
+
+	add_wait_queue(sk_sleep(sk), &wait);
+	sk_wait_event(sk, timeo,
+		      test_bit(MPTCP_SEND_SPACE, &msk->flags) || sk->sk_err ||
+		      (sk->sk_shutdown & SEND_SHUTDOWN), &wait);
+	remove_wait_queue(sk_sleep(sk), &wait);
+
+	if (signal_pending(current))
+		return sock_intr_errno(*timeo);
+
+	return 0;
+}
+
+/* Copy the next chunk of @msg to a page fragment owned by the MPTCP
+ * socket and queue it on @ssk. Returns the number of bytes sent,
+ * zero if the subflow had no room after all.
+ */
+static int mptcp_sendmsg_frag(struct sock *sk, struct sock *ssk,
+			      struct msghdr *msg)
+{
+	struct page_frag *pfrag = sk_page_frag(sk);
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_data_frag *dfrag;
+	size_t psize;
+	int ret;
+
+	if (!sk_page_frag_refill(sk, pfrag))
+		return -ENOMEM;
+
+	dfrag = kmalloc(sizeof(*dfrag), sk->sk_allocation);
+	if (!dfrag)
+		return -ENOMEM;
+
+	psize = min_t(size_t, pfrag->size - pfrag->offset,
+		      msg_data_left(msg));
+	if (copy_page_from_iter(pfrag->page, pfrag->offset, psize,
+				&msg->msg_iter) != psize) {
+		kfree(dfrag);
+		return -EFAULT;
+	}
+
+	lock_sock(ssk);
+	ret = mptcp_subflow_send(ssk, pfrag->page, pfrag->offset, psize,
+				 msk->write_seq);
+	release_sock(ssk);
+	if (ret <= 0) {
+		iov_iter_revert(&msg->msg_iter, psize);
+		kfree(dfrag);
+		return ret;
+	}
+	if (ret < psize)
+		iov_iter_revert(&msg->msg_iter, psize - ret);
+
+	dfrag->data_seq = msk->write_seq;
+	dfrag->data_len = ret;
+	dfrag->offset = pfrag->offset;
+	dfrag->page = pfrag->page;
+	get_page(dfrag->page);
+	list_add_tail(&dfrag->list, &msk->rtx_queue);
+
+	pfrag->offset += ret;
+	sk->sk_wmem_queued += ret;
+	WRITE_ONCE(msk->write_seq, msk->write_seq + ret);
+	msk->last_snd = ssk;
+
+	return ret;
+}
+
+static int mptcp_sendmsg(struct sock *sk, struct msghdr *msg, size_t len)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	int copied = 0;
+	int ret = 0;
+	long timeo;
+
+	if (msg->msg_flags & ~(MSG_MORE | MSG_DONTWAIT | MSG_NOSIGNAL |
+			       MSG_EOR | MSG_CMSG_COMPAT))
+		return -EOPNOTSUPP;
+
+	lock_sock(sk);
+
+	timeo = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
+	if ((1 << sk->sk_state) & ~(TCPF_ESTABLISHED | TCPF_CLOSE_WAIT)) {
+		ret = sk_stream_wait_connect(sk, &timeo);
+		if (ret)
+			goto out;
+	}
+
+	if (test_bit(MPTCP_FALLBACK, &msk->flags)) {
+		struct sock *ssk = msk->subflow->sk;
+
+		release_sock(sk);
+		return tcp_sendmsg(ssk, msg, len);
+	}
+
+	while (msg_data_left(msg)) {
+		struct sock *ssk;
+
+		if (sk->sk_err || (sk->sk_shutdown & SEND_SHUTDOWN)) {
+			ret = -EPIPE;
+			goto out;
+		}
+
+		mptcp_splice_joins(msk);
+		mptcp_clean_una(sk);
+
+		ssk = mptcp_get_subflow(sk);
+		if (!ssk) {
+			/* recheck after asking for a write space event */
+			mptcp_nospace(msk);
+			ssk = mptcp_get_subflow(sk);
+		}
+		if (!ssk) {
+			ret = mptcp_wait_sndbuf(sk, &timeo);
+			if (ret)
+				goto out;
+			continue;
+		}
+
+		ret = mptcp_sendmsg_frag(sk, ssk, msg);
+		if (ret < 0)
+			goto out;
+		if (!ret) {
+			mptcp_nospace(msk);
+			continue;
+		}
+		copied += ret;
+	}
+
+out:
+	if (copied)
+		ret = copied;
+	else if (ret < 0)
+		ret = sk_stream_error(sk, msg->msg_flags, ret);
+	release_sock(sk);
+	return ret;
+}
+
+struct mptcp_read_arg {
+	struct msghdr			*msg;
+	struct mptcp_sock		*msk;
+	struct mptcp_subflow_context	*subflow;
+	int				copied;
+};
+
+/* Copies subflow data that is next in data sequence order, and drops
+ * data already received on another subflow.
+ */
+static int mptcp_read_actor(read_descriptor_t *desc, struct sk_buff *skb,
+			    unsigned int offset, size_t len)
+{
+	struct mptcp_read_arg *arg = desc->arg.data;
+	u32 seq = TCP_SKB_CB(skb)->seq + offset;
+	struct mptcp_sock *msk = arg->msk;
+	struct mptcp_map *map;
+	u64 ack_seq, dsn;
+	size_t avail;
+
+	if (!desc->count)
+		return 0;
+
+	map = mptcp_subflow_rx_map(arg->subflow, seq);
+	if (!map)
+		return 0;
+
+	ack_seq = atomic64_read(&msk->ack_seq);
+	dsn = map->data_seq + (seq - map->subflow_seq);
+	avail = min_t(size_t, len, map->subflow_seq + map->len - seq);
+
+	if (before64(dsn, ack_seq))
+		return min_t(u64, avail, ack_seq - dsn);
+
+	/* wait for the data before it, on another subflow */
+	if (after64(dsn, ack_seq))
+		return 0;
+
+	avail = min(avail, desc->count);
+	if (skb_copy_datagram_msg(skb, offset, arg->msg, avail)) {
+		desc->error = -EFAULT;
+		return 0;
+	}
+
+	atomic64_add(avail, &msk->ack_seq);
+	desc->count -= avail;
+	arg->copied += avail;
+
+	return avail;
+}
+
+/* Returns the number of subflow bytes consumed, @copied is increased
+ * by the number of bytes copied to @msg.
+ */
+static int mptcp_read_subflow(struct mptcp_sock *msk,
+			      struct mptcp_subflow_context *subflow,
+			      struct msghdr *msg, size_t len, int *copied)
+{
+	struct mptcp_read_arg arg = {
+		.msg		= msg,
+		.msk		= msk,
+		.subflow	= subflow,
+	};
+	read_descriptor_t desc = {
+		.arg.data	= &arg,
+		.count		= len,
+	};
+	struct sock *ssk = subflow->ssk;
+	int ret;
+
+	lock_sock(ssk);
+	ret = tcp_read_sock(ssk, &desc, mptcp_read_actor);
+	mptcp_subflow_rx_maps_prune(subflow, tcp_sk(ssk)->copied_seq);
+	release_sock(ssk);
+
+	*copied += arg.copied;
+	if (desc.error)
+		return desc.error;
+
+	return ret;
+}
+
+static int mptcp_read_subflows(struct sock *sk, struct msghdr *msg,
+			       size_t len)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+	int copied = 0;
+	bool progress;
+
+	do {
+		progress = false;
+		mptcp_for_each_subflow(msk, subflow) {
+			int ret;
+
+			if (copied >= len)
+				break;
+
+			ret = mptcp_read_subflow(msk, subflow, msg,
+						 len - copied, &copied);
+			if (ret < 0)
+				return copied ? : ret;
+			if (ret > 0)
+				progress = true;
+		}
+	} while (progress && copied < len);
+
+	return copied;
+}
+
+/* All data has been read once the DATA_FIN is reached, or, should the
+ * peer never send one, when all subflows are closed and drained.
+ */
+static bool mptcp_rcv_eof(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+
+	if (sk->sk_shutdown & RCV_SHUTDOWN)
+		return true;
+
+	if (test_bit(MPTCP_DATA_FIN, &msk->flags)) {
+		smp_mb__after_atomic();
+		if (atomic64_read(&msk->ack_seq) != msk->rcv_data_fin_seq)
+			return false;
+
+		atomic64_set(&msk->ack_seq, msk->rcv_data_fin_seq + 1);
+		mptcp_send_data_ack(msk);
+		goto eof;
+	}
+
+	if (list_empty(&msk->conn_list))
+		return false;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = subflow->ssk;
+
+		if (!(ssk->sk_shutdown & RCV_SHUTDOWN) ||
+		    !skb_queue_empty(&ssk->sk_receive_queue))
+			return false;
+	}
+
+eof:
+	sk->sk_shutdown |= RCV_SHUTDOWN;
+	return true;
+}
+
+static void mptcp_wait_data(struct sock *sk, long *timeo)
+{
+	DEFINE_WAIT_FUNC(wait, woken_wake_function);
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	add_wait_queue(sk_sleep(sk), &wait);
+	sk_set_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+	sk_wait_event(sk, timeo,
+		      test_bit(MPTCP_DATA_READY, &msk->flags), &wait);
+	sk_clear_bit(SOCKWQ_ASYNC_WAITDATA, sk);
+	remove_wait_queue(sk_sleep(sk), &wait);
+}
+
+static int mptcp_recvmsg(struct sock *sk, struct msghdr *msg, size_t len,
+			 int nonblock, int flags, int *addr_len)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	int copied = 0;
+	int target;
+	long timeo;
+
+	if (flags & (MSG_PEEK | MSG_OOB | MSG_ERRQUEUE))
+		return -EOPNOTSUPP;
+
+	lock_sock(sk);
+	if (test_bit(MPTCP_FALLBACK, &msk->flags)) {
+		struct sock *ssk = msk->subflow->sk;
+
+		release_sock(sk);
+		return tcp_recvmsg(ssk, msg, len, nonblock, flags, addr_len);
+	}
+
+	len = min_t(size_t, len, INT_MAX);
+	timeo = sock_rcvtimeo(sk, nonblock);
+	target = sock_rcvlowat(sk, flags & MSG_WAITALL, len);
+
+	while (copied < len) {
+		int ret;
+
+		clear_bit(MPTCP_DATA_READY, &msk->flags);
+		smp_mb__after_atomic();
+
+		mptcp_splice_joins(msk);
+		ret = mptcp_read_subflows(sk, msg, len - copied);
+		if (ret < 0) {
+			if (!copied)
+				copied = ret;
+			break;
+		}
+		copied += ret;
+		if (ret)
+			continue;
+
+		if (copied >= target || mptcp_rcv_eof(sk))
+			break;
+
+		if (copied) {
+			if (sk->sk_err || sk->sk_state == TCP_CLOSE ||
+			    !timeo || signal_pending(current))
+				break;
+		} else {
+			if (sk->sk_err) {
+				copied = sock_error(sk);
+				break;
+			}
+			if (sk->sk_state == TCP_CLOSE) {
+				copied = -ENOTCONN;
+				break;
+			}
+			if (!timeo) {
+				copied = -EAGAIN;
+				break;
+			}
+			if (signal_pending(current)) {
+				copied = sock_intr_errno(timeo);
+				break;
+			}
+		}
+
+		mptcp_wait_data(sk, &timeo);
+	}
+
+	/* more data may be left in the subflows */
+	if (copied == len)
+		set_bit(MPTCP_DATA_READY, &msk->flags);
+
+	release_sock(sk);
+	return copied;
+}
+
+static int mptcp_hash(struct sock *sk)
+{
+	return 0;
+}
+
+static void mptcp_unhash(struct sock *sk)
+{
+}
+
+static struct proto mptcp_prot = {
+	.name		= "MPTCP",
+	.owner		= THIS_MODULE,
+	.init		= mptcp_init_sock,
+	.close		= mptcp_close,
+	.destroy	= mptcp_destroy,
+	.disconnect	= mptcp_disconnect,
+	.shutdown	= mptcp_shutdown,
+	.setsockopt	= mptcp_setsockopt,
+	.getsockopt	= mptcp_getsockopt,
+	.sendmsg	= mptcp_sendmsg,
+	.recvmsg	= mptcp_recvmsg,
+	.hash		= mptcp_hash,
+	.unhash		= mptcp_unhash,
+	.no_autobind	= true,
+	.obj_size	= sizeof(struct mptcp_sock),
+};
+
+static int mptcp_stream_bind(struct socket *sock, struct sockaddr *uaddr,
+			     int addr_len)
+{
+	struct mptcp_sock *msk = mptcp_sk(sock->sk);
+	struct socket *ssock;
+	int err = -EINVAL;
+
+	lock_sock(sock->sk);
+	ssock = msk->subflow;
+	if (ssock) {
+		err = ssock->ops->bind(ssock, uaddr, addr_len);
+		if (!err)
+			mptcp_copy_inaddrs(sock->sk, ssock->sk);
+	}
+	release_sock(sock->sk);
+
+	return err;
+}
+
+static int mptcp_stream_connect(struct socket *sock, struct sockaddr *uaddr,
+				int addr_len, int flags)
+{
+	struct sock *sk = sock->sk;
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+	struct socket *ssock;
+	int err = -EINVAL;
+	u64 idsn;
+
+	lock_sock(sk);
+	ssock = msk->subflow;
+	if (!ssock)
+		goto unlock;
+
+	if (sk->sk_state == TCP_CLOSE) {
+		subflow = mptcp_subflow_ctx(ssock->sk);
+
+		if (hlist_unhashed(&msk->token_node))
+			mptcp_token_new_connect(sk);
+		mptcp_crypto_key_sha1(msk->local_key, NULL, &idsn);
+		msk->write_seq = idsn + 1;
+		atomic64_set(&msk->snd_una, msk->write_seq);
+		clear_bit(MPTCP_FALLBACK, &msk->flags);
+
+		subflow->request_mptcp = 1;
+		subflow->local_key = msk->local_key;
+		subflow->token = msk->token;
+		if (list_empty(&subflow->node)) {
+			list_add(&subflow->node, &msk->conn_list);
+			spin_lock_bh(&msk->join_list_lock);
+			msk->subflows = 1;
+			spin_unlock_bh(&msk->join_list_lock);
+		}
+		inet_sk_state_store(sk, TCP_SYN_SENT);
+	}
+
+	/* the handshake completes from softirq context without the lock */
+	release_sock(sk);
+	err = ssock->ops->connect(ssock, uaddr, addr_len, flags);
+	lock_sock(sk);
+
+	if (err && err != -EINPROGRESS && err != -EALREADY &&
+	    sk->sk_state == TCP_SYN_SENT && ssock->sk->sk_state == TCP_CLOSE)
+		inet_sk_state_store(sk, TCP_CLOSE);
+
+	mptcp_copy_inaddrs(sk, ssock->sk);
+	sock->state = ssock->state;
+
+unlock:
+	release_sock(sk);
+	return err;
+}
+
+static int mptcp_stream_accept(struct socket *sock, struct socket *newsock,
+			       int flags, bool kern)
+{
+	struct mptcp_sock *msk = mptcp_sk(sock->sk);
+	struct mptcp_subflow_context *subflow;
+	struct mptcp_sock *new_msk;
+	struct socket *ssock;
+	struct sock *ssk;
+	struct sock *nsk;
+	int err = -EINVAL;
+
+	ssock = READ_ONCE(msk->subflow);
+	if (!ssock)
+		return err;
+
+	ssk = ssock->sk->sk_prot->accept(ssock->sk, flags, &err, kern);
+	if (!ssk)
+		return err;
+
+	/* the peer does not speak MPTCP, hand out the TCP socket */
+	if (!tcp_sk(ssk)->is_mptcp) {
+		lock_sock(ssk);
+		sock_graft(ssk, newsock);
+		newsock->ops = &inet_stream_ops;
+		newsock->state = SS_CONNECTED;
+		release_sock(ssk);
+		return 0;
+	}
+
+	subflow = mptcp_subflow_ctx(ssk);
+	nsk = subflow->conn;
+	new_msk = mptcp_sk(nsk);
+
+	lock_sock(nsk);
+	mptcp_copy_inaddrs(nsk, ssk);
+
+	/* MP_JOINs arriving from now on graft themselves */
+	spin_lock_bh(&new_msk->join_list_lock);
+	sock_graft(nsk, newsock);
+	list_splice_tail_init(&new_msk->join_list, &new_msk->conn_list);
+	spin_unlock_bh(&new_msk->join_list_lock);
+
+	subflow->owns_conn = false;
+	list_add(&subflow->node, &new_msk->conn_list);
+	mptcp_for_each_subflow(new_msk, subflow)
+		mptcp_sock_graft(subflow->ssk, newsock);
+
+	newsock->state = SS_CONNECTED;
+	release_sock(nsk);
+
+	return 0;
+}
+
+static int mptcp_stream_getname(struct socket *sock, struct sockaddr *uaddr,
+				int peer)
+{
+	struct socket *ssock = READ_ONCE(mptcp_sk(sock->sk)->subflow);
+
+	/* accepted connections carry the addresses of their first subflow */
+	if (!ssock)
+		return inet_getname(sock, uaddr, peer);
+
+	return inet_getname(ssock, uaddr, peer);
+}
+
+static int mptcp_stream_listen(struct socket *sock, int backlog)
+{
+	struct mptcp_sock *msk = mptcp_sk(sock->sk);
+	struct socket *ssock;
+	int err = -EINVAL;
+
+	lock_sock(sock->sk);
+	ssock = msk->subflow;
+	if (ssock) {
+		err = ssock->ops->listen(ssock, backlog);
+		if (!err) {
+			mptcp_copy_inaddrs(sock->sk, ssock->sk);
+			inet_sk_state_store(sock->sk, TCP_LISTEN);
+		}
+	}
+	release_sock(sock->sk);
+
+	return err;
+}
+
+static __poll_t mptcp_poll(struct file *file, struct socket *sock,
+			   struct poll_table_struct *wait)
+{
+	struct sock *sk = sock->sk;
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct socket *ssock;
+	__poll_t mask = 0;
+	int state;
+
+	/* subflows forward their wake ups to the MPTCP socket */
+	sock_poll_wait(file, sk_sleep(sk), wait);
+
+	state = inet_sk_state_load(sk);
+	ssock = READ_ONCE(msk->subflow);
+	if (ssock && (state == TCP_LISTEN ||
+		      test_bit(MPTCP_FALLBACK, &msk->flags)))
+		return tcp_poll(file, ssock, NULL);
+
+	if (sk->sk_shutdown == SHUTDOWN_MASK || state == TCP_CLOSE)
+		mask |= EPOLLHUP;
+	if (sk->sk_shutdown & RCV_SHUTDOWN)
+		mask |= EPOLLIN | EPOLLRDNORM | EPOLLRDHUP;
+
+	if (state != TCP_SYN_SENT) {
+		if (test_bit(MPTCP_DATA_READY, &msk->flags))
+			mask |= EPOLLIN | EPOLLRDNORM;
+
+		if (!(sk->sk_shutdown & SEND_SHUTDOWN)) {
+			if (test_bit(MPTCP_SEND_SPACE, &msk->flags) &&
+			    sk_stream_is_writeable(sk))
+				mask |= EPOLLOUT | EPOLLWRNORM;
+			else
+				set_bit(SOCK_NOSPACE, &sock->flags);
+		} else {
+			mask |= EPOLLOUT | EPOLLWRNORM;
+		}
+	}
+
+	if (sk->sk_err)
+		mask |= EPOLLERR;
+
+	return mask;
+}
+
+static const struct proto_ops mptcp_stream_ops = {
+	.family		   = PF_INET,
+	.owner		   = THIS_MODULE,
+	.release	   = inet_release,
+	.bind		   = mptcp_stream_bind,
+	.connect	   = mptcp_stream_connect,
+	.socketpair	   = sock_no_socketpair,
+	.accept		   = mptcp_stream_accept,
+	.getname	   = mptcp_stream_getname,
+	.poll		   = mptcp_poll,
+	.ioctl		   = inet_ioctl,
+	.listen		   = mptcp_stream_listen,
+	.shutdown	   = inet_shutdown,
+	.setsockopt	   = sock_common_setsockopt,
+	.getsockopt	   = sock_common_getsockopt,
+	.sendmsg	   = inet_sendmsg,
+	.recvmsg	   = inet_recvmsg,
+	.mmap		   = sock_no_mmap,
+	.sendpage	   = sock_no_sendpage,
+#ifdef CONFIG_COMPAT
+	.compat_setsockopt = compat_sock_common_setsockopt,
+	.compat_getsockopt = compat_sock_common_getsockopt,
+#endif
+};
+
+static struct inet_protosw mptcp_protosw = {
+	.type		= SOCK_STREAM,
+	.protocol	= IPPROTO_MPTCP,
+	.prot		= &mptcp_prot,
+	.ops		= &mptcp_stream_ops,
+};
+
+void __init mptcp_init(void)
+{
+	if (mptcp_ctrl_init())
+		panic("Failed to register MPTCP pernet operations\n");
+
+	mptcp_token_init();
+	mptcp_sched_init();
+	mptcp_pm_init();
+	mptcp_subflow_init();
+
+	if (proto_register(&mptcp_prot, 1) != 0)
+		panic("Failed to register MPTCP proto.\n");
+
+	inet_register_protosw(&mptcp_protosw);
+}
@@ -0,0 +1,302 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Multipath TCP
+ *
+ * Internal definitions shared by the MPTCP socket, the subflow ULP and
+ * the option handling code.
+ */
+
+#ifndef __MPTCP_PROTOCOL_H
+#define __MPTCP_PROTOCOL_H
+
+#include <linux/atomic.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <net/inet_connection_sock.h>
+#include <net/mptcp.h>
+#include <net/tcp.h>
+
+#define MPTCP_VERSION		0
+
+/* MPTCP option subtypes */
+#define MPTCPOPT_MP_CAPABLE	0
+#define MPTCPOPT_MP_JOIN	1
+#define MPTCPOPT_DSS		2
+
+/* MPTCP suboption lengths */
+#define TCPOLEN_MPTCP_MPC_SYN		12
+#define TCPOLEN_MPTCP_MPC_SYNACK	12
+#define TCPOLEN_MPTCP_MPC_ACK		20
+#define TCPOLEN_MPTCP_MPJ_SYN		12
+#define TCPOLEN_MPTCP_MPJ_SYNACK	16
+#define TCPOLEN_MPTCP_MPJ_ACK		24
+#define TCPOLEN_MPTCP_DSS_BASE		4
+#define TCPOLEN_MPTCP_DSS_ACK32		4
+#define TCPOLEN_MPTCP_DSS_ACK64		8
+#define TCPOLEN_MPTCP_DSS_MAP32		10
+#define TCPOLEN_MPTCP_DSS_MAP64		14
+#define TCPOLEN_MPTCP_DSS_CHECKSUM	2
+/* DSS with a 64 bit data ack, and the same plus a 64 bit mapping */
+#define TCPOLEN_MPTCP_DSS_ACK_ALIGNED	12
+#define TCPOLEN_MPTCP_DSS_MAP_ALIGNED	28
+
+/* MP_CAPABLE flags */
+#define MPTCP_CAP_CHECKSUM_REQD	BIT(7)
+#define MPTCP_CAP_HMAC_SHA1	BIT(0)
+
+/* MP_JOIN flags */
+#define MPTCPOPT_BACKUP		BIT(0)
+
+/* DSS flags */
+#define MPTCP_DSS_DATA_FIN	BIT(4)
+#define MPTCP_DSS_DSN64		BIT(3)
+#define MPTCP_DSS_HAS_MAP	BIT(2)
+#define MPTCP_DSS_ACK64		BIT(1)
+#define MPTCP_DSS_HAS_ACK	BIT(0)
+
+/* suboptions carried by struct mptcp_out_options */
+#define OPTION_MPTCP_MPC_SYN	BIT(0)
+#define OPTION_MPTCP_MPC_SYNACK	BIT(1)
+#define OPTION_MPTCP_MPC_ACK	BIT(2)
+#define OPTION_MPTCP_MPJ_SYN	BIT(3)
+#define OPTION_MPTCP_MPJ_SYNACK	BIT(4)
+#define OPTION_MPTCP_MPJ_ACK	BIT(5)
+#define OPTION_MPTCP_DSS	BIT(6)
+
+/* MPTCP socket flags */
+#define MPTCP_DATA_READY	0
+#define MPTCP_SEND_SPACE	1
+#define MPTCP_FALLBACK		2	/* peer did not send MP_CAPABLE */
+#define MPTCP_DATA_FIN		3	/* rcv_data_fin_seq is valid */
+#define MPTCP_SEND_DATA_FIN	4	/* DATA_FIN queued at data_fin_seq */
+#define MPTCP_WORK_REINJECT	5
+#define MPTCP_WORK_SEND_ACK	6
+#define MPTCP_WORK_PM		7
+#define MPTCP_WORK_CLOSE_SUBFLOW 8
+#define MPTCP_WORK_ORPHAN	9	/* never accepted, listener gone */
+
+/* upper bound on the receive mappings remembered per subflow */
+#define MPTCP_RX_MAPS_MAX	1024
+
+struct mptcp_options_received {
+	u64	sndr_key;
+	u64	rcvr_key;
+	u64	data_ack;
+	u64	data_seq;
+	u64	thmac;
+	u32	subflow_seq;
+	u32	token;
+	u32	nonce;
+	u16	data_len;
+	u8	hmac[MPTCPOPT_HMAC_LEN];
+	u16	mp_capable : 1,
+		mpc_ack : 1,	/* MP_CAPABLE carrying both keys */
+		mp_join_syn : 1,
+		mp_join_synack : 1,
+		mp_join_ack : 1,
+		dss : 1,
+		use_map : 1,
+		dsn64 : 1,
+		use_ack : 1,
+		ack64 : 1,
+		data_fin : 1,
+		backup : 1;
+	u8	join_id;
+};
+
+/* data queued on the MPTCP socket until the peer DATA_ACKs it */
+struct mptcp_data_frag {
+	struct list_head	list;
+	u64			data_seq;
+	int			data_len;
+	int			offset;
+	struct page		*page;
+};
+
+/* MPTCP connection sock */
+struct mptcp_sock {
+	/* inet_sock must be the first member */
+	struct inet_sock	sk;
+	u64		local_key;
+	u64		remote_key;
+	u64		write_seq;
+	u64		data_fin_seq;
+	u64		rcv_data_fin_seq;
+	u64		reinject_seq;	/* resend from here on subflow loss */
+	atomic64_t	snd_una;
+	atomic64_t	ack_seq;
+	u32		token;
+	u32		remote_token;
+	unsigned long	flags;
+	u8		subflows;	/* protected by join_list_lock */
+	u8		local_id;
+	struct hlist_node	token_node;
+	struct work_struct	work;
+	struct list_head	conn_list;	/* protected by the msk lock */
+	struct list_head	join_list;	/* under join_list_lock */
+	spinlock_t		join_list_lock;
+	struct list_head	rtx_queue;	/* struct mptcp_data_frag */
+	struct sock		*last_snd;
+	struct socket		*subflow;	/* initial subflow */
+	const struct mptcp_sched_ops	*sched;
+	const struct mptcp_pm_ops	*pm;
+};
+
+#define mptcp_for_each_subflow(__msk, __subflow)			\
+	list_for_each_entry(__subflow, &((__msk)->conn_list), node)
+
+static inline struct mptcp_sock *mptcp_sk(const struct sock *sk)
+{
+	return (struct mptcp_sock *)sk;
+}
+
+static inline bool before64(u64 seq1, u64 seq2)
+{
+	return (s64)(seq1 - seq2) < 0;
+}
+
+#define after64(seq2, seq1)	before64(seq1, seq2)
+
+/* expand a 32 bit sequence number received on the wire to the 64 bit
+ * value closest to @old
+ */
+static inline u64 mptcp_expand_seq(u64 old, u32 cur)
+{
+	return old + (s32)(cur - (u32)old);
+}
+
+struct mptcp_subflow_request_sock {
+	struct	tcp_request_sock sk;
+	u8	mp_capable : 1,
+		mp_join : 1,
+		backup : 1;
+	u8	remote_id;
+	u64	local_key;
+	u64	remote_key;
+	u64	thmac;
+	u32	token;
+	u32	local_nonce;
+	u32	remote_nonce;
+	struct sock	*msk;	/* joined connection, holds a reference */
+};
+
+static inline struct mptcp_subflow_request_sock *
+mptcp_subflow_rsk(const struct request_sock *rsk)
+{
+	return (struct mptcp_subflow_request_sock *)rsk;
+}
+
+/* data sequence mapping of a range of subflow sequence numbers */
+struct mptcp_map {
+	struct list_head	list;
+	u64			data_seq;
+	u32			subflow_seq;	/* absolute */
+	u32			len;
+};
+
+/* MPTCP subflow context */
+struct mptcp_subflow_context {
+	struct	list_head node;	/* conn_list or join_list of the msk */
+	struct	list_head tx_maps;
+	struct	list_head rx_maps;
+	u64	local_key;
+	u64	remote_key;
+	u32	token;
+	u32	snd_isn;
+	u32	rcv_isn;
+	u32	local_nonce;
+	u32	remote_nonce;
+	u16	rx_maps_nr;
+	u8	local_id;
+	u8	remote_id;
+	u8	hmac[MPTCPOPT_HMAC_LEN];
+	u32	request_mptcp : 1,	/* send MP_CAPABLE */
+		request_join : 1,	/* send MP_JOIN */
+		mp_capable : 1,		/* remote is MPTCP capable */
+		mp_join : 1,		/* remote is JOINing */
+		send_hs_ack : 1,	/* handshake not acked yet */
+		conn_finished : 1,
+		backup : 1,
+		reset : 1,		/* HMAC check failed, drop subflow */
+		send_ack : 1;
+	bool	owns_conn;		/* conn not accepted yet */
+	struct	socket *sock;		/* owned by us, NULL on the server */
+	struct	sock *ssk;
+	struct	sock *conn;		/* parent mptcp_sock, refcounted */
+	void	(*tcp_data_ready)(struct sock *sk);
+	void	(*tcp_state_change)(struct sock *sk);
+	void	(*tcp_write_space)(struct sock *sk);
+};
+
+static inline struct mptcp_subflow_context *
+mptcp_subflow_ctx(const struct sock *sk)
+{
+	return inet_csk(sk)->icsk_ulp_data;
+}
+
+/* ctrl.c */
+int mptcp_ctrl_init(void);
+bool mptcp_is_enabled(const struct net *net);
+void mptcp_get_scheduler(const struct net *net, char *name);
+void mptcp_get_path_manager(const struct net *net, char *name);
+
+/* crypto.c */
+void mptcp_crypto_key_sha1(u64 key, u32 *token, u64 *idsn);
+void mptcp_crypto_hmac_sha1(u64 key1, u64 key2, u32 nonce1, u32 nonce2,
+			    u8 *hmac);
+
+/* token.c */
+void mptcp_token_init(void);
+void mptcp_token_new_request(struct mptcp_subflow_request_sock *subflow_req);
+void mptcp_token_new_connect(struct sock *sk);
+int mptcp_token_insert(struct sock *sk);
+struct sock *mptcp_token_get_sock(const struct net *net, u32 token);
+void mptcp_token_destroy(struct sock *sk);
+
+/* sched.c */
+void mptcp_sched_init(void);
+bool mptcp_sched_registered(const char *name);
+void mptcp_sched_get(struct mptcp_sock *msk);
+void mptcp_sched_put(struct mptcp_sock *msk);
+struct sock *mptcp_sched_get_subflow(struct mptcp_sock *msk);
+
+/* pm.c */
+void mptcp_pm_init(void);
+bool mptcp_pm_registered(const char *name);
+void mptcp_pm_get(struct mptcp_sock *msk);
+void mptcp_pm_put(struct mptcp_sock *msk);
+
+/* options.c */
+void mptcp_get_options(const struct sk_buff *skb,
+		       struct mptcp_options_received *mp_opt);
+
+/* subflow.c */
+void mptcp_subflow_init(void);
+int mptcp_subflow_create_socket(struct sock *sk, struct socket **new_sock,
+				int kern);
+bool mptcp_subflow_usable(const struct mptcp_subflow_context *subflow);
+void mptcp_subflow_reset(struct sock *ssk);
+int mptcp_subflow_send(struct sock *ssk, struct page *page, int offset,
+		       size_t size, u64 data_seq);
+int mptcp_subflow_rx_map_add(struct mptcp_subflow_context *subflow,
+			     u64 data_seq, u32 subflow_seq, u32 len);
+struct mptcp_map *mptcp_subflow_rx_map(struct mptcp_subflow_context *subflow,
+				       u32 seq);
+struct mptcp_map *mptcp_subflow_tx_map(struct mptcp_subflow_context *subflow,
+				       u32 seq);
+void mptcp_subflow_rx_maps_prune(struct mptcp_subflow_context *subflow,
+				 u32 seq);
+
+/* protocol.c */
+void mptcp_schedule_work(struct sock *sk);
+void mptcp_data_ready(struct sock *sk);
+void mptcp_write_space(struct sock *sk);
+void mptcp_data_acked(struct sock *sk, u64 data_ack);
+void mptcp_finish_connect(struct sock *sk, u64 remote_key);
+bool mptcp_finish_join(struct sock *sk,
+		       struct mptcp_subflow_context *subflow);
+struct sock *mptcp_sk_clone(const struct sock *sk, u64 local_key,
+			    u64 remote_key, gfp_t priority);
+void mptcp_sock_graft(struct sock *sk, struct socket *parent);
+
+#endif /* __MPTCP_PROTOCOL_H */
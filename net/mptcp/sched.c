@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP packet schedulers
+ *
+ * The scheduler picks the subflow each chunk of data written to an
+ * MPTCP socket is sent on. Schedulers register under a name like TCP
+ * congestion control algorithms do; net.mptcp.scheduler selects the one
+ * new connections use.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+
+#include "protocol.h"
+
+static DEFINE_SPINLOCK(mptcp_sched_list_lock);
+static LIST_HEAD(mptcp_sched_list);
+
+/* Simple linear search, don't expect many entries! */
+static struct mptcp_sched_ops *mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *e;
+
+	list_for_each_entry_rcu(e, &mptcp_sched_list, list) {
+		if (strcmp(e->name, name) == 0)
+			return e;
+	}
+
+	return NULL;
+}
+
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	int ret = 0;
+
+	if (!sched->get_subflow) {
+		pr_err("%s does not implement required ops\n", sched->name);
+		return -EINVAL;
+	}
+
+	spin_lock(&mptcp_sched_list_lock);
+	if (mptcp_sched_find(sched->name)) {
+		pr_notice("%s already registered\n", sched->name);
+		ret = -EEXIST;
+	} else {
+		list_add_tail_rcu(&sched->list, &mptcp_sched_list);
+		pr_debug("%s registered\n", sched->name);
+	}
+	spin_unlock(&mptcp_sched_list_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_scheduler);
+
+/* Connections keep a module reference on their scheduler, so none can
+ * be using it once the module is unloaded.
+ */
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
+{
+	spin_lock(&mptcp_sched_list_lock);
+	list_del_rcu(&sched->list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_scheduler);
+
+bool mptcp_sched_registered(const char *name)
+{
+	bool found;
+
+	rcu_read_lock();
+	found = !!mptcp_sched_find(name);
+	rcu_read_unlock();
+
+	return found;
+}
+
+/* Lowest RTT first, backup subflows only when no other one is usable. */
+static struct sock *mptcp_sched_default_get(const struct mptcp_sched_data *data)
+{
+	struct sock *best = NULL, *best_backup = NULL;
+	u32 rtt = U32_MAX, rtt_backup = U32_MAX;
+	unsigned int i;
+
+	for (i = 0; i < data->nr; i++) {
+		struct sock *ssk = data->subflows[i];
+		u32 srtt = tcp_sk(ssk)->srtt_us;
+
+		if (mptcp_subflow_is_backup(ssk)) {
+			if (srtt < rtt_backup) {
+				rtt_backup = srtt;
+				best_backup = ssk;
+			}
+		} else if (srtt < rtt) {
+			rtt = srtt;
+			best = ssk;
+		}
+	}
+
+	return best ? : best_backup;
+}
+
+static struct mptcp_sched_ops mptcp_sched_default = {
+	.get_subflow	= mptcp_sched_default_get,
+	.name		= "default",
+	.owner		= THIS_MODULE,
+};
+
+static struct sock *mptcp_sched_rr_get(const struct mptcp_sched_data *data)
+{
+	unsigned int i;
+
+	for (i = 0; i < data->nr; i++) {
+		if (data->subflows[i] == data->last)
+			return data->subflows[(i + 1) % data->nr];
+	}
+
+	return data->subflows[0];
+}
+
+static struct mptcp_sched_ops mptcp_sched_rr = {
+	.get_subflow	= mptcp_sched_rr_get,
+	.name		= "roundrobin",
+	.owner		= THIS_MODULE,
+};
+
+void mptcp_sched_get(struct mptcp_sock *msk)
+{
+	const struct mptcp_sched_ops *sched;
+	char name[MPTCP_SCHED_NAME_MAX];
+
+	mptcp_get_scheduler(sock_net((struct sock *)msk), name);
+
+	rcu_read_lock();
+	sched = mptcp_sched_find(name);
+	if (!sched || !try_module_get(sched->owner))
+		sched = &mptcp_sched_default;
+	rcu_read_unlock();
+
+	msk->sched = sched;
+}
+
+void mptcp_sched_put(struct mptcp_sock *msk)
+{
+	if (msk->sched) {
+		module_put(msk->sched->owner);
+		msk->sched = NULL;
+	}
+}
+
+/* Must be called with the MPTCP socket locked. Returns NULL if no
+ * subflow can take more data right now.
+ */
+struct sock *mptcp_sched_get_subflow(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+	struct mptcp_sched_data data;
+
+	data.last = msk->last_snd;
+	data.nr = 0;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = subflow->ssk;
+
+		if (!((1 << ssk->sk_state) &
+		      (TCPF_ESTABLISHED | TCPF_CLOSE_WAIT)) ||
+		    !mptcp_subflow_usable(subflow) ||
+		    !sk_stream_memory_free(ssk))
+			continue;
+
+		data.subflows[data.nr++] = ssk;
+		if (data.nr == MPTCP_SUBFLOWS_MAX)
+			break;
+	}
+
+	if (!data.nr)
+		return NULL;
+
+	return msk->sched->get_subflow(&data);
+}
+
+void __init mptcp_sched_init(void)
+{
+	mptcp_register_scheduler(&mptcp_sched_default);
+	mptcp_register_scheduler(&mptcp_sched_rr);
+}
@@ -0,0 +1,862 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP subflows
+ *
+ * Subflows are plain TCP sockets carrying the "mptcp" upper layer
+ * protocol. The ULP hooks the MPTCP handshake into connection setup and
+ * forwards socket callbacks to the MPTCP socket owning the subflow.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <crypto/algapi.h>
+#include <linux/in.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/net.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <net/sock.h>
+#include <net/inet_common.h>
+#include <net/inet_connection_sock.h>
+#include <net/route.h>
+#include <net/tcp.h>
+#include <net/transp_v6.h>
+#include <asm/unaligned.h>
+
+#include "protocol.h"
+
+struct request_sock_ops mptcp_subflow_request_sock_ops __read_mostly;
+static struct tcp_request_sock_ops subflow_request_sock_ipv4_ops __read_mostly;
+static struct inet_connection_sock_af_ops subflow_specific __read_mostly;
+
+static struct mptcp_subflow_context *subflow_create_ctx(struct sock *sk,
+							 gfp_t priority)
+{
+	struct inet_connection_sock *icsk = inet_csk(sk);
+	struct mptcp_subflow_context *ctx;
+
+	ctx = kzalloc(sizeof(*ctx), priority);
+	if (!ctx)
+		return NULL;
+
+	INIT_LIST_HEAD(&ctx->node);
+	INIT_LIST_HEAD(&ctx->tx_maps);
+	INIT_LIST_HEAD(&ctx->rx_maps);
+	ctx->ssk = sk;
+	icsk->icsk_ulp_data = ctx;
+
+	return ctx;
+}
+
+/* Turn @sk back into a plain TCP socket, @old holds the original socket
+ * callbacks.
+ */
+static void subflow_ulp_fallback(struct sock *sk,
+				 const struct mptcp_subflow_context *old)
+{
+	struct inet_connection_sock *icsk = inet_csk(sk);
+
+	sk->sk_data_ready = old->tcp_data_ready;
+	sk->sk_state_change = old->tcp_state_change;
+	sk->sk_write_space = old->tcp_write_space;
+	icsk->icsk_ulp_ops = NULL;
+	icsk->icsk_ulp_data = NULL;
+	icsk->icsk_af_ops = &ipv4_specific;
+	tcp_sk(sk)->is_mptcp = 0;
+}
+
+static void subflow_req_destructor(struct request_sock *req)
+{
+	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
+
+	if (subflow_req->msk)
+		sock_put(subflow_req->msk);
+
+	tcp_request_sock_ops.destructor(req);
+}
+
+static u64 subflow_thmac(u64 key1, u64 key2, u32 nonce1, u32 nonce2)
+{
+	u8 hmac[MPTCPOPT_HMAC_LEN];
+
+	mptcp_crypto_hmac_sha1(key1, key2, nonce1, nonce2, hmac);
+	return get_unaligned_be64(hmac);
+}
+
+/* Look up the connection a MP_JOIN SYN wants to join. Joins are taken
+ * while the connection is established and below the subflow limit.
+ */
+static bool
+subflow_token_join_request(struct request_sock *req,
+			   const struct sock *sk_listener,
+			   const struct mptcp_options_received *mp_opt)
+{
+	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
+	struct mptcp_sock *msk;
+	struct sock *sk;
+	bool ok;
+
+	sk = mptcp_token_get_sock(sock_net(sk_listener), mp_opt->token);
+	if (!sk)
+		return false;
+
+	msk = mptcp_sk(sk);
+	spin_lock_bh(&msk->join_list_lock);
+	ok = sk->sk_state == TCP_ESTABLISHED &&
+	     msk->subflows < MPTCP_SUBFLOWS_MAX &&
+	     !test_bit(MPTCP_FALLBACK, &msk->flags);
+	spin_unlock_bh(&msk->join_list_lock);
+	if (!ok) {
+		sock_put(sk);
+		return false;
+	}
+
+	subflow_req->msk = sk;
+	subflow_req->local_key = msk->local_key;
+	subflow_req->remote_key = msk->remote_key;
+	subflow_req->token = msk->token;
+	subflow_req->remote_nonce = mp_opt->nonce;
+	subflow_req->remote_id = mp_opt->join_id;
+	subflow_req->backup = mp_opt->backup;
+	get_random_bytes(&subflow_req->local_nonce,
+			 sizeof(subflow_req->local_nonce));
+	subflow_req->thmac = subflow_thmac(subflow_req->local_key,
+					   subflow_req->remote_key,
+					   subflow_req->local_nonce,
+					   subflow_req->remote_nonce);
+	return true;
+}
+
+static void subflow_v4_init_req(struct request_sock *req,
+				const struct sock *sk_listener,
+				struct sk_buff *skb)
+{
+	struct mptcp_subflow_request_sock *subflow_req = mptcp_subflow_rsk(req);
+	struct mptcp_options_received mp_opt;
+
+	tcp_request_sock_ipv4_ops.init_req(req, sk_listener, skb);
+
+	subflow_req->mp_capable = 0;
+	subflow_req->mp_join = 0;
+	subflow_req->backup = 0;
+	subflow_req->msk = NULL;
+
+	mptcp_get_options(skb, &mp_opt);
+
+	if (mp_opt.mp_capable && !mp_opt.mpc_ack) {
+		subflow_req->mp_capable = 1;
+		subflow_req->remote_key = mp_opt.sndr_key;
+		mptcp_token_new_request(subflow_req);
+	} else if (mp_opt.mp_join_syn) {
+		subflow_req->mp_join =
+			subflow_token_join_request(req, sk_listener, &mp_opt);
+	}
+}
+
+static int subflow_v4_conn_request(struct sock *sk, struct sk_buff *skb)
+{
+	/* Never answer to SYNs send to broadcast or multicast */
+	if (skb_rtable(skb)->rt_flags & (RTCF_BROADCAST | RTCF_MULTICAST))
+		goto drop;
+
+	return tcp_conn_request(&mptcp_subflow_request_sock_ops,
+				&subflow_request_sock_ipv4_ops, sk, skb);
+drop:
+	tcp_listendrop(sk);
+	return 0;
+}
+
+/**
+ * mptcp_subflow_reset - stop using a subflow and reset it
+ * @ssk: the subflow
+ *
+ * The MPTCP worker sends the reset, and tears down the connection if
+ * no other subflow is left. Can be called from softirq context.
+ */
+void mptcp_subflow_reset(struct sock *ssk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+
+	subflow->reset = 1;
+	tcp_sk(ssk)->is_mptcp = 0;
+	set_bit(MPTCP_WORK_CLOSE_SUBFLOW, &mptcp_sk(subflow->conn)->flags);
+	mptcp_schedule_work(subflow->conn);
+}
+
+/* Runs once the SYN/ACK of a connection we opened was received. */
+static void subflow_finish_connect(struct sock *sk, const struct sk_buff *skb)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+	struct mptcp_options_received mp_opt;
+	u8 hmac[MPTCPOPT_HMAC_LEN];
+
+	inet_sk_rx_dst_set(sk, skb);
+
+	if (!subflow || subflow->conn_finished || !subflow->conn)
+		return;
+
+	subflow->conn_finished = 1;
+	subflow->rcv_isn = TCP_SKB_CB(skb)->seq;
+	mptcp_get_options(skb, &mp_opt);
+
+	if (subflow->request_mptcp) {
+		struct mptcp_sock *msk = mptcp_sk(subflow->conn);
+
+		subflow->request_mptcp = 0;
+		if (mp_opt.mp_capable && !mp_opt.mpc_ack) {
+			subflow->mp_capable = 1;
+			subflow->send_hs_ack = 1;
+			subflow->remote_key = mp_opt.sndr_key;
+		} else {
+			tcp_sk(sk)->is_mptcp = 0;
+			set_bit(MPTCP_FALLBACK, &msk->flags);
+		}
+		mptcp_finish_connect(subflow->conn, subflow->remote_key);
+		return;
+	}
+
+	if (!subflow->request_join)
+		return;
+
+	subflow->request_join = 0;
+	if (!mp_opt.mp_join_synack)
+		goto reset;
+
+	subflow->remote_nonce = mp_opt.nonce;
+	subflow->remote_id = mp_opt.join_id;
+	if (subflow_thmac(subflow->remote_key, subflow->local_key,
+			  subflow->remote_nonce, subflow->local_nonce) !=
+	    mp_opt.thmac)
+		goto reset;
+
+	mptcp_crypto_hmac_sha1(subflow->local_key, subflow->remote_key,
+			       subflow->local_nonce, subflow->remote_nonce,
+			       hmac);
+	memcpy(subflow->hmac, hmac, sizeof(hmac));
+	subflow->mp_join = 1;
+	subflow->send_hs_ack = 1;
+	return;
+
+reset:
+	mptcp_subflow_reset(sk);
+}
+
+static bool subflow_hmac_valid(const struct mptcp_subflow_request_sock *req,
+			       const struct mptcp_options_received *mp_opt)
+{
+	u8 hmac[MPTCPOPT_HMAC_LEN];
+
+	mptcp_crypto_hmac_sha1(req->remote_key, req->local_key,
+			       req->remote_nonce, req->local_nonce, hmac);
+
+	return !crypto_memneq(hmac, mp_opt->hmac, MPTCPOPT_HMAC_LEN);
+}
+
+/* Kill a child created for a subflow that cannot be used after all. */
+static void subflow_dispose_child(struct sock *sk, struct request_sock *req,
+				  struct sock *child)
+{
+	tcp_send_active_reset(child, GFP_ATOMIC);
+	inet_csk_prepare_forced_close(child);
+	tcp_done(child);
+	inet_csk_reqsk_queue_drop(sk, req);
+	reqsk_queue_removed(&inet_csk(sk)->icsk_accept_queue, req);
+}
+
+/* A valid MP_JOIN ACK: attach the new subflow to its connection. The
+ * child is not queued on the listener, it belongs to the connection
+ * from now on and keeps the reference otherwise owned by accept().
+ */
+static struct sock *subflow_join_child(const struct sock *sk,
+				       struct request_sock *req,
+				       struct sock *child, bool *own_req)
+{
+	struct mptcp_subflow_context *listener = mptcp_subflow_ctx(sk);
+	struct mptcp_subflow_request_sock *subflow_req;
+	struct mptcp_subflow_context *ctx;
+
+	subflow_req = mptcp_subflow_rsk(req);
+	ctx = subflow_create_ctx(child, GFP_ATOMIC);
+	if (!ctx)
+		goto dispose;
+
+	ctx->tcp_data_ready = listener->tcp_data_ready;
+	ctx->tcp_state_change = listener->tcp_state_change;
+	ctx->tcp_write_space = listener->tcp_write_space;
+	ctx->conn = subflow_req->msk;
+	subflow_req->msk = NULL;
+	ctx->mp_join = 1;
+	ctx->conn_finished = 1;
+	ctx->backup = subflow_req->backup;
+	ctx->remote_id = subflow_req->remote_id;
+	ctx->local_key = subflow_req->local_key;
+	ctx->remote_key = subflow_req->remote_key;
+	ctx->token = subflow_req->token;
+	ctx->snd_isn = tcp_rsk(req)->snt_isn;
+	ctx->rcv_isn = tcp_rsk(req)->rcv_isn;
+
+	if (!mptcp_finish_join(ctx->conn, ctx))
+		goto dispose;
+
+	inet_csk_reqsk_queue_drop((struct sock *)sk, req);
+	reqsk_queue_removed(&inet_csk(sk)->icsk_accept_queue, req);
+	*own_req = false;
+	return child;
+
+dispose:
+	subflow_ulp_fallback(child, listener);
+	if (ctx) {
+		sock_put(ctx->conn);
+		kfree(ctx);
+	}
+	subflow_dispose_child((struct sock *)sk, req, child);
+	return NULL;
+}
+
+static struct sock *subflow_syn_recv_sock(const struct sock *sk,
+					  struct sk_buff *skb,
+					  struct request_sock *req,
+					  struct dst_entry *dst,
+					  struct request_sock *req_unhash,
+					  bool *own_req)
+{
+	struct mptcp_subflow_context *listener = mptcp_subflow_ctx(sk);
+	struct mptcp_subflow_request_sock *subflow_req = NULL;
+	struct mptcp_options_received mp_opt;
+	struct mptcp_subflow_context *ctx;
+	u64 local_key = 0, remote_key = 0;
+	bool mp_capable = false;
+	struct sock *child;
+	struct sock *conn;
+
+	if (req->rsk_ops == &mptcp_subflow_request_sock_ops)
+		subflow_req = mptcp_subflow_rsk(req);
+
+	/* fast open children are answered without MPTCP */
+	if (TCP_SKB_CB(skb)->tcp_flags & TCPHDR_SYN) {
+		if (subflow_req) {
+			subflow_req->mp_capable = 0;
+			subflow_req->mp_join = 0;
+		}
+		goto create_child;
+	}
+
+	mptcp_get_options(skb, &mp_opt);
+
+	if ((subflow_req && subflow_req->mp_join) ||
+	    (!subflow_req && mp_opt.mp_join_ack)) {
+		if (!subflow_req || !mp_opt.mp_join_ack ||
+		    !subflow_hmac_valid(subflow_req, &mp_opt)) {
+			req->rsk_ops->send_reset(sk, skb);
+			if (subflow_req)
+				inet_csk_reqsk_queue_drop((struct sock *)sk,
+							  req);
+			return NULL;
+		}
+
+		child = tcp_v4_syn_recv_sock(sk, skb, req, dst, req_unhash,
+					     own_req);
+		if (!child)
+			return NULL;
+		if (!*own_req) {
+			subflow_ulp_fallback(child, listener);
+			return child;
+		}
+		return subflow_join_child(sk, req, child, own_req);
+	}
+
+	if (subflow_req && subflow_req->mp_capable) {
+		/* the keys of a lost third ACK are implied by a DSS */
+		if (mp_opt.mpc_ack || mp_opt.dss) {
+			local_key = subflow_req->local_key;
+			remote_key = subflow_req->remote_key;
+			mp_capable = true;
+		}
+	} else if (!subflow_req && mp_opt.mpc_ack) {
+		/* syncookie, the ACK echoes both keys */
+		local_key = mp_opt.rcvr_key;
+		remote_key = mp_opt.sndr_key;
+		mp_capable = true;
+	}
+
+create_child:
+	child = tcp_v4_syn_recv_sock(sk, skb, req, dst, req_unhash, own_req);
+	if (!child)
+		return NULL;
+
+	if (!mp_capable || !*own_req)
+		goto fallback;
+
+	ctx = subflow_create_ctx(child, GFP_ATOMIC);
+	if (!ctx)
+		goto fallback;
+
+	conn = mptcp_sk_clone(listener->conn, local_key, remote_key,
+			      GFP_ATOMIC);
+	if (!conn) {
+		kfree(ctx);
+		goto fallback;
+	}
+
+	ctx->tcp_data_ready = listener->tcp_data_ready;
+	ctx->tcp_state_change = listener->tcp_state_change;
+	ctx->tcp_write_space = listener->tcp_write_space;
+	ctx->conn = conn;
+	ctx->owns_conn = true;
+	ctx->mp_capable = 1;
+	ctx->conn_finished = 1;
+	ctx->local_key = local_key;
+	ctx->remote_key = remote_key;
+	ctx->token = mptcp_sk(conn)->token;
+	ctx->snd_isn = tcp_rsk(req)->snt_isn;
+	ctx->rcv_isn = tcp_rsk(req)->rcv_isn;
+	return child;
+
+fallback:
+	subflow_ulp_fallback(child, listener);
+	return child;
+}
+
+static void subflow_data_ready(struct sock *sk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+
+	subflow->tcp_data_ready(sk);
+
+	/* the MPTCP socket is polled instead of the subflows, also after
+	 * a fallback to TCP
+	 */
+	if (subflow->conn)
+		mptcp_data_ready(subflow->conn);
+}
+
+static void subflow_state_change(struct sock *sk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+	struct sock *conn = subflow->conn;
+	struct mptcp_sock *msk;
+
+	subflow->tcp_state_change(sk);
+
+	if (!conn || sk->sk_state == TCP_LISTEN)
+		return;
+
+	msk = mptcp_sk(conn);
+	if (sk->sk_state == TCP_ESTABLISHED && subflow->mp_join &&
+	    !subflow->sock) {
+		/* let the peer know its MP_JOIN ACK arrived */
+		subflow->send_ack = 1;
+		set_bit(MPTCP_WORK_SEND_ACK, &msk->flags);
+		mptcp_schedule_work(conn);
+		mptcp_write_space(conn);
+	} else if (sk->sk_state == TCP_CLOSE) {
+		/* the initial subflow failed to connect */
+		if (conn->sk_state == TCP_SYN_SENT && subflow->sock &&
+		    subflow->sock == READ_ONCE(msk->subflow)) {
+			conn->sk_err = sk->sk_err;
+			inet_sk_state_store(conn, TCP_CLOSE);
+			conn->sk_state_change(conn);
+		} else {
+			set_bit(MPTCP_WORK_CLOSE_SUBFLOW, &msk->flags);
+			mptcp_schedule_work(conn);
+		}
+	}
+
+	mptcp_data_ready(conn);
+}
+
+static void subflow_write_space(struct sock *sk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(sk);
+
+	subflow->tcp_write_space(sk);
+
+	if (subflow->conn && sk_stream_is_writeable(sk))
+		mptcp_write_space(subflow->conn);
+}
+
+static int subflow_ulp_init(struct sock *sk)
+{
+	struct inet_connection_sock *icsk = inet_csk(sk);
+	struct mptcp_subflow_context *ctx;
+
+	/* subflows are only created by the MPTCP socket */
+	if (!sk->sk_kern_sock)
+		return -EOPNOTSUPP;
+
+	ctx = subflow_create_ctx(sk, GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	tcp_sk(sk)->is_mptcp = 1;
+	icsk->icsk_af_ops = &subflow_specific;
+	ctx->tcp_data_ready = sk->sk_data_ready;
+	ctx->tcp_state_change = sk->sk_state_change;
+	ctx->tcp_write_space = sk->sk_write_space;
+	sk->sk_data_ready = subflow_data_ready;
+	sk->sk_state_change = subflow_state_change;
+	sk->sk_write_space = subflow_write_space;
+
+	return 0;
+}
+
+static void subflow_maps_purge(struct list_head *maps)
+{
+	struct mptcp_map *map, *tmp;
+
+	list_for_each_entry_safe(map, tmp, maps, list) {
+		list_del(&map->list);
+		kfree(map);
+	}
+}
+
+static void subflow_ulp_release(struct sock *sk)
+{
+	struct mptcp_subflow_context *ctx = mptcp_subflow_ctx(sk);
+
+	/* children that lost the race for their request still point to
+	 * the context of the listener
+	 */
+	if (!ctx || ctx->ssk != sk)
+		return;
+
+	subflow_maps_purge(&ctx->tx_maps);
+	subflow_maps_purge(&ctx->rx_maps);
+
+	if (ctx->conn) {
+		if (ctx->owns_conn) {
+			set_bit(MPTCP_WORK_ORPHAN, &mptcp_sk(ctx->conn)->flags);
+			mptcp_schedule_work(ctx->conn);
+		}
+		sock_put(ctx->conn);
+	}
+
+	kfree(ctx);
+}
+
+static struct tcp_ulp_ops subflow_ulp_ops __read_mostly = {
+	.name		= "mptcp",
+	.uid		= TCP_ULP_MPTCP,
+	.user_visible	= false,
+	.owner		= THIS_MODULE,
+	.init		= subflow_ulp_init,
+	.release	= subflow_ulp_release,
+};
+
+bool mptcp_subflow_usable(const struct mptcp_subflow_context *subflow)
+{
+	if (subflow->reset)
+		return false;
+
+	return subflow->mp_capable || (subflow->mp_join &&
+				       !subflow->send_hs_ack);
+}
+
+bool mptcp_subflow_is_backup(const struct sock *ssk)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+
+	return subflow && subflow->backup;
+}
+EXPORT_SYMBOL_GPL(mptcp_subflow_is_backup);
+
+static struct mptcp_map *subflow_map_lookup(struct list_head *maps, u32 seq)
+{
+	struct mptcp_map *map;
+
+	/* newest first, retransmissions are rare */
+	list_for_each_entry_reverse(map, maps, list) {
+		if (!before(seq, map->subflow_seq) &&
+		    before(seq, map->subflow_seq + map->len))
+			return map;
+	}
+
+	return NULL;
+}
+
+struct mptcp_map *mptcp_subflow_rx_map(struct mptcp_subflow_context *subflow,
+				       u32 seq)
+{
+	return subflow_map_lookup(&subflow->rx_maps, seq);
+}
+
+struct mptcp_map *mptcp_subflow_tx_map(struct mptcp_subflow_context *subflow,
+				       u32 seq)
+{
+	return subflow_map_lookup(&subflow->tx_maps, seq);
+}
+
+/* forget mappings of subflow data before @seq */
+static int subflow_maps_prune(struct list_head *maps, u32 seq)
+{
+	struct mptcp_map *map, *tmp;
+	int pruned = 0;
+
+	list_for_each_entry_safe(map, tmp, maps, list) {
+		if (after(map->subflow_seq + map->len, seq))
+			continue;
+		list_del(&map->list);
+		kfree(map);
+		pruned++;
+	}
+
+	return pruned;
+}
+
+void mptcp_subflow_rx_maps_prune(struct mptcp_subflow_context *subflow,
+				 u32 seq)
+{
+	subflow->rx_maps_nr -= subflow_maps_prune(&subflow->rx_maps, seq);
+}
+
+/* Called from the receive path with the subflow locked. */
+int mptcp_subflow_rx_map_add(struct mptcp_subflow_context *subflow,
+			     u64 data_seq, u32 subflow_seq, u32 len)
+{
+	struct mptcp_map *map;
+
+	map = mptcp_subflow_rx_map(subflow, subflow_seq);
+	if (map && !after(subflow_seq + len, map->subflow_seq + map->len) &&
+	    map->data_seq + (subflow_seq - map->subflow_seq) == data_seq)
+		return 0;
+
+	if (!list_empty(&subflow->rx_maps)) {
+		map = list_last_entry(&subflow->rx_maps, struct mptcp_map,
+				      list);
+		if (map->subflow_seq + map->len == subflow_seq &&
+		    map->data_seq + map->len == data_seq) {
+			map->len += len;
+			return 0;
+		}
+	}
+
+	if (subflow->rx_maps_nr >= MPTCP_RX_MAPS_MAX)
+		return -ENOBUFS;
+
+	map = kmalloc(sizeof(*map), GFP_ATOMIC);
+	if (!map)
+		return -ENOMEM;
+
+	map->data_seq = data_seq;
+	map->subflow_seq = subflow_seq;
+	map->len = len;
+	list_add_tail(&map->list, &subflow->rx_maps);
+	subflow->rx_maps_nr++;
+
+	return 0;
+}
+
+/**
+ * mptcp_subflow_send - queue connection data on a subflow
+ * @ssk: the subflow, locked by the caller
+ * @page: page holding the data
+ * @offset: offset of the data in @page
+ * @size: number of bytes
+ * @data_seq: data sequence number of the first byte
+ *
+ * Records the mapping of the data before queueing it, so that every
+ * segment carrying it can announce its data sequence numbers. Data
+ * not contiguous with the previous mapping starts a new skb, segments
+ * never span two mappings.
+ */
+int mptcp_subflow_send(struct sock *ssk, struct page *page, int offset,
+		       size_t size, u64 data_seq)
+{
+	struct mptcp_subflow_context *subflow = mptcp_subflow_ctx(ssk);
+	struct tcp_sock *tp = tcp_sk(ssk);
+	struct mptcp_map *map = NULL;
+	u32 seq = tp->write_seq;
+	int ret;
+
+	subflow_maps_prune(&subflow->tx_maps, tp->snd_una);
+
+	if (!list_empty(&subflow->tx_maps)) {
+		map = list_last_entry(&subflow->tx_maps, struct mptcp_map,
+				      list);
+		if (map->subflow_seq + map->len != seq ||
+		    map->data_seq + map->len != data_seq) {
+			struct sk_buff *skb = tcp_write_queue_tail(ssk);
+
+			if (!skb)
+				skb = skb_rb_last(&ssk->tcp_rtx_queue);
+			if (skb)
+				TCP_SKB_CB(skb)->eor = 1;
+			map = NULL;
+		}
+	}
+
+	if (map) {
+		map->len += size;
+	} else {
+		map = kmalloc(sizeof(*map), ssk->sk_allocation);
+		if (!map)
+			return -ENOMEM;
+
+		map->data_seq = data_seq;
+		map->subflow_seq = seq;
+		map->len = size;
+		list_add_tail(&map->list, &subflow->tx_maps);
+	}
+
+	ret = do_tcp_sendpages(ssk, page, offset, size, MSG_DONTWAIT);
+	if (ret < (int)size) {
+		map->len -= size - max(ret, 0);
+		if (!map->len) {
+			list_del(&map->list);
+			kfree(map);
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * mptcp_subflow_create_socket - create a subflow of an MPTCP socket
+ * @sk: the owning MPTCP socket
+ * @new_sock: set to the new subflow on success
+ * @kern: create a kernel socket, not holding a reference on the netns
+ *
+ * The initial subflow must be a user socket when @sk is one: a child
+ * accepted on it falls back to plain TCP by being grafted onto the user
+ * socket, and inherits its netns reference from the listener.
+ */
+int mptcp_subflow_create_socket(struct sock *sk, struct socket **new_sock,
+				int kern)
+{
+	struct mptcp_subflow_context *subflow;
+	struct net *net = sock_net(sk);
+	struct socket *sf;
+	int err;
+
+	err = __sock_create(net, PF_INET, SOCK_STREAM, IPPROTO_TCP, &sf, kern);
+	if (err)
+		return err;
+
+	lock_sock(sf->sk);
+	err = tcp_set_ulp_id(sf->sk, TCP_ULP_MPTCP);
+	release_sock(sf->sk);
+	if (err) {
+		sock_release(sf);
+		return err;
+	}
+
+	subflow = mptcp_subflow_ctx(sf->sk);
+	subflow->sock = sf;
+	sock_hold(sk);
+	subflow->conn = sk;
+	*new_sock = sf;
+
+	return 0;
+}
+
+/**
+ * mptcp_subflow_connect - open an additional subflow
+ * @sk: the MPTCP socket, locked by the caller
+ * @saddr: local address of the new subflow
+ *
+ * The subflow is opened towards the address and port of the initial
+ * one. Returns -EMLINK once the connection has MPTCP_SUBFLOWS_MAX
+ * subflows.
+ */
+int mptcp_subflow_connect(struct sock *sk, __be32 saddr)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	struct mptcp_subflow_context *subflow;
+	struct sockaddr_in addr;
+	struct socket *sf;
+	int err;
+
+	if (sk->sk_state != TCP_ESTABLISHED ||
+	    test_bit(MPTCP_FALLBACK, &msk->flags))
+		return -ENOTCONN;
+
+	spin_lock_bh(&msk->join_list_lock);
+	if (msk->subflows >= MPTCP_SUBFLOWS_MAX) {
+		spin_unlock_bh(&msk->join_list_lock);
+		return -EMLINK;
+	}
+	msk->subflows++;
+	spin_unlock_bh(&msk->join_list_lock);
+
+	err = mptcp_subflow_create_socket(sk, &sf, 1);
+	if (err)
+		goto out_dec;
+
+	subflow = mptcp_subflow_ctx(sf->sk);
+	subflow->request_join = 1;
+	subflow->local_key = msk->local_key;
+	subflow->remote_key = msk->remote_key;
+	subflow->token = msk->remote_token;
+	subflow->local_id = ++msk->local_id;
+	get_random_bytes(&subflow->local_nonce, sizeof(subflow->local_nonce));
+	sf->sk->sk_mark = sk->sk_mark;
+	sf->sk->sk_priority = sk->sk_priority;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = saddr;
+	err = kernel_bind(sf, (struct sockaddr *)&addr, sizeof(addr));
+	if (err)
+		goto out_release;
+
+	addr.sin_addr.s_addr = inet_sk(sk)->inet_daddr;
+	addr.sin_port = inet_sk(sk)->inet_dport;
+	list_add_tail(&subflow->node, &msk->conn_list);
+	err = kernel_connect(sf, (struct sockaddr *)&addr, sizeof(addr),
+			     O_NONBLOCK);
+	if (err && err != -EINPROGRESS) {
+		list_del(&subflow->node);
+		goto out_release;
+	}
+
+	return 0;
+
+out_release:
+	sock_release(sf);
+out_dec:
+	spin_lock_bh(&msk->join_list_lock);
+	msk->subflows--;
+	spin_unlock_bh(&msk->join_list_lock);
+	return err;
+}
+EXPORT_SYMBOL_GPL(mptcp_subflow_connect);
+
+/* Must be called with the MPTCP socket locked. */
+bool mptcp_uses_saddr(const struct sock *sk, __be32 saddr)
+{
+	struct mptcp_subflow_context *subflow;
+
+	mptcp_for_each_subflow(mptcp_sk(sk), subflow) {
+		if (inet_sk(subflow->ssk)->inet_saddr == saddr)
+			return true;
+	}
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(mptcp_uses_saddr);
+
+void __init mptcp_subflow_init(void)
+{
+	mptcp_subflow_request_sock_ops = tcp_request_sock_ops;
+	mptcp_subflow_request_sock_ops.obj_size =
+		sizeof(struct mptcp_subflow_request_sock);
+	mptcp_subflow_request_sock_ops.slab_name = "request_sock_subflow";
+	mptcp_subflow_request_sock_ops.slab =
+		kmem_cache_create(mptcp_subflow_request_sock_ops.slab_name,
+				  mptcp_subflow_request_sock_ops.obj_size, 0,
+				  SLAB_ACCOUNT | SLAB_TYPESAFE_BY_RCU, NULL);
+	if (!mptcp_subflow_request_sock_ops.slab)
+		panic("MPTCP: failed to create subflow request sock cache\n");
+	mptcp_subflow_request_sock_ops.destructor = subflow_req_destructor;
+
+	subflow_request_sock_ipv4_ops = tcp_request_sock_ipv4_ops;
+	subflow_request_sock_ipv4_ops.init_req = subflow_v4_init_req;
+
+	subflow_specific = ipv4_specific;
+	subflow_specific.conn_request = subflow_v4_conn_request;
+	subflow_specific.syn_recv_sock = subflow_syn_recv_sock;
+	subflow_specific.sk_rx_dst_set = subflow_finish_connect;
+
+	if (tcp_register_ulp(&subflow_ulp_ops) != 0)
+		panic("MPTCP: failed to register subflows to ULP\n");
+}
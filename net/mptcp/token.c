@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP token management
+ *
+ * The token is derived from the key each end announces in MP_CAPABLE
+ * and identifies the connection in the MP_JOIN SYN of further
+ * subflows. Local tokens of all connections are kept in one hash table
+ * so that they are unique and can be looked up from softirq context.
+ */
+
+#include <linux/hashtable.h>
+#include <linux/kernel.h>
+#include <linux/random.h>
+#include <linux/spinlock.h>
+#include <net/sock.h>
+
+#include "protocol.h"
+
+#define MPTCP_TOKEN_HASH_BITS	10
+
+static DEFINE_HASHTABLE(token_hash, MPTCP_TOKEN_HASH_BITS);
+static DEFINE_SPINLOCK(token_hash_lock);
+
+/* must be called with token_hash_lock held */
+static struct mptcp_sock *__token_lookup(u32 token)
+{
+	struct mptcp_sock *msk;
+
+	hash_for_each_possible(token_hash, msk, token_node, token) {
+		if (msk->token == token)
+			return msk;
+	}
+
+	return NULL;
+}
+
+static bool token_used(u32 token)
+{
+	bool used;
+
+	spin_lock_bh(&token_hash_lock);
+	used = !!__token_lookup(token);
+	spin_unlock_bh(&token_hash_lock);
+
+	return used;
+}
+
+/**
+ * mptcp_token_new_request - pick the key and token for an MPTCP request
+ * @subflow_req: the request socket of an MP_CAPABLE SYN
+ *
+ * The token is only claimed when the connection is created from the
+ * request, see mptcp_token_insert().
+ */
+void mptcp_token_new_request(struct mptcp_subflow_request_sock *subflow_req)
+{
+	do {
+		get_random_bytes(&subflow_req->local_key,
+				 sizeof(subflow_req->local_key));
+		mptcp_crypto_key_sha1(subflow_req->local_key,
+				      &subflow_req->token, NULL);
+	} while (token_used(subflow_req->token));
+}
+
+/**
+ * mptcp_token_new_connect - pick the key and token of an active opener
+ * @sk: the MPTCP socket, hashed under its new token
+ */
+void mptcp_token_new_connect(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	spin_lock_bh(&token_hash_lock);
+	do {
+		get_random_bytes(&msk->local_key, sizeof(msk->local_key));
+		mptcp_crypto_key_sha1(msk->local_key, &msk->token, NULL);
+	} while (__token_lookup(msk->token));
+	hash_add(token_hash, &msk->token_node, msk->token);
+	spin_unlock_bh(&token_hash_lock);
+}
+
+/* hash a connection created by a listener, fails if another connection
+ * took the same token after the SYN was answered
+ */
+int mptcp_token_insert(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+	int err = 0;
+
+	spin_lock_bh(&token_hash_lock);
+	if (__token_lookup(msk->token))
+		err = -EBUSY;
+	else
+		hash_add(token_hash, &msk->token_node, msk->token);
+	spin_unlock_bh(&token_hash_lock);
+
+	return err;
+}
+
+/**
+ * mptcp_token_get_sock - find the connection owning a token
+ * @net: namespace the MP_JOIN SYN was received in
+ * @token: token carried by the MP_JOIN SYN
+ *
+ * Returns the MPTCP socket with a reference held, or NULL.
+ */
+struct sock *mptcp_token_get_sock(const struct net *net, u32 token)
+{
+	struct mptcp_sock *msk;
+	struct sock *sk = NULL;
+
+	spin_lock_bh(&token_hash_lock);
+	msk = __token_lookup(token);
+	if (msk && net_eq(sock_net((struct sock *)msk), net)) {
+		sk = (struct sock *)msk;
+		sock_hold(sk);
+	}
+	spin_unlock_bh(&token_hash_lock);
+
+	return sk;
+}
+
+void mptcp_token_destroy(struct sock *sk)
+{
+	struct mptcp_sock *msk = mptcp_sk(sk);
+
+	spin_lock_bh(&token_hash_lock);
+	if (!hlist_unhashed(&msk->token_node))
+		hash_del(&msk->token_node);
+	spin_unlock_bh(&token_hash_lock);
+}
+
+void __init mptcp_token_init(void)
+{
+	hash_init(token_hash);
+}
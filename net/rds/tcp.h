@@ -6,7 +6,9 @@
 
 struct rds_tcp_incoming {
 	struct rds_incoming	ti_inc;
-	struct sk_buff_head	ti_skb_list;
+	/* payload, in page sized fragments allocated as data arrives */
+	struct scatterlist	*ti_sg;
+	unsigned int		ti_nents;
 };
 
 struct rds_tcp_connection {
@@ -84,7 +86,6 @@ void rds_tcp_inc_free(struct rds_incoming *inc);
 int rds_tcp_inc_copy_to_user(struct rds_incoming *inc, struct iov_iter *to);
 
 /* tcp_send.c */
-void rds_tcp_xmit_path_prepare(struct rds_conn_path *cp);
 void rds_tcp_xmit_path_complete(struct rds_conn_path *cp);
 int rds_tcp_xmit(struct rds_connection *conn, struct rds_message *rm,
 		 unsigned int hdr_off, unsigned int sg, unsigned int off);
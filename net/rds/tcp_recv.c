@@ -32,6 +32,8 @@
  */
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/highmem.h>
+#include <linux/scatterlist.h>
 #include <net/tcp.h>
 
 #include "rds.h"
@@ -42,9 +44,17 @@ static struct kmem_cache *rds_tcp_incoming_slab;
 static void rds_tcp_inc_purge(struct rds_incoming *inc)
 {
 	struct rds_tcp_incoming *tinc;
+	unsigned int i;
+
 	tinc = container_of(inc, struct rds_tcp_incoming, ti_inc);
 	rdsdebug("purging tinc %p inc %p\n", tinc, inc);
-	skb_queue_purge(&tinc->ti_skb_list);
+	for (i = 0; i < tinc->ti_nents; i++) {
+		if (sg_page(&tinc->ti_sg[i]))
+			__free_page(sg_page(&tinc->ti_sg[i]));
+	}
+	kfree(tinc->ti_sg);
+	tinc->ti_sg = NULL;
+	tinc->ti_nents = 0;
 }
 
 void rds_tcp_inc_free(struct rds_incoming *inc)
@@ -56,44 +66,50 @@ void rds_tcp_inc_free(struct rds_incoming *inc)
 	kmem_cache_free(rds_tcp_incoming_slab, tinc);
 }
 
-/*
- * this is pretty lame, but, whatever.
- */
 int rds_tcp_inc_copy_to_user(struct rds_incoming *inc, struct iov_iter *to)
 {
 	struct rds_tcp_incoming *tinc;
-	struct sk_buff *skb;
-	int ret = 0;
-
-	if (!iov_iter_count(to))
-		goto out;
+	struct scatterlist *sg;
+	unsigned long to_copy;
+	unsigned long vec_off;
+	int copied;
+	int ret;
+	u32 len;
 
 	tinc = container_of(inc, struct rds_tcp_incoming, ti_inc);
+	len = be32_to_cpu(inc->i_hdr.h_len);
 
-	skb_queue_walk(&tinc->ti_skb_list, skb) {
-		unsigned long to_copy, skb_off;
-		for (skb_off = 0; skb_off < skb->len; skb_off += to_copy) {
-			to_copy = iov_iter_count(to);
-			to_copy = min(to_copy, skb->len - skb_off);
+	sg = tinc->ti_sg;
+	vec_off = 0;
+	copied = 0;
 
-			if (skb_copy_datagram_iter(skb, skb_off, to, to_copy))
-				return -EFAULT;
+	while (iov_iter_count(to) && copied < len) {
+		to_copy = min_t(unsigned long, iov_iter_count(to),
+				sg->length - vec_off);
+		to_copy = min_t(unsigned long, to_copy, len - copied);
 
-			rds_stats_add(s_copy_to_user, to_copy);
-			ret += to_copy;
+		rds_stats_add(s_copy_to_user, to_copy);
+		ret = copy_page_to_iter(sg_page(sg), sg->offset + vec_off,
+					to_copy, to);
+		if (ret != to_copy)
+			return -EFAULT;
 
-			if (!iov_iter_count(to))
-				goto out;
+		vec_off += to_copy;
+		copied += to_copy;
+
+		if (vec_off == sg->length) {
+			vec_off = 0;
+			sg++;
 		}
 	}
-out:
-	return ret;
+
+	return copied;
 }
 
 /*
- * We have a series of skbs that have fragmented pieces of the congestion
+ * We have a series of fragments that have pieces of the congestion
  * bitmap.  They must add up to the exact size of the congestion bitmap.  We
- * use the skb helpers to copy those into the pages that make up the in-memory
+ * copy those into the pages that make up the in-memory
  * congestion bitmap for the remote address of this connection.  We then tell
  * the congestion core that the bitmap has been changed so that it can wake up
  * sleepers.
@@ -105,12 +121,13 @@ int rds_tcp_inc_copy_to_user(struct rds_incoming *inc, struct iov_iter *to)
 static void rds_tcp_cong_recv(struct rds_connection *conn,
 			      struct rds_tcp_incoming *tinc)
 {
-	struct sk_buff *skb;
-	unsigned int to_copy, skb_off;
+	struct scatterlist *sg;
+	unsigned int to_copy, sg_off;
 	unsigned int map_off;
 	unsigned int map_page;
 	struct rds_cong_map *map;
-	int ret;
+	unsigned int i;
+	void *addr;
 
 	/* catch completely corrupt packets */
 	if (be32_to_cpu(tinc->ti_inc.i_hdr.h_len) != RDS_CONG_MAP_BYTES)
@@ -120,21 +137,21 @@ static void rds_tcp_cong_recv(struct rds_connection *conn,
 	map_off = 0;
 	map = conn->c_fcong;
 
-	skb_queue_walk(&tinc->ti_skb_list, skb) {
-		skb_off = 0;
-		while (skb_off < skb->len) {
+	for (i = 0; i < tinc->ti_nents; i++) {
+		sg = &tinc->ti_sg[i];
+		sg_off = 0;
+		while (sg_off < sg->length) {
 			to_copy = min_t(unsigned int, PAGE_SIZE - map_off,
-					skb->len - skb_off);
+					sg->length - sg_off);
 
 			BUG_ON(map_page >= RDS_CONG_MAP_PAGES);
 
-			/* only returns 0 or -error */
-			ret = skb_copy_bits(skb, skb_off,
-				(void *)map->m_page_addrs[map_page] + map_off,
-				to_copy);
-			BUG_ON(ret != 0);
+			addr = kmap_atomic(sg_page(sg));
+			memcpy((void *)map->m_page_addrs[map_page] + map_off,
+			       addr + sg->offset + sg_off, to_copy);
+			kunmap_atomic(addr);
 
-			skb_off += to_copy;
+			sg_off += to_copy;
 			map_off += to_copy;
 			if (map_off == PAGE_SIZE) {
 				map_off = 0;
@@ -151,6 +168,56 @@ struct rds_tcp_desc_arg {
 	gfp_t gfp;
 };
 
+/*
+ * Copy up to @len bytes of payload at @offset in @skb into the page sized
+ * fragment that the next byte of the message belongs to, allocating the
+ * fragment first if need be.  @rem is what is still missing of the
+ * payload.  Returns the number of bytes copied or a negative error.
+ */
+static int rds_tcp_inc_fill(struct rds_tcp_incoming *tinc, size_t rem,
+			    struct sk_buff *skb, unsigned int offset,
+			    size_t len, gfp_t gfp)
+{
+	unsigned int total = be32_to_cpu(tinc->ti_inc.i_hdr.h_len);
+	unsigned int filled = total - rem;
+	unsigned int frag_off = filled & ~PAGE_MASK;
+	struct scatterlist *sg;
+	void *addr;
+	int ret;
+
+	if (!tinc->ti_sg) {
+		if (total > RDS_MAX_MSG_SIZE)
+			return -EPROTO;
+
+		tinc->ti_nents = DIV_ROUND_UP(total, PAGE_SIZE);
+		tinc->ti_sg = kcalloc(tinc->ti_nents, sizeof(*tinc->ti_sg),
+				      gfp);
+		if (!tinc->ti_sg) {
+			tinc->ti_nents = 0;
+			return -ENOMEM;
+		}
+		sg_init_table(tinc->ti_sg, tinc->ti_nents);
+	}
+
+	sg = &tinc->ti_sg[filled >> PAGE_SHIFT];
+	if (!sg_page(sg)) {
+		ret = rds_page_remainder_alloc(sg, min_t(unsigned int, rem,
+							 PAGE_SIZE), gfp);
+		if (ret)
+			return ret;
+	}
+
+	len = min_t(size_t, len, sg->length - frag_off);
+
+	addr = kmap_atomic(sg_page(sg));
+	ret = skb_copy_bits(skb, offset, addr + sg->offset + frag_off, len);
+	kunmap_atomic(addr);
+	if (ret)
+		return ret;
+
+	return len;
+}
+
 static int rds_tcp_data_recv(read_descriptor_t *desc, struct sk_buff *skb,
 			     unsigned int offset, size_t len)
 {
@@ -158,8 +225,8 @@ static int rds_tcp_data_recv(read_descriptor_t *desc, struct sk_buff *skb,
 	struct rds_conn_path *cp = arg->conn_path;
 	struct rds_tcp_connection *tc = cp->cp_transport_data;
 	struct rds_tcp_incoming *tinc = tc->t_tinc;
-	struct sk_buff *clone;
 	size_t left = len, to_copy;
+	int ret;
 
 	rdsdebug("tcp data tc %p skb %p offset %u len %zu\n", tc, skb, offset,
 		 len);
@@ -182,12 +249,8 @@ static int rds_tcp_data_recv(read_descriptor_t *desc, struct sk_buff *skb,
 					  cp->cp_conn->c_faddr);
 			tinc->ti_inc.i_rx_lat_trace[RDS_MSG_RX_HDR] =
 					local_clock();
-
-			/*
-			 * XXX * we might be able to use the __ variants when
-			 * we've already serialized at a higher level.
-			 */
-			skb_queue_head_init(&tinc->ti_skb_list);
+			tinc->ti_sg = NULL;
+			tinc->ti_nents = 0;
 		}
 
 		if (left && tc->t_tinc_hdr_rem) {
@@ -215,22 +278,19 @@ static int rds_tcp_data_recv(read_descriptor_t *desc, struct sk_buff *skb,
 		if (left && tc->t_tinc_data_rem) {
 			to_copy = min(tc->t_tinc_data_rem, left);
 
-			clone = pskb_extract(skb, offset, to_copy, arg->gfp);
-			if (!clone) {
-				desc->error = -ENOMEM;
+			ret = rds_tcp_inc_fill(tinc, tc->t_tinc_data_rem, skb,
+					       offset, to_copy, arg->gfp);
+			if (ret < 0) {
+				desc->error = ret;
 				goto out;
 			}
 
-			skb_queue_tail(&tinc->ti_skb_list, clone);
+			rdsdebug("skb %p len %d off %u to_copy %zu copied %d\n",
+				 skb, skb->len, offset, to_copy, ret);
 
-			rdsdebug("skb %p data %p len %d off %u to_copy %zu -> "
-				 "clone %p data %p len %d\n",
-				 skb, skb->data, skb->len, offset, to_copy,
-				 clone, clone->data, clone->len);
-
-			tc->t_tinc_data_rem -= to_copy;
-			left -= to_copy;
-			offset += to_copy;
+			tc->t_tinc_data_rem -= ret;
+			left -= ret;
+			offset += ret;
 		}
 
 		if (tc->t_tinc_hdr_rem == 0 && tc->t_tinc_data_rem == 0) {
@@ -276,6 +336,10 @@ static int rds_tcp_read_sock(struct rds_conn_path *cp, gfp_t gfp)
 	rdsdebug("tcp_read_sock for tc %p gfp 0x%x returned %d\n", tc, gfp,
 		 desc.error);
 
+	/* the stream can't be resynchronized after a bogus header */
+	if (desc.error == -EPROTO)
+		rds_conn_path_drop(cp, false);
+
 	return desc.error;
 }
 
@@ -38,37 +38,44 @@
 #include "rds.h"
 #include "tcp.h"
 
-static void rds_tcp_cork(struct socket *sock, int val)
-{
-	kernel_setsockopt(sock, SOL_TCP, TCP_CORK, (void *)&val, sizeof(val));
-}
-
-void rds_tcp_xmit_path_prepare(struct rds_conn_path *cp)
+/*
+ * Messages are sent with MSG_MORE while others are queued behind them, so
+ * that a batch goes out in full sized segments.  Push out whatever is left
+ * once the batch is done.
+ */
+void rds_tcp_xmit_path_complete(struct rds_conn_path *cp)
 {
 	struct rds_tcp_connection *tc = cp->cp_transport_data;
+	struct sock *sk = tc->t_sock->sk;
 
-	rds_tcp_cork(tc->t_sock, 1);
+	lock_sock(sk);
+	tcp_push_pending_frames(sk);
+	release_sock(sk);
 }
 
-void rds_tcp_xmit_path_complete(struct rds_conn_path *cp)
+/*
+ * Only a hint, taken without cp_lock: a message queued after we looked is
+ * pushed out by rds_tcp_xmit_path_complete() at the latest.
+ */
+static int rds_tcp_more_queued(struct rds_conn_path *cp)
 {
-	struct rds_tcp_connection *tc = cp->cp_transport_data;
-
-	rds_tcp_cork(tc->t_sock, 0);
+	return !list_empty(&cp->cp_send_queue) ||
+	       test_bit(0, &cp->cp_conn->c_map_queued);
 }
 
-/* the core send_sem serializes this with other xmit and shutdown */
-static int rds_tcp_sendmsg(struct socket *sock, void *data, unsigned int len)
+/* the caller has to hold the sock lock */
+static int rds_tcp_sendmsg(struct sock *sk, void *data, unsigned int len,
+			   int flags)
 {
 	struct kvec vec = {
 		.iov_base = data,
 		.iov_len = len,
 	};
 	struct msghdr msg = {
-		.msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL,
+		.msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL | flags,
 	};
 
-	return kernel_sendmsg(sock, &msg, &vec, 1, vec.iov_len);
+	return kernel_sendmsg_locked(sk, &msg, &vec, 1, vec.iov_len);
 }
 
 /* the core send_sem serializes this with other xmit and shutdown */
@@ -77,6 +84,7 @@ int rds_tcp_xmit(struct rds_connection *conn, struct rds_message *rm,
 {
 	struct rds_conn_path *cp = rm->m_inc.i_conn_path;
 	struct rds_tcp_connection *tc = cp->cp_transport_data;
+	struct sock *sk = tc->t_sock->sk;
 	int done = 0;
 	int ret = 0;
 	int more;
@@ -102,13 +110,23 @@ int rds_tcp_xmit(struct rds_connection *conn, struct rds_message *rm,
 			 (unsigned long long)rm->m_ack_seq);
 	}
 
+	/* the last fragment of the message, if another one follows */
+	more = rds_tcp_more_queued(cp) ? MSG_MORE : 0;
+
+	/*
+	 * Header and payload are queued under one hold of the socket lock.
+	 * The header is sent with MSG_MORE, the payload pages are then
+	 * appended to the same skb instead of starting a new segment.
+	 */
+	lock_sock(sk);
+
 	if (hdr_off < sizeof(struct rds_header)) {
 		/* see rds_tcp_write_space() */
-		set_bit(SOCK_NOSPACE, &tc->t_sock->sk->sk_socket->flags);
+		set_bit(SOCK_NOSPACE, &sk->sk_socket->flags);
 
-		ret = rds_tcp_sendmsg(tc->t_sock,
-				      (void *)&rm->m_inc.i_hdr + hdr_off,
-				      sizeof(rm->m_inc.i_hdr) - hdr_off);
+		ret = rds_tcp_sendmsg(sk, (void *)&rm->m_inc.i_hdr + hdr_off,
+				      sizeof(rm->m_inc.i_hdr) - hdr_off,
+				      rm->data.op_nents ? MSG_MORE : more);
 		if (ret < 0)
 			goto out;
 		done += ret;
@@ -116,15 +134,18 @@ int rds_tcp_xmit(struct rds_connection *conn, struct rds_message *rm,
 			goto out;
 	}
 
-	more = rm->data.op_nents > 1 ? (MSG_MORE | MSG_SENDPAGE_NOTLAST) : 0;
 	while (sg < rm->data.op_nents) {
-		int flags = MSG_DONTWAIT | MSG_NOSIGNAL | more;
+		int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
 
-		ret = tc->t_sock->ops->sendpage(tc->t_sock,
-						sg_page(&rm->data.op_sg[sg]),
-						rm->data.op_sg[sg].offset + off,
-						rm->data.op_sg[sg].length - off,
-						flags);
+		if (sg < rm->data.op_nents - 1)
+			flags |= MSG_MORE | MSG_SENDPAGE_NOTLAST;
+		else
+			flags |= more;
+
+		ret = kernel_sendpage_locked(sk, sg_page(&rm->data.op_sg[sg]),
+					     rm->data.op_sg[sg].offset + off,
+					     rm->data.op_sg[sg].length - off,
+					     flags);
 		rdsdebug("tcp sendpage %p:%u:%u ret %d\n", (void *)sg_page(&rm->data.op_sg[sg]),
 			 rm->data.op_sg[sg].offset + off, rm->data.op_sg[sg].length - off,
 			 ret);
@@ -137,11 +158,11 @@ int rds_tcp_xmit(struct rds_connection *conn, struct rds_message *rm,
 			off = 0;
 			sg++;
 		}
-		if (sg == rm->data.op_nents - 1)
-			more = 0;
 	}
 
 out:
+	release_sock(sk);
+
 	if (ret <= 0) {
 		/* write_space will hit after EAGAIN, all else fatal */
 		if (ret == -EAGAIN) {
@@ -1381,6 +1381,41 @@ const union sctp_addr *sctp_source(const struct sctp_chunk *chunk)
 	}
 }
 
+/* DATA and I-DATA chunks are only made by sendmsg(), with the socket
+ * locked.  Carve their buffer out of the socket's page frag, like TCP
+ * does for its payload, rather than taking a kmalloc()ed head for every
+ * small message.  Chunks that do not fit in a page fall back to
+ * alloc_skb().
+ */
+static struct sk_buff *sctp_alloc_data_skb(struct sock *sk, int chunklen,
+					   gfp_t gfp)
+{
+	unsigned int size = SKB_DATA_ALIGN(chunklen) +
+			    SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	struct page_frag *pfrag;
+	struct sk_buff *skb;
+
+	sock_owned_by_me(sk);
+
+	if (size > PAGE_SIZE)
+		return alloc_skb(chunklen, gfp);
+
+	/* the task frag is shared with other sockets, keep heads aligned */
+	pfrag = sk_page_frag(sk);
+	pfrag->offset = ALIGN(pfrag->offset, SMP_CACHE_BYTES);
+	if (!skb_page_frag_refill(size, pfrag, gfp))
+		return alloc_skb(chunklen, gfp);
+
+	skb = build_skb(page_address(pfrag->page) + pfrag->offset, size);
+	if (!skb)
+		return NULL;
+
+	get_page(pfrag->page);
+	pfrag->offset += size;
+
+	return skb;
+}
+
 /* Create a new chunk, setting the type and flags headers from the
  * arguments, reserving enough space for a 'paylen' byte payload.
  */
@@ -1399,7 +1434,10 @@ static struct sctp_chunk *_sctp_make_chunk(const struct sctp_association *asoc,
 		goto nodata;
 
 	/* No need to allocate LL here, as this is only a chunk. */
-	skb = alloc_skb(chunklen, gfp);
+	if (type == SCTP_CID_DATA || type == SCTP_CID_I_DATA)
+		skb = sctp_alloc_data_skb(asoc->base.sk, chunklen, gfp);
+	else
+		skb = alloc_skb(chunklen, gfp);
 	if (!skb)
 		goto nodata;
 
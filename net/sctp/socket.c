@@ -1463,6 +1463,41 @@ static int sctp_getsockopt_connectx3(struct sock *sk, int len,
 	return err;
 }
 
+/* A burst of MSG_MORE sends keeps its DATA chunks on the outqueue without
+ * flushing it for every message, until about as much data as one packet
+ * can carry, a GSO one if the route allows, is queued.  The send buffer
+ * is charged the truesize of the chunks and fills well before that with
+ * small messages, so stop holding as soon as what is left of it is less
+ * than what is queued: the data must be in flight before sendmsg() has
+ * to wait for the peer to free some of it.
+ */
+static bool sctp_sendmsg_hold(struct sctp_association *asoc)
+{
+	struct sock *sk = asoc->base.sk;
+	unsigned int limit;
+
+	if (!asoc->force_delay)
+		return false;
+
+	limit = sk_can_gso(sk) ? sk->sk_gso_max_size : asoc->pathmtu;
+	limit = min_t(unsigned int, limit, sctp_wspace(asoc));
+
+	return asoc->outqueue.out_qlen < limit;
+}
+
+/* Push out what a MSG_MORE burst left on the outqueue, when no further
+ * send is going to do it: the association is shut down, or sendmsg() is
+ * about to wait for send buffer space.
+ */
+static void sctp_sendmsg_flush(struct sctp_association *asoc)
+{
+	if (!asoc->force_delay && list_empty(&asoc->outqueue.out_chunk_list))
+		return;
+
+	asoc->force_delay = 0;
+	sctp_outq_uncork(&asoc->outqueue, GFP_KERNEL);
+}
+
 /* API 3.1.4 close() - UDP Style Syntax
  * Applications use close() to perform graceful shutdown (as described in
  * Section 10.1 of [SCTP]) on ALL the associations currently represented
@@ -1557,8 +1592,10 @@ static void sctp_close(struct sock *sk, long timeout)
 
 			chunk = sctp_make_abort_user(asoc, NULL, 0);
 			sctp_primitive_ABORT(net, asoc, chunk);
-		} else
+		} else {
+			sctp_sendmsg_flush(asoc);
 			sctp_primitive_SHUTDOWN(net, asoc, NULL);
+		}
 	}
 
 	/* On a TCP-style socket, block for at most linger_time if set. */
@@ -1871,6 +1908,7 @@ static int sctp_sendmsg_check_sflags(struct sctp_association *asoc,
 
 	if (sflags & SCTP_EOF) {
 		pr_debug("%s: shutting down association:%p\n", __func__, asoc);
+		sctp_sendmsg_flush(asoc);
 		sctp_primitive_SHUTDOWN(net, asoc, NULL);
 
 		return 0;
@@ -1932,6 +1970,8 @@ static int sctp_sendmsg_to_asoc(struct sctp_association *asoc,
 		sctp_prsctp_prune(asoc, sinfo, msg_len - sctp_wspace(asoc));
 
 	if (!sctp_wspace(asoc)) {
+		/* only what is in flight can free up the send buffer */
+		sctp_sendmsg_flush(asoc);
 		timeo = sock_sndtimeo(sk, msg->msg_flags & MSG_DONTWAIT);
 		err = sctp_wait_for_sndbuf(asoc, &timeo, msg_len);
 		if (err)
@@ -1969,7 +2009,24 @@ static int sctp_sendmsg_to_asoc(struct sctp_association *asoc,
 		chunk->transport = transport;
 	}
 
+	/* Corking here keeps the command interpreter from flushing the
+	 * outqueue behind the new chunks.  Whatever flushes it next, this
+	 * send if the burst is over, a SACK or a timer otherwise, sends the
+	 * chunks of the whole burst together, so the stream scheduler picks
+	 * from all of them at once.
+	 */
+	if (sctp_sendmsg_hold(asoc))
+		sctp_outq_cork(&asoc->outqueue);
+
 	err = sctp_primitive_SEND(net, asoc, datamsg);
+
+	if (asoc->outqueue.cork) {
+		if (!err && sctp_sendmsg_hold(asoc))
+			asoc->outqueue.cork = 0;
+		else
+			sctp_outq_uncork(&asoc->outqueue, GFP_KERNEL);
+	}
+
 	if (err) {
 		sctp_datamsg_free(datamsg);
 		goto err;
@@ -4888,6 +4945,7 @@ static void sctp_shutdown(struct sock *sk, int how)
 		inet_sk_set_state(sk, SCTP_SS_CLOSING);
 		asoc = list_entry(ep->asocs.next,
 				  struct sctp_association, asocs);
+		sctp_sendmsg_flush(asoc);
 		sctp_primitive_SHUTDOWN(net, asoc, NULL);
 	}
 }
@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Shared Memory Communications Direct over loopback (SMC-D loopback)
+ *
+ * Software ISM device. Both ends of a connection live in the same kernel,
+ * so a DMB is plain kernel memory and "moving data" into the peer DMB is a
+ * memcpy. A signalling write schedules the receiver's tasklet directly,
+ * just like the ISM interrupt handler would.
+ */
+
+#include <linux/bitops.h>
+#include <linux/hashtable.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "smc_ism.h"
+#include "smc_loopback.h"
+
+#define SMC_LO_MAX_DMBS		5000
+#define SMC_LO_DMBS_HASH_BITS	12
+
+struct smc_lo_dmb_node {
+	struct hlist_node list;
+	u64 token;
+	u32 len;
+	u32 sba_idx;
+	void *cpu_addr;
+};
+
+struct smc_lo_dev {
+	struct smcd_dev *smcd;
+	DECLARE_BITMAP(sba_idx_mask, SMC_LO_MAX_DMBS);
+	rwlock_t dmb_ht_lock;	/* protects dmb_ht */
+	DECLARE_HASHTABLE(dmb_ht, SMC_LO_DMBS_HASH_BITS);
+};
+
+static struct smc_lo_dev *smc_lo;
+struct smcd_dev *smc_lo_smcd;
+
+static struct smc_lo_dmb_node *smc_lo_find_dmb(struct smc_lo_dev *ldev,
+					       u64 token)
+{
+	struct smc_lo_dmb_node *dmb_node;
+
+	hash_for_each_possible(ldev->dmb_ht, dmb_node, list, token) {
+		if (dmb_node->token == token)
+			return dmb_node;
+	}
+	return NULL;
+}
+
+/* Only the local GID is reachable through the loopback device. */
+static int smc_lo_query_rgid(struct smcd_dev *smcd, u64 rgid, u32 vid_valid,
+			     u32 vid)
+{
+	return rgid == smcd->local_gid ? 0 : -ENETUNREACH;
+}
+
+static int smc_lo_register_dmb(struct smcd_dev *smcd, struct smcd_dmb *dmb)
+{
+	struct smc_lo_dev *ldev = smcd->priv;
+	struct smc_lo_dmb_node *dmb_node;
+	int sba_idx, rc;
+
+	/* an index of 0 asks the device to choose one; a concurrent
+	 * registration may take the bit we found, so search again until
+	 * we win one or the bitmap is full
+	 */
+	sba_idx = dmb->sba_idx;
+	if (!sba_idx) {
+		do {
+			sba_idx = find_next_zero_bit(ldev->sba_idx_mask,
+						     SMC_LO_MAX_DMBS, 1);
+			if (sba_idx >= SMC_LO_MAX_DMBS)
+				return -ENOSPC;
+		} while (test_and_set_bit(sba_idx, ldev->sba_idx_mask));
+	} else if (sba_idx >= SMC_LO_MAX_DMBS ||
+		   test_and_set_bit(sba_idx, ldev->sba_idx_mask)) {
+		return -EINVAL;
+	}
+
+	dmb_node = kzalloc(sizeof(*dmb_node), GFP_KERNEL);
+	if (!dmb_node) {
+		rc = -ENOMEM;
+		goto err_bit;
+	}
+	dmb_node->cpu_addr = kzalloc(dmb->dmb_len, GFP_KERNEL |
+				     __GFP_NOWARN | __GFP_NORETRY |
+				     __GFP_NOMEMALLOC);
+	if (!dmb_node->cpu_addr) {
+		rc = -ENOMEM;
+		goto err_node;
+	}
+	dmb_node->len = dmb->dmb_len;
+	dmb_node->sba_idx = sba_idx;
+
+	/* tokens are handed to the peer, keep them unique and unguessable */
+	write_lock_bh(&ldev->dmb_ht_lock);
+	do {
+		get_random_bytes(&dmb_node->token, sizeof(dmb_node->token));
+	} while (!dmb_node->token ||
+		 smc_lo_find_dmb(ldev, dmb_node->token));
+	hash_add(ldev->dmb_ht, &dmb_node->list, dmb_node->token);
+	write_unlock_bh(&ldev->dmb_ht_lock);
+
+	dmb->sba_idx = dmb_node->sba_idx;
+	dmb->dmb_tok = dmb_node->token;
+	dmb->cpu_addr = dmb_node->cpu_addr;
+	dmb->dma_addr = 0;
+	dmb->dmb_len = dmb_node->len;
+	return 0;
+
+err_node:
+	kfree(dmb_node);
+err_bit:
+	clear_bit(sba_idx, ldev->sba_idx_mask);
+	return rc;
+}
+
+static int smc_lo_unregister_dmb(struct smcd_dev *smcd, struct smcd_dmb *dmb)
+{
+	struct smc_lo_dev *ldev = smcd->priv;
+	struct smc_lo_dmb_node *dmb_node;
+
+	write_lock_bh(&ldev->dmb_ht_lock);
+	dmb_node = smc_lo_find_dmb(ldev, dmb->dmb_tok);
+	if (!dmb_node) {
+		write_unlock_bh(&ldev->dmb_ht_lock);
+		return -EINVAL;
+	}
+	hash_del(&dmb_node->list);
+	write_unlock_bh(&ldev->dmb_ht_lock);
+
+	clear_bit(dmb_node->sba_idx, ldev->sba_idx_mask);
+	kfree(dmb_node->cpu_addr);
+	kfree(dmb_node);
+	return 0;
+}
+
+/* There is no hardware VLAN filtering to configure. */
+static int smc_lo_add_vlan_id(struct smcd_dev *smcd, u64 vlan_id)
+{
+	return 0;
+}
+
+static int smc_lo_del_vlan_id(struct smcd_dev *smcd, u64 vlan_id)
+{
+	return 0;
+}
+
+static int smc_lo_set_vlan_required(struct smcd_dev *smcd)
+{
+	return 0;
+}
+
+static int smc_lo_reset_vlan_required(struct smcd_dev *smcd)
+{
+	return 0;
+}
+
+static int smc_lo_signal_event(struct smcd_dev *smcd, u64 rgid,
+			       u32 trigger_irq, u32 event_code, u64 info)
+{
+	return 0;
+}
+
+static int smc_lo_move_data(struct smcd_dev *smcd, u64 dmb_tok,
+			    unsigned int idx, bool sf, unsigned int offset,
+			    void *data, unsigned int size)
+{
+	struct smc_lo_dev *ldev = smcd->priv;
+	struct smc_lo_dmb_node *rmb_node;
+	u32 sba_idx;
+
+	read_lock_bh(&ldev->dmb_ht_lock);
+	rmb_node = smc_lo_find_dmb(ldev, dmb_tok);
+	if (!rmb_node) {
+		read_unlock_bh(&ldev->dmb_ht_lock);
+		return -EINVAL;
+	}
+	if (offset > rmb_node->len || size > rmb_node->len - offset) {
+		read_unlock_bh(&ldev->dmb_ht_lock);
+		return -EINVAL;
+	}
+	memcpy((char *)rmb_node->cpu_addr + offset, data, size);
+	sba_idx = rmb_node->sba_idx;
+	read_unlock_bh(&ldev->dmb_ht_lock);
+
+	if (sf)
+		smcd_handle_irq(smcd, sba_idx);
+	return 0;
+}
+
+static const struct smcd_ops smc_lo_ops = {
+	.query_remote_gid = smc_lo_query_rgid,
+	.register_dmb = smc_lo_register_dmb,
+	.unregister_dmb = smc_lo_unregister_dmb,
+	.add_vlan_id = smc_lo_add_vlan_id,
+	.del_vlan_id = smc_lo_del_vlan_id,
+	.set_vlan_required = smc_lo_set_vlan_required,
+	.reset_vlan_required = smc_lo_reset_vlan_required,
+	.signal_event = smc_lo_signal_event,
+	.move_data = smc_lo_move_data,
+};
+
+int smc_loopback_init(void)
+{
+	struct smcd_dev *smcd;
+	int rc;
+
+	smc_lo = kzalloc(sizeof(*smc_lo), GFP_KERNEL);
+	if (!smc_lo)
+		return -ENOMEM;
+	rwlock_init(&smc_lo->dmb_ht_lock);
+	hash_init(smc_lo->dmb_ht);
+
+	smcd = smcd_alloc_dev(NULL, "smc_lo", &smc_lo_ops, SMC_LO_MAX_DMBS);
+	if (!smcd) {
+		rc = -ENOMEM;
+		goto out_free;
+	}
+	smcd->priv = smc_lo;
+	do {
+		get_random_bytes(&smcd->local_gid, sizeof(smcd->local_gid));
+	} while (!smcd->local_gid);
+	smc_lo->smcd = smcd;
+
+	rc = smcd_register_dev(smcd);
+	if (rc)
+		goto out_list;
+	smc_lo_smcd = smcd;
+	return 0;
+
+out_list:
+	/* the device was listed but never added, undo only the former */
+	spin_lock(&smcd_dev_list.lock);
+	list_del(&smcd->list);
+	spin_unlock(&smcd_dev_list.lock);
+	destroy_workqueue(smcd->event_wq);
+	smcd_free_dev(smcd);
+out_free:
+	kfree(smc_lo);
+	smc_lo = NULL;
+	return rc;
+}
+
+void smc_loopback_exit(void)
+{
+	if (!smc_lo)
+		return;
+	smc_lo_smcd = NULL;
+	smcd_unregister_dev(smc_lo->smcd);
+	smcd_free_dev(smc_lo->smcd);
+	kfree(smc_lo);
+	smc_lo = NULL;
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/* Shared Memory Communications Direct over loopback (SMC-D loopback)
+ *
+ * Software ISM device for connections between sockets on the same host.
+ */
+
+#ifndef SMC_LOOPBACK_H
+#define SMC_LOOPBACK_H
+
+#include <net/smc.h>
+
+#if IS_ENABLED(CONFIG_SMC_LO)
+extern struct smcd_dev *smc_lo_smcd;	/* loopback ISM device */
+
+int smc_loopback_init(void);
+void smc_loopback_exit(void);
+#else
+#define smc_lo_smcd	((struct smcd_dev *)NULL)
+
+static inline int smc_loopback_init(void)
+{
+	return 0;
+}
+
+static inline void smc_loopback_exit(void)
+{
+}
+#endif
+
+#endif
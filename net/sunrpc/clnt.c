@@ -499,6 +499,20 @@ static struct rpc_clnt *rpc_create_xprt(struct rpc_create_args *args,
 	return clnt;
 }
 
+/*
+ * The extra nconnect transports bind the same kind of source port as
+ * the first one.
+ */
+static int rpc_create_setup_xprt(struct rpc_clnt *clnt,
+				 struct rpc_xprt_switch *xps,
+				 struct rpc_xprt *xprt, void *data)
+{
+	struct rpc_create_args *args = data;
+
+	xprt->resvport = !(args->flags & RPC_CLNT_CREATE_NONPRIVPORT);
+	return 0;
+}
+
 /**
  * rpc_create - create an RPC client and transport with one call
  * @args: rpc_clnt create argument structure
@@ -508,9 +522,13 @@ static struct rpc_clnt *rpc_create_xprt(struct rpc_create_args *args,
  * It can ping the server in order to determine if it is up, and to see if
  * it supports this program and version.  RPC_CLNT_CREATE_NOPING disables
  * this behavior so asynchronous tasks can also use rpc_create.
+ *
+ * If args->nconnect is greater than one, additional transports to the
+ * same server are opened and requests are spread across all of them.
  */
 struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 {
+	struct rpc_clnt *clnt;
 	struct rpc_xprt *xprt;
 	struct xprt_create xprtargs = {
 		.net = args->net,
@@ -522,6 +540,7 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 		.bc_xprt = args->bc_xprt,
 	};
 	char servername[48];
+	unsigned int i;
 
 	if (args->bc_xprt) {
 		WARN_ON_ONCE(!(args->protocol & XPRT_TRANSPORT_BC));
@@ -584,7 +603,23 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
-	return rpc_create_xprt(args, xprt);
+	clnt = rpc_create_xprt(args, xprt);
+	if (IS_ERR(clnt))
+		return clnt;
+
+	for (i = 1; i < args->nconnect; i++) {
+		if (rpc_clnt_add_xprt(clnt, &xprtargs, rpc_create_setup_xprt,
+				      args) < 0)
+			break;
+	}
+	/* The transports are interchangeable, use the least busy one */
+	if (i > 1) {
+		rcu_read_lock();
+		rpc_xprt_switch_set_leastqueued(
+			rcu_dereference(clnt->cl_xpi.xpi_xpswitch));
+		rcu_read_unlock();
+	}
+	return clnt;
 }
 EXPORT_SYMBOL_GPL(rpc_create);
 
@@ -983,6 +1018,8 @@ void rpc_task_release_client(struct rpc_task *task)
 	if (xprt != NULL) {
 		task->tk_xprt = NULL;
 
+		if (clnt != NULL)
+			atomic_long_dec(&xprt->queuelen);
 		xprt_put(xprt);
 	}
 }
@@ -994,6 +1031,9 @@ void rpc_task_set_client(struct rpc_task *task, struct rpc_clnt *clnt)
 	if (clnt != NULL) {
 		if (task->tk_xprt == NULL)
 			task->tk_xprt = xprt_iter_get_next(&clnt->cl_xpi);
+		/* Lets the xprt switch steer new tasks to idle transports */
+		if (task->tk_xprt != NULL)
+			atomic_long_inc(&task->tk_xprt->queuelen);
 		task->tk_client = clnt;
 		atomic_inc(&clnt->cl_count);
 		if (clnt->cl_softrtry)
@@ -2584,6 +2624,14 @@ int rpc_clnt_test_and_add_xprt(struct rpc_clnt *clnt,
 	struct rpc_cb_add_xprt_calldata *data;
 	struct rpc_cred *cred;
 	struct rpc_task *task;
+	bool found;
+
+	/* Aliases of an address that is already in use are not added */
+	rcu_read_lock();
+	found = rpc_xprt_switch_has_addr(xps, (struct sockaddr *)&xprt->addr);
+	rcu_read_unlock();
+	if (found)
+		return 1;
 
 	data = kmalloc(sizeof(*data), GFP_NOFS);
 	if (!data)
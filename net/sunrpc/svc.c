@@ -476,8 +476,10 @@ __svc_create(struct svc_program *prog, unsigned int bufsize, int npools,
 				i, serv->sv_name);
 
 		pool->sp_id = i;
+		pool->sp_node = svc_pool_map_get_node(i);
 		INIT_LIST_HEAD(&pool->sp_sockets);
 		INIT_LIST_HEAD(&pool->sp_all_threads);
+		init_llist_head(&pool->sp_idle_threads);
 		spin_lock_init(&pool->sp_lock);
 	}
 
@@ -644,6 +646,7 @@ svc_prepare_thread(struct svc_serv *serv, struct svc_pool *pool, int node)
 	spin_lock_bh(&pool->sp_lock);
 	pool->sp_nrthreads++;
 	list_add_rcu(&rqstp->rq_all, &pool->sp_all_threads);
+	svc_pool_clear_congested(serv, pool);
 	spin_unlock_bh(&pool->sp_lock);
 	return rqstp;
 }
@@ -848,6 +851,24 @@ svc_rqst_free(struct svc_rqst *rqstp)
 }
 EXPORT_SYMBOL_GPL(svc_rqst_free);
 
+/*
+ * Take an exiting thread off the idle list. Entries are only ever
+ * popped under sp_lock, which the caller holds, so the list can be
+ * rebuilt here while idle threads keep pushing themselves onto it.
+ */
+static void
+svc_pool_forget_idle_thread(struct svc_pool *pool, struct svc_rqst *rqstp)
+{
+	struct llist_node *ln, *next;
+
+	ln = llist_del_all(&pool->sp_idle_threads);
+	llist_for_each_safe(ln, next, ln) {
+		if (ln != &rqstp->rq_idle)
+			llist_add(ln, &pool->sp_idle_threads);
+	}
+	clear_bit(RQ_IDLE, &rqstp->rq_flags);
+}
+
 void
 svc_exit_thread(struct svc_rqst *rqstp)
 {
@@ -858,6 +879,8 @@ svc_exit_thread(struct svc_rqst *rqstp)
 	pool->sp_nrthreads--;
 	if (!test_and_set_bit(RQ_VICTIM, &rqstp->rq_flags))
 		list_del_rcu(&rqstp->rq_all);
+	if (test_bit(RQ_IDLE, &rqstp->rq_flags))
+		svc_pool_forget_idle_thread(pool, rqstp);
 	spin_unlock_bh(&pool->sp_lock);
 
 	svc_rqst_free(rqstp);
@@ -376,8 +376,71 @@ static bool svc_xprt_has_something_to_do(struct svc_xprt *xprt)
 	return false;
 }
 
+/*
+ * Pop an idle thread off the pool's idle list and claim it. Entries
+ * can be stale: a thread that timed out or was woken for some other
+ * reason stays on the list while it works, with RQ_BUSY set. Such
+ * entries are dropped here and the thread pushes itself back the next
+ * time it goes idle. Called with pool->sp_lock held, which makes us
+ * the only consumer of the llist.
+ */
+static struct svc_rqst *svc_pool_get_idle_thread(struct svc_pool *pool)
+{
+	struct llist_node *ln;
+	struct svc_rqst *rqstp;
+
+	while ((ln = llist_del_first(&pool->sp_idle_threads)) != NULL) {
+		rqstp = llist_entry(ln, struct svc_rqst, rq_idle);
+		clear_bit(RQ_IDLE, &rqstp->rq_flags);
+		smp_mb__after_atomic();
+		if (!test_and_set_bit(RQ_BUSY, &rqstp->rq_flags))
+			return rqstp;
+	}
+	return NULL;
+}
+
+static void svc_pool_wake_thread(struct svc_pool *pool, struct svc_rqst *rqstp)
+{
+	atomic_long_inc(&pool->sp_stats.threads_woken);
+	rqstp->rq_qtime = ktime_get();
+	wake_up_process(rqstp->rq_task);
+}
+
+/*
+ * The local pool has no idle thread: wake one in another pool so it
+ * can steal the transport. Stay on the local NUMA node unless the
+ * local pool has no threads at all, in which case nobody else would
+ * ever pick the transport up.
+ */
+static struct svc_rqst *svc_pool_wake_sibling(struct svc_serv *serv,
+					      struct svc_pool *local)
+{
+	unsigned int n = serv->sv_nrpools;
+	struct svc_rqst *rqstp;
+	struct svc_pool *pool;
+	unsigned int i;
+
+	for (i = 1; i < n; i++) {
+		pool = &serv->sv_pools[(local->sp_id + i) % n];
+		if (pool->sp_node != local->sp_node && local->sp_nrthreads)
+			continue;
+		if (llist_empty(&pool->sp_idle_threads))
+			continue;
+
+		spin_lock_bh(&pool->sp_lock);
+		rqstp = svc_pool_get_idle_thread(pool);
+		spin_unlock_bh(&pool->sp_lock);
+		if (rqstp) {
+			svc_pool_wake_thread(pool, rqstp);
+			return rqstp;
+		}
+	}
+	return NULL;
+}
+
 void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 {
+	struct svc_serv *serv = xprt->xpt_server;
 	struct svc_pool *pool;
 	struct svc_rqst	*rqstp = NULL;
 	int cpu;
@@ -393,30 +456,28 @@ void svc_xprt_do_enqueue(struct svc_xprt *xprt)
 	if (test_and_set_bit(XPT_BUSY, &xprt->xpt_flags))
 		return;
 
+	/* The transport is queued on the pool of the cpu that received
+	 * its data, so the thread that handles it runs close to the
+	 * socket's cache lines.
+	 */
 	cpu = get_cpu();
-	pool = svc_pool_for_cpu(xprt->xpt_server, cpu);
+	pool = svc_pool_for_cpu(serv, cpu);
 
 	atomic_long_inc(&pool->sp_stats.packets);
 
 	spin_lock_bh(&pool->sp_lock);
 	list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
 	pool->sp_stats.sockets_queued++;
+	/* find a thread for this xprt */
+	rqstp = svc_pool_get_idle_thread(pool);
+	if (!rqstp && !test_and_set_bit(SP_CONGESTED, &pool->sp_flags))
+		atomic_inc(&serv->sv_nrcongested);
 	spin_unlock_bh(&pool->sp_lock);
 
-	/* find a thread for this xprt */
-	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		if (test_and_set_bit(RQ_BUSY, &rqstp->rq_flags))
-			continue;
-		atomic_long_inc(&pool->sp_stats.threads_woken);
-		rqstp->rq_qtime = ktime_get();
-		wake_up_process(rqstp->rq_task);
-		goto out_unlock;
-	}
-	set_bit(SP_CONGESTED, &pool->sp_flags);
-	rqstp = NULL;
-out_unlock:
-	rcu_read_unlock();
+	if (rqstp)
+		svc_pool_wake_thread(pool, rqstp);
+	else if (serv->sv_nrpools > 1)
+		rqstp = svc_pool_wake_sibling(serv, pool);
 	put_cpu();
 	trace_svc_xprt_do_enqueue(xprt, rqstp);
 }
@@ -438,7 +499,8 @@ EXPORT_SYMBOL_GPL(svc_xprt_enqueue);
 /*
  * Dequeue the first transport, if there is one.
  */
-static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
+static struct svc_xprt *svc_xprt_dequeue(struct svc_serv *serv,
+					 struct svc_pool *pool)
 {
 	struct svc_xprt	*xprt = NULL;
 
@@ -451,12 +513,67 @@ static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 					struct svc_xprt, xpt_ready);
 		list_del_init(&xprt->xpt_ready);
 		svc_xprt_get(xprt);
+		if (list_empty(&pool->sp_sockets))
+			svc_pool_clear_congested(serv, pool);
 	}
 	spin_unlock_bh(&pool->sp_lock);
 out:
 	return xprt;
 }
 
+/*
+ * Find a pool other than our own that ran out of idle threads while
+ * transports were queued on it. Pools on our NUMA node are tried first,
+ * remote ones only once the local node has nothing left. Threads call
+ * this each time they go idle, so the pools are only scanned while at
+ * least one of them is marked congested.
+ */
+static struct svc_pool *svc_find_congested_pool(struct svc_rqst *rqstp)
+{
+	struct svc_serv *serv = rqstp->rq_server;
+	struct svc_pool *local = rqstp->rq_pool;
+	unsigned int n = serv->sv_nrpools;
+	struct svc_pool *pool;
+	unsigned int i;
+	int remote;
+
+	if (!atomic_read(&serv->sv_nrcongested))
+		return NULL;
+
+	for (remote = 0; remote < 2; remote++) {
+		for (i = 1; i < n; i++) {
+			pool = &serv->sv_pools[(local->sp_id + i) % n];
+			if ((pool->sp_node != local->sp_node) != remote)
+				continue;
+			if (test_bit(SP_CONGESTED, &pool->sp_flags) &&
+			    !list_empty(&pool->sp_sockets))
+				return pool;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Dequeue a transport from our own pool, or steal one from a
+ * congested pool if ours has nothing queued.
+ */
+static struct svc_xprt *svc_xprt_dequeue_or_steal(struct svc_rqst *rqstp)
+{
+	struct svc_xprt *xprt;
+	struct svc_pool *pool;
+
+	xprt = svc_xprt_dequeue(rqstp->rq_server, rqstp->rq_pool);
+	if (xprt || rqstp->rq_server->sv_nrpools == 1)
+		return xprt;
+
+	while ((pool = svc_find_congested_pool(rqstp)) != NULL) {
+		xprt = svc_xprt_dequeue(rqstp->rq_server, pool);
+		if (xprt)
+			break;
+	}
+	return xprt;
+}
+
 /**
  * svc_reserve - change the space reserved for the reply to a request.
  * @rqstp:  The request in question
@@ -525,17 +642,14 @@ void svc_wake_up(struct svc_serv *serv)
 
 	pool = &serv->sv_pools[0];
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
-		/* skip any that aren't queued */
-		if (test_bit(RQ_BUSY, &rqstp->rq_flags))
-			continue;
-		rcu_read_unlock();
+	spin_lock_bh(&pool->sp_lock);
+	rqstp = svc_pool_get_idle_thread(pool);
+	spin_unlock_bh(&pool->sp_lock);
+	if (rqstp) {
 		wake_up_process(rqstp->rq_task);
 		trace_svc_wake_up(rqstp->rq_task->pid);
 		return;
 	}
-	rcu_read_unlock();
 
 	/* No free entries available */
 	set_bit(SP_TASK_PENDING, &pool->sp_flags);
@@ -666,6 +780,10 @@ rqst_should_sleep(struct svc_rqst *rqstp)
 	if (!list_empty(&pool->sp_sockets))
 		return false;
 
+	/* is there work to steal from another pool? */
+	if (rqstp->rq_server->sv_nrpools > 1 && svc_find_congested_pool(rqstp))
+		return false;
+
 	/* are we shutting down? */
 	if (signalled() || kthread_should_stop())
 		return false;
@@ -685,7 +803,7 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	/* rq_xprt should be clear on entry */
 	WARN_ON_ONCE(rqstp->rq_xprt);
 
-	rqstp->rq_xprt = svc_xprt_dequeue(pool);
+	rqstp->rq_xprt = svc_xprt_dequeue_or_steal(rqstp);
 	if (rqstp->rq_xprt)
 		goto out_found;
 
@@ -695,9 +813,14 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 	 */
 	set_current_state(TASK_INTERRUPTIBLE);
 	smp_mb__before_atomic();
-	clear_bit(SP_CONGESTED, &pool->sp_flags);
+	svc_pool_clear_congested(rqstp->rq_server, pool);
 	clear_bit(RQ_BUSY, &rqstp->rq_flags);
 	smp_mb__after_atomic();
+	/* Pairs with svc_pool_get_idle_thread(): either it sees RQ_BUSY
+	 * clear, or we see RQ_IDLE clear and push ourselves again.
+	 */
+	if (!test_and_set_bit(RQ_IDLE, &rqstp->rq_flags))
+		llist_add(&rqstp->rq_idle, &pool->sp_idle_threads);
 
 	if (likely(rqst_should_sleep(rqstp)))
 		time_left = schedule_timeout(timeout);
@@ -708,7 +831,7 @@ static struct svc_xprt *svc_get_next_xprt(struct svc_rqst *rqstp, long timeout)
 
 	set_bit(RQ_BUSY, &rqstp->rq_flags);
 	smp_mb__after_atomic();
-	rqstp->rq_xprt = svc_xprt_dequeue(pool);
+	rqstp->rq_xprt = svc_xprt_dequeue_or_steal(rqstp);
 	if (rqstp->rq_xprt)
 		goto out_found;
 
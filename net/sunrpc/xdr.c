@@ -12,6 +12,7 @@
 #include <linux/string.h>
 #include <linux/kernel.h>
 #include <linux/pagemap.h>
+#include <linux/bvec.h>
 #include <linux/errno.h>
 #include <linux/sunrpc/xdr.h>
 #include <linux/sunrpc/msg_prot.h>
@@ -150,6 +151,42 @@ xdr_inline_pages(struct xdr_buf *xdr, unsigned int offset,
 }
 EXPORT_SYMBOL_GPL(xdr_inline_pages);
 
+/**
+ * xdr_alloc_bvec - describe the page data of an xdr_buf as bio_vecs
+ * @buf: xdr_buf to receive into
+ * @gfp: allocation flags
+ *
+ * Lets a stream transport receive directly into the pages with an
+ * ITER_BVEC iov_iter.  Entries for pages that are not allocated yet
+ * are left NULL and must be filled in by the caller before use.
+ */
+int
+xdr_alloc_bvec(struct xdr_buf *buf, gfp_t gfp)
+{
+	unsigned int i, n = xdr_buf_pagecount(buf);
+
+	if (n != 0 && buf->bvec == NULL) {
+		buf->bvec = kmalloc_array(n, sizeof(buf->bvec[0]), gfp);
+		if (!buf->bvec)
+			return -ENOMEM;
+		for (i = 0; i < n; i++) {
+			buf->bvec[i].bv_page = buf->pages[i];
+			buf->bvec[i].bv_len = PAGE_SIZE;
+			buf->bvec[i].bv_offset = 0;
+		}
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xdr_alloc_bvec);
+
+void
+xdr_free_bvec(struct xdr_buf *buf)
+{
+	kfree(buf->bvec);
+	buf->bvec = NULL;
+}
+EXPORT_SYMBOL_GPL(xdr_free_bvec);
+
 /*
  * Helper routines for doing 'memmove' like operations on a struct xdr_buf
  */
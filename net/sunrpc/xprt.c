@@ -1018,6 +1018,13 @@ void xprt_transmit(struct rpc_task *task)
 			/*
 			 * Add to the list only if we're expecting a reply
 			 */
+			if (xprt->ops->prepare_request) {
+				status = xprt->ops->prepare_request(req);
+				if (status) {
+					task->tk_status = status;
+					return;
+				}
+			}
 			/* Update the softirq receive buffer */
 			memcpy(&req->rq_private_buf, &req->rq_rcv_buf,
 					sizeof(req->rq_private_buf));
@@ -1362,6 +1369,7 @@ void xprt_release(struct rpc_task *task)
 		xprt_wait_on_pinned_rqst(req);
 	}
 	spin_unlock(&xprt->recv_lock);
+	xdr_free_bvec(&req->rq_rcv_buf);
 	spin_lock_bh(&xprt->transport_lock);
 	xprt->ops->release_xprt(xprt, task);
 	if (xprt->ops->release_request)
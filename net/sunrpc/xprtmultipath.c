@@ -24,6 +24,7 @@ typedef struct rpc_xprt *(*xprt_switch_find_xprt_t)(struct list_head *head,
 
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_singular;
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_roundrobin;
+static const struct rpc_xprt_iter_ops rpc_xprt_iter_leastqueued;
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_listall;
 
 static void xprt_switch_add_xprt_locked(struct rpc_xprt_switch *xps,
@@ -43,7 +44,9 @@ static void xprt_switch_add_xprt_locked(struct rpc_xprt_switch *xps,
  * @xps: pointer to struct rpc_xprt_switch
  * @xprt: pointer to struct rpc_xprt
  *
- * Adds xprt to the end of the list of struct rpc_xprt in xps.
+ * Adds xprt to the end of the list of struct rpc_xprt in xps. Several
+ * transports may share the same server address; callers that want
+ * one transport per address must check rpc_xprt_switch_has_addr().
  */
 void rpc_xprt_switch_add_xprt(struct rpc_xprt_switch *xps,
 		struct rpc_xprt *xprt)
@@ -51,8 +54,7 @@ void rpc_xprt_switch_add_xprt(struct rpc_xprt_switch *xps,
 	if (xprt == NULL)
 		return;
 	spin_lock(&xps->xps_lock);
-	if ((xps->xps_net == xprt->xprt_net || xps->xps_net == NULL) &&
-	    !rpc_xprt_switch_has_addr(xps, (struct sockaddr *)&xprt->addr))
+	if (xps->xps_net == xprt->xprt_net || xps->xps_net == NULL)
 		xprt_switch_add_xprt_locked(xps, xprt);
 	spin_unlock(&xps->xps_lock);
 }
@@ -165,14 +167,29 @@ void xprt_switch_put(struct rpc_xprt_switch *xps)
  * rpc_xprt_switch_set_roundrobin - Set a round-robin policy on rpc_xprt_switch
  * @xps: pointer to struct rpc_xprt_switch
  *
- * Sets a round-robin default policy for iterators acting on xps.
+ * Sets a round-robin default policy for iterators acting on xps,
+ * unless a multi-transport policy has already been chosen.
  */
 void rpc_xprt_switch_set_roundrobin(struct rpc_xprt_switch *xps)
 {
-	if (READ_ONCE(xps->xps_iter_ops) != &rpc_xprt_iter_roundrobin)
+	if (READ_ONCE(xps->xps_iter_ops) == &rpc_xprt_iter_singular)
 		WRITE_ONCE(xps->xps_iter_ops, &rpc_xprt_iter_roundrobin);
 }
 
+/**
+ * rpc_xprt_switch_set_leastqueued - Set a least-queued policy
+ * @xps: pointer to struct rpc_xprt_switch
+ *
+ * Sets a default policy for iterators acting on xps that picks the
+ * transport with the fewest queued tasks. Meant for switches whose
+ * transports all lead to the same server, as with nconnect.
+ */
+void rpc_xprt_switch_set_leastqueued(struct rpc_xprt_switch *xps)
+{
+	if (READ_ONCE(xps->xps_iter_ops) != &rpc_xprt_iter_leastqueued)
+		WRITE_ONCE(xps->xps_iter_ops, &rpc_xprt_iter_leastqueued);
+}
+
 static
 const struct rpc_xprt_iter_ops *xprt_iter_ops(const struct rpc_xprt_iter *xpi)
 {
@@ -321,6 +338,49 @@ struct rpc_xprt *xprt_iter_next_entry_roundrobin(struct rpc_xprt_iter *xpi)
 			xprt_switch_find_next_entry_roundrobin);
 }
 
+/*
+ * Pick the transport with the fewest tasks queued on it. Candidates are
+ * ranked in round-robin order starting after @cur, so that transports
+ * with equal queue lengths (e.g. all idle) are still used in turn.
+ */
+static
+struct rpc_xprt *xprt_switch_find_next_entry_leastqueued(struct list_head *head,
+		const struct rpc_xprt *cur)
+{
+	struct rpc_xprt *pos, *prev = NULL;
+	struct rpc_xprt *after = NULL, *before = NULL;
+	long qlen, min_after = 0, min_before = 0;
+	bool past_cur = false;
+
+	list_for_each_entry_rcu(pos, head, xprt_switch) {
+		if (prev == cur)
+			past_cur = true;
+		prev = pos;
+		qlen = atomic_long_read(&pos->queuelen);
+		if (past_cur) {
+			if (after == NULL || qlen < min_after) {
+				after = pos;
+				min_after = qlen;
+			}
+		} else {
+			if (before == NULL || qlen < min_before) {
+				before = pos;
+				min_before = qlen;
+			}
+		}
+	}
+	if (after == NULL || (before != NULL && min_before < min_after))
+		return before;
+	return after;
+}
+
+static
+struct rpc_xprt *xprt_iter_next_entry_leastqueued(struct rpc_xprt_iter *xpi)
+{
+	return xprt_iter_next_entry_multiple(xpi,
+			xprt_switch_find_next_entry_leastqueued);
+}
+
 static
 struct rpc_xprt *xprt_iter_next_entry_all(struct rpc_xprt_iter *xpi)
 {
@@ -487,6 +547,14 @@ const struct rpc_xprt_iter_ops rpc_xprt_iter_roundrobin = {
 	.xpi_next = xprt_iter_next_entry_roundrobin,
 };
 
+/* Policy for picking the least queued entry in the rpc_xprt_switch */
+static
+const struct rpc_xprt_iter_ops rpc_xprt_iter_leastqueued = {
+	.xpi_rewind = xprt_iter_default_rewind,
+	.xpi_xprt = xprt_iter_current_entry,
+	.xpi_next = xprt_iter_next_entry_leastqueued,
+};
+
 /* Policy for once-through iteration of entries in the rpc_xprt_switch */
 static
 const struct rpc_xprt_iter_ops rpc_xprt_iter_listall = {
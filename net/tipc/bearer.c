@@ -520,6 +520,8 @@ void tipc_bearer_xmit(struct net *net, u32 bearer_id,
 	b = bearer_get(net, bearer_id);
 	if (unlikely(!b))
 		__skb_queue_purge(xmitq);
+	else if (b->media->send_msgs && test_bit(0, &b->up))
+		b->media->send_msgs(net, xmitq, b, dst);
 	skb_queue_walk_safe(xmitq, skb, tmp) {
 		__skb_dequeue(xmitq);
 		if (likely(test_bit(0, &b->up) || msg_is_reset(buf_msg(skb))))
@@ -85,6 +85,7 @@ struct tipc_bearer;
 /**
  * struct tipc_media - Media specific info exposed to generic bearer layer
  * @send_msg: routine which handles buffer transmission
+ * @send_msgs: optional routine which transmits a queue of buffers at once
  * @enable_media: routine which enables a media
  * @disable_media: routine which disables a media
  * @addr2str: convert media address format to string
@@ -104,6 +105,9 @@ struct tipc_media {
 	int (*send_msg)(struct net *net, struct sk_buff *buf,
 			struct tipc_bearer *b,
 			struct tipc_media_addr *dest);
+	int (*send_msgs)(struct net *net, struct sk_buff_head *xmitq,
+			 struct tipc_bearer *b,
+			 struct tipc_media_addr *dest);
 	int (*enable_media)(struct net *net, struct tipc_bearer *b,
 			    struct nlattr *attr[]);
 	void (*disable_media)(struct tipc_bearer *b);
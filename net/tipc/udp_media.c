@@ -58,6 +58,9 @@
 
 #define UDP_MIN_HEADROOM        48
 
+/* upper bound on the payload of a GSO buffer built from a packet train */
+#define UDP_GSO_MAX_PAYLOAD	(GSO_MAX_SIZE - UDP_MIN_HEADROOM - 1)
+
 /**
  * struct udp_media_addr - IP/UDP addressing information
  *
@@ -178,9 +181,10 @@ static int tipc_udp_xmit(struct net *net, struct sk_buff *skb,
 
 		skb->dev = rt->dst.dev;
 		ttl = ip4_dst_hoplimit(&rt->dst);
+		/* segmentation needs the checksum to fix up the UDP length */
 		udp_tunnel_xmit_skb(rt, ub->ubsock->sk, skb, src->ipv4.s_addr,
 				    dst->ipv4.s_addr, 0, ttl, 0, src->port,
-				    dst->port, false, true);
+				    dst->port, false, !skb_is_gso(skb));
 #if IS_ENABLED(CONFIG_IPV6)
 	} else {
 		struct dst_entry *ndst;
@@ -256,6 +260,85 @@ static int tipc_udp_send_msg(struct net *net, struct sk_buff *skb,
 	return err;
 }
 
+/* tipc_udp_gso_build - chain a train of packets into one GSO buffer
+ *
+ * Takes the packets at the head of @xmitq that have the same size as the
+ * first one, plus a shorter one ending the train, as a large message's
+ * fragments are, and hangs them off the frag_list of a new buffer marked
+ * for UDP segmentation.  The IP and UDP layers are then traversed once
+ * for the whole train, and each packet still leaves as its own datagram.
+ * Returns NULL if there is no train of at least two packets.
+ */
+static struct sk_buff *tipc_udp_gso_build(struct sk_buff_head *xmitq)
+{
+	struct sk_buff *first = skb_peek(xmitq);
+	unsigned int mss = first->len;
+	struct sk_buff *skb, *gso, **tail;
+	unsigned int segs = 0;
+	unsigned int len = 0;
+
+	skb_queue_walk(xmitq, skb) {
+		if (skb->len > mss || skb_is_nonlinear(skb) ||
+		    segs == UDP_MAX_SEGMENTS ||
+		    len + skb->len > UDP_GSO_MAX_PAYLOAD)
+			break;
+		len += skb->len;
+		segs++;
+		if (skb->len < mss)
+			break;
+	}
+	if (segs < 2)
+		return NULL;
+
+	gso = alloc_skb(LL_MAX_HEADER + UDP_MIN_HEADROOM, GFP_ATOMIC);
+	if (!gso)
+		return NULL;
+	skb_reserve(gso, LL_MAX_HEADER + UDP_MIN_HEADROOM);
+	gso->mark = first->mark;
+	gso->priority = first->priority;
+
+	tail = &skb_shinfo(gso)->frag_list;
+	while (segs--) {
+		skb = __skb_dequeue(xmitq);
+		*tail = skb;
+		tail = &skb->next;
+		gso->len += skb->len;
+		gso->data_len += skb->len;
+		gso->truesize += skb->truesize;
+	}
+
+	skb_shinfo(gso)->gso_size = mss;
+	skb_shinfo(gso)->gso_segs = DIV_ROUND_UP(len, mss);
+	skb_shinfo(gso)->gso_type = SKB_GSO_UDP_L4;
+
+	/* the UDP header is pushed in front of the current data */
+	gso->ip_summed = CHECKSUM_PARTIAL;
+	gso->csum_start = skb_headroom(gso) - sizeof(struct udphdr);
+	gso->csum_offset = offsetof(struct udphdr, check);
+
+	return gso;
+}
+
+/* tipc_udp_send_msgs - send a queue of buffers, packing packet trains
+ * into GSO buffers
+ */
+static int tipc_udp_send_msgs(struct net *net, struct sk_buff_head *xmitq,
+			      struct tipc_bearer *b,
+			      struct tipc_media_addr *addr)
+{
+	struct sk_buff *skb;
+
+	while (!skb_queue_empty(xmitq)) {
+		skb = NULL;
+		if (addr->broadcast != TIPC_REPLICAST_SUPPORT)
+			skb = tipc_udp_gso_build(xmitq);
+		if (!skb)
+			skb = __skb_dequeue(xmitq);
+		tipc_udp_send_msg(net, skb, b, addr);
+	}
+	return 0;
+}
+
 static bool tipc_udp_is_known_peer(struct tipc_bearer *b,
 				   struct udp_media_addr *addr)
 {
@@ -794,6 +877,7 @@ static void tipc_udp_disable(struct tipc_bearer *b)
 
 struct tipc_media udp_media_info = {
 	.send_msg	= tipc_udp_send_msg,
+	.send_msgs	= tipc_udp_send_msgs,
 	.enable_media	= tipc_udp_enable,
 	.disable_media	= tipc_udp_disable,
 	.addr2str	= tipc_udp_addr2str,
@@ -164,6 +164,7 @@ enum bpf_attach_type {
 	BPF_CGROUP_UDP4_SENDMSG,
 	BPF_CGROUP_UDP6_SENDMSG,
 	BPF_LIRC_MODE2,
+	BPF_INET_DIAG,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -2324,6 +2325,16 @@ struct bpf_sock {
 	__u32 src_port;		/* Allows 4-byte read.
 				 * Stored in host byte order
 				 */
+	__u32 dst_port;		/* Allows 4-byte read.
+				 * Stored in network byte order
+				 */
+	__u32 dst_ip4;		/* Allows 1,2,4-byte read.
+				 * Stored in network byte order.
+				 */
+	__u32 dst_ip6[4];	/* Allows 1,2,4-byte read.
+				 * Stored in network byte order.
+				 */
+	__u32 state;
 };
 
 #define XDP_PACKET_HEADROOM 256
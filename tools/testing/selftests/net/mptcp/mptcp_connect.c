@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Exchange data over one MPTCP (or TCP) connection.
+ *
+ * The listener accepts a single connection, optionally checks the
+ * protocol of the accepted socket, and echoes everything it reads. The
+ * client sends a pattern, checks that it comes back unchanged, and can
+ * keep the connection open for a while, so that the caller can look at
+ * the subflows.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <error.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef IPPROTO_MPTCP
+#define IPPROTO_MPTCP 262
+#endif
+
+#define BUF_SIZE 8192
+
+static bool cfg_listen;
+static int cfg_proto = IPPROTO_MPTCP;
+static int cfg_expect_proto;
+static size_t cfg_size = 1 << 20;
+static int cfg_wait;
+static struct sockaddr_in cfg_addr;
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-l] [-p mptcp|tcp] [-P mptcp|tcp] [-s bytes] [-w sec] addr port\n"
+		"  -l  listen and echo, default is to connect\n"
+		"  -p  protocol of the socket, default mptcp\n"
+		"  -P  expected protocol of the accepted socket\n"
+		"  -s  bytes to send\n"
+		"  -w  seconds to keep the connection open afterwards\n",
+		prog);
+	exit(1);
+}
+
+static int parse_proto(const char *str)
+{
+	if (!strcmp(str, "mptcp"))
+		return IPPROTO_MPTCP;
+	if (!strcmp(str, "tcp"))
+		return IPPROTO_TCP;
+
+	error(1, 0, "unknown protocol: %s", str);
+	return -1;
+}
+
+static void parse_opts(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "lp:P:s:w:")) != -1) {
+		switch (c) {
+		case 'l':
+			cfg_listen = true;
+			break;
+		case 'p':
+			cfg_proto = parse_proto(optarg);
+			break;
+		case 'P':
+			cfg_expect_proto = parse_proto(optarg);
+			break;
+		case 's':
+			cfg_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			cfg_wait = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind + 2 != argc)
+		usage(argv[0]);
+
+	cfg_addr.sin_family = AF_INET;
+	cfg_addr.sin_port = htons(atoi(argv[optind + 1]));
+	if (inet_pton(AF_INET, argv[optind], &cfg_addr.sin_addr) != 1)
+		error(1, 0, "bad address: %s", argv[optind]);
+}
+
+static char pattern(size_t off)
+{
+	return 'a' + off % 26;
+}
+
+static void do_echo(int fd)
+{
+	char buf[BUF_SIZE];
+	ssize_t ret, len;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0) {
+		char *p = buf;
+
+		while (len) {
+			ret = write(fd, p, len);
+			if (ret < 0)
+				error(1, errno, "write");
+			p += ret;
+			len -= ret;
+		}
+	}
+	if (len < 0)
+		error(1, errno, "read");
+}
+
+static void do_listen(void)
+{
+	int fd, cfd, one = 1, proto;
+	socklen_t len = sizeof(proto);
+
+	fd = socket(AF_INET, SOCK_STREAM, cfg_proto);
+	if (fd < 0)
+		error(1, errno, "socket");
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)))
+		error(1, errno, "setsockopt SO_REUSEADDR");
+	if (bind(fd, (void *)&cfg_addr, sizeof(cfg_addr)))
+		error(1, errno, "bind");
+	if (listen(fd, 1))
+		error(1, errno, "listen");
+
+	cfd = accept(fd, NULL, NULL);
+	if (cfd < 0)
+		error(1, errno, "accept");
+
+	if (getsockopt(cfd, SOL_SOCKET, SO_PROTOCOL, &proto, &len))
+		error(1, errno, "getsockopt SO_PROTOCOL");
+	if (cfg_expect_proto && proto != cfg_expect_proto)
+		error(1, 0, "accepted protocol %d, expected %d",
+		      proto, cfg_expect_proto);
+
+	do_echo(cfd);
+
+	close(cfd);
+	close(fd);
+}
+
+static void do_connect(void)
+{
+	size_t sent = 0, rcvd = 0;
+	char buf[BUF_SIZE];
+	struct pollfd pfd;
+	ssize_t ret;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, cfg_proto);
+	if (fd < 0)
+		error(1, errno, "socket");
+	if (connect(fd, (void *)&cfg_addr, sizeof(cfg_addr)))
+		error(1, errno, "connect");
+
+	/* send and receive at once, the echo would block us otherwise */
+	pfd.fd = fd;
+	while (rcvd < cfg_size) {
+		pfd.events = POLLIN;
+		if (sent < cfg_size)
+			pfd.events |= POLLOUT;
+		ret = poll(&pfd, 1, 10000);
+		if (ret < 0)
+			error(1, errno, "poll");
+		if (!ret)
+			error(1, 0, "timeout, %zu/%zu bytes back",
+			      rcvd, cfg_size);
+
+		if (pfd.revents & POLLOUT) {
+			size_t i, len = cfg_size - sent;
+
+			if (len > sizeof(buf))
+				len = sizeof(buf);
+			for (i = 0; i < len; i++)
+				buf[i] = pattern(sent + i);
+			ret = write(fd, buf, len);
+			if (ret < 0)
+				error(1, errno, "write");
+			sent += ret;
+			if (sent == cfg_size && shutdown(fd, SHUT_WR))
+				error(1, errno, "shutdown");
+		}
+
+		if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+			ssize_t i;
+
+			ret = read(fd, buf, sizeof(buf));
+			if (ret < 0)
+				error(1, errno, "read");
+			if (!ret)
+				error(1, 0, "unexpected EOF, %zu/%zu bytes back",
+				      rcvd, cfg_size);
+			for (i = 0; i < ret; i++)
+				if (buf[i] != pattern(rcvd + i))
+					error(1, 0, "data mismatch at %zu",
+					      rcvd + i);
+			rcvd += ret;
+		}
+	}
+
+	sleep(cfg_wait);
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	parse_opts(argc, argv);
+
+	if (cfg_listen)
+		do_listen();
+	else
+		do_connect();
+
+	return 0;
+}
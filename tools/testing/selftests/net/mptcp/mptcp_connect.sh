@@ -0,0 +1,147 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Multipath TCP between two namespaces connected by two veth pairs:
+#  - MP_CAPABLE: both ends use MPTCP
+#  - MP_JOIN: the client runs the fullmesh path manager and opens a
+#    second subflow from its second address
+#  - fallback: one end uses plain TCP
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+readonly BIN="./mptcp_connect"
+readonly RAND="$(mktemp -u XXXXXX)"
+readonly NS1="mptcp-srv-${RAND}"
+readonly NS2="mptcp-cli-${RAND}"
+readonly SRV_ADDR="10.0.1.1"
+readonly PORT=10000
+
+ret=0
+port=${PORT}
+
+cleanup()
+{
+	ip netns del "${NS2}" 2>/dev/null
+	ip netns del "${NS1}" 2>/dev/null
+}
+
+setup()
+{
+	local i
+
+	ip netns add "${NS1}" || return 1
+	ip netns add "${NS2}" || return 1
+
+	for i in 1 2; do
+		ip link add "srv${i}" netns "${NS1}" type veth \
+			peer name "cli${i}" netns "${NS2}" || return 1
+		ip -netns "${NS1}" addr add "10.0.${i}.1/24" dev "srv${i}"
+		ip -netns "${NS2}" addr add "10.0.${i}.2/24" dev "cli${i}"
+		ip -netns "${NS1}" link set "srv${i}" up
+		ip -netns "${NS2}" link set "cli${i}" up
+	done
+
+	# subflows from 10.0.2.2 to 10.0.1.1 take the first link on the
+	# way out and the second one on the way back
+	for ns in "${NS1}" "${NS2}"; do
+		ip netns exec "${ns}" sysctl -q -w net.ipv4.conf.all.rp_filter=0
+		ip netns exec "${ns}" sysctl -q -w net.ipv4.conf.default.rp_filter=0
+		ip -netns "${ns}" link set lo up
+	done
+	for i in 1 2; do
+		ip netns exec "${NS1}" sysctl -q -w net.ipv4.conf.srv${i}.rp_filter=0
+		ip netns exec "${NS2}" sysctl -q -w net.ipv4.conf.cli${i}.rp_filter=0
+	done
+}
+
+log_test()
+{
+	local rc=$1
+	local msg="$2"
+
+	if [ "${rc}" -eq 0 ]; then
+		printf "    TEST: %-50s  [ OK ]\n" "${msg}"
+	else
+		ret=1
+		printf "    TEST: %-50s  [FAIL]\n" "${msg}"
+	fi
+}
+
+# run_test <msg> <server proto> <accepted proto> <client proto> [check]
+#
+# [check] runs in the client namespace while the connection is still
+# open, with the server port as argument.
+run_test()
+{
+	local msg="$1"
+	local srv_proto="$2"
+	local acc_proto="$3"
+	local cli_proto="$4"
+	local check="$5"
+	local srv_pid cli_pid rc=0
+
+	port=$((port + 1))
+
+	ip netns exec "${NS1}" "${BIN}" -l -p "${srv_proto}" \
+		-P "${acc_proto}" "${SRV_ADDR}" "${port}" &
+	srv_pid=$!
+	sleep 0.5
+
+	ip netns exec "${NS2}" "${BIN}" -p "${cli_proto}" -w 2 \
+		"${SRV_ADDR}" "${port}" &
+	cli_pid=$!
+
+	if [ -n "${check}" ]; then
+		sleep 1
+		${check} "${port}" || rc=1
+	fi
+
+	wait ${cli_pid} || rc=1
+	wait ${srv_pid} || rc=1
+
+	log_test ${rc} "${msg}"
+}
+
+# both subflows of the connection must be established
+check_two_subflows()
+{
+	local nr
+
+	nr=$(ip netns exec "${NS2}" ss -tn state established \
+		dst "${SRV_ADDR}:$1" | grep -c "${SRV_ADDR}:$1")
+	[ "${nr}" -eq 2 ]
+}
+
+if [ "$(id -u)" -ne 0 ]; then
+	echo "SKIP: need root privileges"
+	exit ${ksft_skip}
+fi
+
+if [ ! -x "${BIN}" ]; then
+	echo "SKIP: ${BIN} not built"
+	exit ${ksft_skip}
+fi
+
+trap cleanup EXIT
+
+if ! setup; then
+	echo "SKIP: could not set up the namespaces"
+	exit ${ksft_skip}
+fi
+
+if ! ip netns exec "${NS1}" sysctl -q net.mptcp.enabled >/dev/null 2>&1; then
+	echo "SKIP: MPTCP not available"
+	exit ${ksft_skip}
+fi
+
+run_test "MP_CAPABLE" mptcp mptcp mptcp
+
+ip netns exec "${NS2}" sysctl -q -w net.mptcp.path_manager=fullmesh
+run_test "MP_JOIN, fullmesh" mptcp mptcp mptcp check_two_subflows
+ip netns exec "${NS2}" sysctl -q -w net.mptcp.path_manager=default
+
+run_test "fallback, TCP client" mptcp tcp tcp
+run_test "fallback, TCP server" tcp tcp mptcp
+
+exit ${ret}